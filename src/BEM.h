@@ -21,22 +21,50 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <algorithm>
 
 //
 // Class to hold BEM parameters and temporaries
 //
 // templatized on 'S'torage type and 'I'ndex type
 //
+// the influence matrix may be shared read-only among several simulations with identical
+//   geometry (see share_A_from), and is copied before any of its blocks are rewritten
+//
+// after a re-initialization, blocks between unchanged collections can be carried over
+//   from the previous matrix (see reset_but_keep_A and keep_blocks), and so can the leading
+//   rows and columns of a collection whose remaining panels changed
+//
 template <class S, class I>
 class BEM {
 public:
-  BEM() : A_is_current(false), solver_initialized(false) {};
+  BEM() : A(std::make_shared<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>>()),
+          A_is_current(false), solver_initialized(false), last_time(-99.9),
+          kept_A(), kept_start(), kept_lead(), kept_time(-99.9), use_guess(false) {};
 
   bool is_A_current() { return A_is_current; }
   void just_made_A() { A_is_current = true; }
   void panels_changed() { A_is_current = false; solver_initialized = false; }
+  bool is_A_shared() const { return A.use_count() > 1; }
+  void share_A_from(const BEM<S,I>&);
+  double get_last_time() const { return last_time; }
+  void set_last_time(const double _t) { last_time = _t; }
   void reset();
+  void reset_but_keep_A();
+  void keep_blocks(std::vector<std::optional<size_t>>&&,
+                   std::vector<std::vector<size_t>>&& _lead = std::vector<std::vector<size_t>>());
+  bool have_kept_blocks() const { return (bool)kept_A; }
+  double get_kept_time() const { return kept_time; }
+  std::pair<size_t,size_t> copy_kept_block(const size_t, const size_t, const size_t, const size_t, const size_t, const size_t);
+  void drop_kept_blocks() { kept_A.reset(); kept_start.clear(); kept_lead.clear(); }
+  void set_guess(const size_t, const Vector<S>&);
   void set_block(const size_t, const size_t, const size_t, const size_t, const Vector<S>&);
+  void resize_A(const size_t, const size_t);
+  S* get_block_ptr(const size_t, const size_t);
+  size_t get_ld() const { return (size_t)A->rows(); }
   void set_rhs(std::vector<S>&);
   void set_rhs(const size_t, const size_t, std::vector<S>&);
   void solve();
@@ -49,13 +77,30 @@ protected:
 
 private:
   // the actual matrix equation
-  Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> A;
+  std::shared_ptr<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>> A;
   Eigen::Matrix<S, Eigen::Dynamic, 1> b;
   Eigen::Matrix<S, Eigen::Dynamic, 1> strengths;
 
+  // the Eigen solver object - persistent from call to call
+  Eigen::GMRES<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> > solver;
+
   // is the A matrix current?
   bool A_is_current;
   bool solver_initialized;
+
+  // simulation time of the last solve, to detect moving blocks
+  double last_time;
+
+  // the matrix from before a re-initialization, and where each new collection's rows were in it:
+  //   all of them from kept_start, or else the leading ones from kept_lead, one entry per row
+  std::shared_ptr<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>> kept_A;
+  std::vector<std::optional<size_t>> kept_start;
+  std::vector<std::vector<size_t>> kept_lead;
+  double kept_time;
+
+  // a starting solution for the next solve only
+  Eigen::Matrix<S, Eigen::Dynamic, 1> guess;
+  bool use_guess;
 };
 
 // remove any memory and reset flags
@@ -63,9 +108,98 @@ template <class S, class I>
 void BEM<S,I>::reset() {
   A_is_current = false;
   solver_initialized = false;
-  A.resize(1,1);
+  last_time = -99.9;
+  A = std::make_shared<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>>(1,1);
   b.resize(1);
   strengths.resize(1);
+  use_guess = false;
+  drop_kept_blocks();
+}
+
+// reset, but hold on to a complete matrix until we know which of its blocks are still good
+template <class S, class I>
+void BEM<S,I>::reset_but_keep_A() {
+  std::shared_ptr<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>> oldA;
+  if (A_is_current) oldA = A;
+  const double oldtime = last_time;
+  reset();
+  kept_A = oldA;
+  kept_time = oldtime;
+}
+
+//
+// For each current collection (in order), the first row of its match in the kept matrix,
+//   or failing that, the old row of each of its leading rows that did not change
+//
+template <class S, class I>
+void BEM<S,I>::keep_blocks(std::vector<std::optional<size_t>>&& _start,
+                           std::vector<std::vector<size_t>>&& _lead) {
+  kept_start = std::move(_start);
+  kept_lead = std::move(_lead);
+  kept_lead.resize(kept_start.size());
+  bool any = false;
+  for (size_t i=0; i<kept_start.size(); ++i) if (kept_start[i] or not kept_lead[i].empty()) any = true;
+  if (not any) drop_kept_blocks();
+}
+
+//
+// Copy what was kept of one block into place, and return how many leading rows and columns
+//   of it that covers; the rest of those rows and columns still need to be computed
+//
+template <class S, class I>
+std::pair<size_t,size_t> BEM<S,I>::copy_kept_block(const size_t it, const size_t is,
+                                                   const size_t rstart, const size_t nrows,
+                                                   const size_t cstart, const size_t ncols) {
+  const std::pair<size_t,size_t> none(0, 0);
+  if (not kept_A or it >= kept_start.size() or is >= kept_start.size()) return none;
+
+  // how many leading rows of a collection were kept, and where each one was
+  auto lead = [&](const size_t _i, const size_t _n) {
+    return kept_start[_i] ? _n : std::min(_n, kept_lead[_i].size());
+  };
+  auto old_row = [&](const size_t _i, const size_t _r) {
+    return kept_start[_i] ? *kept_start[_i] + _r : kept_lead[_i][_r];
+  };
+  const size_t nr = lead(it, nrows);
+  const size_t nc = lead(is, ncols);
+  if (nr == 0 or nc == 0) return none;
+  if (old_row(it, nr-1) >= (size_t)kept_A->rows() or old_row(is, nc-1) >= (size_t)kept_A->cols()) return none;
+
+  // resize_A has already made sure that this matrix is our own
+  if (kept_start[it] and kept_start[is]) {
+    A->block(rstart, cstart, nr, nc) = kept_A->block(*kept_start[it], *kept_start[is], nr, nc);
+  } else {
+    #pragma omp parallel for
+    for (int32_t j=0; j<(int32_t)nc; ++j) {
+      const S* src = kept_A->data() + old_row(is, j)*kept_A->rows();
+      S* dest = A->data() + (cstart+j)*A->rows() + rstart;
+      for (size_t i=0; i<nr; ++i) dest[i] = src[old_row(it, i)];
+    }
+  }
+  return std::make_pair(nr, nc);
+}
+
+//
+// Seed the next solve with these unknowns, starting at row cstart
+//
+template <class S, class I>
+void BEM<S,I>::set_guess(const size_t cstart, const Vector<S>& _in) {
+  if (not use_guess) guess.setZero(b.size());
+  if ((size_t)guess.size() < cstart+_in.size()) guess.conservativeResize(cstart+_in.size());
+  for (size_t i=0; i<_in.size(); ++i) guess[cstart+i] = _in[i];
+  use_guess = true;
+}
+
+//
+// Adopt another system's influence matrix - no copy is made until a block changes
+//
+template <class S, class I>
+void BEM<S,I>::share_A_from(const BEM<S,I>& _other) {
+  assert(_other.A_is_current && "Sharing an incomplete A matrix");
+  A = _other.A;
+  A_is_current = true;
+  solver_initialized = false;
+  last_time = _other.last_time;
 }
 
 //
@@ -107,20 +241,52 @@ void BEM<S,I>::set_block(const size_t rstart, const size_t nrows,
   //std::cout << "    putting data into A matrix at " << rstart << ":" << (rstart+nrows) << " "
   //                                                  << cstart << ":" << (cstart+ncols) << std::endl;
 
+  // never write into a matrix that another simulation is using
+  if (is_A_shared()) {
+    A = std::make_shared<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>>(*A);
+    solver_initialized = false;
+  }
+  Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>& Am = *A;
+
   // allocate space
-  const size_t new_rows = std::max((size_t)(A.rows()), (size_t)(rstart+nrows));
-  const size_t new_cols = std::max((size_t)(A.cols()), (size_t)(cstart+ncols));
+  const size_t new_rows = std::max((size_t)(Am.rows()), (size_t)(rstart+nrows));
+  const size_t new_cols = std::max((size_t)(Am.cols()), (size_t)(cstart+ncols));
   //std::cout << "    resizing A to " << new_rows << " rows and " << new_cols << " cols" << std::endl;
-  A.conservativeResize(new_rows, new_cols);
+  Am.conservativeResize(new_rows, new_cols);
 
   size_t iptr = 0;
   for (size_t j=0; j<ncols; ++j) {
     for (size_t i=0; i<nrows; ++i) {
-      A(i+rstart,j+cstart) = _in[iptr++];
+      Am(i+rstart,j+cstart) = _in[iptr++];
     }
   }
 }
 
+//
+// Size the A matrix once before writing blocks directly into its storage
+//
+template <class S, class I>
+void BEM<S,I>::resize_A(const size_t nrows, const size_t ncols) {
+
+  // never write into a matrix that another simulation is using
+  if (is_A_shared()) {
+    A = std::make_shared<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic>>(*A);
+    solver_initialized = false;
+  }
+
+  if ((size_t)A->rows() != nrows or (size_t)A->cols() != ncols) A->conservativeResize(nrows, ncols);
+}
+
+//
+// Pointer to the top-left entry of a block, the matrix is column-major with get_ld() rows
+//
+template <class S, class I>
+S* BEM<S,I>::get_block_ptr(const size_t rstart, const size_t cstart) {
+  assert(not is_A_shared() && "Writing into a shared A matrix");
+  assert(rstart < (size_t)A->rows() && cstart < (size_t)A->cols() && "Block is outside of A matrix");
+  return A->data() + cstart*A->rows() + rstart;
+}
+
 //
 // Set the rhs vector from a set of input velocities
 // trying to make the input "const" is asking for trouble!
@@ -164,14 +330,11 @@ void BEM<S,I>::solve() {
   //std::cout << "b is " << b.size() << std::endl;
   //std::cout << "x is " << strengths.size() << std::endl;
 
-  // the Eigen solver object - persistent from call to call
-  static Eigen::GMRES<Eigen::Matrix<S, Eigen::Dynamic, Eigen::Dynamic> > solver(A);
-
   if (not solver_initialized) {
 
     // if A changes, we need to re-run this
     auto istart = std::chrono::system_clock::now();
-    solver.compute(A);
+    solver.compute(*A);
     auto iend = std::chrono::system_clock::now();
 
     std::chrono::duration<double> ielapsed_seconds = iend-istart;
@@ -181,11 +344,15 @@ void BEM<S,I>::solve() {
   }
 
   // note that BiCGSTAB accepts a preconditioner as a template arg
-  // note that solveWithGuess() can seed the solution with last step's solution!
 
-  // here is the matrix solution
+  // here is the matrix solution, from a starting guess if we were given one
   auto start = std::chrono::system_clock::now();
-  strengths = solver.solve(b);
+  if (use_guess and guess.size() == b.size()) {
+    strengths = solver.solveWithGuess(b, guess);
+  } else {
+    strengths = solver.solve(b);
+  }
+  use_guess = false;
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
   printf("    solver.solve:\t[%.6f] cpu seconds\n", (float)elapsed_seconds.count());
@@ -194,9 +361,9 @@ void BEM<S,I>::solve() {
     const size_t nr = 20;
     //const size_t nr = b.size();
     std::cout << "Matrix equation is" << std::endl;
-    std::cout << A.block(0,0,nr,8) << std::endl;
+    std::cout << A->block(0,0,nr,8) << std::endl;
     std::cout << " bottom right is" << std::endl;
-    std::cout << A.block(b.size()-nr,b.size()-8,nr,8) << std::endl;
+    std::cout << A->block(b.size()-nr,b.size()-8,nr,8) << std::endl;
     std::cout << "RHS vector is" << std::endl;
     std::cout << b.head(nr) << std::endl;
     std::cout << "Solution vector is" << std::endl;
@@ -212,7 +379,7 @@ void BEM<S,I>::solve() {
   // b.norm() is 0 for first computation, so we let it be one for the error computation
   double b_norm = b.norm(); // norm() is L2 norm
   if (b_norm == 0) { b_norm = 1.0; }
-  double relative_error = (A*strengths - b).norm() / b_norm;
+  double relative_error = ((*A)*strengths - b).norm() / b_norm;
   if (verbose) printf("    L2 norm of error is %g\n", relative_error);
   end = std::chrono::system_clock::now();
   elapsed_seconds = end-start;
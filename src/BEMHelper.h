@@ -23,24 +23,52 @@
 #include <cassert>
 
 
+//
+// velocities on every boundary collection's panels from the given vorticity only (not yet
+//   scaled or including the freestream), for passing back into solve_bem as _extra
+//
+template <class S, class A>
+std::vector<std::array<Vector<S>,Dimensions>> find_panel_vels(const double             _time,
+                                                              std::vector<Collection>& _vort,
+                                                              std::vector<Collection>& _bdry) {
+
+  InfluenceVisitor<A> ivisitor = {ExecEnv()};
+  std::vector<std::array<Vector<S>,Dimensions>> vels;
+
+  for (auto &targ : _bdry) {
+    std::visit([=](auto& elem) { elem.transform(_time); }, targ);
+    std::visit([=](auto& elem) { elem.zero_vels(); }, targ);
+    for (auto &src : _vort) {
+      std::visit(ivisitor, src, targ);
+    }
+    vels.push_back(std::visit([=](auto& elem) { return elem.get_vel(); }, targ));
+  }
+
+  return vels;
+}
+
 //
 // helper function to solve BEM equations on given state
 //
+// if _extra is given, it holds unscaled velocities on each boundary collection (see
+//   find_panel_vels) from sources that are not in _vort, and those are added to the rhs
+//
 template <class S, class A, class I>
 void solve_bem(const double                         _time,
                const std::array<double,Dimensions>& _fs,
                std::vector<Collection>&             _vort,
                std::vector<Collection>&             _bdry,
-               BEM<S,I>&                            _bem) {
+               BEM<S,I>&                            _bem,
+               const std::vector<std::array<Vector<S>,Dimensions>>* _extra = nullptr) {
 
   // no unknowns? no problem.
   if (_bdry.size() == 0) return;
 
-  // save the simulation time from the last time we entered this function
-  static double last_time = -99.9;
+  // the simulation time from the last time we entered this function
+  const double last_time = _bem.get_last_time();
 
-  // if this is the first time through after a reset, recalculate the row indices
-  if (not _bem.is_A_current()) {
+  // recalculate the row indices (cheap, and the A matrix may have come from elsewhere)
+  {
     I rowcnt = 0;
     // loop over boundary collections
     for (auto &targ : _bdry) {
@@ -66,7 +94,8 @@ void solve_bem(const double                         _time,
   std::cout << "  Solving for BEM RHS" << std::endl;
 
   // loop over boundary collections
-  for (auto &targ : _bdry) {
+  for (size_t it=0; it<_bdry.size(); ++it) {
+    auto &targ = _bdry[it];
     std::cout << "  Solving for velocities on" << to_string(targ) << std::endl;
 
     // transform the collection according to prescribed motion
@@ -80,6 +109,17 @@ void solve_bem(const double                         _time,
       std::visit(ivisitor, src, targ);
     }
 
+    // and from sources that were summed earlier
+    if (_extra and it < _extra->size()) {
+      std::visit([=](auto& elem) {
+        std::array<Vector<S>,Dimensions>& u = elem.get_vel();
+        for (size_t d=0; d<Dimensions; ++d) {
+          assert(u[d].size() == (*_extra)[it][d].size() && "Extra velocities do not match targets");
+          for (size_t i=0; i<u[d].size(); ++i) u[d][i] += (*_extra)[it][d][i];
+        }
+      }, targ);
+    }
+
     // divide by factor and add freestream
     std::visit([=](auto& elem) { elem.finalize_vels(_fs); }, targ);
 
@@ -98,6 +138,7 @@ void solve_bem(const double                         _time,
     if (std::visit([=](auto& elem) { return elem.is_augmented(); }, targ)) {
       assert(tnum-rhs.size()==3 && "Number of augmented rows is not 3");
       assert(std::holds_alternative<Surfaces<S>>(targ) && "Augmented boundary is not Surface!");
+      assert(not _extra && "Augmented rows need the circulation of every source");
 
       // make this easier
       //Surfaces<S>& surf = std::get<Surfaces<S>>(targ);
@@ -159,11 +200,19 @@ void solve_bem(const double                         _time,
     // need this to inform bem that we need to re-init the solver
     _bem.panels_changed();
 
+    // size the whole matrix once, blocks are then written directly into it
+    size_t nunk = 0;
+    for (auto &targ : _bdry) {
+      nunk = std::max(nunk, std::visit([=](auto& elem) { return (size_t)(elem.get_first_row() + elem.get_num_rows()); }, targ));
+    }
+    _bem.resize_A(nunk, nunk);
+
     // this is the dispatcher for Points/Surfaces on Points/Surfaces
     CoefficientVisitor cvisitor;
 
     // loop over boundary collections
-    for (auto &targ : _bdry) {
+    for (size_t it=0; it<_bdry.size(); ++it) {
+      auto &targ = _bdry[it];
       //std::cout << "  Solving for influence coefficients on" << to_string(targ) << std::endl;
 
       // find portion of influence matrix
@@ -171,7 +220,8 @@ void solve_bem(const double                         _time,
       const size_t tnum = std::visit([=](auto& elem) { return elem.get_num_rows(); }, targ);
 
       // assemble from all boundaries
-      for (auto &src : _bdry) {
+      for (size_t is=0; is<_bdry.size(); ++is) {
+        auto &src = _bdry[is];
 
         // should we build/rebuild this block of the A matrix?
         bool rebuild_this_block = rebuild_every_block;
@@ -200,16 +250,57 @@ void solve_bem(const double                         _time,
             std::visit([=](auto& elem) { elem.finalize_vels(std::array<double,Dimensions>({0.0,0.0,0.0})); }, targ);
           }
 
-          // solve for the coefficients in this block
-          Vector<S> coeffs = std::visit(cvisitor, src, targ);
-          assert(coeffs.size() == tnum*snum && "Number of coefficients does not match predicted");
-          // targets are rows, sources are cols
-          _bem.set_block(tstart, tnum, sstart, snum, coeffs);
+          // after a re-initialization, unchanged pairs that have not moved relative to each other
+          //   can use the block from the previous matrix; a kept collection's key includes its
+          //   body's position and motion, so the new body can stand in for the old one here
+          cvisitor.tkeep = 0;
+          cvisitor.skeep = 0;
+          if (rebuild_every_block and _bem.have_kept_blocks()) {
+            std::shared_ptr<Body> tb = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, targ);
+            std::shared_ptr<Body> sb = std::visit([=](auto& elem) { return elem.get_body_ptr(); }, src);
+            const double kt = _bem.get_kept_time();
+            bool moved = false;
+            if (tb and sb) {
+              moved = tb->relative_motion_vs(sb, kt, _time);
+            } else if (tb or sb) {
+              std::shared_ptr<Body> mb = (tb ? tb : sb);
+              moved = not mb->get_transform_mat(kt).isApprox(mb->get_transform_mat(_time));
+            }
+            const std::pair<size_t,size_t> kept = moved ? std::make_pair((size_t)0, (size_t)0)
+                                                        : _bem.copy_kept_block(it, is, tstart, tnum, sstart, snum);
+            if (kept.first == tnum and kept.second == snum) {
+              std::cout << "    reusing block from before re-initialization" << std::endl;
+              continue;
+            }
+
+            // an adapted surface kept its leading panels, so only the rest need computing
+            if (kept.first > 0 and std::holds_alternative<Surfaces<S>>(targ) and std::holds_alternative<Surfaces<S>>(src)) {
+              cvisitor.tkeep = kept.first / std::get<Surfaces<S>>(targ).num_unknowns_per_panel();
+              cvisitor.skeep = kept.second / std::get<Surfaces<S>>(src).num_unknowns_per_panel();
+              std::cout << "    reusing " << cvisitor.tkeep << " x " << cvisitor.skeep << " panels from before re-initialization" << std::endl;
+            }
+          }
+
+          // solve for the coefficients in this block, targets are rows, sources are cols
+          cvisitor.dest = _bem.get_block_ptr(tstart, sstart);
+          cvisitor.ld = _bem.get_ld();
+          std::visit(cvisitor, src, targ);
+        }
+      }
+    }
+
+    // adapted surfaces start from the strengths they carried over
+    if (rebuild_every_block and _bem.have_kept_blocks()) {
+      for (auto &targ : _bdry) {
+        if (std::holds_alternative<Surfaces<S>>(targ)) {
+          Surfaces<S>& surf = std::get<Surfaces<S>>(targ);
+          _bem.set_guess(surf.get_first_row(), surf.get_unknowns());
         }
       }
     }
 
     _bem.just_made_A();
+    _bem.drop_kept_blocks();
 
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double> elapsed_seconds = end-start;
@@ -247,6 +338,6 @@ void solve_bem(const double                         _time,
   }
 
   // save the simulation time to compare to the next call
-  last_time = _time;
+  _bem.set_last_time(_time);
 }
 
@@ -40,6 +40,7 @@ void parse_boundary_json(std::vector<std::unique_ptr<BoundaryFeature>>& _flist,
   if      (ftype == "sphere") { _flist.emplace_back(std::make_unique<Ovoid>(_bp)); }
   else if (ftype == "rect")   { _flist.emplace_back(std::make_unique<SolidRect>(_bp)); }
   else if (ftype == "quad")   { _flist.emplace_back(std::make_unique<BoundaryQuad>(_bp)); }
+  else if (ftype == "outflow") { _flist.emplace_back(std::make_unique<OutflowPlane>(_bp)); }
   // otherwise it's a file to read
   else                        { _flist.emplace_back(std::make_unique<ExteriorFromFile>(_bp)); }
 
@@ -742,3 +743,136 @@ bool ExteriorFromFile::draw_info_gui(const std::string _action) {
   return add;
 }
 #endif
+
+
+//
+// An outflow region makes no panels
+//
+ElementPacket<float>
+OutflowPlane::init_elements(const float _ips) const {
+  return ElementPacket<float>(std::vector<float>(), std::vector<Int>(), std::vector<float>(), 0, 2);
+}
+
+void
+OutflowPlane::add_to(Simulation& _sim) const {
+  _sim.get_outflow().add_region({m_x, m_y, m_z}, {m_nx, m_ny, m_nz}, {m_sx, m_sy, m_sz},
+                                m_nsuper, m_radfactor);
+}
+
+void
+OutflowPlane::debug(std::ostream& os) const {
+  os << to_string();
+}
+
+std::string
+OutflowPlane::to_string() const {
+  std::stringstream ss;
+  if (m_sx > 0.0 or m_sy > 0.0 or m_sz > 0.0) {
+    ss << "outflow box at " << m_x << " " << m_y << " " << m_z << " size " << m_sx << " " << m_sy << " " << m_sz;
+  } else {
+    ss << "outflow plane at " << m_x << " " << m_y << " " << m_z << " facing " << m_nx << " " << m_ny << " " << m_nz;
+  }
+  return ss.str();
+}
+
+void
+OutflowPlane::from_json(const nlohmann::json j) {
+  const std::vector<float> c = j["center"];
+  m_x = c[0];
+  m_y = c[1];
+  m_z = c[2];
+  if (j.find("normal") != j.end()) {
+    const std::vector<float> n = j["normal"];
+    m_nx = n[0];
+    m_ny = n[1];
+    m_nz = n[2];
+  }
+  if (j.find("size") != j.end()) {
+    const std::vector<float> sz = j["size"];
+    m_sx = sz[0];
+    m_sy = sz[1];
+    m_sz = sz[2];
+  }
+  m_nsuper = j.value("superParticles", m_nsuper);
+  m_radfactor = j.value("superRadius", m_radfactor);
+  m_enabled = j.value("enabled", true);
+}
+
+nlohmann::json
+OutflowPlane::to_json() const {
+  nlohmann::json mesh = nlohmann::json::object();
+  mesh["geometry"] = "outflow";
+  mesh["center"] = {m_x, m_y, m_z};
+  mesh["normal"] = {m_nx, m_ny, m_nz};
+  if (m_sx > 0.0 or m_sy > 0.0 or m_sz > 0.0) mesh["size"] = {m_sx, m_sy, m_sz};
+  mesh["superParticles"] = m_nsuper;
+  mesh["superRadius"] = m_radfactor;
+  mesh["enabled"] = m_enabled;
+  return mesh;
+}
+
+// draw a square across the plane, or the face of the box that the normal points to
+void OutflowPlane::generate_draw_geom() {
+  std::array<float,3> n = {m_nx, m_ny, m_nz};
+  const float nlen = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+  if (nlen > 0.0) for (auto& v : n) v /= nlen;
+  else n = {1.0, 0.0, 0.0};
+
+  // two directions in the plane
+  std::array<float,3> t1 = (std::abs(n[0]) < 0.9) ? std::array<float,3>({0.0, n[2], -n[1]})
+                                                   : std::array<float,3>({-n[2], 0.0, n[0]});
+  const float t1len = std::sqrt(t1[0]*t1[0] + t1[1]*t1[1] + t1[2]*t1[2]);
+  for (auto& v : t1) v /= t1len;
+  const std::array<float,3> t2 = {n[1]*t1[2]-n[2]*t1[1], n[2]*t1[0]-n[0]*t1[2], n[0]*t1[1]-n[1]*t1[0]};
+
+  const float half = 0.5 * std::max(2.0f, std::max(m_sx, std::max(m_sy, m_sz)));
+  std::array<float,3> c = {m_x, m_y, m_z};
+  if (m_sx > 0.0 or m_sy > 0.0 or m_sz > 0.0) {
+    c[0] += 0.5*m_sx*n[0];
+    c[1] += 0.5*m_sy*n[1];
+    c[2] += 0.5*m_sz*n[2];
+  }
+
+  std::array<std::array<float,3>,4> p;
+  const float sgn[4][2] = {{-1.0,-1.0}, {1.0,-1.0}, {1.0,1.0}, {-1.0,1.0}};
+  for (size_t k=0; k<4; ++k) {
+    for (size_t d=0; d<3; ++d) p[k][d] = c[d] + half*(sgn[k][0]*t1[d] + sgn[k][1]*t2[d]);
+  }
+
+  BoundaryQuad quad(nullptr, p[0][0], p[0][1], p[0][2], p[1][0], p[1][1], p[1][2],
+                             p[2][0], p[2][1], p[2][2], p[3][0], p[3][1], p[3][2]);
+  m_draw = quad.init_elements(1);
+  m_draw.val.resize(m_draw.val.size()/Dimensions);
+}
+
+#ifdef USE_IMGUI
+bool OutflowPlane::draw_info_gui(const std::string _action) {
+  float xc[3] = {m_x, m_y, m_z};
+  float xn[3] = {m_nx, m_ny, m_nz};
+  float xs[3] = {m_sx, m_sy, m_sz};
+  std::string buttonText = _action+" outflow";
+  bool add = false;
+
+  ImGui::InputFloat3("Center", xc);
+  ImGui::InputFloat3("Normal", xn);
+  ImGui::InputFloat3("Box size", xs);
+  ImGui::SameLine();
+  ShowHelpMarker("Leave the size at zero to remove everything past the plane, set it to remove everything in a box.");
+  ImGui::InputInt("Super-particles", &m_nsuper);
+  ImGui::Spacing();
+  ImGui::TextWrapped("This feature will remove particles that leave the domain");
+  ImGui::Spacing();
+  if (ImGui::Button(buttonText.c_str())) { add = true; }
+  m_x = xc[0];
+  m_y = xc[1];
+  m_z = xc[2];
+  m_nx = xn[0];
+  m_ny = xn[1];
+  m_nz = xn[2];
+  m_sx = xs[0];
+  m_sy = xs[1];
+  m_sz = xs[2];
+
+  return add;
+}
+#endif
@@ -253,3 +253,50 @@ protected:
   std::string m_infile;
 };
 
+
+//
+// Concrete class for an outflow boundary: not a surface, but a plane (or box) past which
+//   particles are removed and replaced by a few far-field super-particles (see Outflow.h)
+//
+class OutflowPlane : public BoundaryFeature {
+public:
+  OutflowPlane(std::shared_ptr<Body> _bp = nullptr,
+               float _x = 5.0,
+               float _y = 0.0,
+               float _z = 0.0,
+               float _nx = 1.0,
+               float _ny = 0.0,
+               float _nz = 0.0)
+    : BoundaryFeature(_bp, true, _x, _y, _z),
+      m_nx(_nx),
+      m_ny(_ny),
+      m_nz(_nz),
+      m_sx(0.0),
+      m_sy(0.0),
+      m_sz(0.0),
+      m_nsuper(32),
+      m_radfactor(8.0)
+    {}
+  OutflowPlane* copy() const override { return new OutflowPlane(*this); }
+
+  void debug(std::ostream& os) const override;
+  std::string to_string() const override;
+  std::string to_short_string() const override { return "outflow"; }
+  void from_json(const nlohmann::json) override;
+  nlohmann::json to_json() const override;
+  void create() override { }
+  ElementPacket<float> init_elements(const float) const override;
+#ifdef USE_IMGUI
+  bool draw_info_gui(const std::string) override;
+#endif
+  void generate_draw_geom() override;
+
+  // hand the region to the simulation, which does the removal every step
+  void add_to(Simulation&) const;
+
+protected:
+  float m_nx, m_ny, m_nz;
+  float m_sx, m_sy, m_sz;
+  int32_t m_nsuper;
+  float m_radfactor;
+};
@@ -29,32 +29,28 @@
 
 
 template <class S>
-Vector<S> points_on_points_coeff (Points<S> const& src, Points<S>& targ) {
+void points_on_points_coeff (Points<S> const& src, Points<S>& targ, S* const dest, const size_t ld) {
   std::cout << "    0_0 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
   auto start = std::chrono::system_clock::now();
 
   assert(false && "ERROR: points_on_points_coeff is not implemented");
 
   // when we need this, copy it from Influence.h
-  Vector<S> coeffs;
   float flops = 0.0;
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
   const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
   printf("    points_on_points_coeff: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
-
-  return coeffs;
 }
 
 template <class S>
-Vector<S> panels_on_points_coeff (Surfaces<S> const& src, Points<S>& targ) {
+void panels_on_points_coeff (Surfaces<S> const& src, Points<S>& targ, S* const dest, const size_t ld) {
   std::cout << "    1_0 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
   auto start = std::chrono::system_clock::now();
 
   assert(false && "ERROR: panels_on_points_coeff is not implemented");
 
-  Vector<S> coeffs;
   float flops = 0.0;
 
 /*
@@ -95,19 +91,16 @@ Vector<S> panels_on_points_coeff (Surfaces<S> const& src, Points<S>& targ) {
   std::chrono::duration<double> elapsed_seconds = end-start;
   const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
   printf("    panels_on_points_coeff: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
-
-  return coeffs;
 }
 
 
 template <class S>
-Vector<S> points_on_panels_coeff (Points<S> const& src, Surfaces<S>& targ) {
+void points_on_panels_coeff (Points<S> const& src, Surfaces<S>& targ, S* const dest, const size_t ld) {
   std::cout << "    0_1 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
   auto start = std::chrono::system_clock::now();
 
   assert(false && "ERROR: points_on_panels_coeff is not implemented");
 
-  Vector<S> coeffs;
   float flops = 0.0;
 
 /*
@@ -148,315 +141,279 @@ Vector<S> points_on_panels_coeff (Points<S> const& src, Surfaces<S>& targ) {
   std::chrono::duration<double> elapsed_seconds = end-start;
   const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
   printf("    points_on_panels_coeff: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+}
 
-  return coeffs;
+// number of source and of target panels in one tile of a matrix block
+#define COEFF_TILE 64
+
+// gather the corners and area of each panel into flat arrays, padded with copies of the
+//   last panel to a multiple of the vector width, plus one more vector, so that targets
+//   load as whole vectors even when a loop starts at an unaligned index near the end
+template <class S>
+std::array<Vector<S>,10> gather_panel_geom (Surfaces<S> const& _surf, const size_t _width) {
+  const size_t np = _surf.get_npanels();
+  const size_t npad = _width * (2 + (np-1) / _width);
+  const std::array<Vector<S>,Dimensions>& x = _surf.get_pos();
+  const std::vector<Int>&                idx = _surf.get_idx();
+  const Vector<S>&                      area = _surf.get_area();
+
+  std::array<Vector<S>,10> g;
+  for (auto& v : g) v.resize(npad);
+  for (size_t i=0; i<npad; ++i) {
+    const size_t ip = std::min(i, np-1);
+    for (size_t c=0; c<3; ++c) {
+      for (size_t d=0; d<Dimensions; ++d) g[3*c+d][i] = x[d][idx[3*ip+c]];
+    }
+    g[9][i] = area[ip];
+  }
+  return g;
+}
+
+// write the influence of panel j's unknowns on panel i's equations, given the
+//   geometric influence g and the area and scale of panel j
+template <class S>
+static inline void put_panel_coeffs (S* const dest, const size_t ld,
+                                     const size_t i, const size_t tnunk, const bool targ_has_src,
+                                     const size_t j, const size_t snunk, const bool src_has_src,
+                                     const S gx, const S gy, const S gz, const S wsa,
+                                     const std::array<Vector<S>,Dimensions>& sb1,
+                                     const std::array<Vector<S>,Dimensions>& sb2,
+                                     const std::array<Vector<S>,Dimensions>& tb1,
+                                     const std::array<Vector<S>,Dimensions>& tb2,
+                                     const std::array<Vector<S>,Dimensions>& tn) {
+
+  // one column per source unknown, one row per target equation
+  S* col = dest + (j*snunk)*ld + i*tnunk;
+
+  // unit vortex sheet strength along each of the source's tangent vectors, then source strength
+  for (size_t k=0; k<(src_has_src ? 3 : 2); ++k) {
+    S u, v, w;
+    if (k < 2) {
+      const std::array<Vector<S>,Dimensions>& sb = (k == 0 ? sb1 : sb2);
+      u = wsa * (sb[1][j]*gz - sb[2][j]*gy);
+      v = wsa * (sb[2][j]*gx - sb[0][j]*gz);
+      w = wsa * (sb[0][j]*gy - sb[1][j]*gx);
+    } else {
+      u = wsa * gx;
+      v = wsa * gy;
+      w = wsa * gz;
+    }
+    col[0] = u*tb1[0][i] + v*tb1[1][i] + w*tb1[2][i];
+    col[1] = u*tb2[0][i] + v*tb2[1][i] + w*tb2[2][i];
+    if (targ_has_src) col[2] = u*tn[0][i] + v*tn[1][i] + w*tn[2][i];
+    col += ld;
+  }
 }
 
+//
+// Write the influence coefficients of all source panels on all target panels directly into
+//   the column-major destination with leading dimension ld (target rows, source columns)
+//
+// Work is split into tiles of sources by targets, with SIMD over targets. All three source
+//   unknowns share one geometric influence vector, and in a self-block that same vector
+//   (negated) also gives the transposed entry, so only the lower triangle of tiles is computed.
+//
+// Entries between the first tkeep target panels and the first skeep source panels are
+//   already in place (carried over from an older matrix) and are skipped.
+//
 template <class S>
-Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
+void panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ, S* const dest, const size_t ld,
+                             const size_t tkeep = 0, const size_t skeep = 0) {
   std::cout << "    2_2 compute coefficients of" << src.to_string() << " on" << targ.to_string() << std::endl;
   auto start = std::chrono::system_clock::now();
 
   // how large of a problem do we have?
   const size_t nsrc  = src.get_npanels();
   const size_t ntarg = targ.get_npanels();
+  if (nsrc == 0 or ntarg == 0) return;
 
   // and how many rows and cols does that mean?
   const bool src_has_src  = src.src_is_unknown();
   const bool targ_has_src = targ.src_is_unknown();
   const size_t snunk = src.num_unknowns_per_panel();
   const size_t tnunk = targ.num_unknowns_per_panel();
-  const size_t oldncols =  nsrc * snunk;
-  const size_t oldnrows = ntarg * tnunk;
-  const size_t nunk = targ.num_unknowns_per_panel();
+  assert(ld >= ntarg*tnunk && "Leading dimension is too small");
   assert(targ.num_unknowns_per_panel() == src.num_unknowns_per_panel() && "nunk are not the same");
+  const bool self = (&src == &targ);
 
-  // pull references to the element arrays
-  const std::array<Vector<S>,Dimensions>&  sx = src.get_pos();
-  const std::vector<Int>&                  si = src.get_idx();
+#ifdef USE_VC
+  // define vector types for Vc (still only S==A supported here)
+  typedef Vc::Vector<S> StoreVec;
+  const size_t vw = StoreVec::size();
+#else
+  typedef S StoreVec;
+  const size_t vw = 1;
+#endif
+
+  // panel orientations
   const std::array<Vector<S>,Dimensions>& sb1 = src.get_x1();
   const std::array<Vector<S>,Dimensions>& sb2 = src.get_x2();
-  const Vector<S>&                         sa = src.get_area();
-
-  const std::array<Vector<S>,Dimensions>&  tx = targ.get_pos();
-  const std::vector<Int>&                  ti = targ.get_idx();
   const std::array<Vector<S>,Dimensions>& tb1 = targ.get_x1();
   const std::array<Vector<S>,Dimensions>& tb2 = targ.get_x2();
   const std::array<Vector<S>,Dimensions>&  tn = targ.get_norm();
-  const Vector<S>&                         ta = targ.get_area();
 
-#ifdef USE_VC
-  // define vector types for Vc (still only S==A supported here)
-  typedef Vc::Vector<S> StoreVec;
-#endif
+  // corner geometry, computed once per block instead of once per source
+  const std::array<Vector<S>,10> sg = gather_panel_geom<S>(src, 1);
+  const std::array<Vector<S>,10> tg = gather_panel_geom<S>(targ, vw);
+
+  // list all pairs of tiles; self-blocks only need those on or below the diagonal
+  const size_t nstile = 1 + (nsrc-1) / COEFF_TILE;
+  const size_t nttile = 1 + (ntarg-1) / COEFF_TILE;
+  std::vector<std::pair<size_t,size_t>> tiles;
+  for (size_t jt=0; jt<nstile; ++jt) {
+    for (size_t it=(self ? jt : 0); it<nttile; ++it) {
+      if ((jt+1)*COEFF_TILE <= skeep and (it+1)*COEFF_TILE <= tkeep) continue;
+      tiles.push_back(std::make_pair(jt,it));
+    }
+  }
 
-  // allocate space for the output array
-  Vector<S> coeffs;
-  coeffs.resize(oldncols*oldnrows);
+  // all influences scale by this constant
+  const S fac = 1.0 / (4.0 * M_PI);
 
   // use floats to prevent overruns
   float flops = 0.0;
 
-  // run a panels-on-points algorithm - THIS CAN BE MORE EFFICIENT
-  #pragma omp parallel for
-  for (int32_t j=0; j<(int32_t)nsrc; j++) {
-    // we are looping over sources first, so we're computing the next nunk *columns* in the A matrix
-
-    // store separate pointers for each of the nunk columns
-    std::vector<size_t> jptr;
-    for (size_t i = 0; i < snunk; ++i) { jptr.push_back((j * snunk + i) * (ntarg * tnunk)); }
-
-    // source triangular panel stays the same
-    const Int sfirst  = si[3*j];
-    const Int ssecond = si[3*j+1];
-    const Int sthird  = si[3*j+2];
+  #pragma omp parallel for schedule(dynamic) reduction(+:flops)
+  for (int32_t t=0; t<(int32_t)tiles.size(); ++t) {
+    const size_t jfirst = tiles[t].first * COEFF_TILE;
+    const size_t jlast  = std::min(nsrc, jfirst+COEFF_TILE);
+    const size_t ifirst = tiles[t].second * COEFF_TILE;
+    const size_t ilast  = std::min(ntarg, ifirst+COEFF_TILE);
+
+    for (size_t j=jfirst; j<jlast; ++j) {
+      // source triangle is broadcast across all lanes
+      const StoreVec sx0 = sg[0][j], sy0 = sg[1][j], sz0 = sg[2][j];
+      const StoreVec sx1 = sg[3][j], sy1 = sg[4][j], sz1 = sg[5][j];
+      const StoreVec sx2 = sg[6][j], sy2 = sg[7][j], sz2 = sg[8][j];
+      const StoreVec sarea = sg[9][j];
+      const S swsa = fac * sg[9][j];
+
+      // in a diagonal tile of a self-block, only targets past the source, and only targets
+      //   that were not kept if this source was
+      size_t istart = self ? std::max(ifirst, j+1) : ifirst;
+      if (j < skeep) istart = std::max(istart, tkeep);
 
 #ifdef USE_VC
-    const StoreVec sx0 = sx[0][sfirst];
-    const StoreVec sy0 = sx[1][sfirst];
-    const StoreVec sz0 = sx[2][sfirst];
-    const StoreVec sx1 = sx[0][ssecond];
-    const StoreVec sy1 = sx[1][ssecond];
-    const StoreVec sz1 = sx[2][ssecond];
-    const StoreVec sx2 = sx[0][sthird];
-    const StoreVec sy2 = sx[1][sthird];
-    const StoreVec sz2 = sx[2][sthird];
-    const S sarea = sa[j];
-
-    const size_t ntargvec = 1 + (ntarg-1) / StoreVec::size();
-
-    for (size_t i=0; i<ntargvec; i++) {
-
-      // fill a 4- or 8-wide vector with the target coordinates
-      StoreVec tx0, ty0, tz0, tx1, ty1, tz1, tx2, ty2, tz2, tav;
-      for (size_t ii=0; ii<StoreVec::size() && i*StoreVec::size()+ii<ntarg; ++ii) {
-        const size_t idx = i*StoreVec::size() + ii;
-        const Int tfirst  = ti[3*idx];
-        const Int tsecond = ti[3*idx+1];
-        const Int tthird  = ti[3*idx+2];
-        tx0[ii] = tx[0][tfirst];
-        ty0[ii] = tx[1][tfirst];
-        tz0[ii] = tx[2][tfirst];
-        tx1[ii] = tx[0][tsecond];
-        ty1[ii] = tx[1][tsecond];
-        tz1[ii] = tx[2][tsecond];
-        tx2[ii] = tx[0][tthird];
-        ty2[ii] = tx[1][tthird];
-        tz2[ii] = tx[2][tthird];
-        tav[ii] = ta[idx];
+      for (size_t i=istart; i<ilast; i+=vw) {
+        const StoreVec tx0(&tg[0][i], Vc::Unaligned), ty0(&tg[1][i], Vc::Unaligned), tz0(&tg[2][i], Vc::Unaligned);
+        const StoreVec tx1(&tg[3][i], Vc::Unaligned), ty1(&tg[4][i], Vc::Unaligned), tz1(&tg[5][i], Vc::Unaligned);
+        const StoreVec tx2(&tg[6][i], Vc::Unaligned), ty2(&tg[7][i], Vc::Unaligned), tz2(&tg[8][i], Vc::Unaligned);
+        const StoreVec tarea(&tg[9][i], Vc::Unaligned);
+
+        StoreVec gx, gy, gz;
+        gx = 0.0; gy = 0.0; gz = 0.0;
+        flops += rkernel_2_2pg<StoreVec,StoreVec>(sx0, sy0, sz0,
+                                                  sx1, sy1, sz1,
+                                                  sx2, sy2, sz2,
+                                                  tx0, ty0, tz0,
+                                                  tx1, ty1, tz1,
+                                                  tx2, ty2, tz2,
+                                                  sarea, tarea, StoreVec(1.0), 0, RECURSIVE_LEVELS,
+                                                  &gx, &gy, &gz);
+
+        // spread the results from a vector register back to the matrix
+        for (size_t ii=0; ii<vw && i+ii<ilast; ++ii) {
+          const S lgx = gx[ii], lgy = gy[ii], lgz = gz[ii];
+          put_panel_coeffs<S>(dest, ld, i+ii, tnunk, targ_has_src, j, snunk, src_has_src,
+                              lgx, lgy, lgz, swsa, sb1, sb2, tb1, tb2, tn);
+
+          // and the reciprocal entry, source and target swapped
+          if (self) {
+            put_panel_coeffs<S>(dest, ld, j, tnunk, targ_has_src, i+ii, snunk, src_has_src,
+                                -lgx, -lgy, -lgz, fac*sg[9][i+ii], sb1, sb2, tb1, tb2, tn);
+          }
+        }
+        flops += (self ? 2.0 : 1.0) * 60.0 * std::min(vw, ilast-i);
       }
-
-      // influence of vortex panel j with unit circulation on center of panel i
-      StoreVec resultu, resultv, resultw;
-      resultu = 0.0; resultv = 0.0; resultw = 0.0;
-
-      // first, strength along panel-centric x1 vector
-      flops += rkernel_2vs_2p<StoreVec,StoreVec>(sx0, sy0, sz0,
-                                      sx1, sy1, sz1,
-                                      sx2, sy2, sz2,
-                                      StoreVec(sb1[0][j]), StoreVec(sb1[1][j]), StoreVec(sb1[2][j]),
-                                      StoreVec(0.0),
-                                      tx0, ty0, tz0,
-                                      tx1, ty1, tz1,
-                                      tx2, ty2, tz2,
-                                      StoreVec(sarea), tav, 0, RECURSIVE_LEVELS,
-                                      &resultu, &resultv, &resultw);
-
-      // dot product with tangent vector, applying normalization here
-      // spread the results from a vector register back to the primary array
-      for (size_t ii=0; ii<StoreVec::size() && i*StoreVec::size()+ii<ntarg; ++ii) {
-        const size_t idx = i*StoreVec::size() + ii;
-        coeffs[jptr[0]++] = resultu[ii]*tb1[0][idx] + resultv[ii]*tb1[1][idx] + resultw[ii]*tb1[2][idx];
-
-        // recompute for other target vector
-        coeffs[jptr[0]++] = resultu[ii]*tb2[0][idx] + resultv[ii]*tb2[1][idx] + resultw[ii]*tb2[2][idx];
-
-        // recompute for normal
-        if (targ_has_src) coeffs[jptr[0]++] = resultu[ii]*tn[0][idx] + resultv[ii]*tn[1][idx] + resultw[ii]*tn[2][idx];
+#else
+      // without Vc, the well-separated pairs (most of them) take one branch-free loop over
+      //   the tile's targets that the compiler can vectorize; this is the same arithmetic
+      //   as the top level of rkernel_2_2pg, which then only runs on the close pairs
+      if (istart >= ilast) continue;
+      const size_t nt = ilast - istart;
+      S fgx[COEFF_TILE], fgy[COEFF_TILE], fgz[COEFF_TILE];
+      uint8_t is_close[COEFF_TILE];
+      const S ssize = std::sqrt(sarea);
+      const S* const __restrict__ ptx0 = tg[0].data() + istart;
+      const S* const __restrict__ pty0 = tg[1].data() + istart;
+      const S* const __restrict__ ptz0 = tg[2].data() + istart;
+      const S* const __restrict__ ptx1 = tg[3].data() + istart;
+      const S* const __restrict__ pty1 = tg[4].data() + istart;
+      const S* const __restrict__ ptz1 = tg[5].data() + istart;
+      const S* const __restrict__ ptx2 = tg[6].data() + istart;
+      const S* const __restrict__ pty2 = tg[7].data() + istart;
+      const S* const __restrict__ ptz2 = tg[8].data() + istart;
+      const S* const __restrict__ ptarea = tg[9].data() + istart;
+
+      #pragma omp simd
+      for (size_t ii=0; ii<nt; ++ii) {
+        const S dx = (ptx0[ii] + ptx1[ii] + ptx2[ii] - sx0 - sx1 - sx2) / S(3.0);
+        const S dy = (pty0[ii] + pty1[ii] + pty2[ii] - sy0 - sy1 - sy2) / S(3.0);
+        const S dz = (ptz0[ii] + ptz1[ii] + ptz2[ii] - sz0 - sz1 - sz2) / S(3.0);
+        const S distsq = dx*dx + dy*dy + dz*dz;
+        const S trisize = ssize + std::sqrt(ptarea[ii]);
+        const bool well = (distsq > S(16.0)*trisize*trisize);
+        const S r2 = core_func<S>(distsq, S(0.0));
+        fgx[ii] = r2 * dx;
+        fgy[ii] = r2 * dy;
+        fgz[ii] = r2 * dz;
+        is_close[ii] = well ? 0 : 1;
       }
+      flops += (self ? 2.0 : 1.0) * (float)nt * (float)(40 + flops_tp_nograds<S>());
 
-      // now, along x2 direction (another 168+20 flops)
-      resultu = 0.0; resultv = 0.0; resultw = 0.0;
-      flops += rkernel_2vs_2p<StoreVec,StoreVec>(sx0, sy0, sz0,
-                                      sx1, sy1, sz1,
-                                      sx2, sy2, sz2,
-                                      StoreVec(sb2[0][j]), StoreVec(sb2[1][j]), StoreVec(sb2[2][j]),
-                                      StoreVec(0.0),
-                                      tx0, ty0, tz0,
-                                      tx1, ty1, tz1,
-                                      tx2, ty2, tz2,
-                                      StoreVec(sarea), tav, 0, RECURSIVE_LEVELS,
-                                      &resultu, &resultv, &resultw);
-      for (size_t ii=0; ii<StoreVec::size() && i*StoreVec::size()+ii<ntarg; ++ii) {
-        const size_t idx = i*StoreVec::size() + ii;
-        coeffs[jptr[1]++] = resultu[ii]*tb1[0][idx] + resultv[ii]*tb1[1][idx] + resultw[ii]*tb1[2][idx];
-        coeffs[jptr[1]++] = resultu[ii]*tb2[0][idx] + resultv[ii]*tb2[1][idx] + resultw[ii]*tb2[2][idx];
-        if (targ_has_src) coeffs[jptr[1]++] = resultu[ii]*tn[0][idx] + resultv[ii]*tn[1][idx] + resultw[ii]*tn[2][idx];
-      }
+      for (size_t ii=0; ii<nt; ++ii) {
+        const size_t i = istart + ii;
+        S lgx = fgx[ii], lgy = fgy[ii], lgz = fgz[ii];
 
-      // finally the influence of a unit-strength source sheet
-      if (src_has_src) {
-        resultu = 0.0; resultv = 0.0; resultw = 0.0;
-        flops += rkernel_2vs_2p<StoreVec,StoreVec>(sx0, sy0, sz0,
+        // close pairs subdivide
+        if (is_close[ii]) {
+          lgx = 0.0; lgy = 0.0; lgz = 0.0;
+          flops += rkernel_2_2pg<S,S>(sx0, sy0, sz0,
                                       sx1, sy1, sz1,
                                       sx2, sy2, sz2,
-                                      StoreVec(0.0), StoreVec(0.0), StoreVec(0.0),
-                                      StoreVec(1.0),
-                                      tx0, ty0, tz0,
-                                      tx1, ty1, tz1,
-                                      tx2, ty2, tz2,
-                                      StoreVec(sarea), tav, 0, RECURSIVE_LEVELS,
-                                      &resultu, &resultv, &resultw);
-        for (size_t ii=0; ii<StoreVec::size() && i*StoreVec::size()+ii<ntarg; ++ii) {
-          const size_t idx = i*StoreVec::size() + ii;
-          coeffs[jptr[2]++] = resultu[ii]*tb1[0][idx] + resultv[ii]*tb1[1][idx] + resultw[ii]*tb1[2][idx];
-          coeffs[jptr[2]++] = resultu[ii]*tb2[0][idx] + resultv[ii]*tb2[1][idx] + resultw[ii]*tb2[2][idx];
-          if (targ_has_src) coeffs[jptr[2]++] = resultu[ii]*tn[0][idx] + resultv[ii]*tn[1][idx] + resultw[ii]*tn[2][idx];
+                                      tg[0][i], tg[1][i], tg[2][i],
+                                      tg[3][i], tg[4][i], tg[5][i],
+                                      tg[6][i], tg[7][i], tg[8][i],
+                                      sarea, tg[9][i], S(1.0), 0, RECURSIVE_LEVELS,
+                                      &lgx, &lgy, &lgz);
         }
-      }
-    }
-#else	// no Vc
-
-    const S sx0 = sx[0][sfirst];
-    const S sy0 = sx[1][sfirst];
-    const S sz0 = sx[2][sfirst];
-    const S sx1 = sx[0][ssecond];
-    const S sy1 = sx[1][ssecond];
-    const S sz1 = sx[2][ssecond];
-    const S sx2 = sx[0][sthird];
-    const S sy2 = sx[1][sthird];
-    const S sz2 = sx[2][sthird];
-    const S sarea = sa[j];
-
-    for (size_t i=0; i<ntarg; i++) {
-      // 382 flops for each of these, assuming vortex-only interactions
-
-      const Int tfirst  = ti[3*i];
-      const Int tsecond = ti[3*i+1];
-      const Int tthird  = ti[3*i+2];
-
-      // influence of panel j with unit vortex sheet strength on entirety of panel i
-      S resultu, resultv, resultw;
-      resultu = 0.0; resultv = 0.0; resultw = 0.0;
-
-      // first, strength along panel-centric x1 vector
-      flops += rkernel_2vs_2p<S,S> (sx0, sy0, sz0,
-                                    sx1, sy1, sz1,
-                                    sx2, sy2, sz2,
-                                    sb1[0][j], sb1[1][j], sb1[2][j], S(0.0),
-                                    tx[0][tfirst], tx[1][tfirst], tx[2][tfirst],
-                                    tx[0][tsecond], tx[1][tsecond], tx[2][tsecond],
-                                    tx[0][tthird], tx[1][tthird], tx[2][tthird],
-                                    sarea, ta[i], 0, RECURSIVE_LEVELS,
-                                    &resultu, &resultv, &resultw);
-
-      // dot product with tangent vector, applying normalization here
-      coeffs[jptr[0]++] = resultu*tb1[0][i] + resultv*tb1[1][i] + resultw*tb1[2][i];
-
-      // recompute for other target vector
-      coeffs[jptr[0]++] = resultu*tb2[0][i] + resultv*tb2[1][i] + resultw*tb2[2][i];
-
-      // recompute for normal
-      if (targ_has_src) coeffs[jptr[0]++] = resultu*tn[0][i] + resultv*tn[1][i] + resultw*tn[2][i];
-
-
-      // now, along x2 direction (another 168+20 flops)
-      resultu = 0.0; resultv = 0.0; resultw = 0.0;
-      flops += rkernel_2vs_2p<S,S> (sx0, sy0, sz0,
-                                    sx1, sy1, sz1,
-                                    sx2, sy2, sz2,
-                                    sb2[0][j], sb2[1][j], sb2[2][j], S(0.0),
-                                    tx[0][tfirst], tx[1][tfirst], tx[2][tfirst],
-                                    tx[0][tsecond], tx[1][tsecond], tx[2][tsecond],
-                                    tx[0][tthird], tx[1][tthird], tx[2][tthird],
-                                    sarea, ta[i], 0, RECURSIVE_LEVELS,
-                                    &resultu, &resultv, &resultw);
-      coeffs[jptr[1]++] = resultu*tb1[0][i] + resultv*tb1[1][i] + resultw*tb1[2][i];
-      coeffs[jptr[1]++] = resultu*tb2[0][i] + resultv*tb2[1][i] + resultw*tb2[2][i];
-      if (targ_has_src) coeffs[jptr[1]++] = resultu*tn[0][i] + resultv*tn[1][i] + resultw*tn[2][i];
-
-
-      // finally the influence of a unit-strength source sheet
-      if (src_has_src) {
-        resultu = 0.0; resultv = 0.0; resultw = 0.0;
 
-        flops += rkernel_2vs_2p<S,S> (sx0, sy0, sz0,
-                                      sx1, sy1, sz1,
-                                      sx2, sy2, sz2,
-                                      (S)0.0, (S)0.0, (S)0.0, (S)1.0,
-                                      tx[0][tfirst], tx[1][tfirst], tx[2][tfirst],
-                                      tx[0][tsecond], tx[1][tsecond], tx[2][tsecond],
-                                      tx[0][tthird], tx[1][tthird], tx[2][tthird],
-                                      sarea, ta[i], 0, RECURSIVE_LEVELS,
-                                      &resultu, &resultv, &resultw);
-
-        coeffs[jptr[2]++] = resultu*tb1[0][i] + resultv*tb1[1][i] + resultw*tb1[2][i];
-        coeffs[jptr[2]++] = resultu*tb2[0][i] + resultv*tb2[1][i] + resultw*tb2[2][i];
-        if (targ_has_src) coeffs[jptr[2]++] = resultu*tn[0][i] + resultv*tn[1][i] + resultw*tn[2][i];
+        put_panel_coeffs<S>(dest, ld, i, tnunk, targ_has_src, j, snunk, src_has_src,
+                            lgx, lgy, lgz, swsa, sb1, sb2, tb1, tb2, tn);
+
+        // and the reciprocal entry, source and target swapped
+        if (self) {
+          put_panel_coeffs<S>(dest, ld, j, tnunk, targ_has_src, i, snunk, src_has_src,
+                              -lgx, -lgy, -lgz, fac*sg[9][i], sb1, sb2, tb1, tb2, tn);
+        }
       }
-    }
 #endif
+    }
+  }
 
-    // special case: self-influence
-    if (&src == &targ) {
+  // special case: self-influence
+  if (self) {
+    for (size_t j=std::min(skeep,tkeep); j<nsrc; ++j) {
       // find the diagonal components
-      size_t dptr = j*ntarg*nunk*nunk + j*nunk;
+      S* dptr = dest + (j*snunk)*ld + j*tnunk;
       // and set to 0 or pi
-      coeffs[dptr]   = 0.0;
-      coeffs[dptr+1] = 2.0*M_PI;
-      if (targ_has_src) coeffs[dptr+2] = 0.0;
+      dptr[0] = 0.0;
+      dptr[1] = 2.0*M_PI*fac;
+      if (targ_has_src) dptr[2] = 0.0;
 
       // next column
-      dptr += ntarg*nunk;
-      coeffs[dptr]   = -2.0*M_PI;
-      coeffs[dptr+1] = 0.0;
-      if (targ_has_src) coeffs[dptr+2] = 0.0;
+      dptr += ld;
+      dptr[0] = -2.0*M_PI*fac;
+      dptr[1] = 0.0;
+      if (targ_has_src) dptr[2] = 0.0;
 
       // last (source) column
       if (src_has_src) {
-        dptr += ntarg*nunk;
-        coeffs[dptr]   = 0.0;
-        coeffs[dptr+1] = 0.0;
-        if (targ_has_src) coeffs[dptr+2] = 2.0*M_PI;
-      }
-    }
-  }
-
-#ifdef USE_VC
-  flops += (float)nsrc*(float)ntarg*382.0;
-#endif
-
-  // scale all influences by the constant
-  const S fac = 1.0 / (4.0 * M_PI);
-  std::transform(coeffs.begin(), coeffs.end(), coeffs.begin(),
-                 [fac](S elem) { return elem * fac; });
-  flops += 2.0 + (float)coeffs.size();
-
-  // debug print the top-left and bottom-right corners
-  if (false) {
-    const size_t nrows = nunk*ntarg;
-    const size_t ncols = nunk*nsrc;
-    std::cout << "Influence matrix is " << nrows << " by " << ncols << std::endl;
-    std::cout << "Top-left corner of influence matrix:" << std::endl;
-    for (size_t i=0; i<6; ++i) {
-      for (size_t j=0; j<6; ++j) {
-        std::cout << " \t" << coeffs[nrows*j+i];
-      }
-      std::cout << std::endl;
-    }
-    std::cout << "Top-right corner of influence matrix:" << std::endl;
-    for (size_t i=0; i<6; ++i) {
-      for (size_t j=ncols-6; j<ncols; ++j) {
-        std::cout << " \t" << coeffs[nrows*j+i];
+        dptr += ld;
+        dptr[0] = 0.0;
+        dptr[1] = 0.0;
+        if (targ_has_src) dptr[2] = 2.0*M_PI*fac;
       }
-      std::cout << std::endl;
-    }
-    std::cout << "Bottom-right corner of influence matrix:" << std::endl;
-    for (size_t i=nrows-6; i<nrows; ++i) {
-      for (size_t j=ncols-6; j<ncols; ++j) {
-        std::cout << " \t" << coeffs[nrows*j+i];
-      }
-      std::cout << std::endl;
     }
   }
 
@@ -464,126 +421,21 @@ Vector<S> panels_on_panels_coeff (Surfaces<S> const& src, Surfaces<S>& targ) {
   std::chrono::duration<double> elapsed_seconds = end-start;
   const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
   printf("    matrix block:\t[%.4f] cpu seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
-
-  // SKIP THE REST IF THERES NO AUGMENTATION - TESTING ONLY
-  return coeffs;
-
-
-  //
-  // now we augment this "matrix" with an optional new row and column
-  //
-
-  const size_t nrows = nunk*ntarg + (targ.is_augmented() ? 3 : 0);
-  const size_t ncols = nunk*nsrc  + ( src.is_augmented() ? 3 : 0);
-  std::cout << "    augmenting the " << ntarg << " x " << nsrc << " block to " << nrows << " x " << ncols << std::endl;
-
-  // make a new 1-D vector to contain the coefficients
-  Vector<S> augcoeff;
-  augcoeff.resize(nrows*ncols);
-
-  // first, copy the old vector into the new and generate the new bottom row
-
-  // original vector is column-major (src/column index changes slowest), so let's keep that
-  for (size_t j=0; j<nsrc; j++) {
-
-    // iterators in each vector
-    auto c_iter = coeffs.begin() + j*ntarg;
-    auto a_iter = augcoeff.begin() + j*nrows;
-
-    // copy the next nsrc numbers into the new vector
-    std::copy(c_iter, c_iter+ntarg, a_iter);
-
-    // and add the bottom value to this column
-    if (src.is_augmented()) {
-      // always include the panel lengths of the source body
-      a_iter += nsrc;
-      // then write the last value in this column - the length of this panel
-      const Int tfirst  = ti[2*j];
-      const Int tsecond = ti[2*j+1];
-      // target panel vector
-      const S panelx = tx[0][tsecond] - tx[0][tfirst];
-      const S panely = tx[1][tsecond] - tx[1][tfirst];
-      const S panell = std::sqrt(panelx*panelx + panely*panely);
-      // coefficient in matrix is the panel length
-      *a_iter = panell;
-    }
-  }
-
-  // no longer need coeffs
-  coeffs.clear();
-
-  // then add the last column, if necessary, if target rotates
-  if (targ.is_augmented()) {
-    auto a_iter = augcoeff.begin() + nsrc*nrows;
-
-    // this is the velocity influence from the source body with unit rotational rate on these target panels
-    std::array<Vector<S>,Dimensions> const& vel = targ.get_vel();
-
-    // fill in the entries - the influence of the source body's panels, when vort and source terms are set
-    //   such that the integration results in the flow imposed by the body's volume of vorticity,
-    //   on this target panel.
-    for (size_t i=0; i<ntarg; ++i) {
-
-      // find target point - just above the panel
-      // yes, I know I am calling these "source"
-      const Int tfirst  = ti[2*i];
-      const Int tsecond = ti[2*i+1];
-      const S panelx = tx[0][tsecond] - tx[0][tfirst];
-      const S panely = tx[1][tsecond] - tx[1][tfirst];
-      const S panell = std::sqrt(panelx*panelx + panely*panely);
-      //std::cout << "targ panel " << i << " at " << tx[0][tfirst] << " " << tx[1][tfirst] << std::endl;
-
-      // and find the component of that velocity along the "target" panel
-      *a_iter = (vel[0][i]*panelx + vel[1][i]*panely) / panell;
-      ++a_iter;
-    }
-
-    // finally, the bottom corner is a 3x3 of the circulation at unit rotation of the body
-    if (&src == &targ) {
-      *a_iter = 2.0 * src.get_vol();
-    } else {
-      *a_iter = 0.0;
-    }
-  } else {
-    // if there's no body pointer, then what?
-  }
-
-  // debug print the top-left and bottom-right corners
-  if (true) {
-    std::cout << "Influence matrix is " << nrows << " by " << ncols << std::endl;
-    std::cout << "Top-left corner of influence matrix:" << std::endl;
-    for (size_t i=0; i<6; ++i) {
-      for (size_t j=0; j<6; ++j) {
-        std::cout << " \t" << augcoeff[nrows*j+i];
-      }
-      std::cout << std::endl;
-    }
-    std::cout << "Top-right corner of influence matrix:" << std::endl;
-    for (size_t i=0; i<6; ++i) {
-      for (size_t j=ncols-6; j<ncols; ++j) {
-        std::cout << " \t" << augcoeff[nrows*j+i];
-      }
-      std::cout << std::endl;
-    }
-    std::cout << "Bottom-right corner of influence matrix:" << std::endl;
-    for (size_t i=nrows-6; i<nrows; ++i) {
-      for (size_t j=ncols-6; j<ncols; ++j) {
-        std::cout << " \t" << augcoeff[nrows*j+i];
-      }
-      std::cout << std::endl;
-    }
-  }
-
-  return augcoeff;
 }
 
 
 // helper struct for dispatching through a variant
+//   coefficients are written in place, column-major, starting at dest
 struct CoefficientVisitor {
+  float* dest;
+  size_t ld;
+  // panels whose entries are already in place, see panels_on_panels_coeff
+  size_t tkeep = 0;
+  size_t skeep = 0;
   // source collection, target collection
-  Vector<float> operator()(Points<float> const& src,   Points<float>& targ)   { return points_on_points_coeff<float>(src, targ); } 
-  Vector<float> operator()(Surfaces<float> const& src, Points<float>& targ)   { return panels_on_points_coeff<float>(src, targ); } 
-  Vector<float> operator()(Points<float> const& src,   Surfaces<float>& targ) { return points_on_panels_coeff<float>(src, targ); } 
-  Vector<float> operator()(Surfaces<float> const& src, Surfaces<float>& targ) { return panels_on_panels_coeff<float>(src, targ); } 
+  void operator()(Points<float> const& src,   Points<float>& targ)   { points_on_points_coeff<float>(src, targ, dest, ld); } 
+  void operator()(Surfaces<float> const& src, Points<float>& targ)   { panels_on_points_coeff<float>(src, targ, dest, ld); } 
+  void operator()(Points<float> const& src,   Surfaces<float>& targ) { points_on_panels_coeff<float>(src, targ, dest, ld); } 
+  void operator()(Surfaces<float> const& src, Surfaces<float>& targ) { panels_on_panels_coeff<float>(src, targ, dest, ld, tkeep, skeep); } 
 };
 
@@ -14,13 +14,20 @@
 #include "BEM.h"
 #include "BEMHelper.h"
 #include "Reflect.h"
+#include "DistanceField.h"
+#include "FieldStats.h"
 #include "GuiHelper.h"
 #include "ExecEnv.h"
 
+#include "json/json.hpp"
+
 #include <cstdlib>
+#include <cstdint>
 #include <iostream>
+#include <chrono>
 #include <vector>
 #include <variant>
+#include <optional>
 
 
 //
@@ -53,20 +60,90 @@ public:
                   std::vector<Collection>&,
                   std::vector<Collection>&,
                   BEM<S,I>&);
+  void advect_multirate(const double,
+                        const double,
+                        const std::array<double,Dimensions>&,
+                        const S,
+                        std::vector<Collection>&,
+                        std::vector<Collection>&,
+                        std::vector<Collection>&,
+                        BEM<S,I>&);
+
+  // multirate integration is used only if near-field particles take more than one substep
+  bool using_multirate() const { return mr_substeps > 1; }
+
+  // the summation method and hardware used for velocities
+  const ExecEnv& get_env() const { return conv_env; }
+
+  // sample statistics on fixed field points at the start of each step, before anything moves
+  void set_stats(FieldStats<S>* _stats) { stats = _stats; }
+
+  // only use summations whose results do not depend on the number of threads
+  void set_reproducible(const bool);
 
 #ifdef USE_IMGUI
   void draw_advanced();
 #endif
 
+  // read/write parameters
+  void from_json(const nlohmann::json);
+  void add_to_json(nlohmann::json&) const;
+
 private:
   // local copies of particle data
   //Particles<S> temp;
 
-  // execution environment for velocity summations (not BEM)
+  // execution environment for velocity summations (not BEM), and the one it replaced
+  //   while reproducible summations are on
   ExecEnv conv_env;
+  std::optional<ExecEnv> saved_env;
+
+  // flag the particles that need to take the smaller multirate substeps
+  std::vector<bool> find_near_field(Points<S> const&,
+                                    PanelTree<S> const&,
+                                    const double,
+                                    const S);
+
+  // multirate parameters: number of near-field substeps per step,
+  //   distance from a body (in nominal separations) inside which particles substep,
+  //   and the strain per step (dt times velocity gradient norm) above which they substep
+  int32_t mr_substeps = 1;
+  S mr_near_dist = 5.0;
+  S mr_strain_limit = 0.25;
+
+  FieldStats<S>* stats = nullptr;
+
+  // find velocities on the field points at the start of a step, and sample them if wanted
+  void find_field_vels(const double,
+                       const std::array<double,Dimensions>&,
+                       std::vector<Collection>&,
+                       std::vector<Collection>&,
+                       std::vector<Collection>&);
 };
 
 
+//
+// the internal CPU summations add each target's sources in a fixed order on any thread,
+//   but the GPU and external solvers do not; turning this off restores the previous choice
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::set_reproducible(const bool _on) {
+  if (not _on) {
+    if (saved_env) conv_env = *saved_env;
+    saved_env.reset();
+    return;
+  }
+  if (not saved_env) saved_env = conv_env;
+  conv_env.set_internal(true);
+  if (conv_env.get_instrs() == gpu_opengl) {
+#ifdef USE_VC
+    conv_env.set_instrs(cpu_vc);
+#else
+    conv_env.set_instrs(cpu_x86);
+#endif
+  }
+}
+
 //
 // helper function to find velocities at a given state, assuming BEM is solved
 //
@@ -123,6 +200,21 @@ void Convection<S,A,I>::find_vels(const std::array<double,Dimensions>& _fs,
   }
 }
 
+//
+// the field points' velocities at the start of a step, solving the fixed ones too if statistics
+//   want a sample now, and take that sample here, before any field point is pushed or moved
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::find_field_vels(const double                         _time,
+                                        const std::array<double,Dimensions>& _fs,
+                                        std::vector<Collection>&             _vort,
+                                        std::vector<Collection>&             _bdry,
+                                        std::vector<Collection>&             _fldpt) {
+  const bool sample = (stats and stats->wants_sample(_time));
+  find_vels(_fs, _vort, _bdry, _fldpt, sample);
+  if (sample) stats->update(_time, _fldpt);
+}
+
 //
 // first-order Euler forward integration
 //
@@ -149,7 +241,7 @@ void Convection<S,A,I>::advect_1st(const double                         _time,
   // part B - knowns
 
   find_vels(_fs, _vort, _bdry, _vort);
-  find_vels(_fs, _vort, _bdry, _fldpt);
+  find_field_vels(_time, _fs, _vort, _bdry, _fldpt);
 
   // part C - convection here
 
@@ -193,7 +285,7 @@ void Convection<S,A,I>::advect_2nd(const double                         _time,
 
   // find the derivatives
   find_vels(_fs, _vort, _bdry, _vort);
-  find_vels(_fs, _vort, _bdry, _fldpt);
+  find_field_vels(_time, _fs, _vort, _bdry, _fldpt);
 
   // advect into an intermediate system
   std::vector<Collection> interim_vort = _vort;
@@ -257,6 +349,243 @@ void Convection<S,A,I>::advect_2nd(const double                         _time,
 }
 
 
+//
+// flag particles near a body or in a region of high strain
+//
+template <class S, class A, class I>
+std::vector<bool> Convection<S,A,I>::find_near_field(Points<S> const&         _pts,
+                                                     PanelTree<S> const&      _panels,
+                                                     const double             _dt,
+                                                     const S                  _ips) {
+
+  const size_t n = _pts.get_n();
+  std::array<Vector<S>,Dimensions> const& tx = _pts.get_pos();
+  auto const& ug = _pts.get_velgrad();
+
+  const S near_dist = mr_near_dist * _ips;
+  const S strain_limit = mr_strain_limit / (S)_dt;
+
+  // vector<bool> cannot be written from multiple threads
+  std::vector<uint8_t> flags(n, 0);
+
+  #pragma omp parallel for schedule(dynamic,256)
+  for (int32_t i=0; i<(int32_t)n; ++i) {
+
+    // check the local strain first, it's cheap
+    if (ug) {
+      S ugsq = 0.0;
+      for (size_t d=0; d<Dimensions*Dimensions; ++d) ugsq += (*ug)[d][i] * (*ug)[d][i];
+      if (ugsq > strain_limit*strain_limit) {
+        flags[i] = 1;
+        continue;
+      }
+    }
+
+    // then look for any panel within the near-field distance
+    if (_panels.any_within(tx[0][i], tx[1][i], tx[2][i], near_dist)) flags[i] = 1;
+  }
+
+  return std::vector<bool>(flags.begin(), flags.end());
+}
+
+
+//
+// multirate second-order integration
+//
+// particles near bodies (or in high strain) take mr_substeps RK2 substeps of size dt/mr_substeps,
+//   while the far field takes a single RK2 step of size dt; during the near-field substeps the
+//   far-field sources are linearly interpolated in time between the start of the step and
+//   the far-field predictor, and the far-field corrector sees the near field at t+dt
+//
+// the far field's influence on the panels is summed only at the two ends of the step and
+//   interpolated the same way, so each substep's BEM solve only sums the near field
+//
+template <class S, class A, class I>
+void Convection<S,A,I>::advect_multirate(const double                         _time,
+                                         const double                         _dt,
+                                         const std::array<double,Dimensions>& _fs,
+                                         const S                              _ips,
+                                         std::vector<Collection>&             _vort,
+                                         std::vector<Collection>&             _bdry,
+                                         std::vector<Collection>&             _fldpt,
+                                         BEM<S,I>&                            _bem) {
+
+  // multirate only helps when there are bodies, and only applies to vortex particles
+  bool can_multirate = (mr_substeps > 1 and _bdry.size() > 0);
+  for (auto &coll : _vort) {
+    if (not std::holds_alternative<Points<S>>(coll)) can_multirate = false;
+  }
+  if (not can_multirate) {
+    advect_2nd(_time, _dt, _fs, _ips, _vort, _bdry, _fldpt, _bem);
+    return;
+  }
+
+  std::cout << "Inside Convection::advect_multirate with dt=" << _dt << " and " << mr_substeps << " substeps" << std::endl;
+
+  // find the velocities at the start of the step, just like RK2 ---------
+
+  // push away particles inside or too close to the body
+  assert(M_PI != 0); // Can't divide by 0
+  clear_inner_layer<S>(1, _bdry, _vort, 1.0/std::sqrt(2.0*M_PI), _ips);
+  // perform the first BEM
+  solve_bem<S,A,I>(_time, _fs, _vort, _bdry, _bem);
+
+  // find the derivatives
+  find_vels(_fs, _vort, _bdry, _vort);
+  find_field_vels(_time, _fs, _vort, _bdry, _fldpt);
+
+  // bin the particles into near and far levels ---------
+
+  auto start = std::chrono::system_clock::now();
+
+  // one near and one far collection for every vortex collection, in the same order
+  std::vector<Collection> near_vort;
+  std::vector<Collection> far_vort;
+  size_t num_near = 0;
+  size_t num_far = 0;
+  const PanelTree<S> panels(_bdry);
+  for (auto &coll : _vort) {
+    Points<S>& pts = std::get<Points<S>>(coll);
+
+    const std::vector<bool> is_near = find_near_field(pts, panels, _dt, _ips);
+    std::vector<bool> is_far(is_near.size());
+    for (size_t i=0; i<is_near.size(); ++i) is_far[i] = not is_near[i];
+
+    Points<S> near_pts = pts;
+    near_pts.compact(is_far);
+    Points<S> far_pts = pts;
+    far_pts.compact(is_near);
+
+    num_near += near_pts.get_n();
+    num_far += far_pts.get_n();
+    near_vort.push_back(std::move(near_pts));
+    far_vort.push_back(std::move(far_pts));
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  std::cout << "    binned " << num_near << " near-field and " << num_far << " far-field particles" << std::endl;
+  printf("    multirate binning:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+
+  // helper to assemble the source list: near field plus far field at a fraction of the step
+  auto gather_sources = [&](std::vector<Collection> const& _near,
+                            std::vector<Collection> const& _far1,
+                            const S _frac) {
+    std::vector<Collection> sources = _near;
+    for (size_t i=0; i<far_vort.size(); ++i) {
+      Points<S> const& p0 = std::get<Points<S>>(far_vort[i]);
+      Points<S> const& p1 = std::get<Points<S>>(_far1[i]);
+      Points<S> pts = p0;
+      std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+      std::array<Vector<S>,Dimensions>& s = pts.get_str();
+      for (size_t d=0; d<Dimensions; ++d) {
+        for (size_t j=0; j<pts.get_n(); ++j) {
+          x[d][j] = ((S)1.0-_frac)*x[d][j] + _frac*p1.get_pos()[d][j];
+          s[d][j] = ((S)1.0-_frac)*s[d][j] + _frac*p1.get_str()[d][j];
+        }
+      }
+      sources.push_back(std::move(pts));
+    }
+    return sources;
+  };
+
+  // far-field predictor: one Euler step of the full dt ---------
+
+  std::vector<Collection> far_pred = far_vort;
+  for (auto &coll : far_pred) {
+    std::visit([=](auto& elem) { elem.move(_time, _dt); }, coll);
+  }
+  std::vector<Collection> interim_fldpt = _fldpt;
+  for (auto &coll : interim_fldpt) {
+    std::visit([=](auto& elem) { elem.move(_time, _dt); }, coll);
+  }
+
+  // the far field's influence on the panels at both ends of the step, so that the substep
+  //   solves only need to sum the near field
+  const std::vector<std::array<Vector<S>,Dimensions>> far_on_panels0 = find_panel_vels<S,A>(_time, far_vort, _bdry);
+  const std::vector<std::array<Vector<S>,Dimensions>> far_on_panels1 = find_panel_vels<S,A>(_time + _dt, far_pred, _bdry);
+  auto far_on_panels = [&](const S _frac) {
+    std::vector<std::array<Vector<S>,Dimensions>> vels = far_on_panels0;
+    for (size_t i=0; i<vels.size(); ++i) {
+      for (size_t d=0; d<Dimensions; ++d) {
+        for (size_t j=0; j<vels[i][d].size(); ++j) {
+          vels[i][d][j] = ((S)1.0-_frac)*vels[i][d][j] + _frac*far_on_panels1[i][d][j];
+        }
+      }
+    }
+    return vels;
+  };
+
+  // near-field substeps, each is RK2 ---------
+
+  const double sub_dt = _dt / (double)mr_substeps;
+  for (int32_t k=0; k<mr_substeps; ++k) {
+    const double sub_time = _time + (double)k * sub_dt;
+    std::cout << "  Near-field substep " << (k+1) << " of " << mr_substeps << " at t=" << sub_time << std::endl;
+
+    // the first substep uses the velocities found above
+    if (k > 0) {
+      clear_inner_layer<S>(1, _bdry, near_vort, 1.0/std::sqrt(2.0*M_PI), _ips);
+      const auto far_vels = far_on_panels((S)k/(S)mr_substeps);
+      solve_bem<S,A,I>(sub_time, _fs, near_vort, _bdry, _bem, &far_vels);
+      std::vector<Collection> sources = gather_sources(near_vort, far_pred, (S)k/(S)mr_substeps);
+      find_vels(_fs, sources, _bdry, near_vort);
+    }
+
+    // advect into an intermediate system
+    std::vector<Collection> interim_near = near_vort;
+    for (auto &coll : interim_near) {
+      std::visit([=](auto& elem) { elem.move(sub_time, sub_dt); }, coll);
+    }
+
+    // find the derivatives at the end of the substep
+    clear_inner_layer<S>(1, _bdry, interim_near, 1.0/std::sqrt(2.0*M_PI), _ips);
+    const auto far_vels = far_on_panels((S)(k+1)/(S)mr_substeps);
+    solve_bem<S,A,I>(sub_time + sub_dt, _fs, interim_near, _bdry, _bem, &far_vels);
+    std::vector<Collection> sources = gather_sources(interim_near, far_pred, (S)(k+1)/(S)mr_substeps);
+    find_vels(_fs, sources, _bdry, interim_near);
+
+    // advect using the combination of both velocities
+    for (size_t i=0; i<near_vort.size(); ++i) {
+      Points<S>& p1 = std::get<Points<S>>(near_vort[i]);
+      Points<S>& p2 = std::get<Points<S>>(interim_near[i]);
+      p1.move(sub_time, sub_dt, 0.5, p1, 0.5, p2);
+    }
+  }
+
+  // far-field corrector, seeing the near field at t+dt ---------
+
+  {
+    solve_bem<S,A,I>(_time + _dt, _fs, near_vort, _bdry, _bem, &far_on_panels1);
+    std::vector<Collection> sources = gather_sources(near_vort, far_pred, (S)1.0);
+    find_vels(_fs, sources, _bdry, far_pred);
+    find_vels(_fs, sources, _bdry, interim_fldpt);
+  }
+
+  for (size_t i=0; i<far_vort.size(); ++i) {
+    Points<S>& p1 = std::get<Points<S>>(far_vort[i]);
+    Points<S>& p2 = std::get<Points<S>>(far_pred[i]);
+    p1.move(_time, _dt, 0.5, p1, 0.5, p2);
+  }
+
+  for (size_t i=0; i<_fldpt.size(); ++i) {
+    if (std::holds_alternative<Points<S>>(_fldpt[i]) and std::holds_alternative<Points<S>>(interim_fldpt[i])) {
+      Points<S>& p1 = std::get<Points<S>>(_fldpt[i]);
+      Points<S>& p2 = std::get<Points<S>>(interim_fldpt[i]);
+      p1.move(_time, _dt, 0.5, p1, 0.5, p2);
+    }
+  }
+
+  // and put the levels back together ---------
+
+  for (size_t i=0; i<_vort.size(); ++i) {
+    Points<S>& pts = std::get<Points<S>>(_vort[i]);
+    pts = std::get<Points<S>>(near_vort[i]);
+    pts.append(std::get<Points<S>>(far_vort[i]));
+  }
+}
+
+
 #ifdef USE_IMGUI
 //
 // draw advanced options parts of the GUI
@@ -336,6 +665,56 @@ void Convection<S,A,I>::draw_advanced() {
       conv_env.set_summation(direct);
     }
   }
+
+  ImGui::PushItemWidth(-270);
+  int substeps = mr_substeps;
+  ImGui::SliderInt("Near-body substeps", &substeps, 1, 8);
+  ImGui::SameLine();
+  ShowHelpMarker("Particles close to bodies or in high strain take this many smaller substeps per time step, while the far field takes one. Set to 1 to advect all particles together.");
+  mr_substeps = substeps;
+  ImGui::PopItemWidth();
 }
 #endif
 
+//
+// read/write parameters to json
+//
+
+// read "simparams" json object
+template <class S, class A, class I>
+void Convection<S,A,I>::from_json(const nlohmann::json simj) {
+
+  if (simj.find("multirate") != simj.end()) {
+    nlohmann::json j = simj["multirate"];
+
+    if (j.find("substeps") != j.end()) {
+      mr_substeps = std::max(1, j["substeps"].get<int32_t>());
+      std::cout << "  setting multirate substeps= " << mr_substeps << std::endl;
+    }
+
+    if (j.find("nearDistance") != j.end()) {
+      mr_near_dist = j["nearDistance"];
+      std::cout << "  setting multirate near_dist= " << mr_near_dist << std::endl;
+    }
+
+    if (j.find("strainLimit") != j.end()) {
+      mr_strain_limit = j["strainLimit"];
+      std::cout << "  setting multirate strain_limit= " << mr_strain_limit << std::endl;
+    }
+  }
+}
+
+// write the multirate parameters into the "simparams" json object
+template <class S, class A, class I>
+void Convection<S,A,I>::add_to_json(nlohmann::json& simj) const {
+
+  // only write them if they are being used
+  if (using_multirate()) {
+    nlohmann::json j;
+    j["substeps"] = mr_substeps;
+    j["nearDistance"] = mr_near_dist;
+    j["strainLimit"] = mr_strain_limit;
+    simj["multirate"] = j;
+  }
+}
+
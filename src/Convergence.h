@@ -0,0 +1,453 @@
+/*
+ * Convergence.h - Watch the status quantities and stop a run once they settle
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "GuiHelper.h"
+#include "json/json.hpp"
+
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <array>
+#include <string>
+#include <algorithm>
+
+
+//
+// Keep the last two windows of the quantities that go into the status file (forces,
+//   circulation, particle count) and decide, after every step, whether they have settled.
+//
+// A channel is steady when its mean and standard deviation barely change from the older
+//   window to the newer one. A channel is periodic when one frequency holds most of its
+//   fluctuation, that frequency agrees between the two windows, and the mean and standard
+//   deviation over whole cycles agree too. Tolerances are fractions of the largest mean
+//   plus deviation among the channels of the same quantity, so that a side force near zero
+//   is compared to the drag, not to itself, and every test allows for twice the standard
+//   error expected from uncorrelated noise of the measured deviation.
+//
+// The run has converged when every watched channel is steady or periodic.
+//
+template <class S>
+class Convergence {
+public:
+  Convergence()
+    : enabled(false),
+      window(100),
+      min_steps(0),
+      mean_tol(0.01),
+      std_tol(0.05),
+      use_periodic(true),
+      min_cycles(3),
+      period_tol(0.02),
+      watch_forces(true),
+      watch_circ(false),
+      watch_count(false),
+      converged(false)
+    {}
+
+  bool is_enabled() const { return enabled; }
+  void set_enabled(const bool _on) { enabled = _on; }
+  bool has_converged() const { return converged; }
+  std::string get_reason() const { return reason; }
+  const std::string& get_summary_file() const { return summary_file; }
+
+  void reset();
+  void add_sample(const double, const size_t, const std::array<float,3>&, const std::array<float,Dimensions>&);
+  bool check(const size_t);
+  void print_summary() const;
+  bool write_summary(const std::string, const size_t, const double) const;
+
+  void from_json(const nlohmann::json);
+  void add_to_json(nlohmann::json&) const;
+#ifdef USE_IMGUI
+  void draw_advanced();
+#endif
+
+private:
+  // one watched value, its quantity (0 forces, 1 circulation, 2 particles) and what we found
+  struct Channel {
+    std::string name;
+    int group;
+    std::deque<S> vals;
+    double mean, stdev, period;
+  };
+
+  void make_channels();
+  static double sampling_error(const double _s0, const double _s1, const size_t _n) {
+    return 2.0*std::sqrt((_s0*_s0 + _s1*_s1) / (double)_n);
+  }
+  static void mean_and_std(const std::deque<S>&, const size_t, const size_t, double&, double&);
+  static double dominant_period(const std::deque<S>&, const size_t, const size_t, const double, const int32_t);
+
+  // settings
+  bool enabled;
+  int32_t window;
+  int32_t min_steps;
+  float mean_tol;
+  float std_tol;
+  bool use_periodic;
+  int32_t min_cycles;
+  float period_tol;
+  bool watch_forces;
+  bool watch_circ;
+  bool watch_count;
+  std::string summary_file;
+
+  // state
+  std::vector<Channel> chan;
+  std::deque<double> times;
+  bool converged;
+  std::string reason;
+};
+
+
+template <class S>
+void Convergence<S>::make_channels() {
+  chan.clear();
+  const char dirs[] = "xyz";
+  if (watch_forces) {
+    for (size_t d=0; d<Dimensions; ++d) chan.push_back({std::string("force ") + dirs[d], 0, {}, 0.0, 0.0, 0.0});
+  }
+  if (watch_circ) {
+    for (size_t d=0; d<3; ++d) chan.push_back({std::string("circulation ") + dirs[d], 1, {}, 0.0, 0.0, 0.0});
+  }
+  if (watch_count) chan.push_back({"particles", 2, {}, 0.0, 0.0, 0.0});
+}
+
+template <class S>
+void Convergence<S>::reset() {
+  make_channels();
+  times.clear();
+  converged = false;
+  reason.clear();
+}
+
+//
+// Add the values of one step, keeping only the last two windows
+//
+template <class S>
+void Convergence<S>::add_sample(const double _time, const size_t _nparts,
+                                const std::array<float,3>& _circ,
+                                const std::array<float,Dimensions>& _force) {
+  if (not enabled) return;
+  if (chan.empty()) make_channels();
+
+  // channels are in order: forces, circulation, particles
+  const size_t nforce = watch_forces ? Dimensions : 0;
+  for (size_t c=0; c<chan.size(); ++c) {
+    std::deque<S>& v = chan[c].vals;
+    if (chan[c].group == 0) v.push_back((S)_force[c]);
+    else if (chan[c].group == 1) v.push_back((S)_circ[c-nforce]);
+    else v.push_back((S)_nparts);
+    if (v.size() > 2*(size_t)window) v.pop_front();
+  }
+  times.push_back(_time);
+  if (times.size() > 2*(size_t)window) times.pop_front();
+}
+
+template <class S>
+void Convergence<S>::mean_and_std(const std::deque<S>& _v, const size_t _first, const size_t _n,
+                                  double& _mean, double& _std) {
+  double sum = 0.0;
+  for (size_t i=_first; i<_first+_n; ++i) sum += _v[i];
+  _mean = sum / (double)_n;
+  double ssq = 0.0;
+  for (size_t i=_first; i<_first+_n; ++i) ssq += std::pow(_v[i] - _mean, 2);
+  _std = std::sqrt(ssq / (double)_n);
+}
+
+//
+// Find the period (in samples) of the strongest frequency in _n samples, or zero if no
+//   frequency of at least _mincyc cycles holds most of the fluctuation. A Hann window keeps
+//   the leakage down, and the peak is refined between the integer frequencies.
+//
+template <class S>
+double Convergence<S>::dominant_period(const std::deque<S>& _v, const size_t _first, const size_t _n,
+                                       const double _mean, const int32_t _mincyc) {
+  if (_n < 8) return 0.0;
+
+  std::vector<double> x(_n);
+  for (size_t i=0; i<_n; ++i) {
+    const double hann = 0.5 - 0.5*std::cos(2.0*M_PI*(double)i/(double)(_n-1));
+    x[i] = hann * (_v[_first+i] - _mean);
+  }
+
+  // power at a (possibly fractional) number of cycles in the window
+  auto power = [&](const double _k) {
+    double re = 0.0, im = 0.0;
+    for (size_t i=0; i<_n; ++i) {
+      const double arg = 2.0*M_PI*_k*(double)i/(double)_n;
+      re += x[i]*std::cos(arg);
+      im -= x[i]*std::sin(arg);
+    }
+    return re*re + im*im;
+  };
+
+  const size_t nk = _n/2;
+  std::vector<double> pwr(nk+1, 0.0);
+  double total = 0.0;
+  size_t kmax = 0;
+  for (size_t k=1; k<=nk; ++k) {
+    pwr[k] = power((double)k);
+    total += pwr[k];
+    if ((int32_t)k >= _mincyc and (kmax == 0 or pwr[k] > pwr[kmax])) kmax = k;
+  }
+  if (kmax == 0 or total <= 0.0) return 0.0;
+
+  // the Hann window spreads a pure tone over three bins
+  double peak = pwr[kmax];
+  if (kmax > 1) peak += pwr[kmax-1];
+  if (kmax < nk) peak += pwr[kmax+1];
+  if (peak < 0.5*total) return 0.0;
+
+  double kbest = (double)kmax;
+  double pbest = pwr[kmax];
+  for (double k = (double)kmax-0.98; k < (double)kmax+1.0; k += 0.02) {
+    const double p = power(k);
+    if (p > pbest) {
+      pbest = p;
+      kbest = k;
+    }
+  }
+  if (kbest < (double)_mincyc) return 0.0;
+
+  return (double)_n / kbest;
+}
+
+//
+// Test every channel, return true once all have settled
+//
+template <class S>
+bool Convergence<S>::check(const size_t _nstep) {
+  if (not enabled or converged or chan.empty()) return converged;
+  const size_t w = (size_t)window;
+  if (times.size() < 2*w or _nstep < (size_t)min_steps) return false;
+
+  // the means and deviations of both windows
+  std::vector<std::array<double,4>> ms(chan.size());
+  for (size_t c=0; c<chan.size(); ++c) {
+    mean_and_std(chan[c].vals, 0, w, ms[c][0], ms[c][1]);
+    mean_and_std(chan[c].vals, w, w, ms[c][2], ms[c][3]);
+  }
+
+  // the scale of each quantity
+  std::array<double,3> scale = {0.0, 0.0, 0.0};
+  for (size_t c=0; c<chan.size(); ++c) {
+    const int g = chan[c].group;
+    scale[g] = std::max(scale[g], std::abs(ms[c][2]) + ms[c][3]);
+  }
+
+  // sample spacing in time
+  const double dt = (times.back() - times[w]) / (double)(w-1);
+
+  // a channel that is identically zero says nothing, and neither do all of them together
+  bool all_settled = true;
+  bool any_watched = false;
+  double longest = 0.0;
+  for (size_t c=0; c<chan.size(); ++c) {
+    Channel& ch = chan[c];
+    const double tol = scale[ch.group];
+    ch.mean = ms[c][2];
+    ch.stdev = ms[c][3];
+    ch.period = 0.0;
+
+    // nothing to watch
+    if (tol <= 0.0) continue;
+    any_watched = true;
+
+    // periodic: same period in both windows, and the same statistics over whole cycles
+    if (use_periodic) {
+      const double pold = dominant_period(ch.vals, 0, w, ms[c][0], min_cycles);
+      const double pnew = dominant_period(ch.vals, w, w, ms[c][2], min_cycles);
+      if (pold > 0.0 and pnew > 0.0 and std::abs(pnew-pold) <= period_tol*pnew) {
+        const size_t ncyc = (size_t)std::round(std::floor((double)w / pnew) * pnew);
+        double m0, s0, m1, s1;
+        mean_and_std(ch.vals, w-ncyc, ncyc, m0, s0);
+        mean_and_std(ch.vals, 2*w-ncyc, ncyc, m1, s1);
+        if (std::abs(m1-m0) <= mean_tol*tol + sampling_error(s0, s1, ncyc) and
+            std::abs(s1-s0) <= std_tol*tol + sampling_error(s0, s1, 2*ncyc)) {
+          ch.mean = m1;
+          ch.stdev = s1;
+          ch.period = pnew * dt;
+          longest = std::max(longest, ch.period);
+          continue;
+        }
+      }
+    }
+
+    // statistically steady
+    if (std::abs(ms[c][2]-ms[c][0]) <= mean_tol*tol + sampling_error(ms[c][1], ms[c][3], w) and
+        std::abs(ms[c][3]-ms[c][1]) <= std_tol*tol + sampling_error(ms[c][1], ms[c][3], 2*w)) continue;
+
+    all_settled = false;
+    break;
+  }
+
+  if (all_settled and any_watched) {
+    converged = true;
+    std::ostringstream os;
+    if (longest > 0.0) os << "periodic with period " << longest;
+    else os << "statistically steady";
+    os << " over the last " << window << " steps";
+    reason = os.str();
+  }
+  return converged;
+}
+
+template <class S>
+void Convergence<S>::print_summary() const {
+  std::cout << "  Converged: " << reason << std::endl;
+  for (auto const& c : chan) {
+    std::cout << "    " << std::setw(14) << std::left << c.name << std::right
+              << " mean " << std::setw(12) << c.mean << "  std dev " << std::setw(12) << c.stdev;
+    if (c.period > 0.0) std::cout << "  period " << c.period;
+    std::cout << std::endl;
+  }
+}
+
+// write the final statistics as json, return false if the file could not be written
+template <class S>
+bool Convergence<S>::write_summary(const std::string _fn, const size_t _nstep, const double _time) const {
+  nlohmann::json j;
+  j["reason"] = reason;
+  j["step"] = _nstep;
+  j["time"] = _time;
+  j["window"] = window;
+  nlohmann::json q = nlohmann::json::object();
+  for (auto const& c : chan) {
+    nlohmann::json cj;
+    cj["mean"] = c.mean;
+    cj["stdDev"] = c.stdev;
+    if (c.period > 0.0) cj["period"] = c.period;
+    q[c.name] = cj;
+  }
+  j["quantities"] = q;
+
+  std::ofstream os(_fn);
+  if (not os) return false;
+  os << std::setw(2) << j << std::endl;
+  std::cout << "  wrote convergence summary to " << _fn << std::endl;
+  return true;
+}
+
+//
+// read/write parameters
+//
+template <class S>
+void Convergence<S>::from_json(const nlohmann::json simj) {
+  if (simj.find("convergence") != simj.end()) {
+    nlohmann::json j = simj["convergence"];
+    enabled = j.value("enabled", true);
+    std::cout << "  setting convergence monitor= " << enabled << std::endl;
+    if (j.find("window") != j.end()) {
+      window = std::max(10, j["window"].get<int32_t>());
+      std::cout << "  setting convergence window= " << window << std::endl;
+    }
+    if (j.find("minSteps") != j.end()) {
+      min_steps = std::max(0, j["minSteps"].get<int32_t>());
+      std::cout << "  setting convergence min steps= " << min_steps << std::endl;
+    }
+    if (j.find("meanTol") != j.end()) {
+      mean_tol = j["meanTol"];
+      std::cout << "  setting convergence mean tolerance= " << mean_tol << std::endl;
+    }
+    if (j.find("stdTol") != j.end()) {
+      std_tol = j["stdTol"];
+      std::cout << "  setting convergence std dev tolerance= " << std_tol << std::endl;
+    }
+    if (j.find("periodic") != j.end()) {
+      use_periodic = j["periodic"];
+      std::cout << "  setting convergence periodic detection= " << use_periodic << std::endl;
+    }
+    if (j.find("minCycles") != j.end()) {
+      min_cycles = std::max(2, j["minCycles"].get<int32_t>());
+      std::cout << "  setting convergence min cycles= " << min_cycles << std::endl;
+    }
+    if (j.find("periodTol") != j.end()) {
+      period_tol = j["periodTol"];
+      std::cout << "  setting convergence period tolerance= " << period_tol << std::endl;
+    }
+    if (j.find("summaryFile") != j.end()) {
+      summary_file = j["summaryFile"].get<std::string>();
+      std::cout << "  setting convergence summary file= " << summary_file << std::endl;
+    }
+    if (j.find("quantities") != j.end()) {
+      const std::vector<std::string> q = j["quantities"];
+      watch_forces = (std::find(q.begin(), q.end(), "forces") != q.end());
+      watch_circ = (std::find(q.begin(), q.end(), "circulation") != q.end());
+      watch_count = (std::find(q.begin(), q.end(), "particles") != q.end());
+      std::cout << "  setting convergence quantities=";
+      for (auto const& s : q) std::cout << " " << s;
+      std::cout << std::endl;
+    }
+    make_channels();
+  }
+}
+
+template <class S>
+void Convergence<S>::add_to_json(nlohmann::json& simj) const {
+  if (enabled) {
+    nlohmann::json j;
+    j["enabled"] = true;
+    j["window"] = window;
+    j["minSteps"] = min_steps;
+    j["meanTol"] = mean_tol;
+    j["stdTol"] = std_tol;
+    j["periodic"] = use_periodic;
+    j["minCycles"] = min_cycles;
+    j["periodTol"] = period_tol;
+    if (not summary_file.empty()) j["summaryFile"] = summary_file;
+    std::vector<std::string> q;
+    if (watch_forces) q.push_back("forces");
+    if (watch_circ) q.push_back("circulation");
+    if (watch_count) q.push_back("particles");
+    j["quantities"] = q;
+    simj["convergence"] = j;
+  }
+}
+
+#ifdef USE_IMGUI
+//
+// draw advanced options parts of the GUI
+//
+template <class S>
+void Convergence<S>::draw_advanced() {
+
+  ImGui::Spacing();
+  ImGui::Text("Convergence monitor settings");
+
+  ImGui::Checkbox("Stop when the flow settles", &enabled);
+  ImGui::SameLine();
+  ShowHelpMarker("Compare the status quantities over the last two windows of steps, and stop the run once each is steady or repeats with a fixed period.");
+
+  if (enabled) {
+    bool changed = false;
+    changed |= ImGui::Checkbox("Forces", &watch_forces);
+    ImGui::SameLine();
+    changed |= ImGui::Checkbox("Circulation", &watch_circ);
+    ImGui::SameLine();
+    changed |= ImGui::Checkbox("Particle count", &watch_count);
+    changed |= ImGui::SliderInt("Steps per window", &window, 10, 1000);
+    ImGui::SliderInt("Minimum steps", &min_steps, 0, 10000);
+    ImGui::SliderFloat("Mean tolerance", &mean_tol, 0.0001, 0.1, "%.4f");
+    ImGui::SliderFloat("Std dev tolerance", &std_tol, 0.0001, 0.5, "%.4f");
+    ImGui::Checkbox("Detect periodic shedding", &use_periodic);
+    if (use_periodic) {
+      ImGui::SliderInt("Minimum cycles per window", &min_cycles, 2, 20);
+      ImGui::SliderFloat("Period tolerance", &period_tol, 0.001, 0.1, "%.3f");
+    }
+    if (changed) reset();
+  }
+}
+#endif
@@ -0,0 +1,158 @@
+/*
+ * CoreBench.cpp - Time the core function helpers at every accuracy tier
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "CoreBench.h"
+#include "CoreFunc.h"
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <array>
+#include <string>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <type_traits>
+
+
+// the worst relative error allowed at each tier: the bounds given in CoreFunc.h
+//   with the effective error multiplier of each function, plus a few roundings
+template <class S>
+static double error_bound(const int _tier, const double _mult, const double _expbound) {
+  const double eps = (double)std::numeric_limits<S>::epsilon();
+  double bound = 0.0;
+  if (_tier == 1) {
+    bound = std::is_same<S,float>::value ? 4.7e-6 : 3.2e-11;
+  } else if (_tier == 2) {
+    bound = std::is_same<S,float>::value ? 1.8e-3 : 4.7e-6;
+  }
+  if (_expbound > 0.0) {
+    // exp uses the polynomial bounds instead
+    if (_tier == 1) bound = std::is_same<S,float>::value ? 1.0e-7 : 7.8e-16;
+    else if (_tier == 2) bound = std::is_same<S,float>::value ? 1.0e-4 : 2.6e-9;
+    return bound + _expbound*eps;
+  }
+  return _mult*bound + 8.0*eps;
+}
+
+// time the loop _out[i] = _func(_in[i]), which the compiler can vectorize, and the loop
+//   sum += _func(_in[i]) into a double, which stays scalar like the kernels without Vc,
+//   (best of a few of each) and find the worst relative error
+template <class S, class F, class R>
+static void time_one(const std::vector<S>& _in, std::vector<S>& _out, F _func, R _ref,
+                     double* _secs, double* _sumsecs, double* _maxerr) {
+  const size_t n = _in.size();
+  *_secs = std::numeric_limits<double>::max();
+  *_sumsecs = std::numeric_limits<double>::max();
+  double sum = 0.0;
+  for (int irep=0; irep<5; ++irep) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i=0; i<n; ++i) _out[i] = _func(_in[i]);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    *_secs = std::min(*_secs, elapsed.count());
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i=0; i<n; ++i) sum += _func(_in[i]);
+    elapsed = std::chrono::steady_clock::now() - start;
+    *_sumsecs = std::min(*_sumsecs, elapsed.count());
+  }
+  *_maxerr = 0.0;
+  for (size_t i=0; i<n; ++i) {
+    const long double exact = _ref((long double)_in[i]);
+    const long double err = std::abs(((long double)_out[i] - exact) / exact);
+    *_maxerr = std::max(*_maxerr, (double)err);
+  }
+  // keep the sums from being optimized away
+  if (sum == 0.123456789) std::cout << sum << std::endl;
+}
+
+// run one function at all three tiers
+template <class S, class F0, class F1, class F2, class R>
+static int bench_func(const char* _name, const std::vector<S>& _in, std::vector<S>& _out,
+                      F0 _f0, F1 _f1, F2 _f2, R _ref, const double _mult, const double _expbound) {
+  int nfail = 0;
+  std::array<double,3> secs, sumsecs, errs;
+  time_one(_in, _out, _f0, _ref, &secs[0], &sumsecs[0], &errs[0]);
+  time_one(_in, _out, _f1, _ref, &secs[1], &sumsecs[1], &errs[1]);
+  time_one(_in, _out, _f2, _ref, &secs[2], &sumsecs[2], &errs[2]);
+  for (int t=0; t<3; ++t) {
+    const double bound = error_bound<S>(t, _mult, _expbound);
+    const bool pass = (errs[t] <= bound);
+    if (not pass) nfail++;
+    printf("    %s tier %d:\t[%.4f] [%.4f] seconds, %.2fx %.2fx, max rel err %.2e (bound %.1e)%s\n",
+           _name, t, secs[t], sumsecs[t], secs[0]/secs[t], sumsecs[0]/sumsecs[t],
+           errs[t], bound, pass ? "" : "  EXCEEDED");
+  }
+  return nfail;
+}
+
+template <class S>
+static int bench_type(const int _n, const char* _typename) {
+
+  std::cout << std::endl << "Core functions in " << _typename << " over " << _n << " values" << std::endl;
+  std::cout << "  times and speedups are for a vectorizable loop, then for a scalar sum" << std::endl;
+
+  std::mt19937 gen(12345);
+  std::vector<S> pos(_n), neg(_n), dsq(_n), out(_n);
+  // squared distances spread over many decades, exp arguments as in the exponential core
+  std::uniform_real_distribution<S> logdist(-6.0, 4.0);
+  std::uniform_real_distribution<S> expdist(-16.0, 0.0);
+  std::uniform_real_distribution<S> dsqdist(0.0, 4.0);
+  for (int i=0; i<_n; ++i) {
+    pos[i] = std::pow(S(10.0), logdist(gen));
+    neg[i] = expdist(gen);
+    dsq[i] = dsqdist(gen);
+  }
+  const S sr = 0.1;
+  const long double lsr = sr;
+
+  int nfail = 0;
+  nfail += bench_func("rsqrt  ", pos, out,
+                      [](const S x) { return approx_rsqrt<0>(x); },
+                      [](const S x) { return approx_rsqrt<1>(x); },
+                      [](const S x) { return approx_rsqrt<2>(x); },
+                      [](const long double x) { return 1.0l / std::sqrt(x); }, 1.0, 0.0);
+  nfail += bench_func("oor1p5 ", pos, out,
+                      [](const S x) { return approx_oor1p5<0>(x); },
+                      [](const S x) { return approx_oor1p5<1>(x); },
+                      [](const S x) { return approx_oor1p5<2>(x); },
+                      [](const long double x) { return 1.0l / (x*std::sqrt(x)); }, 3.0, 0.0);
+  nfail += bench_func("oor2p5 ", pos, out,
+                      [](const S x) { return approx_oor2p5<0>(x); },
+                      [](const S x) { return approx_oor2p5<1>(x); },
+                      [](const S x) { return approx_oor2p5<2>(x); },
+                      [](const long double x) { return 1.0l / (x*x*std::sqrt(x)); }, 5.0, 0.0);
+  nfail += bench_func("oor0p75", pos, out,
+                      [](const S x) { return approx_oor0p75<0>(x); },
+                      [](const S x) { return approx_oor0p75<1>(x); },
+                      [](const S x) { return approx_oor0p75<2>(x); },
+                      [](const long double x) { return std::pow(x, -0.75l); }, 2.5, 0.0);
+  nfail += bench_func("exp    ", neg, out,
+                      [](const S x) { return approx_exp<0>(x); },
+                      [](const S x) { return approx_exp<1>(x); },
+                      [](const S x) { return approx_exp<2>(x); },
+                      [](const long double x) { return std::exp(x); }, 1.0, 16.0);
+  // the Winckelmans-Leonard velocity core, as in core_func
+  nfail += bench_func("wl core", dsq, out,
+                      [sr](const S d) { return (d + S(2.5)*sr*sr) * approx_oor2p5<0>(d + sr*sr); },
+                      [sr](const S d) { return (d + S(2.5)*sr*sr) * approx_oor2p5<1>(d + sr*sr); },
+                      [sr](const S d) { return (d + S(2.5)*sr*sr) * approx_oor2p5<2>(d + sr*sr); },
+                      [lsr](const long double d) { return (d + 2.5l*lsr*lsr) / std::pow(d + lsr*lsr, 2.5l); },
+                      5.0, 0.0);
+  return nfail;
+}
+
+int bench_core_funcs(const int _n) {
+  std::cout << std::endl << "Benchmarking core functions, this build uses tier " << CORE_FUNC_ACCURACY << std::endl;
+  int nfail = 0;
+  nfail += bench_type<float>(_n, "float");
+  nfail += bench_type<double>(_n, "double");
+  if (nfail > 0) std::cout << std::endl << nfail << " errors exceeded their bounds" << std::endl;
+  return (nfail == 0) ? 0 : 1;
+}
@@ -0,0 +1,17 @@
+/*
+ * CoreBench.h - Time the core function helpers at every accuracy tier
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+//
+// Evaluate rsqrt, the fractional powers, exp and the whole velocity core over _n values at
+//   each accuracy tier of CoreFunc.h, in float and in double, and print the time, the speedup
+//   over tier 0, and the worst relative error against a long double reference
+//
+// Returns 0 if every error was inside the bound documented for its tier, 1 otherwise
+//
+int bench_core_funcs(const int _n);
@@ -16,6 +16,9 @@
 #endif
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 //#define USE_RM_KERNEL
 //#define USE_EXPONENTIAL_KERNEL
@@ -23,6 +26,155 @@
 //#define USE_V2_KERNEL
 //#define USE_V3_KERNEL	// not programmed
 
+//
+// Accuracy tier of the reciprocal square roots and exponentials in the helpers below
+//   0 - library sqrt, divide and exp (and Vc::rsqrt, Vc::reciprocal when using Vc)
+//   1 - bit-trick or hardware estimate of 1/sqrt plus two Newton steps, degree-5 exp polynomial
+//   2 - same estimate plus one Newton step, degree-3 exp polynomial
+// Build with -DCORE_FUNC_ACCURACY=n to choose; Omega3Dbatch.bin --bench-core prints the speed
+//   and the measured error of each tier on the current machine
+//
+#ifndef CORE_FUNC_ACCURACY
+#define CORE_FUNC_ACCURACY 0
+#endif
+
+// first guesses at 1/sqrt for positive, normal inputs - the bit trick is within 3.4e-2
+static inline float rsqrt_seed(const float _in) {
+  uint32_t i;
+  std::memcpy(&i, &_in, sizeof(float));
+  i = 0x5f375a86u - (i >> 1);
+  float y;
+  std::memcpy(&y, &i, sizeof(float));
+  return y;
+}
+static inline double rsqrt_seed(const double _in) {
+  uint64_t i;
+  std::memcpy(&i, &_in, sizeof(double));
+  i = 0x5fe6eb50c7b537a9ull - (i >> 1);
+  double y;
+  std::memcpy(&y, &i, sizeof(double));
+  return y;
+}
+#ifdef USE_VC
+// the hardware estimate is within 1.5*2^-12 for float_v
+template <class S>
+static inline S rsqrt_seed(const S _in) {
+  return Vc::rsqrt(_in);
+}
+#endif
+
+// each Newton step takes a relative error e down to 1.5*e^2
+template <class S>
+static inline S rsqrt_newton(const S _in, const S _y) {
+  return _y * (S(1.5) - S(0.5)*_in*_y*_y);
+}
+
+//
+// 1/sqrt(x) for positive, normal x; the worst relative errors from the bit-trick seed are
+//   tier 1: 4.7e-6 in float, 3.2e-11 in double (one more step)
+//   tier 2: 1.8e-3 in float, 4.7e-6 in double
+// With Vc the better hardware seed gives float round-off at tier 1 and 2e-7 at tier 2
+//
+template <int T, class S>
+static inline S approx_rsqrt(const S _in) {
+  if constexpr (T == 0) {
+    return S(1.0) / std::sqrt(_in);
+  } else {
+    S y = rsqrt_newton(_in, rsqrt_seed(_in));
+    if constexpr (T < 2) y = rsqrt_newton(_in, y);
+    if constexpr (std::is_same<S,double>::value) y = rsqrt_newton(_in, y);
+    return y;
+  }
+}
+
+// the powers below are products of the estimates, so their errors are up to 3, 5 and 2.5
+//   times that of approx_rsqrt, but none of them needs a divide or a square root
+template <int T, class S>
+static inline S approx_oor1p5(const S _in) {
+  if constexpr (T == 0) {
+    return S(1.0) / (_in*std::sqrt(_in));
+  } else {
+    const S r = approx_rsqrt<T>(_in);
+    return r*r*r;
+  }
+}
+
+template <int T, class S>
+static inline S approx_oor2p5(const S _in) {
+  if constexpr (T == 0) {
+    return S(1.0) / (_in*_in*std::sqrt(_in));
+  } else {
+    const S r = approx_rsqrt<T>(_in);
+    const S r2 = r*r;
+    return r2*r2*r;
+  }
+}
+
+template <int T, class S>
+static inline S approx_oor0p75(const S _in) {
+  if constexpr (T == 0) {
+    const S sqd = std::sqrt(_in);
+    return S(1.0) / (sqd*std::sqrt(sqd));
+  } else {
+    const S r = approx_rsqrt<T>(_in);
+    return r*r*approx_rsqrt<T>(r);
+  }
+}
+
+//
+// e^x from e^x = 2^k e^r, with k the nearest integer to x/ln2 and |r| <= ln2/2, and a
+//   near-minimax polynomial for e^r; valid for -87 < x < 88 in float (-708 < x < 709 in
+//   double). The polynomials alone are within
+//   tier 1: 1.0e-7 in float (degree 5), 7.8e-16 in double (degree 10)
+//   tier 2: 1.0e-4 in float (degree 3), 2.6e-9 in double (degree 6)
+//
+template <int T>
+static inline float approx_exp(const float _in) {
+  if constexpr (T == 0) {
+    return std::exp(_in);
+  } else {
+    const float k = std::floor(_in*1.44269504f + 0.5f);
+    // ln2 in two parts, so that k*ln2 is exact enough
+    const float r = (_in - k*0.693359375f) + k*2.12194440e-4f;
+    float p;
+    if constexpr (T < 2) {
+      p = 1.000000075f + r*(1.000000011f + r*(4.999886938e-1f + r*(1.666650526e-1f
+        + r*(4.191750725e-2f + r*8.369148491e-3f))));
+    } else {
+      p = 9.999245570e-1f + r*(9.999849286e-1f + r*(5.050222842e-1f + r*1.676701188e-1f));
+    }
+    const int32_t bits = ((int32_t)k + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return p * scale;
+  }
+}
+
+template <int T>
+static inline double approx_exp(const double _in) {
+  if constexpr (T == 0) {
+    return std::exp(_in);
+  } else {
+    const double k = std::floor(_in*1.4426950408889634 + 0.5);
+    const double r = (_in - k*6.93147180369123816490e-01) - k*1.90821492927058770002e-10;
+    double p;
+    if constexpr (T < 2) {
+      p = 9.99999999999999889e-01 + r*(1.00000000000000755e+00 + r*(5.00000000000021316e-01
+        + r*(1.66666666665543362e-01 + r*(4.16666666657070014e-02 + r*(8.33333338523608962e-03
+        + r*(1.38888890785691748e-03 + r*(1.98411708839618575e-04 + r*(2.48014000961387709e-05
+        + r*(2.76399413080721204e-06 + r*2.76523657038977990e-07)))))))));
+    } else {
+      p = 1.0 + r*(1.00000003771621371e+00 + r*(5.00000004711775636e-01
+        + r*(1.66664155146532683e-01 + r*(4.16663528967579772e-02 + r*(8.37512639815599959e-03
+        + r*1.39411084355018462e-03)))));
+    }
+    const int64_t bits = ((int64_t)k + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(double));
+    return p * scale;
+  }
+}
+
 // helper functions: sqrt, recip, oor1p5
 #ifdef USE_VC
 template <class S>
@@ -47,20 +199,24 @@ static inline S my_sqrt(const S _in) {
 #ifdef USE_VC
 template <class S>
 static inline S my_rsqrt(const S _in) {
+#if CORE_FUNC_ACCURACY > 0
+  return approx_rsqrt<CORE_FUNC_ACCURACY>(_in);
+#else
   return Vc::rsqrt(_in);
+#endif
 }
 template <>
 inline float my_rsqrt(const float _in) {
-  return 1.0f / std::sqrt(_in);
+  return approx_rsqrt<CORE_FUNC_ACCURACY>(_in);
 }
 template <>
 inline double my_rsqrt(const double _in) {
-  return 1.0 / std::sqrt(_in);
+  return approx_rsqrt<CORE_FUNC_ACCURACY>(_in);
 }
 #else
 template <class S>
 static inline S my_rsqrt(const S _in) {
-  return (S)1.0 / std::sqrt(_in);
+  return approx_rsqrt<CORE_FUNC_ACCURACY>(_in);
 }
 #endif
 
@@ -87,67 +243,76 @@ static inline S my_recip(const S _in) {
 #ifdef USE_VC
 template <class S>
 static inline S oor2p5(const S _in) {
+#if CORE_FUNC_ACCURACY > 0
+  return approx_oor2p5<CORE_FUNC_ACCURACY>(_in);
+#else
   //return Vc::reciprocal(_in*_in*Vc::sqrt(_in));	// 234 GFlop/s
   return Vc::rsqrt(_in) * Vc::reciprocal(_in*_in);	// 269 GFlop/s
+#endif
 }
 template <>
 inline float oor2p5(const float _in) {
-  return 1.0f / (_in*_in*std::sqrt(_in));
+  return approx_oor2p5<CORE_FUNC_ACCURACY>(_in);
 }
 template <>
 inline double oor2p5(const double _in) {
-  return 1.0 / (_in*_in*std::sqrt(_in));
+  return approx_oor2p5<CORE_FUNC_ACCURACY>(_in);
 }
 #else
 template <class S>
 static inline S oor2p5(const S _in) {
-  return S(1.0) / (_in*_in*std::sqrt(_in));
+  return approx_oor2p5<CORE_FUNC_ACCURACY>(_in);
 }
 #endif
 
 #ifdef USE_VC
 template <class S>
 static inline S oor1p5(const S _in) {
+#if CORE_FUNC_ACCURACY > 0
+  return approx_oor1p5<CORE_FUNC_ACCURACY>(_in);
+#else
   //return Vc::reciprocal(_in*Vc::sqrt(_in));		// 243 GFlop/s
   return Vc::rsqrt(_in) * Vc::reciprocal(_in);		// 302 GFlop/s
+#endif
 }
 template <>
 inline float oor1p5(const float _in) {
-  return 1.0f / (_in*std::sqrt(_in));
+  return approx_oor1p5<CORE_FUNC_ACCURACY>(_in);
 }
 template <>
 inline double oor1p5(const double _in) {
-  return 1.0 / (_in*std::sqrt(_in));
+  return approx_oor1p5<CORE_FUNC_ACCURACY>(_in);
 }
 #else
 template <class S>
 static inline S oor1p5(const S _in) {
-  return S(1.0) / (_in*std::sqrt(_in));
+  return approx_oor1p5<CORE_FUNC_ACCURACY>(_in);
 }
 #endif
 
 #ifdef USE_VC
 template <class S>
 static inline S oor0p75(const S _in) {
+#if CORE_FUNC_ACCURACY > 0
+  return approx_oor0p75<CORE_FUNC_ACCURACY>(_in);
+#else
   const S rsqd = Vc::rsqrt(_in);
   //return rsqd*Vc::sqrt(rsqd);				// 265 GFlop/s
   return rsqd*rsqd*Vc::rsqrt(rsqd);			// 301 GFlop/s
+#endif
 }
 template <>
 inline float oor0p75(const float _in) {
-  const float sqd = std::sqrt(_in);
-  return 1.0f / (sqd*std::sqrt(sqd));
+  return approx_oor0p75<CORE_FUNC_ACCURACY>(_in);
 }
 template <>
 inline double oor0p75(const double _in) {
-  const double sqd = std::sqrt(_in);
-  return 1.0 / (sqd*std::sqrt(sqd));
+  return approx_oor0p75<CORE_FUNC_ACCURACY>(_in);
 }
 #else
 template <class S>
 static inline S oor0p75(const S _in) {
-  const S sqd = std::sqrt(_in);
-  return S(1.0) / (sqd*std::sqrt(sqd));
+  return approx_oor0p75<CORE_FUNC_ACCURACY>(_in);
 }
 #endif
 
@@ -194,7 +359,7 @@ template <class S> inline size_t flops_tp_grads () { return 7; }
 
 
 #ifdef USE_EXPONENTIAL_KERNEL
-// a helper conditional
+// a helper conditional - Vc::exp is already a vector polynomial, so it is used at every tier
 #ifdef USE_VC
 template <class S>
 static inline S exp_cond (const S ood3, const S corefac, const S reld3) {
@@ -210,7 +375,7 @@ inline float exp_cond (const float ood3, const float corefac, const float reld3)
   } else if (reld3 < 0.001f) {
     return corefac;
   } else {
-    return ood3 * (1.0f - std::exp(-reld3));
+    return ood3 * (1.0f - approx_exp<CORE_FUNC_ACCURACY>(-reld3));
   }
 }
 template <>
@@ -220,7 +385,7 @@ inline double exp_cond (const double ood3, const double corefac, const double re
   } else if (reld3 < 0.001) {
     return corefac;
   } else {
-    return ood3 * (1.0 - std::exp(-reld3));
+    return ood3 * (1.0 - approx_exp<CORE_FUNC_ACCURACY>(-reld3));
   }
 }
 #else
@@ -233,7 +398,7 @@ static inline S exp_cond (const S ood3, const S corefac, const S reld3) {
     return corefac;
     // 2 flops
   } else {
-    return ood3 * (1.0f - std::exp(-reld3));
+    return ood3 * (1.0f - approx_exp<CORE_FUNC_ACCURACY>(-reld3));
     // 3 flops
   }
 }
@@ -256,7 +421,7 @@ inline float exp_bbb (const float r3, const float corefac, const float reld3, co
   } else if (reld3 < 0.001f) {
     return -1.5f * dist * r3 * r3;
   } else {
-    const float expreld3 = std::exp(-reld3);
+    const float expreld3 = approx_exp<CORE_FUNC_ACCURACY>(-reld3);
     return 3.0f * (corefac*expreld3 - r3) / distsq;
   }
 }
@@ -267,7 +432,7 @@ inline double exp_bbb (const double r3, const double corefac, const double reld3
   } else if (reld3 < 0.001) {
     return -1.5 * dist * r3 * r3;
   } else {
-    const double expreld3 = std::exp(-reld3);
+    const double expreld3 = approx_exp<CORE_FUNC_ACCURACY>(-reld3);
     return 3.0 * (corefac*expreld3 - r3) / distsq;
   }
 }
@@ -281,7 +446,7 @@ static inline S exp_bbb (const S r3, const S corefac, const S reld3, const S dis
     return -1.5f * dist * r3 * r3;
     // this is 3 flops
   } else {
-    const S expreld3 = std::exp(-reld3);
+    const S expreld3 = approx_exp<CORE_FUNC_ACCURACY>(-reld3);
     return 3.0f * (corefac*expreld3 - r3) / distsq;
     // this is 5 flops
   }
@@ -43,6 +43,7 @@ public:
       nom_sep_scaled(std::sqrt(8.0)),
       particle_overlap(1.5),
       merge_thresh(0.2),
+      source_thresh(0.0),
       shed_before_diffuse(true)
     {}
 
@@ -75,6 +76,9 @@ public:
   void add_to_json(nlohmann::json&) const;
 
 private:
+  // write one particle per panel straight into the particle arrays
+  void shed_particles(Surfaces<S>&, const S, const S, std::vector<Collection>&);
+
   // the VRM algorithm, template params are storage, solver, max moments
   VRM<S,double,2> vrm;
 
@@ -97,6 +101,9 @@ private:
   // merge aggressivity
   S merge_thresh;
 
+  // particles weaker than this fraction of the strongest are not used as sources
+  S source_thresh;
+
   // method 1 (true) is to shed *at* the boundary, VRM those particles, then push out
   // method 2 (false) is to VRM, push out, *then* generate new particles at the correct distance
   bool shed_before_diffuse;
@@ -109,6 +116,46 @@ void Diffusion<S,A,I>::set_amr(const bool _do_amr) {
   if (_do_amr) set_diffuse(true);
 }
 
+//
+// generate particles just above a surface and append them to the last vortex particle collection
+//
+template <class S, class A, class I>
+void Diffusion<S,A,I>::shed_particles(Surfaces<S>&            _surf,
+                                      const S                 _offset,
+                                      const S                 _vdelta,
+                                      std::vector<Collection>& _vort) {
+
+  // new particles go into the last collection of active particles that move with the flow
+  size_t itarg = _vort.size();
+  for (size_t i=0; i<_vort.size(); ++i) {
+    if (not std::holds_alternative<Points<S>>(_vort[i])) continue;
+    Points<S>& pts = std::get<Points<S>>(_vort[i]);
+    if (pts.get_elemt() == active and pts.get_movet() == lagrangian and pts.get_ring_capacity() == 0) itarg = i;
+  }
+
+  if (itarg == _vort.size()) {
+    // none yet? make a new, empty collection
+    _vort.push_back(Points<S>(std::vector<S>(), active, lagrangian, nullptr));      // vortons
+
+#ifdef USE_OGL_COMPUTE
+    {
+      // grab the compute state from the boundary and copy it to the new points
+      auto gcs = _surf.get_gcs();
+      Points<S>& pts = std::get<Points<S>>(_vort.back());
+      pts.set_opengl_compute_state(gcs);
+    }
+#endif
+  }
+
+  Points<S>& pts = std::get<Points<S>>(_vort[itarg]);
+
+  // make room, then have the surface fill in the new particles
+  const size_t nnew = _surf.get_npanels();
+  std::cout << "  adding " << nnew << " particles to collection..." << std::endl;
+  const size_t ifirst = pts.extend(nnew);
+  _surf.represent_as_particles(_offset, _vdelta, pts.get_pos(), pts.get_str(), pts.get_rad(), ifirst);
+}
+
 //
 // take a diffusion step
 //
@@ -154,31 +201,7 @@ void Diffusion<S,A,I>::step(const double                _time,
         Surfaces<S>& surf = std::get<Surfaces<S>>(coll);
 
         // generate particles just above the surface
-        std::vector<S> new_pts = surf.represent_as_particles(0.01*(S)h_nu, _vdelta);
-
-        // add those particles to the main particle list
-        if (_vort.size() == 0) {
-          // no collections yet? make a new collection
-          _vort.push_back(Points<S>(new_pts, active, lagrangian, nullptr));      // vortons
-
-#ifdef USE_OGL_COMPUTE
-          {
-            // grab the compute state from the boundary and copy it to the new points
-            auto gcs = surf.get_gcs();
-            Points<S>& pts = std::get<Points<S>>(_vort.back());
-            pts.set_opengl_compute_state(gcs);
-          }
-#endif
-
-        } else {
-          // HACK - add all particles to first collection
-          auto& coll = _vort.back();
-          // only proceed if the last collection is Points
-          if (std::holds_alternative<Points<S>>(coll)) {
-            Points<S>& pts = std::get<Points<S>>(coll);
-            pts.add_new(new_pts);
-          }
-        }
+        shed_particles(surf, 0.01*(S)h_nu, _vdelta, _vort);
       }
 
       // Kutta points and lifting lines can generate points here
@@ -198,6 +221,9 @@ void Diffusion<S,A,I>::step(const double                _time,
     if (std::holds_alternative<Points<S>>(coll)) {
 
       Points<S>& pts = std::get<Points<S>>(coll);
+
+      // outflow super-particles stand for vorticity that has left, and are not diffused
+      if (pts.get_movet() != lagrangian) continue;
       std::cout << "    computing diffusion among " << pts.get_n() << " particles" << std::endl;
 
       // vectors are not passed as const, because they may be extended with new particles
@@ -207,7 +233,8 @@ void Diffusion<S,A,I>::step(const double                _time,
                       pts.get_str(),
                       pts.get_rad(),
                       h_nu, core_func,
-                      particle_overlap);
+                      particle_overlap,
+                      &pts.get_tree());
 
       // resize the rest of the arrays
       pts.resize(pts.get_rad().size());
@@ -253,31 +280,7 @@ void Diffusion<S,A,I>::step(const double                _time,
 
         // generate particles above the surface at the centroid of one step of
         //   diffusion from a flat plate
-        std::vector<S> new_pts = surf.represent_as_particles(h_nu*std::sqrt(4.0/M_PI), _vdelta);
-
-        // add those particles to the main particle list
-        if (_vort.size() == 0) {
-          // no collections yet? make a new collection
-          _vort.push_back(Points<S>(new_pts, active, lagrangian, nullptr));      // vortons
-
-#ifdef USE_OGL_COMPUTE
-          {
-            // grab the compute state from the boundary and copy it to the new points
-            auto gcs = surf.get_gcs();
-            Points<S>& pts = std::get<Points<S>>(_vort.back());
-            pts.set_opengl_compute_state(gcs);
-          }
-#endif
-
-        } else {
-          // HACK - add all particles to first collection
-          auto& coll = _vort.back();
-          // only proceed if the last collection is Points
-          if (std::holds_alternative<Points<S>>(coll)) {
-            Points<S>& pts = std::get<Points<S>>(coll);
-            pts.add_new(new_pts);
-          }
-        }
+        shed_particles(surf, h_nu*std::sqrt(4.0/M_PI), _vdelta, _vort);
       }
 
       // Kutta points and lifting lines can generate points here
@@ -294,6 +297,13 @@ void Diffusion<S,A,I>::step(const double                _time,
   for (auto &coll : _vort) {
     std::visit([=](auto& elem) { elem.update_max_str(); }, coll);
   }
+
+  // and to find the zero-strength fill particles and others too weak to affect anything
+  for (auto &coll : _vort) {
+    if (std::holds_alternative<Points<S>>(coll)) {
+      std::get<Points<S>>(coll).set_active_sources(source_thresh);
+    }
+  }
 }
 
 #ifdef USE_IMGUI
@@ -327,6 +337,12 @@ void Diffusion<S,A,I>::draw_advanced() {
   ImGui::SameLine();
   ShowHelpMarker("During diffusion, ignore any particles with strength magnitude less than this power of ten threshold.");
   vrm.set_ignore(std::pow(10.f,ignore_thresh));
+
+  float source_exp = (source_thresh > 0.0) ? std::log10(source_thresh) : -12.0;
+  ImGui::SliderFloat("Threshold to skip as source", &source_exp, -12, -2, "%.1f");
+  ImGui::SameLine();
+  ShowHelpMarker("When computing velocities, do not use particles with strength less than this power of ten times the strongest particle as sources. They still move with the flow. At the left end, only zero-strength particles are skipped.");
+  source_thresh = (source_exp > -11.99f) ? std::pow(10.f,source_exp) : 0.0;
   ImGui::PopItemWidth();
 
 #ifdef PLUGIN_SIMPLEX
@@ -387,6 +403,11 @@ void Diffusion<S,A,I>::from_json(const nlohmann::json j) {
   // regardless, load VRM settings as they were
   vrm.from_json(j);
 
+  if (j.find("ignoreSourcesBelow") != j.end()) {
+    source_thresh = j["ignoreSourcesBelow"];
+    std::cout << "  setting source_thresh= " << source_thresh << std::endl;
+  }
+
 #ifdef PLUGIN_AVRM
   // set adaptive-VRM-specific settings
   if (j.find("adaptiveSize") != j.end()) {
@@ -412,6 +433,8 @@ void Diffusion<S,A,I>::add_to_json(nlohmann::json& j) const {
   //j["overlap"] = particle_overlap;
   //j["core"] = core_func;
 
+  if (source_thresh > 0.0) j["ignoreSourcesBelow"] = source_thresh;
+
   // VRM always writes "VRM" and "AMR" parameters
   vrm.add_to_json(j);
 }
@@ -0,0 +1,688 @@
+/*
+ * DistanceField.h - Closest-panel search, and a cached signed distance field in a body's frame
+ *
+ * (c)2017-20 Applied Scientific Research, Inc.
+ *            Written by Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "MathHelper.h"
+#include "Surfaces.h"
+#include "Collection.h"
+#include "nanoflann.hpp"
+
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <array>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include <chrono>
+
+enum ClosestType { panel, edge, node };
+
+//
+// on output of this routine, jidx is:
+//   -1..-3 if an edge is the closest
+//    0 if the panel face is closest
+//    1..3 if a node is closest
+//
+template <class S> 
+struct ClosestReturn { 
+  int jidx; 
+  S distsq; 
+  S cpx, cpy, cpz;
+  ClosestType disttype; 
+}; 
+
+//
+// find closest distance from a point to a triangle
+// logic taken from pointElemDistance3d
+//
+// most likely 147 flops
+//
+template <class S>
+ClosestReturn<S> panel_point_distance(const S sx0, const S sy0, const S sz0,
+                                      const S sx1, const S sy1, const S sz1,
+                                      const S sx2, const S sy2, const S sz2,
+                                      const S sxn, const S syn, const S szn,
+                                      const S tx,  const S ty,  const S tz) {
+
+  ClosestReturn<S> retval;
+  retval.jidx = 0;
+  retval.distsq = 9.9e+9;
+
+  // test against each of the three corners
+  const std::array<S,3> dt0 = {tx-sx0, ty-sy0, tz-sz0};
+  const S dt0ds = dot_product(dt0, dt0);
+  if (dt0ds < retval.distsq) {
+    retval.jidx = 1;
+    retval.distsq = dt0ds;
+    retval.disttype = node;
+    retval.cpx = sx0;
+    retval.cpy = sy0;
+    retval.cpz = sz0;
+  }
+
+  const std::array<S,3> dt1 = {tx-sx1, ty-sy1, tz-sz1};
+  const S dt1ds = dot_product(dt1, dt1);
+  if (dt1ds < retval.distsq) {
+    retval.jidx = 2;
+    retval.distsq = dt1ds;
+    retval.disttype = node;
+    retval.cpx = sx1;
+    retval.cpy = sy1;
+    retval.cpz = sz1;
+  }
+
+  const std::array<S,3> dt2 = {tx-sx2, ty-sy2, tz-sz2};
+  const S dt2ds = dot_product(dt2, dt2);
+  if (dt2ds < retval.distsq) {
+    retval.jidx = 3;
+    retval.distsq = dt2ds;
+    retval.disttype = node;
+    retval.cpx = sx2;
+    retval.cpy = sy2;
+    retval.cpz = sz2;
+  }
+  // 27 flops to here
+
+  //std::cout << "test point " << tx << " " << ty << " " << tz << std::endl;
+  //std::cout << "  current distsq " << retval.distsq << std::endl;
+
+  // compare to the edges
+  const std::array<S,3> ds01 = {sx1-sx0, sy1-sy0, sz1-sz0};
+  //std::cout << "  ds01 " << ds01[0] << " " << ds01[1] << " " << ds01[2] << std::endl;
+  const S ds01ds = 1.0 / dot_product(ds01, ds01);
+  //std::cout << "  ds01ds " << ds01ds << std::endl;
+  std::array<S,3> rx;
+  cross_product(ds01, dt0, rx);
+  //std::cout << "  rx   " << rx[0] << " " << rx[1] << " " << rx[2] << std::endl;
+  const S dt01ds = dot_product(rx, rx) * ds01ds;
+  //std::cout << "  dt01ds " << dt01ds << std::endl;
+  if (dt01ds < retval.distsq) {
+    const S t = dot_product(ds01, dt0) * ds01ds;
+    //std::cout << "  t " << t << std::endl;
+    if (0.0 < t and t < 1.0) {
+      retval.jidx = -1;
+      retval.distsq = dt01ds;
+      retval.disttype = edge;
+      retval.cpx = sx0 + t*ds01[0];
+      retval.cpy = sy0 + t*ds01[1];
+      retval.cpz = sz0 + t*ds01[2];
+    }
+  }
+  // 25 minimum, 33 maybe, 39 possibly
+
+  const std::array<S,3> ds12 = {sx2-sx1, sy2-sy1, sz2-sz1};
+  const S ds12ds = 1.0 / dot_product(ds12, ds12);
+  cross_product(ds12, dt1, rx);
+  const S dt12ds = dot_product(rx, rx) * ds12ds;
+  //std::cout << "  dt12ds " << dt12ds << std::endl;
+  if (dt12ds < retval.distsq) {
+    const S t = dot_product(ds12, dt1) * ds12ds;
+    //std::cout << "  t " << t << std::endl;
+    if (0.0 < t and t < 1.0) {
+      retval.jidx = -2;
+      retval.distsq = dt12ds;
+      retval.disttype = edge;
+      retval.cpx = sx1 + t*ds12[0];
+      retval.cpy = sy1 + t*ds12[1];
+      retval.cpz = sz1 + t*ds12[2];
+    }
+  }
+
+  const std::array<S,3> ds20 = {sx0-sx2, sy0-sy2, sz0-sz2};
+  const S ds20ds = 1.0 / dot_product(ds20, ds20);
+  cross_product(ds20, dt2, rx);
+  const S dt20ds = dot_product(rx, rx) * ds20ds;
+  //std::cout << "  dt20ds " << dt20ds << std::endl;
+  if (dt20ds < retval.distsq) {
+    const S t = dot_product(ds20, dt2) * ds20ds;
+    //std::cout << "  t " << t << std::endl;
+    if (0.0 < t and t < 1.0) {
+      retval.jidx = -3;
+      retval.distsq = dt20ds;
+      retval.disttype = edge;
+      retval.cpx = sx2 + t*ds20[0];
+      retval.cpy = sy2 + t*ds20[1];
+      retval.cpz = sz2 + t*ds20[2];
+    }
+  }
+  // 102 minimum flops to here
+
+  // finally, check vs. the panel prism
+  // test to see if the test point is in the positive half-space of each edge
+  const std::array<S,3> norm = {sxn, syn, szn};
+  std::array<S,3> interior;
+  cross_product(norm, ds01, interior);
+  const S in01 = dot_product(dt0, interior);
+  cross_product(norm, ds12, interior);
+  const S in12 = dot_product(dt1, interior);
+  cross_product(norm, ds20, interior);
+  const S in20 = dot_product(dt2, interior);
+  //std::cout << "  interior distances are " << in01 << " " << in12 << " " << in20 << std::endl;
+  if (in01 > 0.0 and in12 > 0.0 and in20 > 0.0) {
+    retval.jidx = 0;
+    retval.disttype = panel;
+    const S truedist = dot_product(dt0, norm);
+    retval.distsq = truedist*truedist;
+    retval.cpx = tx - sxn*truedist;
+    retval.cpy = ty - syn*truedist;
+    retval.cpz = tz - szn*truedist;
+  }
+  // minumum 45 more flops here, possibly 57 if match
+
+  return retval;
+}
+
+
+//
+// Find all panels that are closest to the given point (ties within a small tolerance are
+//   kept, in index order). If _list is given, only those _num panels are tested, otherwise
+//   the first _num panels are.
+//
+template <class S>
+std::vector<ClosestReturn<S>> find_closest_panels (const std::array<Vector<S>,Dimensions>& sx,
+                                                   const std::vector<Int>&                 si,
+                                                   const std::array<Vector<S>,Dimensions>& sn,
+                                                   const Int* _list, const size_t _num,
+                                                   const S tx, const S ty, const S tz) {
+
+  S mindist = std::numeric_limits<S>::max();
+  const S eps = 10.0*std::numeric_limits<S>::epsilon();
+  std::vector<ClosestReturn<S>> hits;
+
+  for (size_t jj=0; jj<_num; ++jj) {
+    const size_t j = _list ? (size_t)_list[jj] : jj;
+    const Int jp0 = si[3*j+0];
+    const Int jp1 = si[3*j+1];
+    const Int jp2 = si[3*j+2];
+    ClosestReturn<S> result = panel_point_distance<S>(sx[0][jp0], sx[1][jp0], sx[2][jp0],
+                                                      sx[0][jp1], sx[1][jp1], sx[2][jp1],
+                                                      sx[0][jp2], sx[1][jp2], sx[2][jp2],
+                                                      sn[0][j],   sn[1][j],   sn[2][j],
+                                                      tx, ty, tz);
+
+    if (result.distsq < mindist - eps) {
+      // we blew the old one away
+      mindist = result.distsq;
+      // rewrite jidx as the panel index
+      result.jidx = j;
+      hits.clear();
+      hits.push_back(result);
+
+    } else if (result.distsq < mindist + eps) {
+      // we are effectively the same as the old closest
+      result.jidx = j;
+      hits.push_back(result);
+    }
+  }
+
+  return hits;
+}
+
+//
+// Signed distance of a point from the closest panels, positive on the normal (fluid) side -
+//   this is the same test that reflection and clearing use
+//
+template <class S>
+S signed_distance (std::vector<ClosestReturn<S>> const& _hits,
+                   const std::array<Vector<S>,Dimensions>& sn,
+                   const S tx, const S ty, const S tz) {
+  std::array<S,3> mnorm = {0.0, 0.0, 0.0};
+  std::array<S,3> mcp = {0.0, 0.0, 0.0};
+  for (auto const& hit : _hits) {
+    for (size_t d=0; d<3; ++d) mnorm[d] += sn[d][hit.jidx];
+    mcp[0] += hit.cpx;
+    mcp[1] += hit.cpy;
+    mcp[2] += hit.cpz;
+  }
+  normalizeVec(mnorm);
+  for (size_t d=0; d<3; ++d) mcp[d] /= (S)_hits.size();
+  const std::array<S,3> dx = {tx-mcp[0], ty-mcp[1], tz-mcp[2]};
+  const S dist = std::sqrt(_hits[0].distsq);
+  return (dot_product(mnorm, dx) < 0.0) ? -dist : dist;
+}
+
+
+//
+// The panel centroids of every Surfaces collection in one kd-tree, to find whether a point
+//   is within some distance of any panel without testing all of them
+//
+// A panel is at least (centroid distance - its radius) away, where the radius is the farthest
+//   node from the centroid, so only centroids within (distance + largest radius) are tested
+//
+template <class S>
+class PanelTree {
+public:
+  PanelTree(std::vector<Collection> const&);
+
+  bool any_within(const S, const S, const S, const S) const;
+
+private:
+  typedef Eigen::Matrix<S, Eigen::Dynamic, Dimensions> EigenMatType;
+  typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType > kd_tree_t;
+
+  std::vector<Surfaces<S> const*> surf;
+  std::vector<std::pair<uint32_t,Int>> owner;	// collection and panel index
+  EigenMatType cent;
+  std::vector<S> prad;
+  S maxrad;
+  std::unique_ptr<kd_tree_t> tree;
+};
+
+template <class S>
+PanelTree<S>::PanelTree(std::vector<Collection> const& _bdry)
+  : maxrad(0.0) {
+
+  for (auto const& coll : _bdry) {
+    if (not std::holds_alternative<Surfaces<S>>(coll)) continue;
+    Surfaces<S> const& s = std::get<Surfaces<S>>(coll);
+    for (size_t j=0; j<s.get_npanels(); ++j) owner.emplace_back((uint32_t)surf.size(), (Int)j);
+    surf.push_back(&s);
+  }
+
+  cent.resize(owner.size(), Dimensions);
+  prad.resize(owner.size());
+  for (size_t k=0; k<owner.size(); ++k) {
+    const std::array<Vector<S>,Dimensions>& x = surf[owner[k].first]->get_pos();
+    const std::vector<Int>& idx = surf[owner[k].first]->get_idx();
+    const Int j = owner[k].second;
+    for (size_t d=0; d<Dimensions; ++d) {
+      cent(k,d) = (x[d][idx[3*j]] + x[d][idx[3*j+1]] + x[d][idx[3*j+2]]) / (S)3.0;
+    }
+    S rsq = 0.0;
+    for (size_t c=0; c<3; ++c) {
+      S dsq = 0.0;
+      for (size_t d=0; d<Dimensions; ++d) dsq += std::pow(x[d][idx[3*j+c]] - cent(k,d), 2);
+      rsq = std::max(rsq, dsq);
+    }
+    prad[k] = std::sqrt(rsq);
+    maxrad = std::max(maxrad, prad[k]);
+  }
+
+  if (owner.size() > 0) tree = std::make_unique<kd_tree_t>(Dimensions, std::cref(cent));
+}
+
+//
+// is the point closer than _dist to any panel? safe to call from many threads
+//
+template <class S>
+bool PanelTree<S>::any_within(const S _x, const S _y, const S _z, const S _dist) const {
+  if (not tree) return false;
+  const S query_pt[Dimensions] = { _x, _y, _z };
+
+  // most points are decided by the closest centroid alone
+  typename EigenMatType::Index inear;
+  S dsqnear;
+  tree->index->knnSearch(query_pt, 1, &inear, &dsqnear);
+  if (dsqnear < _dist*_dist) return true;
+  if (std::sqrt(dsqnear) - maxrad >= _dist) return false;
+
+  // otherwise test the panels whose centroids could be close enough
+  std::vector<std::pair<typename EigenMatType::Index,S>> matches;
+  nanoflann::SearchParams params;
+  params.sorted = true;
+  tree->index->radiusSearch(query_pt, std::pow(_dist+maxrad, 2), matches, params);
+  for (auto const& m : matches) {
+    if (std::sqrt(m.second) - prad[m.first] >= _dist) continue;
+    Surfaces<S> const& s = *surf[owner[m.first].first];
+    const std::array<Vector<S>,Dimensions>& sx = s.get_pos();
+    const std::vector<Int>& si = s.get_idx();
+    const std::array<Vector<S>,Dimensions>& sn = s.get_norm();
+    const Int j = owner[m.first].second;
+    const Int jp0 = si[3*j+0];
+    const Int jp1 = si[3*j+1];
+    const Int jp2 = si[3*j+2];
+    const ClosestReturn<S> result = panel_point_distance<S>(sx[0][jp0], sx[1][jp0], sx[2][jp0],
+                                                            sx[0][jp1], sx[1][jp1], sx[2][jp1],
+                                                            sx[0][jp2], sx[1][jp2], sx[2][jp2],
+                                                            sn[0][j],   sn[1][j],   sn[2][j],
+                                                            _x, _y, _z);
+    if (result.distsq < _dist*_dist) return true;
+  }
+  return false;
+}
+
+
+//
+// A signed distance field around one Surfaces collection, in the frame of its untransformed
+//   nodes, so that it never changes as the body moves
+//
+// Voxels are classified as
+//   far_outside - every point in the voxel is on the fluid side and farther than the band
+//   far_inside  - every point is inside the body and farther than the band (or unsure)
+//   near_wall   - the voxel keeps the closest panel and signed distance at its center, and a
+//                 short list of panels of which one must be closest to any point in the voxel
+// Only the near_wall voxels carry data, in a hash map; the others cost one byte each.
+//
+// The near-wall candidate list is exact: the closest panel to a point p in a voxel with
+//   center c and half-diagonal hd is at most dmin(c) + hd from p, so it is at most
+//   dmin(c) + 2*hd from c. Panels farther than that from c (plus a cushion that absorbs
+//   roundoff and the tie tolerance of find_closest_panels) can not be the closest.
+//
+template <class S>
+class DistanceField {
+public:
+  enum cell_t : uint8_t { far_outside = 0, far_inside = 1, near_wall = 2, unknown = 3 };
+
+  DistanceField(Surfaces<S> const&, const S);
+
+  // can this field answer queries for the given collection and band?
+  bool is_valid_for(Surfaces<S> const& _surf, const S _band) const {
+    return _surf.get_npanels() == np and _surf.get_mesh_version() == version and _band <= band;
+  }
+
+  // beyond this distance, a near_wall candidate list can not be trusted
+  S get_reach() const { return reach; }
+
+  // classify a point in the body frame, and for near_wall points, return the candidate panels
+  cell_t lookup(const S _x, const S _y, const S _z, const Int*& _cand, size_t& _ncand) const {
+    const S fx = (_x - lo[0]) / h;
+    const S fy = (_y - lo[1]) / h;
+    const S fz = (_z - lo[2]) / h;
+    if (fx < 0.0 or fy < 0.0 or fz < 0.0) return far_outside;
+    const size_t ix = (size_t)fx;
+    const size_t iy = (size_t)fy;
+    const size_t iz = (size_t)fz;
+    if (ix >= nc[0] or iy >= nc[1] or iz >= nc[2]) return far_outside;
+    const size_t icell = ix + nc[0]*(iy + nc[1]*iz);
+    const cell_t st = (cell_t)state[icell];
+    if (st == near_wall) {
+      const uint32_t ie = near.at(icell);
+      _cand = cand.data() + first[ie];
+      _ncand = first[ie+1] - first[ie];
+    }
+    return st;
+  }
+
+  size_t get_num_near() const { return closest.size(); }
+
+private:
+  size_t np;
+  uint32_t version;
+  S band;			// largest distance at which callers need exact answers
+  S h;				// voxel size
+  S cushion;			// allowance for roundoff and the tie tolerance
+  S reach;			// distance within which every panel was tested
+  std::array<S,Dimensions> lo;
+  std::array<size_t,Dimensions> nc;
+  std::vector<uint8_t> state;
+
+  // near-wall voxels only
+  std::unordered_map<size_t,uint32_t> near;
+  std::vector<uint32_t> first;	// candidate list for entry i is cand[first[i]..first[i+1])
+  std::vector<Int> cand;
+  std::vector<Int> closest;	// closest panel to the voxel center
+  std::vector<S> sdist;		// and the signed distance to it
+};
+
+//
+// build the field: bin panels into the voxels near them, test those voxel centers
+//   exactly, then flood fill from the edges of the box to find the outside
+//
+template <class S>
+DistanceField<S>::DistanceField(Surfaces<S> const& _surf, const S _band)
+  : np(_surf.get_npanels()),
+    version(_surf.get_mesh_version()),
+    band(_band) {
+
+  auto start = std::chrono::system_clock::now();
+
+  const std::array<Vector<S>,Dimensions>& x = _surf.get_body_pos();
+  const std::vector<Int>& idx = _surf.get_idx();
+
+  // panel normals in the body frame, the same way Surfaces computes them
+  std::array<Vector<S>,Dimensions> nrm;
+  for (size_t d=0; d<Dimensions; ++d) nrm[d].resize(np);
+  std::array<S,Dimensions> bblo, bbhi;
+  bblo.fill(std::numeric_limits<S>::max());
+  bbhi.fill(std::numeric_limits<S>::lowest());
+  for (size_t j=0; j<np; ++j) {
+    std::array<S,3> e1, e2, nj;
+    for (size_t d=0; d<3; ++d) {
+      e1[d] = x[d][idx[3*j+1]] - x[d][idx[3*j]];
+      e2[d] = x[d][idx[3*j+2]] - x[d][idx[3*j]];
+    }
+    cross_product(e1, e2, nj);
+    normalizeVec(nj);
+    for (size_t d=0; d<3; ++d) nrm[d][j] = nj[d];
+  }
+  for (size_t d=0; d<Dimensions; ++d) {
+    for (size_t i=0; i<x[d].size(); ++i) {
+      bblo[d] = std::min(bblo[d], x[d][i]);
+      bbhi[d] = std::max(bbhi[d], x[d][i]);
+    }
+  }
+
+  // voxels about half the band across, but never more than 16M of them, and never so small
+  //   that the panel lists (each panel goes in every voxel near its box) pass 64M entries
+  const S diag = std::sqrt(std::pow(bbhi[0]-bblo[0],2) + std::pow(bbhi[1]-bblo[1],2) + std::pow(bbhi[2]-bblo[2],2));
+  h = 0.5 * band;
+  cushion = std::max((S)(1.e-3*diag), (S)(0.05*band));
+  for (int iter=0; iter<4; ++iter) {
+    const S hd = 0.5*std::sqrt(3.0)*h;
+    reach = band + cushion + 2.0*hd;
+    S ncells = 1.0;
+    for (size_t d=0; d<Dimensions; ++d) ncells *= (bbhi[d]-bblo[d] + 2.0*(reach+h)) / h;
+    S npairs = 0.0;
+    for (size_t j=0; j<np; ++j) {
+      S nv = 1.0;
+      for (size_t d=0; d<Dimensions; ++d) {
+        const S ext = std::max({x[d][idx[3*j]], x[d][idx[3*j+1]], x[d][idx[3*j+2]]})
+                    - std::min({x[d][idx[3*j]], x[d][idx[3*j+1]], x[d][idx[3*j+2]]});
+        nv *= (ext + 2.0*(reach+hd)) / h + 2.0;
+      }
+      npairs += nv;
+    }
+    const S over = std::max(ncells / (S)(1<<24), npairs / (S)(1<<26));
+    if (over <= 1.0) break;
+    h *= std::cbrt(over) * 1.01;
+  }
+  const S hd = 0.5*std::sqrt(3.0)*h;
+  reach = band + cushion + 2.0*hd;
+  for (size_t d=0; d<Dimensions; ++d) {
+    lo[d] = bblo[d] - reach - h;
+    nc[d] = 1 + (size_t)((bbhi[d] + reach + h - lo[d]) / h);
+  }
+  const size_t ncell = nc[0]*nc[1]*nc[2];
+  state.assign(ncell, unknown);
+
+  // the voxels within reach of each panel's box
+  const S grow = reach + hd;
+  auto panel_voxels = [&](const size_t j, std::array<size_t,Dimensions>& c0, std::array<size_t,Dimensions>& c1) {
+    for (size_t d=0; d<Dimensions; ++d) {
+      const S plo = std::min({x[d][idx[3*j]], x[d][idx[3*j+1]], x[d][idx[3*j+2]]}) - grow;
+      const S phi = std::max({x[d][idx[3*j]], x[d][idx[3*j+1]], x[d][idx[3*j+2]]}) + grow;
+      c0[d] = (size_t)std::max((S)0.0, std::floor((plo - lo[d]) / h - (S)0.5));
+      c1[d] = std::min(nc[d]-1, (size_t)std::max((S)0.0, std::ceil((phi - lo[d]) / h - (S)0.5)));
+    }
+  };
+
+  // bin the panels into those voxels: count, then fill, so panels stay in index order
+  std::vector<uint32_t> cstart(ncell+1, 0);
+  for (size_t j=0; j<np; ++j) {
+    std::array<size_t,Dimensions> c0, c1;
+    panel_voxels(j, c0, c1);
+    for (size_t iz=c0[2]; iz<=c1[2]; ++iz) {
+      for (size_t iy=c0[1]; iy<=c1[1]; ++iy) {
+        for (size_t ix=c0[0]; ix<=c1[0]; ++ix) cstart[1 + ix + nc[0]*(iy + nc[1]*iz)]++;
+      }
+    }
+  }
+  std::vector<size_t> vcell;
+  for (size_t ic=0; ic<ncell; ++ic) {
+    if (cstart[ic+1] > 0) vcell.push_back(ic);
+    cstart[ic+1] += cstart[ic];
+  }
+  const size_t nvox = vcell.size();
+
+  std::vector<Int> plist(cstart[ncell]);
+  {
+    std::vector<uint32_t> fill(cstart.begin(), cstart.end()-1);
+    for (size_t j=0; j<np; ++j) {
+      std::array<size_t,Dimensions> c0, c1;
+      panel_voxels(j, c0, c1);
+      for (size_t iz=c0[2]; iz<=c1[2]; ++iz) {
+        for (size_t iy=c0[1]; iy<=c1[1]; ++iy) {
+          for (size_t ix=c0[0]; ix<=c1[0]; ++ix) plist[fill[ix + nc[0]*(iy + nc[1]*iz)]++] = (Int)j;
+        }
+      }
+    }
+  }
+  const size_t build_bytes = ncell*(sizeof(uint8_t) + 2*sizeof(uint32_t)) + plist.size()*sizeof(Int)
+                             + nvox*(sizeof(size_t) + sizeof(Int) + sizeof(S) + sizeof(std::vector<Int>));
+
+  // test each of those voxel centers against its panels
+  std::vector<Int> vclose(nvox);
+  std::vector<S> vdist(nvox);
+  std::vector<std::vector<Int>> vcand(nvox);
+
+  #pragma omp parallel for schedule(dynamic,64)
+  for (int32_t iv=0; iv<(int32_t)nvox; ++iv) {
+    const size_t icell = vcell[iv];
+    const size_t ix = icell % nc[0];
+    const size_t iy = (icell / nc[0]) % nc[1];
+    const size_t iz = icell / (nc[0]*nc[1]);
+    const S cx = lo[0] + ((S)ix + 0.5)*h;
+    const S cy = lo[1] + ((S)iy + 0.5)*h;
+    const S cz = lo[2] + ((S)iz + 0.5)*h;
+
+    const Int* list = plist.data() + cstart[icell];
+    const size_t nlist = cstart[icell+1] - cstart[icell];
+    const std::vector<ClosestReturn<S>> hits = find_closest_panels<S>(x, idx, nrm, list, nlist, cx, cy, cz);
+    const S sd = signed_distance<S>(hits, nrm, cx, cy, cz);
+    vclose[iv] = hits[0].jidx;
+    vdist[iv] = sd;
+
+    if (std::abs(sd) > reach) {
+      // the closest panel may not be in the list, so the sign is not known - leave it to the fill
+    } else if (sd - hd > band + cushion) {
+      state[icell] = far_outside;
+    } else if (sd + hd < -(band + cushion)) {
+      state[icell] = far_inside;
+    } else {
+      state[icell] = near_wall;
+      // keep every panel that could be the closest to some point in this voxel
+      const S maxdist = std::abs(sd) + 2.0*hd + cushion;
+      for (size_t jj=0; jj<nlist; ++jj) {
+        const Int j = list[jj];
+        const ClosestReturn<S> r = panel_point_distance<S>(x[0][idx[3*j]],   x[1][idx[3*j]],   x[2][idx[3*j]],
+                                                           x[0][idx[3*j+1]], x[1][idx[3*j+1]], x[2][idx[3*j+1]],
+                                                           x[0][idx[3*j+2]], x[1][idx[3*j+2]], x[2][idx[3*j+2]],
+                                                           nrm[0][j], nrm[1][j], nrm[2][j], cx, cy, cz);
+        if (r.distsq <= maxdist*maxdist) vcand[iv].push_back(j);
+      }
+    }
+  }
+
+  // pack the near-wall voxels
+  first.push_back(0);
+  for (size_t iv=0; iv<nvox; ++iv) {
+    const size_t icell = vcell[iv];
+    if (state[icell] != near_wall) continue;
+    near[icell] = (uint32_t)closest.size();
+    closest.push_back(vclose[iv]);
+    sdist.push_back(vdist[iv]);
+    cand.insert(cand.end(), vcand[iv].begin(), vcand[iv].end());
+    first.push_back((uint32_t)cand.size());
+  }
+
+  // everything reachable from the edge of the box without crossing the wall is outside
+  std::deque<size_t> todo;
+  for (size_t ic=0; ic<ncell; ++ic) {
+    const size_t ix = ic % nc[0];
+    const size_t iy = (ic / nc[0]) % nc[1];
+    const size_t iz = ic / (nc[0]*nc[1]);
+    const bool edge = (ix==0 or iy==0 or iz==0 or ix==nc[0]-1 or iy==nc[1]-1 or iz==nc[2]-1);
+    if (edge and state[ic] == unknown) state[ic] = far_outside;
+    if (state[ic] == far_outside) todo.push_back(ic);
+  }
+  while (not todo.empty()) {
+    const size_t ic = todo.front();
+    todo.pop_front();
+    const size_t ix = ic % nc[0];
+    const size_t iy = (ic / nc[0]) % nc[1];
+    const size_t iz = ic / (nc[0]*nc[1]);
+    const std::array<size_t,6> nbr = {ix>0 ? ic-1 : ic, ix+1<nc[0] ? ic+1 : ic,
+                                      iy>0 ? ic-nc[0] : ic, iy+1<nc[1] ? ic+nc[0] : ic,
+                                      iz>0 ? ic-nc[0]*nc[1] : ic, iz+1<nc[2] ? ic+nc[0]*nc[1] : ic};
+    for (const size_t in : nbr) {
+      if (state[in] == unknown) {
+        state[in] = far_outside;
+        todo.push_back(in);
+      }
+    }
+  }
+
+  // whatever is left is enclosed by the surface
+  for (auto& st : state) if (st == unknown) st = far_inside;
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  std::cout << "    distance field has " << nc[0] << "x" << nc[1] << "x" << nc[2] << " voxels of size " << h
+            << ", " << closest.size() << " near the wall, build used " << (build_bytes >> 20) << " MB" << std::endl;
+  printf("    build distance field:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+}
+
+
+//
+// A band width for callers that do not have their own: twice the rms panel edge
+//
+template <class S>
+S typical_panel_size (Surfaces<S> const& _surf) {
+  const Vector<S>& area = _surf.get_area();
+  if (area.empty()) return (S)1.0;
+  S asum = 0.0;
+  for (auto const& a : area) asum += a;
+  return (S)2.0 * std::sqrt((S)2.0 * asum / (S)area.size());
+}
+
+//
+// Fetch the collection's field, building (or rebuilding) it if it can not serve this band
+//
+template <class S>
+std::shared_ptr<DistanceField<S>> get_distance_field (Surfaces<S> const& _surf, const S _band) {
+  std::shared_ptr<DistanceField<S>> sdf = _surf.get_distance_field();
+  if (not sdf or not sdf->is_valid_for(_surf, _band)) {
+    // leave some room, so that a slightly larger request next time does not force a rebuild
+    sdf = std::make_shared<DistanceField<S>>(_surf, (S)1.5*_band);
+    _surf.set_distance_field(sdf);
+  }
+  return sdf;
+}
+
+//
+// Map points from the current frame into the frame that the field was built in. Returns
+//   false if the collection's nodes do not agree with its body's transform (then the field
+//   can not be used and callers should search every panel).
+//
+template <class S>
+bool get_body_frame (Surfaces<S> const& _surf, const S _tol, Eigen::Transform<double,3,Eigen::Affine>& _xform) {
+  _xform.setIdentity();
+  auto bp = _surf.get_body_ptr();
+  if (not bp or _surf.get_movet() != bodybound or _surf.get_n() == 0) return true;
+
+  const Eigen::Transform<double,3,Eigen::Affine> fwd = bp->get_transform_mat();
+  _xform = fwd.inverse();
+
+  // check the first node
+  const std::array<Vector<S>,Dimensions>& ux = _surf.get_body_pos();
+  const std::array<Vector<S>,Dimensions>& x = _surf.get_pos();
+  const Eigen::Vector3d pre = {ux[0][0], ux[1][0], ux[2][0]};
+  const Eigen::Vector3d post = fwd * pre;
+  const double err = std::abs(post(0)-x[0][0]) + std::abs(post(1)-x[1][0]) + std::abs(post(2)-x[2][0]);
+  return (err < _tol);
+}
@@ -115,12 +115,13 @@ public:
     // new number of nodes (not elements)
     const size_t nnew = _in.x.size()/Dimensions;
 
-    // add node coordinates
-    for (size_t d=0; d<Dimensions; ++d) {
-      // extend with more space for new values
-      x[d].resize(n+nnew);
-      // copy new values to end of vector
-      for (size_t i=0; i<nnew; ++i) {
+    // extend with more space for new values, once
+    for (size_t d=0; d<Dimensions; ++d) x[d].resize(n+nnew);
+
+    // copy new node coordinates to end of vectors
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)nnew; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) {
         x[d][n+i] = _in.x[Dimensions*i+d];
       }
     }
@@ -130,9 +131,10 @@ public:
       assert(_in.val.size() >= nnew && "Input ElementPacket does not have enough values in val");
       const size_t nper = _in.val.size() / nnew;
       // must dereference s to get the actual vector
-      for (size_t j = 0; j < numStrenPerNode; j++) {
-        (*s)[j].resize(n+nnew);
-        for (size_t i=0; i<nnew; ++i) {
+      for (size_t j = 0; j < numStrenPerNode; j++) (*s)[j].resize(n+nnew);
+      #pragma omp parallel for
+      for (int32_t i=0; i<(int32_t)nnew; ++i) {
+        for (size_t j = 0; j < numStrenPerNode; j++) {
           (*s)[j][n+i] = _in.val[nper*i+j];
         }
       }
@@ -184,6 +186,56 @@ public:
     n = _nnew;
   }
 
+  // remove the flagged nodes and compress the arrays, preserving order
+  void compact(const std::vector<bool>& _remove) {
+    assert(_remove.size() == n && "Removal flag array does not match number of nodes");
+
+    size_t copyto = 0;
+    for (size_t i=0; i<n; ++i) {
+      if (not _remove[i]) {
+        if (i != copyto) {
+          for (size_t d=0; d<Dimensions; ++d) x[d][copyto] = x[d][i];
+          if (s) for (size_t d=0; d<numStrenPerNode; ++d) (*s)[d][copyto] = (*s)[d][i];
+          for (size_t d=0; d<Dimensions; ++d) u[d][copyto] = u[d][i];
+          if (ux) for (size_t d=0; d<Dimensions; ++d) (*ux)[d][copyto] = (*ux)[d][i];
+        }
+        copyto++;
+      }
+    }
+
+    // shrink everything down to the new size
+    for (size_t d=0; d<Dimensions; ++d) x[d].resize(copyto);
+    if (s) for (size_t d=0; d<numStrenPerNode; ++d) (*s)[d].resize(copyto);
+    for (size_t d=0; d<Dimensions; ++d) u[d].resize(copyto);
+    if (ux) for (size_t d=0; d<Dimensions; ++d) (*ux)[d].resize(copyto);
+
+    n = copyto;
+  }
+
+  // make room for at least _nmax nodes without changing n
+  void reserve(const size_t _nmax) {
+    for (size_t d=0; d<Dimensions; ++d) x[d].reserve(_nmax);
+    if (s) for (size_t d=0; d<numStrenPerNode; ++d) (*s)[d].reserve(_nmax);
+    for (size_t d=0; d<Dimensions; ++d) u[d].reserve(_nmax);
+    if (ux) for (size_t d=0; d<Dimensions; ++d) (*ux)[d].reserve(_nmax);
+  }
+
+  // append all nodes of another collection of the same type to the end of this one
+  void append(ElementBase<S> const & _other) {
+    assert(E == _other.E && "Cannot append collections of different element types");
+
+    for (size_t d=0; d<Dimensions; ++d) x[d].insert(x[d].end(), _other.x[d].begin(), _other.x[d].end());
+    if (s and _other.s) {
+      for (size_t d=0; d<numStrenPerNode; ++d) (*s)[d].insert((*s)[d].end(), (*_other.s)[d].begin(), (*_other.s)[d].end());
+    }
+    for (size_t d=0; d<Dimensions; ++d) u[d].insert(u[d].end(), _other.u[d].begin(), _other.u[d].end());
+    if (ux and _other.ux) {
+      for (size_t d=0; d<Dimensions; ++d) (*ux)[d].insert((*ux)[d].end(), (*_other.ux)[d].begin(), (*_other.ux)[d].end());
+    }
+
+    n += _other.n;
+  }
+
   void zero_vels() {
     for (size_t d=0; d<Dimensions; ++d) {
       std::fill(u[d].begin(), u[d].end(), 0.0);
@@ -0,0 +1,269 @@
+/*
+ * Ensemble.cpp - Run a set of variants of one simulation concurrently
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "Ensemble.h"
+#include "FlowFeature.h"
+#include "BoundaryFeature.h"
+#include "MeasureFeature.h"
+#include "Simulation.h"
+#include "JsonHelper.h"
+#include "RenderParams.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+
+using json = nlohmann::json;
+
+
+// everything needed to run one variant
+struct EnsembleCase {
+  Simulation sim;
+  std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+  std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+  std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+  RenderParams rparams;
+  int lead = -1;              // case which owns the geometry and BEM matrix
+  bool failed = false;
+  bool write_series = false;  // write data files during the run, as the batch driver does
+  double next_output = 0.0;
+};
+
+// features keep their random number generators in statics, so only one case at a time
+static std::mutex feature_mutex;
+
+
+// each case writes into its own directory
+static std::string case_dir_name(const size_t _icase) {
+  char dirname[32];
+  snprintf(dirname, 32, "case%02ld", _icase);
+  return std::string(dirname);
+}
+
+// panels that came out the same make the same BEM matrix
+static bool same_panels(const std::vector<ElementPacket<float>>& _a,
+                        const std::vector<ElementPacket<float>>& _b) {
+  if (_a.size() != _b.size()) return false;
+  for (size_t i=0; i<_a.size(); ++i) {
+    if (_a[i].ndim != _b[i].ndim or _a[i].x != _b[i].x or _a[i].idx != _b[i].idx) return false;
+  }
+  return true;
+}
+
+// one pass through the main loop of the batch driver, return false when done
+static bool advance_case(EnsembleCase& _c, const size_t _icase) {
+
+  const std::string err = advance_step(_c.sim, _c.ffeatures, _c.mfeatures, _c.rparams, &feature_mutex);
+  if (not err.empty()) {
+    std::cout << std::endl << "ERROR in case " << _icase << ": " << err;
+    _c.failed = true;
+    return false;
+  }
+
+  // export data files at this step?
+  if (_c.write_series and _c.sim.get_output_dt() > 0.0 and
+      _c.sim.get_time() >= _c.next_output - 1.e-6*_c.sim.get_output_dt()) {
+    (void) _c.sim.write_vtk();
+    while (_c.next_output <= _c.sim.get_time()) _c.next_output += _c.sim.get_output_dt();
+  }
+
+  if (not _c.sim.test_vs_stop()) return true;
+
+  // a case that stopped because it settled gets a last checkpoint and a summary
+  if (_c.sim.has_converged()) (void) _c.sim.write_converged();
+  if (not _c.sim.wrote_this_step()) (void) _c.sim.write_stats();
+  return false;
+}
+
+// run the given function over the list of cases with a fixed number of worker threads
+static void run_workers(const std::vector<size_t>& _list, const int _nworkers, const int _nthreads,
+                        const std::function<void(const size_t)>& _func) {
+
+  std::atomic<size_t> inext(0);
+  std::vector<std::thread> workers;
+  for (int w=0; w<std::min(_nworkers, (int)_list.size()); ++w) {
+    workers.emplace_back([&]() {
+#ifdef _OPENMP
+      // each worker gets its own share of the cores
+      omp_set_num_threads(_nthreads);
+#endif
+      for (size_t i=inext++; i<_list.size(); i=inext++) _func(_list[i]);
+    });
+  }
+  for (auto& w : workers) w.join();
+}
+
+
+int run_ensemble(const json& _base, const json& _cases, const int _nconcurrent, const float _panel_spacing) {
+
+  if (not _cases.is_array() or _cases.empty()) {
+    std::cout << "Ensemble case file must contain a non-empty array of patches" << std::endl;
+    return -1;
+  }
+  const size_t ncases = _cases.size();
+
+  // split the cores among the concurrent cases
+  int ncores = (int)std::thread::hardware_concurrency();
+#ifdef _OPENMP
+  ncores = omp_get_max_threads();
+#endif
+  const int nconcurrent = std::max(1, std::min((int)ncases, (_nconcurrent > 0) ? _nconcurrent : ncores));
+  const int nthreads = std::max(1, ncores / nconcurrent);
+  std::cout << std::endl << "Running " << ncases << " cases, " << nconcurrent << " at a time with "
+            << nthreads << " threads each" << std::endl;
+
+  auto start = std::chrono::system_clock::now();
+
+  // parse all cases serially
+  std::vector<std::unique_ptr<EnsembleCase>> cases;
+  std::map<std::string,size_t> geom_lead;
+  std::map<size_t, std::vector<ElementPacket<float>>> geom_packets;
+  if (_panel_spacing > 0.0) std::cout << "All cases discretize their bodies at spacing " << _panel_spacing << std::endl;
+
+  for (size_t ic=0; ic<ncases; ++ic) {
+    std::cout << std::endl << "Setting up case " << ic << std::endl;
+    cases.push_back(std::make_unique<EnsembleCase>());
+    EnsembleCase& c = *cases.back();
+
+    json j = _base;
+    j.merge_patch(_cases[ic]);
+
+    // keep every case's files apart, unless the case itself names them
+    const std::string dirname = case_dir_name(ic);
+    std::error_code ec;
+    std::filesystem::create_directories(dirname, ec);
+    if (ec) {
+      std::cout << "ERROR: could not create directory " << dirname << std::endl;
+      return -1;
+    }
+    for (const char* key : {"statusFile", "seriesFile"}) {
+      if (j.count("runtime") and j["runtime"].count(key) and
+          not (_cases[ic].count("runtime") and _cases[ic]["runtime"].count(key))) {
+        j["runtime"][key] = dirname + "/" + j["runtime"][key].get<std::string>();
+      }
+    }
+
+    parse_json(c.sim, c.ffeatures, c.bfeatures, c.mfeatures, c.rparams, j);
+    c.sim.set_output_prefix(dirname + "/");
+    c.write_series = not c.sim.get_series_file_name().empty();
+
+    // panels depend on the body description and the spacing they are discretized at,
+    //   which is the nominal particle spacing (so depends on dt and Re) unless one was given
+    const std::string bodies_key = j.count("bodies") ? j["bodies"].dump() : std::string("none");
+    const float spacing = (_panel_spacing > 0.0) ? _panel_spacing : c.sim.get_ips();
+    const std::string geom_key = bodies_key + " spacing " + std::to_string(spacing);
+    auto found = geom_lead.find(geom_key);
+    if (found != geom_lead.end()) {
+      c.lead = (int)found->second;
+      std::cout << "  sharing geometry with case " << c.lead << std::endl;
+      continue;
+    }
+
+    // discretize, then see if some other spacing already made the same panels
+    std::vector<ElementPacket<float>> packets;
+    for (auto const& bf : c.bfeatures) {
+      if (bf->is_enabled()) packets.push_back(bf->init_elements(spacing));
+    }
+    for (auto const& other : geom_lead) {
+      if (other.first.compare(0, bodies_key.size(), bodies_key) != 0) continue;
+      if (same_panels(packets, geom_packets[other.second])) {
+        c.lead = (int)other.second;
+        std::cout << "  geometry matches case " << c.lead << ", sharing it" << std::endl;
+        break;
+      }
+    }
+    if (c.lead < 0) {
+      c.lead = (int)ic;
+      geom_packets[ic] = std::move(packets);
+    }
+    geom_lead[geom_key] = (size_t)c.lead;
+  }
+  std::cout << std::endl << "Found " << geom_packets.size() << " distinct geometries among " << ncases << " cases" << std::endl;
+
+  // initialize all cases serially
+  for (size_t ic=0; ic<ncases; ++ic) {
+    EnsembleCase& c = *cases[ic];
+
+    // flow and measurement features as usual, no boundaries here
+    std::vector< std::unique_ptr<BoundaryFeature> > no_bfeatures;
+    add_init_elements(c.sim, c.ffeatures, no_bfeatures, c.mfeatures, c.rparams);
+    add_outflow_regions(c.sim, c.bfeatures);
+
+    // copy the panels from the lead, but attach them to this case's bodies
+    const std::vector<ElementPacket<float>>& packets = geom_packets[c.lead];
+    size_t ipacket = 0;
+    for (auto const& bf : c.bfeatures) {
+      if (bf->is_enabled()) {
+        const move_t newmovetype = (bf->get_body() ? bodybound : fixed);
+        c.sim.add_elements(packets[ipacket++], reactive, newmovetype, bf->get_body() );
+      }
+    }
+
+    c.sim.set_initialized();
+
+    const std::string err = c.sim.check_initialization();
+    if (not err.empty()) {
+      std::cout << std::endl << "ERROR in case " << ic << ": " << err;
+      c.failed = true;
+    }
+  }
+
+  // lead cases take their first step, which builds the BEM matrix
+  std::vector<size_t> leads, followers;
+  for (size_t ic=0; ic<ncases; ++ic) {
+    if (cases[ic]->failed) continue;
+    if (cases[ic]->lead == (int)ic) leads.push_back(ic);
+    else followers.push_back(ic);
+  }
+  std::vector<char> lead_running(ncases, 0);
+  run_workers(leads, nconcurrent, nthreads, [&](const size_t ic) {
+    lead_running[ic] = advance_case(*cases[ic], ic) ? 1 : 0;
+  });
+
+  // now everyone else can use those matrices
+  std::vector<size_t> remaining;
+  for (const size_t ic : followers) {
+    EnsembleCase& lead = *cases[cases[ic]->lead];
+    if (not lead.failed and lead.sim.bem_is_current()) {
+      cases[ic]->sim.share_bem_from(lead.sim);
+      std::cout << "  case " << ic << " uses BEM matrix from case " << cases[ic]->lead << std::endl;
+    }
+    remaining.push_back(ic);
+  }
+  for (const size_t ic : leads) if (lead_running[ic]) remaining.push_back(ic);
+
+  // and run everything to completion
+  run_workers(remaining, nconcurrent, nthreads, [&](const size_t ic) {
+    while (advance_case(*cases[ic], ic)) {}
+  });
+
+  // report
+  int nfailed = 0;
+  for (size_t ic=0; ic<ncases; ++ic) {
+    if (cases[ic]->failed) nfailed++;
+    cases[ic]->sim.reset();
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  printf("\nensemble time:\t[%.4f] seconds for %ld cases, %d failed\n", (float)elapsed_seconds.count(), ncases, nfailed);
+
+  return nfailed;
+}
@@ -0,0 +1,22 @@
+/*
+ * Ensemble.h - Run a set of variants of one simulation concurrently
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "json/json.hpp"
+
+//
+// The base JSON is patched (RFC 7386 merge patch) with each entry of the cases array,
+//   then all variants are run with the available cores split among them. Cases with
+//   identical bodies whose panels come out the same share their discretized geometry
+//   and BEM matrix. Bodies are discretized at each case's particle spacing, which
+//   depends on dt and Re, unless a positive _panel_spacing is given for all cases.
+//
+// Returns the number of cases that ended in error
+//
+int run_ensemble(const nlohmann::json& _base, const nlohmann::json& _cases, const int _nconcurrent,
+                 const float _panel_spacing = 0.0);
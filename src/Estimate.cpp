@@ -0,0 +1,372 @@
+/*
+ * Estimate.cpp - Predict the memory and runtime of a case before running it
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "Estimate.h"
+#include "FlowFeature.h"
+#include "BoundaryFeature.h"
+#include "MeasureFeature.h"
+#include "Simulation.h"
+#include "JsonHelper.h"
+#include "RenderParams.h"
+#include "Influence.h"
+#include "Kernels.h"
+#include "VRM.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <Eigen/Dense>
+
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+using json = nlohmann::json;
+
+
+// work done by one second-order step, as logged by Simulation::step: two velocity
+//   evaluations on the particles, and four BEM solves (two each for convection and diffusion)
+static const int vel_evals_per_step = 2;
+static const int bem_solves_per_step = 4;
+
+// GMRES iterations per solve, typical for the second-kind BEM equations
+static const int gmres_iters = 25;
+
+// bytes per active particle: position, strength, velocity, gradients, radius and
+//   elongation in float, a tag, and a second copy of most of it during the RK2 step
+static const double bytes_per_particle = 2.0 * (3+3+3+9+1+1) * sizeof(float) + 8.0;
+
+// cost of each phase of one step, in seconds
+struct StepCost {
+  double ptpt = 0.0;     // particles on particles
+  double panpt = 0.0;    // panels on particles
+  double ptpan = 0.0;    // particles on panels, for the BEM right-hand side
+  double solve = 0.0;    // BEM matrix build and GMRES
+  double fldpt = 0.0;    // velocities on field points
+  double vrm = 0.0;      // diffusion
+  double total() const { return ptpt + panpt + ptpan + solve + fldpt + vrm; }
+};
+
+// measured seconds per unit of work
+struct KernelRates {
+  double ptpt_pair = 0.0;
+  double ptpt_pair_nograds = 0.0;
+  double panpt_pair = 0.0;
+  double ptpan_pair = 0.0;
+  double matrix_entry = 0.0;
+  double vrm_particle = 0.0;
+};
+
+// the best time of a few runs of a function
+static double best_seconds(const std::function<void()>& _func, const int _nreps = 3) {
+  double best = std::numeric_limits<double>::max();
+  for (int i=0; i<_nreps; ++i) {
+    auto start = std::chrono::system_clock::now();
+    _func();
+    std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+    best = std::min(best, elapsed_seconds.count());
+  }
+  return std::max(best, 1.e-9);
+}
+
+// vortons on a jittered lattice at the nominal spacing, in a cube around a point
+static std::vector<float> sample_packet(const size_t _n, const float _ips, const float _vdelta,
+                                        const std::array<float,Dimensions>& _center, std::mt19937& _gen) {
+  const size_t nside = (size_t)std::ceil(std::cbrt((double)_n));
+  std::uniform_real_distribution<float> jitter(-0.1*_ips, 0.1*_ips);
+  std::uniform_real_distribution<float> str(-1.0, 1.0);
+  const float smag = 0.1 * _ips*_ips*_ips;
+  std::vector<float> packet(7*_n);
+  for (size_t i=0; i<_n; ++i) {
+    const size_t ijk[3] = {i%nside, (i/nside)%nside, i/(nside*nside)};
+    for (size_t d=0; d<Dimensions; ++d) {
+      packet[7*i+d] = _center[d] + _ips*((float)ijk[d] - 0.5*(float)(nside-1)) + jitter(_gen);
+    }
+    for (size_t d=0; d<3; ++d) packet[7*i+3+d] = smag * str(_gen);
+    packet[7*i+6] = _vdelta;
+  }
+  return packet;
+}
+
+// print a duration in the largest sensible units
+static std::string human_time(const double _secs) {
+  char buf[64];
+  if (_secs < 120.0) snprintf(buf, 64, "%.2f seconds", _secs);
+  else if (_secs < 7200.0) snprintf(buf, 64, "%.1f minutes", _secs/60.0);
+  else if (_secs < 172800.0) snprintf(buf, 64, "%.1f hours", _secs/3600.0);
+  else snprintf(buf, 64, "%.1f days", _secs/86400.0);
+  return std::string(buf);
+}
+
+static std::string human_bytes(const double _bytes) {
+  char buf[64];
+  if (_bytes < 1024.0*1024.0) snprintf(buf, 64, "%.1f KiB", _bytes/1024.0);
+  else if (_bytes < 1024.0*1024.0*1024.0) snprintf(buf, 64, "%.1f MiB", _bytes/(1024.0*1024.0));
+  else snprintf(buf, 64, "%.2f GiB", _bytes/(1024.0*1024.0*1024.0));
+  return std::string(buf);
+}
+
+// the phases of one step with _np particles
+static StepCost step_cost(const double _np, const double _npan, const double _nrows, const double _nfld,
+                          const bool _rebuild_A, const KernelRates& _r) {
+  StepCost c;
+  c.ptpt = vel_evals_per_step * _np * _np * _r.ptpt_pair;
+  c.panpt = vel_evals_per_step * _npan * _np * _r.panpt_pair;
+  c.ptpan = bem_solves_per_step * _np * _npan * _r.ptpan_pair;
+  c.solve = bem_solves_per_step * gmres_iters * _nrows * _nrows * _r.matrix_entry;
+  // moving bodies rebuild their blocks at each new solve time, twice per step
+  if (_rebuild_A) c.solve += vel_evals_per_step * _nrows * _npan * _r.panpt_pair;
+  c.fldpt = vel_evals_per_step * _nfld * (_np * _r.ptpt_pair_nograds + _npan * _r.panpt_pair);
+  c.vrm = _np * _r.vrm_particle;
+  return c;
+}
+
+
+int estimate_run(const json& _j) {
+
+  Simulation sim;
+  std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+  std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+  std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+  RenderParams rparams;
+
+  // build everything the batch driver would, but do not step
+  parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, _j);
+
+  add_init_elements(sim, ffeatures, bfeatures, mfeatures, rparams);
+  sim.set_initialized();
+
+  // particles that will appear every step
+  size_t nemit = 0;
+  for (auto const& ff: ffeatures) {
+    if (ff->is_enabled()) nemit += ff->step_elements(sim.get_ips()).x.size() / Dimensions;
+  }
+
+  const std::string err = sim.check_initialization();
+  if (not err.empty()) {
+    std::cout << std::endl << "ERROR: " << err;
+    return 1;
+  }
+
+  // the problem size
+  const size_t npart = sim.get_nparts();
+  const size_t nfld = sim.get_nfldpts();
+  size_t npan = 0;
+  size_t nrows = 0;
+  std::array<float,Dimensions> center = {0.0, 0.0, 0.0};
+  for (auto &coll : sim.get_bdry()) {
+    if (std::holds_alternative<Surfaces<STORE>>(coll)) {
+      Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(coll);
+      if (surf.get_elemt() != reactive) continue;
+      if (npan == 0) center = surf.get_geom_center();
+      npan += surf.get_npanels();
+      nrows += surf.get_num_rows();
+    }
+  }
+  // and the box around the initial vorticity
+  std::array<float,Dimensions> boxmin, boxmax;
+  boxmin.fill(std::numeric_limits<float>::max());
+  boxmax.fill(-std::numeric_limits<float>::max());
+  for (auto &coll : sim.get_vort()) {
+    if (not std::holds_alternative<Points<STORE>>(coll)) continue;
+    Points<STORE>& pts = std::get<Points<STORE>>(coll);
+    if (pts.is_inert()) continue;
+    for (size_t d=0; d<Dimensions; ++d) {
+      for (size_t i=0; i<pts.get_n(); ++i) {
+        boxmin[d] = std::min(boxmin[d], pts.get_pos()[d][i]);
+        boxmax[d] = std::max(boxmax[d], pts.get_pos()[d][i]);
+      }
+    }
+  }
+  const bool diffuse = sim.get_diffuse();
+  const bool moving = sim.do_any_bodies_move();
+  ExecEnv env = sim.get_exec_env();
+
+  // how many steps will run
+  const double dt = sim.get_dt();
+  size_t nsteps = 0;
+  bool bounded = true;
+  if (sim.using_end_time()) nsteps = (size_t)std::ceil(sim.get_end_time() / dt - 0.5);
+  if (sim.using_max_steps()) nsteps = (nsteps == 0) ? sim.get_max_steps() : std::min(nsteps, sim.get_max_steps());
+  if (not sim.using_end_time() and not sim.using_max_steps()) {
+    nsteps = 1000;
+    bounded = false;
+  }
+
+  std::cout << std::endl << "Estimating cost of " << sim.get_description() << std::endl;
+  std::cout << "  " << npart << " particles, " << npan << " reactive panels with " << nrows << " unknowns, "
+            << nfld << " field points" << std::endl;
+  std::cout << "  velocities with" << env.to_string() << ", " << (diffuse ? "viscous" : "inviscid")
+            << ", bodies " << (moving ? "move" : "are fixed") << std::endl;
+
+  //
+  // time a few samples of each kernel
+  //
+  std::cout << std::endl << "Timing kernel samples" << std::endl;
+  std::mt19937 gen(12345);
+  const float ips = sim.get_ips();
+  const float vdelta = sim.get_vdelta();
+  const size_t nsamp = 2000;
+  KernelRates rate;
+
+  Points<STORE> src(sample_packet(nsamp, ips, vdelta, center, gen), active, lagrangian, nullptr);
+  Points<STORE> targ(sample_packet(nsamp, ips, vdelta, center, gen), active, lagrangian, nullptr);
+  // field points take only positions
+  std::vector<float> fpacket = sample_packet(nsamp, ips, vdelta, center, gen);
+  for (size_t i=0; i<nsamp; ++i) {
+    for (size_t d=0; d<Dimensions; ++d) fpacket[3*i+d] = fpacket[7*i+d];
+  }
+  fpacket.resize(3*nsamp);
+  Points<STORE> fpts(fpacket, inert, lagrangian, nullptr);
+
+  double secs = best_seconds([&]() { targ.zero_vels(); points_affect_points<STORE,ACCUM>(src, targ, env); });
+  rate.ptpt_pair = secs / ((double)nsamp*(double)nsamp);
+  double gflops = 1.e-9 * (double)nsamp * (12.0 + (double)flops_0v_0pg<STORE>()*(double)nsamp) / secs;
+  printf("    particles on particles:\t[%.4f] seconds at %.3f GFlop/s\n", (float)secs, (float)gflops);
+
+  secs = best_seconds([&]() { fpts.zero_vels(); points_affect_points<STORE,ACCUM>(src, fpts, env); });
+  rate.ptpt_pair_nograds = secs / ((double)nsamp*(double)nsamp);
+  gflops = 1.e-9 * (double)nsamp * (3.0 + (double)flops_0v_0p<STORE>()*(double)nsamp) / secs;
+  printf("    particles on field points:\t[%.4f] seconds at %.3f GFlop/s\n", (float)secs, (float)gflops);
+
+  if (npan > 0) {
+    double pansecs = 0.0;
+    double ptpansecs = 0.0;
+    for (auto &coll : sim.get_bdry()) {
+      if (not std::holds_alternative<Surfaces<STORE>>(coll)) continue;
+      Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(coll);
+      if (surf.get_elemt() != reactive) continue;
+      pansecs += best_seconds([&]() { targ.zero_vels(); panels_affect_points<STORE,ACCUM>(surf, targ, env); });
+      ptpansecs += best_seconds([&]() { surf.zero_vels(); points_affect_panels<STORE,ACCUM>(src, surf, env); });
+    }
+    rate.panpt_pair = pansecs / ((double)npan*(double)nsamp);
+    rate.ptpan_pair = ptpansecs / ((double)npan*(double)nsamp);
+    gflops = 1.e-9 * (double)nsamp * (double)npan * (double)flops_2v_0pg<STORE>() / pansecs;
+    printf("    panels on particles:\t[%.4f] seconds at %.3f GFlop/s\n", (float)pansecs, (float)gflops);
+    gflops = 1.e-9 * (double)nsamp * (double)npan * (double)flops_2vs_0p<STORE>() / ptpansecs;
+    printf("    particles on panels:\t[%.4f] seconds at %.3f GFlop/s\n", (float)ptpansecs, (float)gflops);
+
+    // the GMRES cost is all in dense matrix-vector products
+    const size_t nmat = std::min(nrows, (size_t)2000);
+    Eigen::Matrix<STORE, Eigen::Dynamic, Eigen::Dynamic> A = Eigen::Matrix<STORE, Eigen::Dynamic, Eigen::Dynamic>::Random(nmat, nmat);
+    Eigen::Matrix<STORE, Eigen::Dynamic, 1> x = Eigen::Matrix<STORE, Eigen::Dynamic, 1>::Random(nmat);
+    Eigen::Matrix<STORE, Eigen::Dynamic, 1> y(nmat);
+    secs = best_seconds([&]() { for (int i=0; i<10; ++i) { y.noalias() = A*x; x(0) = y(0)*1.e-6; } });
+    rate.matrix_entry = secs / (10.0*(double)nmat*(double)nmat);
+    gflops = 1.e-9 * 20.0 * (double)nmat * (double)nmat / secs;
+    printf("    BEM matrix-vector product:\t[%.4f] seconds at %.3f GFlop/s\n", (float)(0.1*secs), (float)gflops);
+  }
+
+  // with this case's thresholds
+  VRM<STORE,double,2> vrm;
+  if (_j.find("simparams") != _j.end()) vrm.from_json(_j["simparams"]);
+
+  if (diffuse) {
+    // VRM changes the particle arrays, so each try starts from a fresh copy
+    const std::vector<float> packet = sample_packet(nsamp, ips, vdelta, center, gen);
+    secs = best_seconds([&]() {
+      Points<STORE> pts(packet, active, lagrangian, nullptr);
+      vrm.diffuse_all(pts.get_pos(), pts.get_str(), pts.get_rad(), sim.get_hnu(), sim.get_core_func(), vdelta/ips);
+    }, 2);
+    rate.vrm_particle = secs / (double)nsamp;
+    printf("    VRM diffusion:\t[%.4f] seconds for %ld particles\n", (float)secs, nsamp);
+  }
+
+  //
+  // memory
+  //
+  std::cout << std::endl << "Memory" << std::endl;
+  const double abytes = (double)nrows * (double)nrows * sizeof(STORE);
+  // GMRES keeps its restart vectors too
+  const double bembytes = abytes + 32.0 * (double)nrows * sizeof(STORE);
+  std::cout << "  BEM matrix: " << nrows << " x " << nrows << ", " << human_bytes(abytes)
+            << ", with the solver " << human_bytes(bembytes) << std::endl;
+
+  //
+  // particle growth: each reactive panel sheds one particle per step, as do the emitting
+  //   features, and VRM spreads each shed sheet over the core size plus sqrt(4 nu t), so a
+  //   sheet k steps old is about (vdelta + 2 sqrt(k) h_nu) / ips particles thick (the wake
+  //   is stretched and merged, so this fits better than the full Gaussian tail)
+  //
+  // the initial vorticity stays in one place and fills its box, grown on every side to
+  //   where its Gaussian falls below the VRM ignore threshold, at one particle per ips^3
+  //
+  const double nshed = (diffuse ? (double)npan : 0.0) + (double)nemit;
+  const double core = diffuse ? vdelta / ips : 0.0;
+  const double thick = diffuse ? 2.0 * sim.get_hnu() / ips : 0.0;
+  const double tail = std::log(1.0 / std::clamp((double)vrm.get_ignore(), 1.e-12, 0.5));
+  std::vector<double> nparts(nsteps+1);
+  nparts[0] = (double)npart;
+  double layers = 0.0;
+  for (size_t k=1; k<=nsteps; ++k) {
+    layers += std::max(1.0, core + thick * std::sqrt((double)k));
+    double ninit = (double)npart;
+    if (diffuse and npart > 0) {
+      const double spread = 2.0 * sim.get_hnu() * std::sqrt((double)k * tail);
+      double vol = M_PI / 6.0;
+      for (size_t d=0; d<Dimensions; ++d) vol *= boxmax[d] - boxmin[d] + 2.0*(vdelta + spread);
+      ninit = std::max(ninit, vol / std::pow((double)ips, 3));
+    }
+    nparts[k] = ninit + nshed * layers;
+  }
+
+  const double partbytes = nparts[nsteps] * bytes_per_particle;
+  std::cout << "  particles at the last step: " << human_bytes(partbytes) << std::endl;
+#ifndef _WIN32
+  const double ram = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGE_SIZE);
+  if (ram > 0.0) {
+    std::cout << "  total " << human_bytes(bembytes + partbytes) << " of " << human_bytes(ram) << " physical memory";
+    if (bembytes + partbytes > 0.8*ram) std::cout << ", WILL NOT FIT";
+    std::cout << std::endl;
+  }
+#endif
+
+  std::cout << std::endl << "Particle growth, " << nshed << " new particles per step" << std::endl;
+  for (int q=1; q<=4; ++q) {
+    const size_t k = (nsteps*q)/4;
+    printf("  step %ld, time %g:\t%.0f particles\n", k, k*dt, nparts[k]);
+  }
+
+  //
+  // time per step and in total
+  //
+  const StepCost first = step_cost(nparts[std::min<size_t>(1,nsteps)], (double)npan, (double)nrows, (double)nfld, moving, rate);
+  const StepCost last = step_cost(nparts[nsteps], (double)npan, (double)nrows, (double)nfld, moving, rate);
+  // the matrix is built once for fixed bodies
+  const double build = moving ? 0.0 : (double)nrows * (double)npan * rate.panpt_pair;
+
+  std::cout << std::endl << "Time per step, first and last" << std::endl;
+  printf("    particles on particles:\t[%.4f] [%.4f] seconds\n", (float)first.ptpt, (float)last.ptpt);
+  printf("    panels on particles:\t[%.4f] [%.4f] seconds\n", (float)first.panpt, (float)last.panpt);
+  printf("    particles on panels:\t[%.4f] [%.4f] seconds\n", (float)first.ptpan, (float)last.ptpan);
+  printf("    BEM solve:\t[%.4f] [%.4f] seconds\n", (float)first.solve, (float)last.solve);
+  printf("    field points:\t[%.4f] [%.4f] seconds\n", (float)first.fldpt, (float)last.fldpt);
+  printf("    VRM diffusion:\t[%.4f] [%.4f] seconds\n", (float)first.vrm, (float)last.vrm);
+  printf("    total:\t[%.4f] [%.4f] seconds\n", (float)first.total(), (float)last.total());
+  if (build > 0.0) printf("    BEM matrix, once:\t[%.4f] seconds\n", (float)build);
+
+  double total = build;
+  for (size_t k=1; k<=nsteps; ++k) {
+    total += step_cost(nparts[k], (double)npan, (double)nrows, (double)nfld, moving, rate).total();
+  }
+
+  std::cout << std::endl << "Predicted runtime for " << nsteps << " steps";
+  if (not bounded) std::cout << " (the case has no end time or step limit)";
+  std::cout << " with" << env.to_string() << ": " << human_time(total) << std::endl;
+  std::cout << "  not counted: merging, splitting, neighbor searches, and output" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * Estimate.h - Predict the memory and runtime of a case before running it
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "json/json.hpp"
+
+//
+// Set up the case in _j (features, panels and particles, but no steps), time a few samples
+//   of the velocity kernels, the BEM matrix-vector product and VRM, and print the BEM
+//   matrix memory, the expected particle growth, the cost of each phase of a step, and the
+//   total runtime to the stopping condition
+//
+// Returns 0 if the case could be set up, 1 otherwise
+//
+int estimate_run(const nlohmann::json& _j);
@@ -0,0 +1,70 @@
+/*
+ * FeatureCache.h - Remember the elements generated by each feature
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "ElementPacket.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <map>
+#include <set>
+
+
+//
+// Features are identified by their full json description and the particle spacing,
+//   so an unchanged feature never re-reads, re-refines, or re-samples its geometry
+//   when the simulation is re-initialized. Any edit changes the key.
+//
+// A geometry file that is edited on disk under the same name is not detected;
+//   reloading the simulation clears the cache.
+//
+class FeatureCache {
+public:
+  FeatureCache() = default;
+
+  // the identity of a feature at a given particle spacing
+  template <class F>
+  std::string key_of(const F& _feat, const float _ips) const {
+    char ipsstr[32];
+    snprintf(ipsstr, 32, " ips %a", _ips);
+    return _feat.to_json().dump() + ipsstr;
+  }
+
+  // return the feature's elements, generating them only if it changed
+  template <class F>
+  const ElementPacket<float>& get(const F& _feat, const float _ips) {
+    const std::string key = key_of(_feat, _ips);
+    used.insert(key);
+
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+      std::cout << "  reusing elements for unchanged feature" << std::endl;
+      return found->second;
+    }
+    return entries.emplace(key, _feat.init_elements(_ips)).first->second;
+  }
+
+  // forget any feature not asked for since the last prune
+  void prune() {
+    for (auto it = entries.begin(); it != entries.end(); ) {
+      if (used.count(it->first) == 0) it = entries.erase(it);
+      else ++it;
+    }
+    used.clear();
+  }
+
+  void clear() {
+    entries.clear();
+    used.clear();
+  }
+
+private:
+  std::map<std::string, ElementPacket<float>> entries;
+  std::set<std::string> used;
+};
@@ -0,0 +1,376 @@
+/*
+ * FieldStats.h - Running flow statistics at fixed measurement points
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "Points.h"
+#include "VtkXmlHelper.h"
+#include "GuiHelper.h"
+#include "json/json.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+
+
+//
+// Accumulate the mean, (co)variance, and extremes of velocity and vorticity at every
+//   fixed (Eulerian) field point, one sample per step, with Welford's single-pass update:
+//
+//   n += 1,  d = x - mean,  mean += d/n,  C_ij += d_i (x_j - mean_j)
+//
+// so that long runs never form the large sums of squares that lose precision in floats.
+// Lagrangian field points move with the flow, so their statistics would mean nothing, and
+//   they are skipped. Each point keeps its own sample count, so points added part way
+//   through a run are fine.
+//
+// Only the statistics are written, as stats_NN_SSSSS.vtu, with the feature tag of each
+//   point so that the results can be separated per measurement feature.
+//
+template <class S>
+class FieldStats {
+public:
+  FieldStats()
+    : enabled(false),
+      start_time(0.0)
+    {}
+
+  bool is_enabled() const { return enabled; }
+  void set_enabled(const bool _on) { enabled = _on; }
+  bool wants_sample(const double _time) const { return enabled and _time >= start_time; }
+  bool has_samples() const { return not accum.empty(); }
+  void reset() { accum.clear(); }
+
+  void update(const double, std::vector<Collection> const&);
+  std::vector<std::string> write(std::vector<Collection> const&, const size_t, const double,
+                                 const std::string& _prefix = std::string()) const;
+
+  void from_json(const nlohmann::json);
+  void add_to_json(nlohmann::json&) const;
+#ifdef USE_IMGUI
+  void draw_advanced();
+#endif
+
+private:
+  // the statistics of one fldpt collection
+  struct Accum {
+    size_t n = 0;
+    Vector<uint32_t> count;
+    std::array<Vector<double>,Dimensions> umean, wmean;
+    std::array<Vector<double>,6> ucov;		// xx, yy, zz, xy, yz, xz like vtk tensors
+    std::array<Vector<double>,Dimensions> wvar;
+    std::array<Vector<S>,Dimensions> umin, umax, wmin, wmax;
+
+    void resize(const size_t _n) {
+      for (size_t d=0; d<Dimensions; ++d) {
+        umean[d].resize(_n, 0.0);
+        wmean[d].resize(_n, 0.0);
+        wvar[d].resize(_n, 0.0);
+        umin[d].resize(_n, std::numeric_limits<S>::max());
+        umax[d].resize(_n, std::numeric_limits<S>::lowest());
+        wmin[d].resize(_n, std::numeric_limits<S>::max());
+        wmax[d].resize(_n, std::numeric_limits<S>::lowest());
+      }
+      for (size_t d=0; d<6; ++d) ucov[d].resize(_n, 0.0);
+      count.resize(_n, 0);
+      n = _n;
+    }
+  };
+
+  bool enabled;
+  double start_time;
+  std::vector<Accum> accum;	// one per fldpt collection, empty if that one is not sampled
+};
+
+
+//
+// add one sample at every fixed field point, using the velocities from the last find_vels
+//
+template <class S>
+void FieldStats<S>::update(const double _time, std::vector<Collection> const& _fldpt) {
+
+  if (not wants_sample(_time)) return;
+  auto start = std::chrono::system_clock::now();
+
+  accum.resize(_fldpt.size());
+
+  size_t nsampled = 0;
+  for (size_t c=0; c<_fldpt.size(); ++c) {
+    if (not std::holds_alternative<Points<S>>(_fldpt[c])) continue;
+    Points<S> const & pts = std::get<Points<S>>(_fldpt[c]);
+    if (pts.get_movet() != fixed or not pts.get_velgrad()) continue;
+
+    const size_t n = pts.get_n();
+    Accum& a = accum[c];
+    // a collection that shrank was rebuilt, so its old statistics do not belong to these points
+    if (n < a.n) a = Accum();
+    if (n > a.n) a.resize(n);
+
+    std::array<Vector<S>,Dimensions>           const& u  = pts.get_vel();
+    std::array<Vector<S>,Dimensions*Dimensions> const& ug = *pts.get_velgrad();
+
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)n; ++i) {
+      const double cnt = (double)(++a.count[i]);
+
+      // velocity: mean, co-moments, extremes
+      const std::array<double,Dimensions> x = {u[0][i], u[1][i], u[2][i]};
+      std::array<double,Dimensions> dold, dnew;
+      for (size_t d=0; d<Dimensions; ++d) {
+        dold[d] = x[d] - a.umean[d][i];
+        a.umean[d][i] += dold[d] / cnt;
+        dnew[d] = x[d] - a.umean[d][i];
+        a.umin[d][i] = std::min(a.umin[d][i], u[d][i]);
+        a.umax[d][i] = std::max(a.umax[d][i], u[d][i]);
+      }
+      a.ucov[0][i] += dold[0]*dnew[0];
+      a.ucov[1][i] += dold[1]*dnew[1];
+      a.ucov[2][i] += dold[2]*dnew[2];
+      a.ucov[3][i] += dold[0]*dnew[1];
+      a.ucov[4][i] += dold[1]*dnew[2];
+      a.ucov[5][i] += dold[0]*dnew[2];
+
+      // vorticity from the velocity gradients, same as in the vtu files
+      const std::array<S,Dimensions> w = {ug[5][i] - ug[7][i],
+                                          ug[6][i] - ug[2][i],
+                                          ug[1][i] - ug[3][i]};
+      for (size_t d=0; d<Dimensions; ++d) {
+        const double dw = w[d] - a.wmean[d][i];
+        a.wmean[d][i] += dw / cnt;
+        a.wvar[d][i] += dw * (w[d] - a.wmean[d][i]);
+        a.wmin[d][i] = std::min(a.wmin[d][i], w[d]);
+        a.wmax[d][i] = std::max(a.wmax[d][i], w[d]);
+      }
+    }
+    nsampled += n;
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  if (nsampled > 0) printf("    field stats:\t[%.4f] seconds at %ld points\n", (float)elapsed_seconds.count(), (long)nsampled);
+}
+
+//
+// write the accumulated statistics, one vtu file per sampled collection
+//
+template <class S>
+std::vector<std::string> FieldStats<S>::write(std::vector<Collection> const& _fldpt,
+                                              const size_t _index, const double _time,
+                                              const std::string& _prefix) const {
+
+  std::vector<std::string> files;
+  const bool compress = false;
+  const bool asbase64 = true;
+
+  for (size_t c=0; c<std::min(accum.size(), _fldpt.size()); ++c) {
+    const Accum& a = accum[c];
+    if (a.n == 0 or not std::holds_alternative<Points<S>>(_fldpt[c])) continue;
+    Points<S> const & pts = std::get<Points<S>>(_fldpt[c]);
+    if (pts.get_n() != a.n) continue;
+    const size_t n = a.n;
+
+    // finish the moments: population variance and Reynolds stresses
+    std::array<Vector<S>,Dimensions> umean, wmean, wvar;
+    Vector<S> stress(6*n);
+    for (size_t d=0; d<Dimensions; ++d) {
+      umean[d].resize(n);
+      wmean[d].resize(n);
+      wvar[d].resize(n);
+    }
+    for (size_t i=0; i<n; ++i) {
+      const double inv = (a.count[i] > 0) ? 1.0 / (double)a.count[i] : 0.0;
+      for (size_t d=0; d<Dimensions; ++d) {
+        umean[d][i] = a.umean[d][i];
+        wmean[d][i] = a.wmean[d][i];
+        wvar[d][i] = a.wvar[d][i] * inv;
+      }
+      for (size_t d=0; d<6; ++d) stress[6*i+d] = a.ucov[d][i] * inv;
+    }
+
+    std::stringstream vtkfn;
+    vtkfn << _prefix << "stats_" << std::setfill('0') << std::setw(2) << c << "_" << std::setw(5) << _index << ".vtu";
+
+    std::FILE* fp = std::fopen(vtkfn.str().c_str(), "wb");
+    tinyxml2::XMLPrinter printer( fp );
+    printer.PushHeader(false, true);
+
+    printer.OpenElement( "VTKFile" );
+    printer.PushAttribute( "type", "UnstructuredGrid" );
+    printer.PushAttribute( "version", "0.1" );
+    printer.PushAttribute( "byte_order", "LittleEndian" );
+    printer.PushAttribute( "header_type", "UInt32" );
+    printer.OpenElement( "UnstructuredGrid" );
+
+    printer.OpenElement( "FieldData" );
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "type", "Float64" );
+    printer.PushAttribute( "Name", "TimeValue" );
+    printer.PushAttribute( "NumberOfTuples", "1" );
+    {
+      Vector<double> time_vec = {_time};
+      write_DataArray (printer, time_vec, false, false);
+    }
+    printer.CloseElement();	// DataArray
+    printer.CloseElement();	// FieldData
+
+    printer.OpenElement( "Piece" );
+    printer.PushAttribute( "NumberOfPoints", std::to_string(n).c_str() );
+    printer.PushAttribute( "NumberOfCells", std::to_string(n).c_str() );
+
+    printer.OpenElement( "Points" );
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "NumberOfComponents", "3" );
+    printer.PushAttribute( "Name", "position" );
+    printer.PushAttribute( "type", "Float32" );
+    write_DataArray (printer, pts.get_pos(), compress, asbase64);
+    printer.CloseElement();	// DataArray
+    printer.CloseElement();	// Points
+
+    printer.OpenElement( "Cells" );
+    {
+      Vector<int32_t> v(n);
+      printer.OpenElement( "DataArray" );
+      printer.PushAttribute( "Name", "connectivity" );
+      printer.PushAttribute( "type", "Int32" );
+      std::iota(v.begin(), v.end(), 0);
+      write_DataArray (printer, v, compress, asbase64);
+      printer.CloseElement();	// DataArray
+
+      printer.OpenElement( "DataArray" );
+      printer.PushAttribute( "Name", "offsets" );
+      printer.PushAttribute( "type", "Int32" );
+      std::iota(v.begin(), v.end(), 1);
+      write_DataArray (printer, v, compress, asbase64);
+      printer.CloseElement();	// DataArray
+
+      Vector<uint8_t> t(n, 1);
+      printer.OpenElement( "DataArray" );
+      printer.PushAttribute( "Name", "types" );
+      printer.PushAttribute( "type", "UInt8" );
+      write_DataArray (printer, t, compress, asbase64);
+      printer.CloseElement();	// DataArray
+    }
+    printer.CloseElement();	// Cells
+
+    printer.OpenElement( "PointData" );
+    printer.PushAttribute( "Vectors", "mean velocity" );
+    printer.PushAttribute( "Tensors", "reynolds stress" );
+
+    // one 3-vector array
+    auto write_vec = [&](const char* _name, std::array<Vector<S>,Dimensions> const& _v) {
+      printer.OpenElement( "DataArray" );
+      printer.PushAttribute( "NumberOfComponents", "3" );
+      printer.PushAttribute( "Name", _name );
+      printer.PushAttribute( "type", "Float32" );
+      write_DataArray (printer, _v, compress, asbase64);
+      printer.CloseElement();	// DataArray
+    };
+
+    write_vec("mean velocity", umean);
+    write_vec("min velocity", a.umin);
+    write_vec("max velocity", a.umax);
+    write_vec("mean vorticity", wmean);
+    write_vec("vorticity variance", wvar);
+    write_vec("min vorticity", a.wmin);
+    write_vec("max vorticity", a.wmax);
+
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "NumberOfComponents", "6" );
+    printer.PushAttribute( "Name", "reynolds stress" );
+    printer.PushAttribute( "type", "Float32" );
+    write_DataArray (printer, stress, compress, asbase64);
+    printer.CloseElement();	// DataArray
+
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "Name", "samples" );
+    printer.PushAttribute( "type", "UInt32" );
+    write_DataArray (printer, a.count, compress, asbase64);
+    printer.CloseElement();	// DataArray
+
+    // which measurement feature made each point
+    if (pts.get_tag().size() == n) {
+      printer.OpenElement( "DataArray" );
+      printer.PushAttribute( "Name", "feature" );
+      printer.PushAttribute( "type", "Int32" );
+      write_DataArray (printer, pts.get_tag(), compress, asbase64);
+      printer.CloseElement();	// DataArray
+    }
+
+    printer.CloseElement();	// PointData
+    printer.CloseElement();	// Piece
+    printer.CloseElement();	// UnstructuredGrid
+    printer.CloseElement();	// VTKFile
+    std::fclose(fp);
+
+    std::cout << "Wrote statistics at " << n << " points to " << vtkfn.str() << std::endl;
+    files.push_back(vtkfn.str());
+  }
+
+  return files;
+}
+
+//
+// read/write parameters to json
+//
+template <class S>
+void FieldStats<S>::from_json(const nlohmann::json simj) {
+  if (simj.find("fieldStatistics") != simj.end()) {
+    nlohmann::json j = simj["fieldStatistics"];
+    if (j.find("enabled") != j.end()) {
+      enabled = j["enabled"];
+      std::cout << "  setting field statistics= " << enabled << std::endl;
+    }
+    if (j.find("startTime") != j.end()) {
+      start_time = j["startTime"];
+      std::cout << "  setting field statistics start time= " << start_time << std::endl;
+    }
+  }
+}
+
+template <class S>
+void FieldStats<S>::add_to_json(nlohmann::json& simj) const {
+  if (enabled) {
+    nlohmann::json j;
+    j["enabled"] = true;
+    j["startTime"] = start_time;
+    simj["fieldStatistics"] = j;
+  }
+}
+
+#ifdef USE_IMGUI
+//
+// draw advanced options parts of the GUI
+//
+template <class S>
+void FieldStats<S>::draw_advanced() {
+
+  ImGui::Spacing();
+  ImGui::Text("Field statistics settings");
+
+  ImGui::Checkbox("Accumulate statistics at fixed measurement points", &enabled);
+  ImGui::SameLine();
+  ShowHelpMarker("Keep running mean, Reynolds stresses, variance, and extremes of velocity and vorticity at every fixed measurement point. They are written to stats_*.vtu files alongside the other output.");
+
+  if (enabled) {
+    float st = start_time;
+    ImGui::SliderFloat("Start time", &st, 0.0, 100.0, "%.2f", 2.0);
+    ImGui::SameLine();
+    ShowHelpMarker("Ignore the flow before this time, to skip the initial transient.");
+    start_time = st;
+  }
+}
+#endif
@@ -9,12 +9,14 @@
 #include "BoundaryFeature.h"
 #include "FlowFeature.h"
 #include "MathHelper.h"
+#include "Philox.h"
 #include "imgui/imgui.h"
 
 #include <cmath>
 #include <iostream>
 #include <sstream>
 #include <random>
+#include <utility>
 
 // write out any object of parent type FlowFeature by dispatching to appropriate "debug" method
 std::ostream& operator<<(std::ostream& os, FlowFeature const& ff) {
@@ -224,52 +226,84 @@ VortexBlob::init_elements(float _ips) const {
 
   std::cout << "Creating vortex blob with up to " << std::pow(2*irad+1,3) << " particles" << std::endl;
 
-  // and a counter for the total circulation
-  double tot_wgt = 0.0;
+  // count the particles in each i-slab first, so that every slab knows where its
+  //   particles go and the slabs can be filled in parallel in the same order as a serial loop
+  const int nslab = 2*irad+1;
+  std::vector<size_t> slab_start(nslab+1, 0);
+  #pragma omp parallel for
+  for (int32_t is=0; is<nslab; ++is) {
+    const int i = is - irad;
+    size_t cnt = 0;
+    for (int j=-irad; j<=irad; ++j) {
+    for (int k=-irad; k<=irad; ++k) {
+      const float dr = std::sqrt((float)(i*i+j*j+k*k)) * _ips;
+      if (dr < m_rad + 0.5*m_softness) ++cnt;
+    }
+    }
+    slab_start[is+1] = cnt;
+  }
+  for (int is=0; is<nslab; ++is) slab_start[is+1] += slab_start[is];
+  const size_t npart = slab_start[nslab];
 
-  // loop over integer indices
-  for (int i=-irad; i<=irad; ++i) {
-  for (int j=-irad; j<=irad; ++j) {
-  for (int k=-irad; k<=irad; ++k) {
+  x.resize(3*npart);
+  vals.resize(4*npart);
 
-    // how far from the center are we?
-    float dr = std::sqrt((float)(i*i+j*j+k*k)) * _ips;
-    if (dr < m_rad + 0.5*m_softness) {
+  // and a counter for the circulation of each slab
+  std::vector<double> slab_wgt(nslab, 0.0);
 
-      // create a particle here
-      x.emplace_back(m_x + _ips*(float)i);
-      x.emplace_back(m_y + _ips*(float)j);
-      x.emplace_back(m_z + _ips*(float)k);
-
-      // figure out the strength from another check
-      double this_wgt = 1.0;
-      if (dr > m_rad - 0.5*m_softness) {
-        // create a weaker particle
-        this_wgt = 0.5 - 0.5*std::sin(M_PI * (dr - m_rad) / m_softness);
+  // loop over integer indices
+  #pragma omp parallel for
+  for (int32_t is=0; is<nslab; ++is) {
+    const int i = is - irad;
+    size_t ip = slab_start[is];
+
+    for (int j=-irad; j<=irad; ++j) {
+    for (int k=-irad; k<=irad; ++k) {
+
+      // how far from the center are we?
+      float dr = std::sqrt((float)(i*i+j*j+k*k)) * _ips;
+      if (dr < m_rad + 0.5*m_softness) {
+
+        // create a particle here
+        x[3*ip+0] = m_x + _ips*(float)i;
+        x[3*ip+1] = m_y + _ips*(float)j;
+        x[3*ip+2] = m_z + _ips*(float)k;
+
+        // figure out the strength from another check
+        double this_wgt = 1.0;
+        if (dr > m_rad - 0.5*m_softness) {
+          // create a weaker particle
+          this_wgt = 0.5 - 0.5*std::sin(M_PI * (dr - m_rad) / m_softness);
+        }
+        vals[4*ip+0] = m_sx * (float)this_wgt;
+        vals[4*ip+1] = m_sy * (float)this_wgt;
+        vals[4*ip+2] = m_sz * (float)this_wgt;
+        slab_wgt[is] += this_wgt;
+
+        // this is the radius - still zero for now
+        vals[4*ip+3] = 0.0f;
+        ++ip;
       }
-      vals.emplace_back(m_sx * (float)this_wgt);
-      vals.emplace_back(m_sy * (float)this_wgt);
-      vals.emplace_back(m_sz * (float)this_wgt);
-      tot_wgt += this_wgt;
-
-      // this is the radius - still zero for now
-      vals.emplace_back(0.0f);
     }
-  }
-  }
+    }
   }
 
+  // sum in a fixed order so that the result never depends on the thread count
+  double tot_wgt = 0.0;
+  for (int is=0; is<nslab; ++is) tot_wgt += slab_wgt[is];
+
   // finally, normalize all particle strengths so that the whole blob
   //   has exactly the right strength
   std::cout << "blob had " << tot_wgt << " initial circulation" << std::endl;
-  double str_scale = 1.0 / tot_wgt;
-  for (size_t i=0; i<vals.size(); i+=4) {
-    vals[i+0] = (float)((double)vals[i+0] * str_scale);
-    vals[i+1] = (float)((double)vals[i+1] * str_scale);
-    vals[i+2] = (float)((double)vals[i+2] * str_scale);
+  const double str_scale = 1.0 / tot_wgt;
+  #pragma omp parallel for
+  for (int32_t i=0; i<(int32_t)npart; ++i) {
+    vals[4*i+0] = (float)((double)vals[4*i+0] * str_scale);
+    vals[4*i+1] = (float)((double)vals[4*i+1] * str_scale);
+    vals[4*i+2] = (float)((double)vals[4*i+2] * str_scale);
   }
 
-  ElementPacket<float> packet({x, idx, vals, x.size()/3, 0});
+  ElementPacket<float> packet(std::move(x), std::move(idx), std::move(vals), npart, 0);
   if (packet.verify(packet.x.size()+packet.val.size(), 7)) {
     return packet;
   } else {
@@ -368,12 +402,6 @@ BlockOfRandom::init_elements(float _ips) const {
 
   std::cout << "Creating random block with " << m_num << " particles" << std::endl;
 
-  // set up the random number generator
-  static std::random_device rd;  //Will be used to obtain a seed for the random number engine
-  static std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-  static std::uniform_real_distribution<> zmean_dist(-0.5, 0.5);
-  static std::uniform_real_distribution<> zo_dist(0.0, 1.0);
-
   // create a new vector to pass on
   std::vector<float> x;
   std::vector<Int> idx;
@@ -381,26 +409,25 @@ BlockOfRandom::init_elements(float _ips) const {
   x.resize(Dimensions*m_num);
   vals.resize(4*m_num);
 
-  // initialize the particles' locations and strengths, leave radius zero for now
-  for (size_t i=0; i<(size_t)m_num; ++i) {
-    size_t idx = 3*i;
+  // every particle draws from its own counter, so any thread count gives the same block
+  #pragma omp parallel for
+  for (int32_t i=0; i<m_num; ++i) {
     // positions
-    x[idx+0] = m_x + m_xsize*zmean_dist(gen);
-    x[idx+1] = m_y + m_ysize*zmean_dist(gen);
-    x[idx+2] = m_z + m_zsize*zmean_dist(gen);
-  }
+    const std::array<float,4> rx = philox_uniform(m_seed, (uint64_t)i, 0);
+    x[3*i+0] = m_x + m_xsize*(rx[0]-0.5f);
+    x[3*i+1] = m_y + m_ysize*(rx[1]-0.5f);
+    x[3*i+2] = m_z + m_zsize*(rx[2]-0.5f);
 
-  for (size_t i=0; i<(size_t)m_num; ++i) {
-    size_t idx = 4*i;
     // strengths
-    vals[idx+0] = m_maxstr * zmean_dist(gen) / (float)m_num;
-    vals[idx+1] = m_maxstr * zmean_dist(gen) / (float)m_num;
-    vals[idx+2] = m_maxstr * zmean_dist(gen) / (float)m_num;
+    const std::array<float,4> rs = philox_uniform(m_seed, (uint64_t)i, 1);
+    vals[4*i+0] = m_maxstr * (rs[0]-0.5f) / (float)m_num;
+    vals[4*i+1] = m_maxstr * (rs[1]-0.5f) / (float)m_num;
+    vals[4*i+2] = m_maxstr * (rs[2]-0.5f) / (float)m_num;
     // radius will get set later
-    vals[idx+3] = 0.0f;
+    vals[4*i+3] = 0.0f;
   }
 
-  ElementPacket<float> packet({x, idx, vals, x.size()/3, 0});
+  ElementPacket<float> packet(std::move(x), std::move(idx), std::move(vals), (size_t)m_num, 0);
   if (packet.verify(packet.x.size()+packet.val.size(), 1)) {
     return packet;
   } else {
@@ -440,6 +467,7 @@ BlockOfRandom::from_json(const nlohmann::json j) {
   m_zsize = s[2];
   m_maxstr = j["max strength"];
   m_num = j["num"];
+  m_seed = j.value("seed", m_seed);
   m_enabled = j.value("enabled", true);
 }
 
@@ -451,6 +479,7 @@ BlockOfRandom::to_json() const {
   j["size"] = {m_xsize, m_ysize, m_zsize};
   j["max strength"] = m_maxstr;
   j["num"] = m_num;
+  j["seed"] = m_seed;
   j["enabled"] = m_enabled;
   return j;
 }
@@ -615,24 +644,30 @@ SingularRing::init_elements(float _ips) const {
   std::array<float,3> b1, b2;
   branchlessONB<float>(norm, b1, b2);
 
+  x.resize(3*ndiam);
+  vals.resize(4*ndiam);
+
   // loop over integer indices
-  for (int i=0; i<ndiam; ++i) {
+  #pragma omp parallel for
+  for (int32_t i=0; i<ndiam; ++i) {
     const float theta = 2.0 * M_PI * (float)i / (float)ndiam;
+    const float st = std::sin(theta);
+    const float ct = std::cos(theta);
 
     // create a particle here
-    x.emplace_back(m_x + m_majrad * (b1[0]*std::cos(theta) + b2[0]*std::sin(theta)));
-    x.emplace_back(m_y + m_majrad * (b1[1]*std::cos(theta) + b2[1]*std::sin(theta)));
-    x.emplace_back(m_z + m_majrad * (b1[2]*std::cos(theta) + b2[2]*std::sin(theta)));
+    x[3*i+0] = m_x + m_majrad * (b1[0]*ct + b2[0]*st);
+    x[3*i+1] = m_y + m_majrad * (b1[1]*ct + b2[1]*st);
+    x[3*i+2] = m_z + m_majrad * (b1[2]*ct + b2[2]*st);
 
     // set the strength
-    vals.emplace_back(this_ips * m_circ * (b2[0]*std::cos(theta) - b1[0]*std::sin(theta)));
-    vals.emplace_back(this_ips * m_circ * (b2[1]*std::cos(theta) - b1[1]*std::sin(theta)));
-    vals.emplace_back(this_ips * m_circ * (b2[2]*std::cos(theta) - b1[2]*std::sin(theta)));
+    vals[4*i+0] = this_ips * m_circ * (b2[0]*ct - b1[0]*st);
+    vals[4*i+1] = this_ips * m_circ * (b2[1]*ct - b1[1]*st);
+    vals[4*i+2] = this_ips * m_circ * (b2[2]*ct - b1[2]*st);
     // this is the radius - still zero for now
-    vals.emplace_back(0.0f);
+    vals[4*i+3] = 0.0f;
   }
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)ndiam, 0});
+  ElementPacket<float> packet(std::move(x), std::move(idx), std::move(vals), (size_t)ndiam, 0);
   if (packet.verify(packet.x.size()+packet.val.size(), 7)) {
     return packet;
   } else {
@@ -835,8 +870,13 @@ ThickRing::init_elements(float _ips) const {
   std::vector<Int> idx;
   std::vector<float> vals;
 
+  // every station holds the same disk of particles
+  x.resize(3*(size_t)ndiam*nthisdisk);
+  vals.resize(4*(size_t)ndiam*nthisdisk);
+
   // loop over integer indices
-  for (int i=0; i<ndiam; ++i) {
+  #pragma omp parallel for
+  for (int32_t i=0; i<ndiam; ++i) {
     const float theta = 2.0 * M_PI * (float)i / (float)ndiam;
     const float st = std::sin(theta);
     const float ct = std::cos(theta);
@@ -846,24 +886,25 @@ ThickRing::init_elements(float _ips) const {
       const size_t ix = 3*j;
       const size_t iy = 3*j+1;
       const size_t il = 3*j+2;
+      const size_t ip = (size_t)i*nthisdisk + j;
 
       // create a particle here
-      x.emplace_back(m_x + (m_majrad + disk[ix]) * (b1[0]*ct + b2[0]*st) + disk[iy]*norm[0]);
-      x.emplace_back(m_y + (m_majrad + disk[ix]) * (b1[1]*ct + b2[1]*st) + disk[iy]*norm[1]);
-      x.emplace_back(m_z + (m_majrad + disk[ix]) * (b1[2]*ct + b2[2]*st) + disk[iy]*norm[2]);
+      x[3*ip+0] = m_x + (m_majrad + disk[ix]) * (b1[0]*ct + b2[0]*st) + disk[iy]*norm[0];
+      x[3*ip+1] = m_y + (m_majrad + disk[ix]) * (b1[1]*ct + b2[1]*st) + disk[iy]*norm[1];
+      x[3*ip+2] = m_z + (m_majrad + disk[ix]) * (b1[2]*ct + b2[2]*st) + disk[iy]*norm[2];
 
       // set the strength
       const float sscale = disk[il] * this_ips * m_circ / (float)nthisdisk;
-      vals.emplace_back(sscale * (b2[0]*ct - b1[0]*st));
-      vals.emplace_back(sscale * (b2[1]*ct - b1[1]*st));
-      vals.emplace_back(sscale * (b2[2]*ct - b1[2]*st));
+      vals[4*ip+0] = sscale * (b2[0]*ct - b1[0]*st);
+      vals[4*ip+1] = sscale * (b2[1]*ct - b1[1]*st);
+      vals[4*ip+2] = sscale * (b2[2]*ct - b1[2]*st);
 
       // this is the radius - still zero for now
-      vals.emplace_back(0.0f);
+      vals[4*ip+3] = 0.0f;
     }
   }
 
-  ElementPacket<float> packet({x, idx, vals, (size_t)x.size()/3, 0});
+  ElementPacket<float> packet(std::move(x), std::move(idx), std::move(vals), (size_t)ndiam*nthisdisk, 0);
   if (packet.verify(packet.x.size()+packet.val.size(), 1)) {
     return packet;
   } else {
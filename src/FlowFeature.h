@@ -15,6 +15,7 @@
 
 #include <iostream>
 #include <vector>
+#include <random>
 
 //
 // Abstract class for any flow feature present initially
@@ -41,6 +42,9 @@ public:
   virtual std::string to_string() const = 0;
   virtual void from_json(const nlohmann::json) = 0;
   virtual nlohmann::json to_json() const = 0;
+  // particles come back interleaved in a packet (x,y,z in x and sx,sy,sz,r in val), which
+  //   the feature cache, the GUI and the ensemble runner all share; Points transposes the
+  //   packet into its own arrays in one presized, parallel pass when it is added
   virtual ElementPacket<float> init_elements(float) const = 0;
   virtual ElementPacket<float> step_elements(float) const = 0;
   virtual void generate_draw_geom() = 0;
@@ -160,7 +164,8 @@ public:
       m_ysize(_ysize),
       m_zsize(_zsize),
       m_maxstr(_maxstr),
-      m_num(_num)
+      m_num(_num),
+      m_seed(std::random_device()())
     {}
   BlockOfRandom* copy() const override 
                  { return new BlockOfRandom(*this); }
@@ -182,6 +187,7 @@ protected:
   float m_zsize;
   float m_maxstr;
   int m_num;
+  uint32_t m_seed;
 };
 
 
@@ -0,0 +1,243 @@
+/*
+ * Fork.cpp - Branch a running simulation into several child runs
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "Fork.h"
+#include "FlowFeature.h"
+#include "BoundaryFeature.h"
+#include "MeasureFeature.h"
+#include "Simulation.h"
+#include "JsonHelper.h"
+#include "RenderParams.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+  #include <ciso646>
+#else
+  #include <unistd.h>
+  #include <sys/types.h>
+  #include <sys/stat.h>
+  #include <sys/wait.h>
+#endif
+
+#include <cstdio>
+#include <cerrno>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+using json = nlohmann::json;
+
+// GNU OpenMP hangs if a forked child of a process that already started its threads tries
+//   to start more, so each child has to stay on one thread; other runtimes handle fork()
+#if defined(_OPENMP) and defined(__GNUC__) and not defined(__clang__)
+static const bool one_thread_after_fork = true;
+#else
+static const bool one_thread_after_fork = false;
+#endif
+
+
+// the state of the batch driver: the simulation, its features, and the output schedule
+struct BranchRun {
+  Simulation sim;
+  std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+  std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+  std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+  RenderParams rparams;
+  double next_output = 0.0;
+};
+
+bool forked_children_are_serial() {
+  return one_thread_after_fork;
+}
+
+void apply_branch_patch(Simulation& _sim, const json& _patch) {
+  for (auto it = _patch.begin(); it != _patch.end(); ++it) {
+    if (it.key() == "simparams") {
+      json j = _sim.to_json();
+      j.merge_patch(it.value());
+      _sim.from_json(j);
+    } else if (it.key() == "flowparams") {
+      json j = _sim.flow_to_json();
+      j.merge_patch(it.value());
+      _sim.flow_from_json(j);
+    } else {
+      std::cout << "  ignoring " << it.key() << " in branch patch, only simparams and flowparams can change" << std::endl;
+    }
+  }
+}
+
+// one pass through the main loop of the batch driver, return false when done
+static bool advance_run(BranchRun& _r, bool& _failed) {
+
+  const std::string err = advance_step(_r.sim, _r.ffeatures, _r.mfeatures, _r.rparams);
+  if (not err.empty()) {
+    std::cout << std::endl << "ERROR: " << err;
+    _failed = true;
+    return false;
+  }
+
+  if (_r.sim.get_output_dt() > 0.0 and _r.sim.get_time() >= _r.next_output - 1.e-6*_r.sim.get_output_dt()) {
+    (void) _r.sim.write_vtk();
+    while (_r.next_output <= _r.sim.get_time()) _r.next_output += _r.sim.get_output_dt();
+  }
+
+  return not _r.sim.test_vs_stop();
+}
+
+#ifndef _WIN32
+// each child writes into its own directory
+static std::string branch_dir_name(const size_t _ib) {
+  char dirname[32];
+  snprintf(dirname, 32, "branch%02ld", _ib);
+  return std::string(dirname);
+}
+
+// everything a child process does after the fork, returns its exit code
+static int run_child(BranchRun& _r, const size_t _ib, const json& _patch, const int _nthreads) {
+
+  const std::string dirname = branch_dir_name(_ib);
+  if (mkdir(dirname.c_str(), 0755) != 0 and errno != EEXIST) {
+    std::cout << "ERROR: could not create directory " << dirname << std::endl;
+    return 1;
+  }
+  if (chdir(dirname.c_str()) != 0) {
+    std::cout << "ERROR: could not move into directory " << dirname << std::endl;
+    return 1;
+  }
+
+  // the children would garble each other's output
+  if (not std::freopen("out.txt", "w", stdout)) return 1;
+
+#ifdef _OPENMP
+  omp_set_num_threads(_nthreads);
+#endif
+
+  std::cout << "Branch " << _ib << " starting at step " << _r.sim.get_nstep() << ", time " << _r.sim.get_time() << std::endl;
+  apply_branch_patch(_r.sim, _patch);
+
+  // a live feed needs its own name, a time series file lands in this directory
+  const std::string feedname = _r.sim.get_shm_feed_name();
+  if (not feedname.empty()) _r.sim.set_shm_feed_name(feedname + "_" + dirname);
+
+  bool failed = false;
+  while (advance_run(_r, failed)) {}
+  if (_r.sim.has_converged()) (void) _r.sim.write_converged();
+  if (not _r.sim.wrote_this_step()) (void) _r.sim.write_stats();
+
+  std::cout << std::endl << "Branch " << _ib << (failed ? " failed" : " finished") << " at step " << _r.sim.get_nstep() << std::endl;
+  std::fflush(stdout);
+  return failed ? 1 : 0;
+}
+#endif
+
+
+int run_branches(const json& _base, const int _nsteps, const json& _branches, const int _nconcurrent) {
+
+#ifdef _WIN32
+  std::cout << "Branching needs fork(), which is not available on this platform" << std::endl;
+  return -1;
+#else
+  if (not _branches.is_array() or _branches.empty()) {
+    std::cout << "Branch file must contain a non-empty array of patches" << std::endl;
+    return -1;
+  }
+  const size_t nbranch = _branches.size();
+
+  // split the cores among the concurrent branches
+  int ncores = (int)std::thread::hardware_concurrency();
+#ifdef _OPENMP
+  ncores = omp_get_max_threads();
+#endif
+  const int nconcurrent = std::max(1, std::min((int)nbranch, (_nconcurrent > 0) ? _nconcurrent : ncores));
+  int nthreads = std::max(1, ncores / nconcurrent);
+  if (one_thread_after_fork and nthreads > 1) {
+    std::cout << "This OpenMP runtime cannot start threads after fork(), so branches will use one thread each" << std::endl;
+    nthreads = 1;
+  }
+
+  // set up and spin up the base case exactly as the batch driver would
+  BranchRun r;
+  parse_json(r.sim, r.ffeatures, r.bfeatures, r.mfeatures, r.rparams, _base);
+
+  add_init_elements(r.sim, r.ffeatures, r.bfeatures, r.mfeatures, r.rparams);
+  r.sim.set_initialized();
+
+  const std::string err = r.sim.check_initialization();
+  if (not err.empty()) {
+    std::cout << std::endl << "ERROR: " << err;
+    return -1;
+  }
+
+  std::cout << std::endl << "Running base case for " << _nsteps << " steps" << std::endl;
+  auto start = std::chrono::system_clock::now();
+  bool failed = false;
+  for (int istep=0; istep<_nsteps; ++istep) {
+    if (not advance_run(r, failed)) break;
+  }
+  if (failed) return -1;
+
+  std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - start;
+  printf("\nspin-up time:\t[%.4f] seconds for %ld steps\n", (float)elapsed_seconds.count(), r.sim.get_nstep());
+
+  // nothing may be open or buffered twice across the fork
+  r.sim.close_streams();
+
+  std::cout << std::endl << "Branching into " << nbranch << " runs, " << nconcurrent << " at a time with "
+            << nthreads << " threads each" << std::endl;
+  start = std::chrono::system_clock::now();
+
+  std::map<pid_t,size_t> running;
+  int nfailed = 0;
+
+  // wait for one child and count it
+  auto reap = [&]() {
+    int status = 0;
+    const pid_t pid = waitpid(-1, &status, 0);
+    if (pid <= 0) {
+      // no children left to wait for
+      running.clear();
+      return;
+    }
+    const bool ok = WIFEXITED(status) and WEXITSTATUS(status) == 0;
+    if (not ok) nfailed++;
+    std::cout << "  branch " << running[pid] << (ok ? " finished" : " failed") << std::endl;
+    running.erase(pid);
+  };
+
+  for (size_t ib=0; ib<nbranch; ++ib) {
+    while (running.size() >= (size_t)nconcurrent) reap();
+
+    std::cout.flush();
+    std::fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0) {
+      std::cout << "  ERROR: could not fork branch " << ib << std::endl;
+      nfailed++;
+    } else if (pid == 0) {
+      // skip the parent's destructors and exit handlers
+      _exit(run_child(r, ib, _branches[ib], nthreads));
+    } else {
+      running[pid] = ib;
+      std::cout << "  branch " << ib << " running as process " << pid << ", output in " << branch_dir_name(ib) << std::endl;
+    }
+  }
+  while (not running.empty()) reap();
+
+  elapsed_seconds = std::chrono::system_clock::now() - start;
+  printf("\nbranch time:\t[%.4f] seconds for %ld branches, %d failed\n", (float)elapsed_seconds.count(), nbranch, nfailed);
+
+  r.sim.reset();
+  return nfailed;
+#endif
+}
@@ -0,0 +1,35 @@
+/*
+ * Fork.h - Branch a running simulation into several child runs
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "json/json.hpp"
+
+class Simulation;
+
+//
+// Change the parameters of a running simulation: the "simparams" and "flowparams" entries
+//   of the patch are merged (RFC 7386) over the current values and read back in. Elements,
+//   time and step count are untouched. Other entries are reported and ignored.
+//
+void apply_branch_patch(Simulation& _sim, const nlohmann::json& _patch);
+
+//
+// True when a child of fork() must run on one thread, as with GNU OpenMP
+//
+bool forked_children_are_serial();
+
+//
+// Run the base case for _nsteps steps, then fork() one child process per entry of the
+//   branches array. Each child shares the parent's memory copy-on-write, so the branch
+//   point costs no copying; it applies its patch, moves into its own directory
+//   (branch00, branch01, ...) and runs to its stopping condition.
+//
+// Returns the number of branches that ended in error, or -1 if none could be started
+//
+int run_branches(const nlohmann::json& _base, const int _nsteps,
+                 const nlohmann::json& _branches, const int _nconcurrent);
@@ -0,0 +1,403 @@
+/*
+ * Hdf5Helper.h - Write a whole run's time series to one HDF5 file with an XDMF index
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "Points.h"
+#include "Surfaces.h"
+
+#ifdef USE_HDF5
+#include "hdf5.h"
+#endif
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+
+
+//
+// Every output frame is a group in the one file, and every collection in that frame is a
+//   subgroup holding one dataset per scalar component, exactly as the arrays sit in memory:
+//
+//   /frame_00010/               attributes: time, step
+//   /frame_00010/vort_00/x, y, z, sx, sy, sz, r, u, v, w, feature
+//   /frame_00010/fldpt_00/x, y, z, u, v, w
+//   /frame_00010/bdry_00/x, y, z, conn, gx, gy, gz, [src], [p], [tx, ty, tz]
+//
+// All datasets are chunked and compressed, so a reader can pull any range of rows of any
+//   one array (with a hyperslab selection) without touching the rest of the frame.
+// The XDMF file beside it gets each frame appended in place of its closing tags, which
+//   are then written again, so ParaView can open the run at any time without the index
+//   ever being rewritten; vectors are re-assembled there from their components with JOIN.
+//
+class Hdf5Series {
+public:
+  Hdf5Series() = default;
+  ~Hdf5Series() { close(); }
+  Hdf5Series(const Hdf5Series&) = delete;
+  Hdf5Series& operator=(const Hdf5Series&) = delete;
+
+  void set_file_name(const std::string _fn) { close(); fname = _fn; }
+  const std::string& get_file_name() const { return fname; }
+  bool is_active() const { return not fname.empty(); }
+
+  // add one frame to the file, return false if it could not be written
+  template <class S>
+  bool write_frame(std::vector<Collection> const&, std::vector<Collection> const&,
+                   std::vector<Collection> const&, const size_t, const double);
+
+  // finish the file, the next frame starts a new one
+  void close() {
+#ifdef USE_HDF5
+    if (fid >= 0) H5Fclose(fid);
+    fid = -1;
+#endif
+    xdmf_tail = -1;
+  }
+
+private:
+  std::string fname;
+  std::streamoff xdmf_tail = -1;	// where the closing tags of the xdmf index start
+
+  // name of the xdmf index that goes with the data file
+  std::string xdmf_name() const {
+    const size_t dot = fname.find_last_of('.');
+    return ((dot == std::string::npos) ? fname : fname.substr(0, dot)) + ".xmf";
+  }
+
+  // the data file as seen from the xdmf file (which sits in the same directory)
+  std::string local_name() const {
+    const size_t slash = fname.find_last_of("/\\");
+    return (slash == std::string::npos) ? fname : fname.substr(slash+1);
+  }
+
+  void append_xdmf(const std::string&);
+
+#ifdef USE_HDF5
+  hid_t fid = -1;
+
+  template <class T> static hid_t h5type();
+  template <class T> static const char* xdmf_type();
+
+  template <class T>
+  void write_dataset(const hid_t, const std::string&, const T*, const size_t, const size_t = 1);
+
+  template <class S>
+  void write_points(const hid_t, const std::string&, const std::string&, Points<S> const&, std::ostringstream&);
+  template <class S>
+  void write_panels(const hid_t, const std::string&, const std::string&, Surfaces<S> const&, std::ostringstream&);
+
+  // xdmf pieces
+  static std::string xdmf_item(const std::string&, const std::string&, const size_t, const char*, const size_t = 1);
+  static std::string xdmf_vector(const std::string&, const std::string&, const std::string&, const size_t,
+                                 const char*, const std::array<const char*,3>);
+  static std::string xdmf_scalar(const std::string&, const std::string&, const std::string&, const size_t,
+                                 const char*, const char*);
+#endif
+};
+
+
+#ifdef USE_HDF5
+
+template <> inline hid_t Hdf5Series::h5type<float>()    { return H5T_NATIVE_FLOAT; }
+template <> inline hid_t Hdf5Series::h5type<double>()   { return H5T_NATIVE_DOUBLE; }
+template <> inline hid_t Hdf5Series::h5type<int32_t>()  { return H5T_NATIVE_INT32; }
+template <> inline hid_t Hdf5Series::h5type<uint32_t>() { return H5T_NATIVE_UINT32; }
+
+template <> inline const char* Hdf5Series::xdmf_type<float>()    { return "NumberType=\"Float\" Precision=\"4\""; }
+template <> inline const char* Hdf5Series::xdmf_type<double>()   { return "NumberType=\"Float\" Precision=\"8\""; }
+template <> inline const char* Hdf5Series::xdmf_type<int32_t>()  { return "NumberType=\"Int\" Precision=\"4\""; }
+template <> inline const char* Hdf5Series::xdmf_type<uint32_t>() { return "NumberType=\"UInt\" Precision=\"4\""; }
+
+//
+// write one n-by-ncomp array as a chunked, shuffled, and deflated dataset
+//
+template <class T>
+void Hdf5Series::write_dataset(const hid_t _gid, const std::string& _name, const T* _data,
+                               const size_t _n, const size_t _ncomp) {
+
+  const hsize_t dims[2] = {(hsize_t)_n, (hsize_t)_ncomp};
+  // 64k rows per chunk is large enough to compress well and small enough for partial reads
+  const hsize_t chunk[2] = {(hsize_t)std::min(_n, (size_t)65536), (hsize_t)_ncomp};
+  const int rank = (_ncomp == 1) ? 1 : 2;
+
+  const hid_t space = H5Screate_simple(rank, dims, nullptr);
+  const hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(plist, rank, chunk);
+  H5Pset_shuffle(plist);
+  H5Pset_deflate(plist, 4);
+
+  const hid_t dset = H5Dcreate2(_gid, _name.c_str(), h5type<T>(), space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Dwrite(dset, h5type<T>(), H5S_ALL, H5S_ALL, H5P_DEFAULT, _data);
+
+  H5Dclose(dset);
+  H5Pclose(plist);
+  H5Sclose(space);
+}
+
+inline std::string Hdf5Series::xdmf_item(const std::string& _file, const std::string& _path,
+                                         const size_t _n, const char* _type, const size_t _ncomp) {
+  std::ostringstream os;
+  os << "<DataItem Dimensions=\"" << _n;
+  if (_ncomp > 1) os << " " << _ncomp;
+  os << "\" " << _type << " Format=\"HDF\">" << _file << ":" << _path << "</DataItem>";
+  return os.str();
+}
+
+inline std::string Hdf5Series::xdmf_vector(const std::string& _file, const std::string& _grp,
+                                           const std::string& _name, const size_t _n, const char* _center,
+                                           const std::array<const char*,3> _comps) {
+  std::ostringstream os;
+  os << "      <Attribute Name=\"" << _name << "\" AttributeType=\"Vector\" Center=\"" << _center << "\">\n"
+     << "       <DataItem ItemType=\"Function\" Function=\"JOIN($0, $1, $2)\" Dimensions=\"" << _n << " 3\">\n";
+  for (size_t d=0; d<3; ++d) {
+    os << "        " << xdmf_item(_file, _grp + "/" + _comps[d], _n, xdmf_type<float>()) << "\n";
+  }
+  os << "       </DataItem>\n      </Attribute>\n";
+  return os.str();
+}
+
+inline std::string Hdf5Series::xdmf_scalar(const std::string& _file, const std::string& _grp,
+                                           const std::string& _name, const size_t _n, const char* _center,
+                                           const char* _dset) {
+  std::ostringstream os;
+  os << "      <Attribute Name=\"" << _name << "\" AttributeType=\"Scalar\" Center=\"" << _center << "\">\n"
+     << "       " << xdmf_item(_file, _grp + "/" + _dset, _n, xdmf_type<float>()) << "\n"
+     << "      </Attribute>\n";
+  return os.str();
+}
+
+//
+// particles or field points
+//
+template <class S>
+void Hdf5Series::write_points(const hid_t _fgid, const std::string& _fgname, const std::string& _name,
+                              Points<S> const& _pts, std::ostringstream& _xml) {
+
+  const size_t n = _pts.get_n();
+  const std::string grp = _fgname + "/" + _name;
+  const hid_t gid = H5Gcreate2(_fgid, _name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  const std::string file = local_name();
+
+  write_dataset(gid, "x", _pts.get_pos()[0].data(), n);
+  write_dataset(gid, "y", _pts.get_pos()[1].data(), n);
+  write_dataset(gid, "z", _pts.get_pos()[2].data(), n);
+  write_dataset(gid, "u", _pts.get_vel()[0].data(), n);
+  write_dataset(gid, "v", _pts.get_vel()[1].data(), n);
+  write_dataset(gid, "w", _pts.get_vel()[2].data(), n);
+
+  _xml << "     <Grid Name=\"" << _name << "\" GridType=\"Uniform\">\n"
+       << "      <Topology TopologyType=\"Polyvertex\" NumberOfElements=\"" << n << "\"/>\n"
+       << "      <Geometry GeometryType=\"X_Y_Z\">\n";
+  for (const char* c : {"x", "y", "z"}) {
+    _xml << "       " << xdmf_item(file, grp + "/" + c, n, xdmf_type<S>()) << "\n";
+  }
+  _xml << "      </Geometry>\n";
+  _xml << xdmf_vector(file, grp, "velocity", n, "Node", {"u", "v", "w"});
+
+  if (not _pts.is_inert()) {
+    write_dataset(gid, "sx", _pts.get_str()[0].data(), n);
+    write_dataset(gid, "sy", _pts.get_str()[1].data(), n);
+    write_dataset(gid, "sz", _pts.get_str()[2].data(), n);
+    write_dataset(gid, "r", _pts.get_rad().data(), n);
+    _xml << xdmf_vector(file, grp, "circulation", n, "Node", {"sx", "sy", "sz"});
+    _xml << xdmf_scalar(file, grp, "radius", n, "Node", "r");
+
+    if (_pts.get_tag().size() == n) {
+      write_dataset(gid, "feature", _pts.get_tag().data(), n);
+      _xml << "      <Attribute Name=\"feature\" AttributeType=\"Scalar\" Center=\"Node\">\n"
+           << "       " << xdmf_item(file, grp + "/feature", n, xdmf_type<int32_t>()) << "\n"
+           << "      </Attribute>\n";
+    }
+  }
+
+  _xml << "     </Grid>\n";
+  H5Gclose(gid);
+}
+
+//
+// triangular panels
+//
+template <class S>
+void Hdf5Series::write_panels(const hid_t _fgid, const std::string& _fgname, const std::string& _name,
+                              Surfaces<S> const& _surf, std::ostringstream& _xml) {
+
+  const size_t nn = _surf.get_n();
+  const size_t np = _surf.get_npanels();
+  const std::string grp = _fgname + "/" + _name;
+  const hid_t gid = H5Gcreate2(_fgid, _name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  const std::string file = local_name();
+
+  write_dataset(gid, "x", _surf.get_pos()[0].data(), nn);
+  write_dataset(gid, "y", _surf.get_pos()[1].data(), nn);
+  write_dataset(gid, "z", _surf.get_pos()[2].data(), nn);
+  write_dataset(gid, "conn", _surf.get_idx().data(), np, 3);
+
+  _xml << "     <Grid Name=\"" << _name << "\" GridType=\"Uniform\">\n"
+       << "      <Topology TopologyType=\"Triangle\" NumberOfElements=\"" << np << "\">\n"
+       << "       " << xdmf_item(file, grp + "/conn", np, xdmf_type<Int>(), 3) << "\n"
+       << "      </Topology>\n"
+       << "      <Geometry GeometryType=\"X_Y_Z\">\n";
+  for (const char* c : {"x", "y", "z"}) {
+    _xml << "       " << xdmf_item(file, grp + "/" + c, nn, xdmf_type<S>()) << "\n";
+  }
+  _xml << "      </Geometry>\n";
+
+  if (not _surf.is_inert()) {
+    // same vortex sheet strength as in the vtu files
+    std::array<Vector<S>,3> str;
+    Vector<S>              const & vs1 = _surf.get_vort1_str();
+    Vector<S>              const & vs2 = _surf.get_vort2_str();
+    std::array<Vector<S>,3> const & x1 = _surf.get_x1();
+    std::array<Vector<S>,3> const & x2 = _surf.get_x2();
+    for (size_t d=0; d<Dimensions; ++d) {
+      str[d].resize(np);
+      for (size_t i=0; i<np; ++i) str[d][i] = vs1[i]*x1[d][i] + vs2[i]*x2[d][i];
+    }
+    write_dataset(gid, "gx", str[0].data(), np);
+    write_dataset(gid, "gy", str[1].data(), np);
+    write_dataset(gid, "gz", str[2].data(), np);
+    _xml << xdmf_vector(file, grp, "vortex sheet strength", np, "Cell", {"gx", "gy", "gz"});
+
+    if (_surf.have_src_str()) {
+      write_dataset(gid, "src", _surf.get_src_str().data(), np);
+      _xml << xdmf_scalar(file, grp, "source sheet strength", np, "Cell", "src");
+    }
+
+    if (_surf.have_loads()) {
+      write_dataset(gid, "p", _surf.get_pressure().data(), np);
+      write_dataset(gid, "tx", _surf.get_shear()[0].data(), np);
+      write_dataset(gid, "ty", _surf.get_shear()[1].data(), np);
+      write_dataset(gid, "tz", _surf.get_shear()[2].data(), np);
+      _xml << xdmf_scalar(file, grp, "pressure", np, "Cell", "p");
+      _xml << xdmf_vector(file, grp, "wall shear stress", np, "Cell", {"tx", "ty", "tz"});
+    }
+  }
+
+  _xml << "     </Grid>\n";
+  H5Gclose(gid);
+}
+
+#endif
+
+//
+// write all collections at the current time as one new frame
+//
+template <class S>
+bool Hdf5Series::write_frame(std::vector<Collection> const& _vort,
+                             std::vector<Collection> const& _fldpt,
+                             std::vector<Collection> const& _bdry,
+                             const size_t _step, const double _time) {
+
+#ifdef USE_HDF5
+  auto start = std::chrono::system_clock::now();
+
+  if (fid < 0) {
+    fid = H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (fid < 0) {
+      std::cout << "  could not create " << fname << std::endl;
+      return false;
+    }
+    xdmf_tail = -1;
+  }
+
+  // one group per frame, a repeated step number replaces nothing and is skipped
+  std::ostringstream fgs;
+  fgs << "frame_" << std::setfill('0') << std::setw(5) << _step;
+  const std::string fgname = "/" + fgs.str();
+  if (H5Lexists(fid, fgname.c_str(), H5P_DEFAULT) > 0) return true;
+  const hid_t fgid = H5Gcreate2(fid, fgname.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+
+  // frame time and step as attributes
+  {
+    const hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attr = H5Acreate2(fgid, "time", H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr, H5T_NATIVE_DOUBLE, &_time);
+    H5Aclose(attr);
+    const uint64_t step = _step;
+    attr = H5Acreate2(fgid, "step", H5T_NATIVE_UINT64, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr, H5T_NATIVE_UINT64, &step);
+    H5Aclose(attr);
+    H5Sclose(space);
+  }
+
+  std::ostringstream xml;
+  xml << "    <Grid Name=\"" << fgs.str() << "\" GridType=\"Collection\" CollectionType=\"Spatial\">\n"
+      << "     <Time Value=\"" << std::setprecision(12) << _time << "\"/>\n";
+
+  // same order and numbering as the vtu files
+  auto write_set = [&](std::vector<Collection> const& _set, const char* _prefix) {
+    size_t idx = 0;
+    for (auto &elem : _set) {
+      std::ostringstream name;
+      name << _prefix << std::setfill('0') << std::setw(2) << idx;
+      if (std::holds_alternative<Points<S>>(elem)) {
+        Points<S> const & pts = std::get<Points<S>>(elem);
+        if (pts.get_n() > 0) { write_points(fgid, fgname, name.str(), pts, xml); idx++; }
+      } else if (std::holds_alternative<Surfaces<S>>(elem)) {
+        Surfaces<S> const & surf = std::get<Surfaces<S>>(elem);
+        if (surf.get_npanels() > 0) { write_panels(fgid, fgname, name.str(), surf, xml); idx++; }
+      }
+    }
+  };
+  write_set(_vort, "vort_");
+  write_set(_fldpt, "fldpt_");
+  write_set(_bdry, "bdry_");
+
+  xml << "    </Grid>\n";
+  H5Gclose(fgid);
+
+  // make the frame visible to readers right away
+  H5Fflush(fid, H5F_SCOPE_GLOBAL);
+  append_xdmf(xml.str());
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  printf("    hdf5 frame:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+  std::cout << "Wrote frame " << _step << " to " << fname << std::endl;
+  return true;
+
+#else
+  static bool warned = false;
+  if (not warned) std::cout << "  HDF5 output was not compiled in (USE_HDF5), writing vtu files instead" << std::endl;
+  warned = true;
+  return false;
+#endif
+}
+
+//
+// add one frame's description to the xdmf index, overwriting only its closing tags
+//
+inline void Hdf5Series::append_xdmf(const std::string& _frame) {
+  std::fstream os;
+  if (xdmf_tail < 0) {
+    os.open(xdmf_name(), std::ios::out | std::ios::trunc);
+    os << "<?xml version=\"1.0\" ?>\n"
+       << "<Xdmf Version=\"3.0\">\n"
+       << " <Domain>\n"
+       << "  <Grid Name=\"Omega3D\" GridType=\"Collection\" CollectionType=\"Temporal\">\n";
+  } else {
+    os.open(xdmf_name(), std::ios::in | std::ios::out);
+    os.seekp(xdmf_tail);
+  }
+  // the new frame is always longer than the tags it replaces, so nothing is left behind
+  os << _frame;
+  xdmf_tail = os.tellp();
+  os << "  </Grid>\n"
+     << " </Domain>\n"
+     << "</Xdmf>\n";
+}
@@ -15,6 +15,7 @@
 #include "Points.h"
 #include "Surfaces.h"
 #include "ExecEnv.h"
+#include "LoadBalance.h"
 
 #ifdef EXTERNAL_VEL_SOLVE
 extern "C" float external_vel_solver_f_(int*, const float*, const float*, const float*,
@@ -57,10 +58,16 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
   auto start = std::chrono::system_clock::now();
   float flops = (float)targ.get_n();
 
+  // sum over only the particles strong enough to matter, if the collection has listed them
+  std::array<Vector<S>,Dimensions> asx, ass;
+  Vector<S> asr;
+  const bool dropped = src.get_active_sources(asx, asr, ass);
+  const size_t nsrc = dropped ? asr.size() : src.get_n();
+
   // get references to use locally
-  const std::array<Vector<S>,Dimensions>&     sx = src.get_pos();
-  const Vector<S>&                            sr = src.get_rad();
-  const std::array<Vector<S>,Dimensions>&     ss = src.get_str();
+  const std::array<Vector<S>,Dimensions>&     sx = dropped ? asx : src.get_pos();
+  const Vector<S>&                            sr = dropped ? asr : src.get_rad();
+  const std::array<Vector<S>,Dimensions>&     ss = dropped ? ass : src.get_str();
 
   const std::array<Vector<S>,Dimensions>&     tx = targ.get_pos();
   std::array<Vector<S>,Dimensions>&           tu = targ.get_vel();
@@ -74,7 +81,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
     assert(opttug && "Targets do not have velocity gradients in points_affect_points");
     if (opttug) {
       std::array<Vector<S>,9>& tug = *opttug;
-      int ns = src.get_n();
+      int ns = nsrc;
       int nt = targ.get_n();
       flops = external_vel_solver_f_(&ns, sx[0].data(), sx[1].data(), sx[2].data(),
                                           ss[0].data(), ss[1].data(), ss[2].data(), sr.data(), 
@@ -105,16 +112,16 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
 
     // fill in gcs's idea of sources
     // the positions
-    gcs->hsx.resize(4*src.get_n());
-    for (size_t i=0; i<src.get_n(); ++i) {
+    gcs->hsx.resize(4*nsrc);
+    for (size_t i=0; i<nsrc; ++i) {
       gcs->hsx[4*i+0] = sx[0][i];
       gcs->hsx[4*i+1] = sx[1][i];
       gcs->hsx[4*i+2] = sx[2][i];
       gcs->hsx[4*i+3] = sr[i];
     }
     // the strengths
-    gcs->hss.resize(4*src.get_n());
-    for (size_t i=0; i<src.get_n(); ++i) {
+    gcs->hss.resize(4*nsrc);
+    for (size_t i=0; i<nsrc; ++i) {
       gcs->hss[4*i+0] = ss[0][i];
       gcs->hss[4*i+1] = ss[1][i];
       gcs->hss[4*i+2] = ss[2][i];
@@ -171,7 +178,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
 
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double> elapsed_seconds = end-start;
-    float flops = (float)targ.get_n() * (12.0 + (float)flops_0v_0bg<S>()*(float)src.get_n());
+    float flops = (float)targ.get_n() * (12.0 + (float)flops_0v_0bg<S>()*(float)nsrc);
     const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
     printf("    ptptvelgrad shader: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
 
@@ -262,7 +269,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
         A accumuy = 0.0; A accumvy = 0.0; A accumwy = 0.0;
         A accumuz = 0.0; A accumvz = 0.0; A accumwz = 0.0;
         // loop over source particles
-        for (size_t j=0; j<src.get_n(); ++j) {
+        for (size_t j=0; j<nsrc; ++j) {
           kernel_0v_0pg<S,A>(sx[0][j], sx[1][j], sx[2][j], sr[j],
                              ss[0][j], ss[1][j], ss[2][j],
                              tx[0][i], tx[1][i], tx[2][i],
@@ -285,7 +292,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
         tug[8][i] += accumwz;
       }
     }
-    flops *= 12.0 + (float)flops_0v_0pg<S>() * (float)src.get_n();
+    flops *= 12.0 + (float)flops_0v_0pg<S>() * (float)nsrc;
 
   } else {
 
@@ -330,7 +337,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
       #pragma omp parallel for
       for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
         A accumu = 0.0; A accumv = 0.0; A accumw = 0.0;
-        for (size_t j=0; j<src.get_n(); ++j) {
+        for (size_t j=0; j<nsrc; ++j) {
           kernel_0v_0p<S,A>(sx[0][j], sx[1][j], sx[2][j], sr[j],
                             ss[0][j], ss[1][j], ss[2][j],
                             tx[0][i], tx[1][i], tx[2][i],
@@ -341,7 +348,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
         tu[2][i] += accumw;
       }
     }
-    flops *= 3.0 + (float)flops_0v_0p<S>() * (float)src.get_n();
+    flops *= 3.0 + (float)flops_0v_0p<S>() * (float)nsrc;
   }
 
   //
@@ -421,7 +428,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
         A accumuy = 0.0; A accumvy = 0.0; A accumwy = 0.0;
         A accumuz = 0.0; A accumvz = 0.0; A accumwz = 0.0;
         // loop over source particles
-        for (size_t j=0; j<src.get_n(); ++j) {
+        for (size_t j=0; j<nsrc; ++j) {
           kernel_0v_0bg<S,A>(sx[0][j], sx[1][j], sx[2][j], sr[j],
                             ss[0][j], ss[1][j], ss[2][j],
                             tx[0][i], tx[1][i], tx[2][i], tr[i],
@@ -444,7 +451,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
         tug[8][i] += accumwz;
       }
     }
-    flops *= 12.0 + (float)flops_0v_0bg<S>() * (float)src.get_n();
+    flops *= 12.0 + (float)flops_0v_0bg<S>() * (float)nsrc;
 
   } else {
     // velocity-only kernel
@@ -490,7 +497,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
       #pragma omp parallel for
       for (int32_t i=0; i<(int32_t)targ.get_n(); ++i) {
         A accumu = 0.0; A accumv = 0.0; A accumw = 0.0;
-        for (size_t j=0; j<src.get_n(); ++j) {
+        for (size_t j=0; j<nsrc; ++j) {
           kernel_0v_0b<S,A>(sx[0][j], sx[1][j], sx[2][j], sr[j],
                            ss[0][j], ss[1][j], ss[2][j],
                            tx[0][i], tx[1][i], tx[2][i], tr[i],
@@ -501,7 +508,7 @@ void points_affect_points (Points<S> const& src, Points<S>& targ, ExecEnv& env)
         tu[2][i] += accumw;
       }
     }
-    flops *= 3.0 + (float)flops_0v_0b<S>() * (float)src.get_n();
+    flops *= 3.0 + (float)flops_0v_0b<S>() * (float)nsrc;
   }
 
   //
@@ -549,6 +556,15 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
   }
 #endif  // no external fast solve, perform calculations below
 
+  // targets near the panels cost up to 4^RECURSIVE_LEVELS times more, so do those first
+  //   and hand out the rest a few at a time
+  float costratio = 1.0;
+  const std::vector<int32_t> order = order_targets_by_cost<S>(src, tx, ntarg, RECURSIVE_LEVELS, &costratio);
+#ifdef _OPENMP
+  const int32_t chunk = dynamic_chunk_size(ntarg);
+#endif
+  ThreadBusy busy;
+
 #ifdef USE_VC
   // define vector types for Vc (still only S==A supported here)
   typedef Vc::Vector<S> StoreVec;
@@ -626,8 +642,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       #ifdef USE_VC
       if (env.get_instrs() == cpu_vc) {
 
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           const StoreVec txv(tx[0][i]);
           const StoreVec tyv(tx[1][i]);
           const StoreVec tzv(tx[2][i]);
@@ -684,8 +702,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       #endif // Vc
 
       {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           A accumu = 0.0; A accumv = 0.0; A accumw = 0.0;
           A accumux = 0.0; A accumvx = 0.0; A accumwx = 0.0;
           A accumuy = 0.0; A accumvy = 0.0; A accumwy = 0.0;
@@ -749,8 +769,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       #ifdef USE_VC
       if (env.get_instrs() == cpu_vc) {
 
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           const StoreVec txv(tx[0][i]);
           const StoreVec tyv(tx[1][i]);
           const StoreVec tzv(tx[2][i]);
@@ -790,8 +812,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       } else
       #endif  // Vc
       {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           A accumu = 0.0; A accumv = 0.0; A accumw = 0.0;
           if (havess) {
             for (size_t j=0; j<src.get_npanels(); ++j) {
@@ -849,8 +873,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       #ifdef USE_VC
       if (env.get_instrs() == cpu_vc) {
 
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           const StoreVec txv(tx[0][i]);
           const StoreVec tyv(tx[1][i]);
           const StoreVec tzv(tx[2][i]);
@@ -909,8 +935,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       } else
       #endif  // Vc
       {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           A accumu = 0.0; A accumv = 0.0; A accumw = 0.0;
           A accumux = 0.0; A accumvx = 0.0; A accumwx = 0.0;
           A accumuy = 0.0; A accumvy = 0.0; A accumwy = 0.0;
@@ -975,8 +1003,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       #ifdef USE_VC
       if (env.get_instrs() == cpu_vc) {
 
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           const StoreVec txv(tx[0][i]);
           const StoreVec tyv(tx[1][i]);
           const StoreVec tzv(tx[2][i]);
@@ -1017,8 +1047,10 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
       } else
       #endif  // Vc
       {
-        #pragma omp parallel for
-        for (int32_t i=0; i<(int32_t)ntarg; ++i) {
+        #pragma omp parallel for schedule(dynamic,chunk)
+        for (int32_t ii=0; ii<ntarg; ++ii) {
+          const int32_t i = order[ii];
+          const ThreadBusy::Scope timer(busy);
           A accumu = 0.0; A accumv = 0.0; A accumw = 0.0;
           if (havess) {
             for (size_t j=0; j<src.get_npanels(); ++j) {
@@ -1060,6 +1092,8 @@ void panels_affect_points (Surfaces<S> const& src, Points<S>& targ, ExecEnv& env
   std::chrono::duration<double> elapsed_seconds = end-start;
   const float gflops = 1.e-9 * flops / (float)elapsed_seconds.count();
   printf("    panels_affect_points: [%.4f] seconds at %.3f GFlop/s\n", (float)elapsed_seconds.count(), gflops);
+  std::cout << "    most/least costly target ratio " << costratio << std::endl;
+  busy.report("panels_affect_points");
 }
 
 
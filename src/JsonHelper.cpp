@@ -75,6 +75,21 @@ void parse_json(Simulation& sim,
       sim.set_status_file_name(sfile);
       std::cout << "  status file name= " << sfile << std::endl;
     }
+    if (params.find("seriesFile") != params.end()) {
+      std::string hfile = params["seriesFile"];
+      sim.set_series_file_name(hfile);
+      std::cout << "  time series file name= " << hfile << std::endl;
+    }
+    if (params.find("shmFeed") != params.end()) {
+      std::string feedname = params["shmFeed"];
+      sim.set_shm_feed_name(feedname);
+      std::cout << "  shared memory feed name= " << feedname << std::endl;
+    }
+    if (params.find("vtuBits") != params.end()) {
+      int bits = params["vtuBits"];
+      sim.set_vtu_bits(bits);
+      std::cout << "  quantize particle output to bits= " << sim.get_vtu_bits() << std::endl;
+    }
     if (params.find("autoStart") != params.end()) {
       bool autostart = params["autoStart"];
       sim.set_auto_start(autostart);
@@ -241,7 +256,18 @@ void write_json(Simulation& sim,
 
   const std::string sfile = sim.get_status_file_name();
   if (not sfile.empty()) {
-    j["runtime"] = { {"statusFile", sfile} };
+    j["runtime"]["statusFile"] = sfile;
+  }
+  const std::string hfile = sim.get_series_file_name();
+  if (not hfile.empty()) {
+    j["runtime"]["seriesFile"] = hfile;
+  }
+  const std::string feedname = sim.get_shm_feed_name();
+  if (not feedname.empty()) {
+    j["runtime"]["shmFeed"] = feedname;
+  }
+  if (sim.get_vtu_bits() > 0) {
+    j["runtime"]["vtuBits"] = sim.get_vtu_bits();
   }
 
   j["flowparams"] = sim.flow_to_json();
@@ -300,3 +326,98 @@ void write_json(Simulation& sim,
   json_out << std::setw(2) << j << std::endl;
 }
 
+
+//
+// the batch driver's feature handling, shared by every driver that runs without the GUI
+//
+void add_init_elements(Simulation& sim,
+                       std::vector<std::unique_ptr<FlowFeature>>& ffeatures,
+                       std::vector<std::unique_ptr<BoundaryFeature>>& bfeatures,
+                       std::vector<std::unique_ptr<MeasureFeature>>& mfeatures,
+                       const RenderParams& rparams) {
+
+  // initialize particle distributions
+  for (auto const& ff: ffeatures) {
+    if (ff->is_enabled()) {
+      sim.add_elements( ff->init_elements(sim.get_ips()), active, lagrangian, ff->get_body(), ff->to_string() );
+    }
+  }
+
+  // initialize solid objects
+  for (auto const& bf : bfeatures) {
+    if (bf->is_enabled()) {
+      const move_t newmovetype = (bf->get_body() ? bodybound : fixed);
+      sim.add_elements( bf->init_elements(sim.get_ips()), reactive, newmovetype, bf->get_body() );
+    }
+  }
+  add_outflow_regions(sim, bfeatures);
+
+  // initialize measurement features
+  for (auto const& mf: mfeatures) {
+    if (mf->is_enabled()) {
+      const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
+      sim.add_elements( mf->init_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body(), mf->to_string(),
+                        mf->get_max_age(), mf->get_max_count() );
+    }
+  }
+}
+
+//
+// outflow boundaries act on the simulation itself, so rebuild its regions from whichever
+//   of them are enabled now
+//
+void add_outflow_regions(Simulation& sim,
+                         const std::vector<std::unique_ptr<BoundaryFeature>>& bfeatures) {
+  sim.get_outflow().clear();
+  for (auto const& bf : bfeatures) {
+    const OutflowPlane* of = dynamic_cast<const OutflowPlane*>(bf.get());
+    if (of and of->is_enabled()) of->add_to(sim);
+  }
+}
+
+void add_step_elements(Simulation& sim,
+                       std::vector<std::unique_ptr<FlowFeature>>& ffeatures,
+                       std::vector<std::unique_ptr<MeasureFeature>>& mfeatures,
+                       const RenderParams& rparams) {
+
+  // generate new particles from emitters
+  for (auto const& ff: ffeatures) {
+    if (ff->is_enabled()) {
+      sim.add_elements( ff->step_elements(sim.get_ips()), active, lagrangian, ff->get_body(), ff->to_string() );
+    }
+  }
+
+  // and new tracers and measurement points
+  for (auto const& mf: mfeatures) {
+    if (mf->is_enabled()) {
+      const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
+      sim.add_elements( mf->step_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body(), mf->to_string(),
+                        mf->get_max_age(), mf->get_max_count() );
+    }
+  }
+}
+
+std::string advance_step(Simulation& sim,
+                         std::vector<std::unique_ptr<FlowFeature>>& ffeatures,
+                         std::vector<std::unique_ptr<MeasureFeature>>& mfeatures,
+                         const RenderParams& rparams,
+                         std::mutex* _feature_lock) {
+
+  // check flow for blow-up or errors
+  const std::string err = sim.check_simulation();
+  if (not err.empty()) return err;
+
+  // features keep their random number generators in statics, so callers running several
+  //   simulations at once pass a lock
+  if (_feature_lock) {
+    std::lock_guard<std::mutex> lock(*_feature_lock);
+    add_step_elements(sim, ffeatures, mfeatures, rparams);
+  } else {
+    add_step_elements(sim, ffeatures, mfeatures, rparams);
+  }
+
+  // begin a new dynamic step: convection and diffusion
+  sim.step();
+
+  return std::string();
+}
@@ -12,6 +12,7 @@
 #include "RenderParams.h"
 
 #include <string>
+#include <mutex>
 
 nlohmann::json read_json(const std::string filename);
 
@@ -28,3 +29,28 @@ void write_json(Simulation&,
                 std::vector<std::unique_ptr<MeasureFeature>>&,
                 const RenderParams&,
                 const std::string);
+
+// add every enabled feature's initial elements to the simulation, as the batch driver does
+void add_init_elements(Simulation&,
+                       std::vector<std::unique_ptr<FlowFeature>>&,
+                       std::vector<std::unique_ptr<BoundaryFeature>>&,
+                       std::vector<std::unique_ptr<MeasureFeature>>&,
+                       const RenderParams&);
+
+// give the simulation the regions of the enabled outflow boundaries, dropping any others
+void add_outflow_regions(Simulation&,
+                         const std::vector<std::unique_ptr<BoundaryFeature>>&);
+
+// add the elements that enabled flow and measurement features emit before every step
+void add_step_elements(Simulation&,
+                       std::vector<std::unique_ptr<FlowFeature>>&,
+                       std::vector<std::unique_ptr<MeasureFeature>>&,
+                       const RenderParams&);
+
+// check the simulation, emit new elements, and take one step; returns an error message
+//   (and does not step) if the simulation has gone bad, an empty string otherwise
+std::string advance_step(Simulation&,
+                         std::vector<std::unique_ptr<FlowFeature>>&,
+                         std::vector<std::unique_ptr<MeasureFeature>>&,
+                         const RenderParams&,
+                         std::mutex* _feature_lock = nullptr);
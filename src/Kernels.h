@@ -1198,6 +1198,85 @@ int rkernel_2vs_0pg (const S sx0, const S sy0, const S sz0,
 }
 
 
+// panel-panel geometric influence, allowing subpaneling
+//   accumulates g = sum w r / |r|^3 from the source triangle to the target triangle,
+//   from which the velocity of any unit vortex sheet is (s x g) and of a unit source sheet is g;
+//   swapping source and target negates g exactly, and neither area is applied here
+//   return value is flops count
+template <class S, class A>
+int rkernel_2_2pg (const S sx0, const S sy0, const S sz0,
+                   const S sx1, const S sy1, const S sz1,
+                   const S sx2, const S sy2, const S sz2,
+                   const S tx0, const S ty0, const S tz0,
+                   const S tx1, const S ty1, const S tz1,
+                   const S tx2, const S ty2, const S tz2,
+                   const S sa, const S ta, const S wgt, const int lev, const int maxlev,
+                   A* const __restrict__ tgx, A* const __restrict__ tgy, A* const __restrict__ tgz) {
+
+  // accumulate flop count
+  int flops = 0;
+
+  // compute the sizes and distance
+  const S dx = (tx0 + tx1 + tx2 - sx0 - sx1 - sx2) / S(3.0);
+  const S dy = (ty0 + ty1 + ty2 - sy0 - sy1 - sy2) / S(3.0);
+  const S dz = (tz0 + tz1 + tz2 - sz0 - sz1 - sz2) / S(3.0);
+  flops += 18;
+  const S trisize = my_sqrt<S>(sa) + my_sqrt<S>(ta);
+  const S dist = my_dist<S>(dx, dy, dz);
+  flops += 9;
+
+  // recurse or solve?
+  const bool wellseparated = my_well_sep<S>(dist, trisize);
+  flops += 1;
+  if (wellseparated or lev == maxlev) {
+
+    // only the geometric part of the influence
+    const S r2 = wgt * core_func<S>(dx*dx + dy*dy + dz*dz, S(0.0));
+    *tgx += r2 * dx;
+    *tgy += r2 * dy;
+    *tgz += r2 * dz;
+
+    flops += 12 + (int)flops_tp_nograds<S>();
+    flops *= my_simdwide<S>(dx);
+
+  } else {
+
+    // split source and target into 4 each and run 16 calls, each with 1/16 of the weight
+    const S cwgt = S(0.0625) * wgt;
+    const S sca = S(0.25) * sa;
+    const S tca = S(0.25) * ta;
+    flops += 3;
+
+    // find the 6 nodes of the source and target triangles
+    const S scx[6] = {sx0, S(0.5)*(sx0+sx1), sx1, S(0.5)*(sx0+sx2), S(0.5)*(sx1+sx2), sx2};
+    const S scy[6] = {sy0, S(0.5)*(sy0+sy1), sy1, S(0.5)*(sy0+sy2), S(0.5)*(sy1+sy2), sy2};
+    const S scz[6] = {sz0, S(0.5)*(sz0+sz1), sz1, S(0.5)*(sz0+sz2), S(0.5)*(sz1+sz2), sz2};
+    const S tcx[6] = {tx0, S(0.5)*(tx0+tx1), tx1, S(0.5)*(tx0+tx2), S(0.5)*(tx1+tx2), tx2};
+    const S tcy[6] = {ty0, S(0.5)*(ty0+ty1), ty1, S(0.5)*(ty0+ty2), S(0.5)*(ty1+ty2), ty2};
+    const S tcz[6] = {tz0, S(0.5)*(tz0+tz1), tz1, S(0.5)*(tz0+tz2), S(0.5)*(tz1+tz2), tz2};
+    flops += 36;
+    flops *= my_simdwide<S>(sx0);
+
+    // the index pointers to the child triangles
+    const int id[4][3] = {{0,1,3}, {1,2,4}, {1,4,3}, {3,4,5}};
+
+    for (int i=0; i<4; ++i) {
+      for (int j=0; j<4; ++j) {
+        flops += rkernel_2_2pg (scx[id[i][0]], scy[id[i][0]], scz[id[i][0]],
+                                scx[id[i][1]], scy[id[i][1]], scz[id[i][1]],
+                                scx[id[i][2]], scy[id[i][2]], scz[id[i][2]],
+                                tcx[id[j][0]], tcy[id[j][0]], tcz[id[j][0]],
+                                tcx[id[j][1]], tcy[id[j][1]], tcz[id[j][1]],
+                                tcx[id[j][2]], tcy[id[j][2]], tcz[id[j][2]],
+                                sca, tca, cwgt, lev+1, maxlev,
+                                tgx, tgy, tgz);
+      }
+    }
+  }
+
+  return flops;
+}
+
 // panel-panel interaction, allowing subpaneling
 //   strengths are assumed to be sheet strengths
 //   return value is flops count
@@ -0,0 +1,181 @@
+/*
+ * LoadBalance.h - Cost estimates and per-thread timing for uneven influence loops
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "Surfaces.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+
+
+//
+// Estimate how many kernel calls each target will need from a set of panels, and return the
+//   targets in order of decreasing cost
+//
+// Every panel costs one call, but a panel whose centroid is closer than 4 times its size is
+//   split into 4 and tested again, down to _maxlev levels, so a target right on the surface
+//   can cost up to 4^_maxlev calls for each of its near panels. Only the panels in the
+//   neighboring bins of a coarse grid can be that close, so this is cheap next to the real sum.
+//
+template <class S>
+std::vector<int32_t> order_targets_by_cost (Surfaces<S> const& _src,
+                                            const std::array<Vector<S>,Dimensions>& _tx,
+                                            const int32_t _ntarg, const int _maxlev,
+                                            float* _costratio = nullptr) {
+
+  std::vector<int32_t> order(_ntarg);
+  std::iota(order.begin(), order.end(), 0);
+  const size_t np = _src.get_npanels();
+
+  // with one thread, the order makes no difference
+  int32_t nthreads = 1;
+#ifdef _OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  if (np == 0 or _ntarg < 2 or nthreads < 2) return order;
+
+  const std::array<Vector<S>,Dimensions>& sx = _src.get_pos();
+  const std::vector<Int>& si = _src.get_idx();
+  const Vector<S>& sa = _src.get_area();
+
+  // panel centroids, and the largest distance at which any panel splits
+  std::array<Vector<S>,Dimensions> sc;
+  for (size_t d=0; d<Dimensions; ++d) sc[d].resize(np);
+  S cell = 0.0;
+  for (size_t j=0; j<np; ++j) {
+    for (size_t d=0; d<Dimensions; ++d) {
+      sc[d][j] = (sx[d][si[3*j]] + sx[d][si[3*j+1]] + sx[d][si[3*j+2]]) / S(3.0);
+    }
+    cell = std::max(cell, S(4.0)*std::sqrt(sa[j]));
+  }
+  if (not (cell > 0.0)) return order;
+
+  // bin the panels on a grid of that spacing
+  auto key = [cell](const S _x, const S _y, const S _z) {
+    const int64_t ix = (int64_t)std::floor(_x/cell) & 0x1fffff;
+    const int64_t iy = (int64_t)std::floor(_y/cell) & 0x1fffff;
+    const int64_t iz = (int64_t)std::floor(_z/cell) & 0x1fffff;
+    return (ix << 42) | (iy << 21) | iz;
+  };
+  std::unordered_map<int64_t,std::vector<Int>> bins;
+  for (size_t j=0; j<np; ++j) bins[key(sc[0][j], sc[1][j], sc[2][j])].push_back(j);
+
+  // extra calls at each recursion depth reached
+  std::vector<float> extra(_maxlev+1, 0.0);
+  for (int l=1; l<=_maxlev; ++l) extra[l] = extra[l-1] + std::pow(4.0f, l);
+
+  std::vector<float> cost(_ntarg);
+  #pragma omp parallel for schedule(dynamic,256)
+  for (int32_t i=0; i<_ntarg; ++i) {
+    float c = (float)np;
+    for (int dz=-1; dz<2; ++dz) {
+      for (int dy=-1; dy<2; ++dy) {
+        for (int dx=-1; dx<2; ++dx) {
+          auto it = bins.find(key(_tx[0][i]+dx*cell, _tx[1][i]+dy*cell, _tx[2][i]+dz*cell));
+          if (it == bins.end()) continue;
+          for (auto const& j : it->second) {
+            const S dx = _tx[0][i] - sc[0][j];
+            const S dy = _tx[1][i] - sc[1][j];
+            const S dz = _tx[2][i] - sc[2][j];
+            const S distsq = dx*dx + dy*dy + dz*dz;
+            // number of levels at which this panel (or its children) are too close,
+            //   each level halves the size, so quarters the (4*size)^2 = 16*area test
+            int nlev = 0;
+            S limsq = S(16.0)*sa[j];
+            while (nlev < _maxlev and not (distsq > limsq)) {
+              nlev++;
+              limsq *= S(0.25);
+            }
+            c += extra[nlev];
+          }
+        }
+      }
+    }
+    cost[i] = c;
+  }
+
+  // most expensive first, so the cheap ones fill in the gaps at the end
+  std::stable_sort(order.begin(), order.end(),
+                   [&cost](const int32_t _a, const int32_t _b) { return cost[_a] > cost[_b]; });
+
+  if (_costratio) *_costratio = cost[order.front()] / cost[order.back()];
+  return order;
+}
+
+//
+// How many targets each thread takes at once - small enough that the last few chunks are short
+//
+inline int32_t dynamic_chunk_size (const int32_t _ntarg) {
+  int32_t nthreads = 1;
+#ifdef _OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  return std::clamp(_ntarg / (32*nthreads), 1, 64);
+}
+
+
+//
+// Time spent working in each thread of a parallel loop, to see how even the split was
+//
+class ThreadBusy {
+public:
+  ThreadBusy() {
+#ifdef _OPENMP
+    busy.assign(omp_get_max_threads(), 0.0);
+#else
+    busy.assign(1, 0.0);
+#endif
+  }
+
+  void add(const double _secs) {
+#ifdef _OPENMP
+    busy[omp_get_thread_num()] += _secs;
+#else
+    busy[0] += _secs;
+#endif
+  }
+
+  // adds the time from construction to destruction to the calling thread
+  class Scope {
+  public:
+    explicit Scope(ThreadBusy& _tb) : tb(_tb), start(std::chrono::steady_clock::now()) {}
+    ~Scope() {
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      tb.add(elapsed.count());
+    }
+  private:
+    ThreadBusy& tb;
+    const std::chrono::steady_clock::time_point start;
+  };
+
+  void report(const char* _name) const {
+    if (busy.size() < 2) return;
+    const double maxb = *std::max_element(busy.begin(), busy.end());
+    const double minb = *std::min_element(busy.begin(), busy.end());
+    const double avgb = std::accumulate(busy.begin(), busy.end(), 0.0) / (double)busy.size();
+    printf("    %s busy:\t[%.4f] [%.4f] [%.4f] min/avg/max seconds over %d threads, imbalance %.2f\n",
+           _name, minb, avgb, maxb, (int)busy.size(), (avgb > 0.0) ? maxb/avgb : 1.0);
+  }
+
+private:
+  // one per thread; neighbors share cache lines, but each is only touched once per target
+  std::vector<double> busy;
+};
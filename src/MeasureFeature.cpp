@@ -99,6 +99,17 @@ bool MeasureFeature::draw_creation_gui(std::vector<std::unique_ptr<MeasureFeatur
 }
 #endif
 
+// optional limits on how long emitted tracers live
+void MeasureFeature::lifetime_from_json(const nlohmann::json& j) {
+  m_max_age = j.value("maxAge", m_max_age);
+  m_max_count = j.value("maxCount", m_max_count);
+}
+
+void MeasureFeature::lifetime_to_json(nlohmann::json& j) const {
+  if (m_max_age > 0.0) j["maxAge"] = m_max_age;
+  if (m_max_count > 0) j["maxCount"] = m_max_count;
+}
+
 float MeasureFeature::jitter(const float _z, const float _ips) const {
   // set up the random number generator
   static std::random_device rd;  //Will be used to obtain a seed for the random number engine
@@ -171,6 +182,7 @@ SinglePoint::from_json(const nlohmann::json j) {
   m_enabled = j.value("enabled", true);
   m_is_lagrangian = j.value("lagrangian", m_is_lagrangian);
   m_emits = j.value("emits", m_emits);
+  lifetime_from_json(j);
 }
 
 nlohmann::json
@@ -181,6 +193,7 @@ SinglePoint::to_json() const {
   j["enabled"] = m_enabled;
   j["lagrangian"] = m_is_lagrangian;
   j["emits"] = m_emits;
+  lifetime_to_json(j);
   return j;
 }
 
@@ -309,6 +322,7 @@ MeasurementBlob::from_json(const nlohmann::json j) {
   m_enabled = j.value("enabled", true);
   m_is_lagrangian = j.value("lagrangian", m_is_lagrangian);
   m_emits = j.value("emits", m_emits);
+  lifetime_from_json(j);
 }
 
 nlohmann::json
@@ -320,6 +334,7 @@ MeasurementBlob::to_json() const {
   j["enabled"] = m_enabled;
   j["lagrangian"] = m_is_lagrangian;
   j["emits"] = m_emits;
+  lifetime_to_json(j);
   return j;
 }
 
@@ -442,6 +457,7 @@ MeasurementLine::from_json(const nlohmann::json j) {
   m_enabled = j.value("enabled", true);
   m_is_lagrangian = j.value("lagrangian", m_is_lagrangian);
   m_emits = j.value("emits", m_emits);
+  lifetime_from_json(j);
 }
 
 nlohmann::json
@@ -454,6 +470,7 @@ MeasurementLine::to_json() const {
   j["enabled"] = m_enabled;
   j["lagrangian"] = m_is_lagrangian;
   j["emits"] = m_emits;
+  lifetime_to_json(j);
   return j;
 }
 
@@ -566,6 +583,7 @@ Grid2dPoints::from_json(const nlohmann::json j) {
   m_enabled = j.value("enabled", true);
   m_is_lagrangian = j.value("lagrangian", m_is_lagrangian);
   m_emits= j.value("emits", m_emits);
+  lifetime_from_json(j);
 }
 
 nlohmann::json
@@ -579,6 +597,7 @@ Grid2dPoints::to_json() const {
   j["enabled"] = m_enabled;
   j["lagrangian"] = m_is_lagrangian;
   j["emits"] = m_emits;
+  lifetime_to_json(j);
   return j;
 }
 
@@ -45,6 +45,9 @@ public:
   ElementPacket<float> get_draw_packet() const { return m_draw; }
   bool get_is_lagrangian() { return m_is_lagrangian; }
   std::shared_ptr<Body> get_body() { return m_bp; }
+  // emitted tracers are retired after this age or beyond this count, 0 means never
+  float get_max_age() const { return m_max_age; }
+  size_t get_max_count() const { return m_max_count; }
 
   virtual void debug(std::ostream& os) const = 0;
   virtual std::string to_string() const = 0;
@@ -66,6 +69,11 @@ protected:
   bool m_emits;
   std::shared_ptr<Body> m_bp;
   ElementPacket<float> m_draw;
+  float m_max_age = 0.0;
+  size_t m_max_count = 0;
+
+  void lifetime_from_json(const nlohmann::json&);
+  void lifetime_to_json(nlohmann::json&) const;
 };
 
 std::ostream& operator<<(std::ostream& os, MeasureFeature const& ff);
@@ -10,6 +10,8 @@
 #include "Omega3D.h"
 #include "VectorHelper.h"
 #include "nanoflann.hpp"
+#include "SearchHelper.h"
+#include "PointsTree.h"
 
 #include <Eigen/Dense>
 
@@ -19,6 +21,7 @@
 #include <cassert>
 #include <iostream>
 #include <chrono>
+#include <memory>
 #include <vector>
 #include <algorithm>
 
@@ -29,13 +32,17 @@
 //
 // templated on storage class S (typically float or double)
 //
+// if a persistent tree is given, its neighbor lists are reused from the last step
+//
 template <class S>
 size_t merge_close_particles(std::array<Vector<S>,3>& pos,
                              std::array<Vector<S>,3>& str,
                              Vector<S>&               rad,
                              const S                  particle_overlap,
                              const S                  threshold,
-                             const bool               adapt_radii) {
+                             const bool               adapt_radii,
+                             PointsTree<S>*           _tree = nullptr,
+                             Vector<int32_t>*         _tag = nullptr) {
 
   // make sure all vector sizes are identical
   assert(pos[0].size()==pos[1].size() && "Input array sizes do not match");
@@ -60,28 +67,42 @@ size_t merge_close_particles(std::array<Vector<S>,3>& pos,
   Vector<S>& sy = str[1];
   Vector<S>& sz = str[2];
 
-  // convert particle positions into something nanoflann can understand
+  // new merging needs two new thresholds
+  const S initial_thresh = 0.5;
+  const S always_thresh = 0.1;
+
+  // find the largest search radius needed below
+  S max_rad = 0.0;
+  for (size_t i=0; i<n; ++i) max_rad = std::max(max_rad, r[i]);
+  const S max_search_rad = initial_thresh * max_rad / particle_overlap;
+
+  // distances are measured to where the particles were before any merged, so keep those
+  //   positions (nanoflann searches its own copy of them)
   Eigen::Matrix<S, Eigen::Dynamic, Dimensions> xp;
   xp.resize(n,Dimensions);
   xp.col(0) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(x.data(), n);
   xp.col(1) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(y.data(), n);
   xp.col(2) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(z.data(), n);
-  
-  // generate the searchable data structure
+
   typedef typename Eigen::Matrix<S, Eigen::Dynamic, Dimensions> EigenMatType;
   typedef typename EigenMatType::Index EigenIndexType;
   typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  mat_index.index->buildIndex();
+  std::unique_ptr<my_kd_tree_t> mat_index;
+
+  if (_tree) {
+    // refit, or rebuild only if particles moved too far
+    _tree->update(pos, max_search_rad);
+
+  } else {
+    // generate the searchable data structure
+    mat_index = std::make_unique<my_kd_tree_t>(Dimensions, std::cref(xp));
+    mat_index->index->buildIndex();
+  }
 
   std::vector<std::pair<EigenIndexType,S> > ret_matches;
   ret_matches.reserve(48);
   nanoflann::SearchParams params;
-  params.sorted = true;
-
-  // new merging needs two new thresholds
-  const S initial_thresh = 0.5;
-  const S always_thresh = 0.1;
+  params.sorted = false;	// sort_matches does this in a repeatable order
 
   // and a measure of the mean strength
   S meanstr = 0.0;
@@ -108,9 +129,22 @@ size_t merge_close_particles(std::array<Vector<S>,3>& pos,
       const S search_rad = nom_sep * initial_thresh;
       const S distsq_thresh = std::pow(search_rad, 2);
 
-      // tree-based search with nanoflann
-      const S query_pt[Dimensions] = { x[i], y[i], z[i] };
-      const size_t nMatches = mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+      if (_tree) {
+        // filter the neighbor list, which includes a skin
+        ret_matches.clear();
+        const int32_t* nbrs = _tree->get_nbrs(i);
+        for (size_t j=0; j<_tree->get_num_nbrs(i); ++j) {
+          const int32_t iother = nbrs[j];
+          const S distsq = std::pow(xp(i,0)-xp(iother,0),2) + std::pow(xp(i,1)-xp(iother,1),2) + std::pow(xp(i,2)-xp(iother,2),2);
+          if (distsq < distsq_thresh) ret_matches.emplace_back((EigenIndexType)iother, distsq);
+        }
+      } else {
+        // tree-based search with nanoflann
+        const S query_pt[Dimensions] = { x[i], y[i], z[i] };
+        (void) mat_index->index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+      }
+      const size_t nMatches = ret_matches.size();
+      sort_matches(ret_matches);
 
       // match 0 should be self, match 1 is closest
       // if there are more than one, check the radii
@@ -180,6 +214,7 @@ size_t merge_close_particles(std::array<Vector<S>,3>& pos,
           sx[copyto] = sx[i];
           sy[copyto] = sy[i];
           sz[copyto] = sz[i];
+          if (_tag) (*_tag)[copyto] = (*_tag)[i];
         }
         copyto++;
       }
@@ -193,6 +228,7 @@ size_t merge_close_particles(std::array<Vector<S>,3>& pos,
     sx.resize(new_n);
     sy.resize(new_n);
     sz.resize(new_n);
+    if (_tag) _tag->resize(new_n);
 
     std::cout << "    merge removed " << num_removed << " particles" << std::endl;
   }
@@ -227,22 +263,31 @@ void merge_operation(std::vector<Collection>& _vort,
 
       Points<S>& pts = std::get<Points<S>>(coll);
 
+      // nor are particles that do not move with the flow
+      if (pts.get_movet() != lagrangian) continue;
+
       //std::cout << "    merging among " << pts.get_n() << " particles" << std::endl;
 
       // perform possibly multiple iterations
+      size_t num_merged = 0;
       for (size_t iter=0; iter<maxiters; ++iter) {
 
         // last two arguments are: relative distance, allow variable core radii
-        (void) merge_close_particles(pts.get_pos(),
+        num_merged += merge_close_particles(pts.get_pos(),
                                      pts.get_str(),
                                      pts.get_rad(),
                                      _overlap,
                                      _thresh,
-                                     _isadapt);
+                                     _isadapt,
+                                     &pts.get_tree(),
+                                     &pts.get_tag());
 
         // resize the rest of the arrays
         pts.resize(pts.get_rad().size());
       }
+
+      // particles were removed and reordered
+      if (num_merged > 0) pts.get_tree().invalidate();
     }
   }
 }
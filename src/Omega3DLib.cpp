@@ -0,0 +1,281 @@
+/*
+ * Omega3DLib.cpp - C interface to the embeddable Omega3D solver library (libomega3d)
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "Omega3DLib.h"
+#include "FlowFeature.h"
+#include "BoundaryFeature.h"
+#include "MeasureFeature.h"
+#include "Simulation.h"
+#include "JsonHelper.h"
+#include "RenderParams.h"
+#include "Fork.h"
+
+#include "json/json.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <cstdio>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+// the opaque handle is a simulation plus the features that a JSON input may define
+struct o3d_sim {
+  Simulation sim;
+  std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+  std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+  std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+  RenderParams rparams;
+  std::string err;
+};
+
+// no exceptions may cross the C boundary
+template <class F>
+static int guarded(o3d_sim* _s, F&& _func) {
+  if (not _s) return -1;
+  try {
+    return _func();
+  } catch (std::exception const& e) {
+    _s->err = e.what();
+  } catch (const char* e) {
+    _s->err = e;
+  } catch (...) {
+    _s->err = "unknown exception";
+  }
+  return -1;
+}
+
+// pull the raw pointers out of one Vector
+static float* vec_ptr(Vector<float>& _v) { return _v.empty() ? nullptr : _v.data(); }
+
+
+extern "C" {
+
+o3d_sim* o3d_create(void) {
+  return new o3d_sim();
+}
+
+void o3d_destroy(o3d_sim* _s) {
+  if (_s) _s->sim.reset();
+  delete _s;
+}
+
+const char* o3d_last_error(const o3d_sim* _s) {
+  return _s ? _s->err.c_str() : "null simulation handle";
+}
+
+int o3d_load_json(o3d_sim* _s, const char* _text) {
+  return guarded(_s, [&]() {
+    nlohmann::json j = nlohmann::json::parse(_text);
+    parse_json(_s->sim, _s->ffeatures, _s->bfeatures, _s->mfeatures, _s->rparams, j);
+    return 0;
+  });
+}
+
+int o3d_set_flow(o3d_sim* _s, const float _re, const float _dt, const float _fs[3]) {
+  return guarded(_s, [&]() {
+    *(_s->sim.addr_re()) = _re;
+    *(_s->sim.addr_dt()) = _dt;
+    if (_fs) for (size_t d=0; d<Dimensions; ++d) _s->sim.addr_fs()[d] = _fs[d];
+    return 0;
+  });
+}
+
+int o3d_add_particles(o3d_sim* _s, const size_t _n,
+                      const float* _x, const float* _y, const float* _z,
+                      const float* _sx, const float* _sy, const float* _sz,
+                      const float* _r) {
+  return guarded(_s, [&]() {
+    if (_n == 0) return 0;
+    // packets are xyz positions and (strength, radius) values
+    std::vector<float> x(3*_n), vals(4*_n);
+    for (size_t i=0; i<_n; ++i) {
+      x[3*i+0] = _x[i];
+      x[3*i+1] = _y[i];
+      x[3*i+2] = _z[i];
+      vals[4*i+0] = _sx[i];
+      vals[4*i+1] = _sy[i];
+      vals[4*i+2] = _sz[i];
+      vals[4*i+3] = _r ? _r[i] : _s->sim.get_vdelta();
+    }
+    _s->sim.add_elements(ElementPacket<float>(x, std::vector<Int>(), vals, _n, 0),
+                         active, lagrangian, nullptr);
+    return 0;
+  });
+}
+
+int o3d_add_field_points(o3d_sim* _s, const size_t _n,
+                         const float* _x, const float* _y, const float* _z) {
+  return guarded(_s, [&]() {
+    if (_n == 0) return 0;
+    std::vector<float> x(3*_n);
+    for (size_t i=0; i<_n; ++i) {
+      x[3*i+0] = _x[i];
+      x[3*i+1] = _y[i];
+      x[3*i+2] = _z[i];
+    }
+    _s->sim.add_elements(ElementPacket<float>(x, std::vector<Int>(), std::vector<float>(), _n, 0),
+                         inert, lagrangian, nullptr);
+    return 0;
+  });
+}
+
+int o3d_add_surface(o3d_sim* _s, const size_t _nnodes, const float* _xyz,
+                    const size_t _npanels, const uint32_t* _idx, const float* _bcs) {
+  return guarded(_s, [&]() {
+    if (_npanels == 0) return 0;
+    std::vector<float> x(_xyz, _xyz+3*_nnodes);
+    std::vector<Int> idx(_idx, _idx+3*_npanels);
+    std::vector<float> vals(3*_npanels, 0.0);
+    if (_bcs) vals.assign(_bcs, _bcs+3*_npanels);
+    _s->sim.add_elements(ElementPacket<float>(x, idx, vals, _npanels, 2),
+                         reactive, fixed, nullptr);
+    return 0;
+  });
+}
+
+int o3d_initialize(o3d_sim* _s) {
+  return guarded(_s, [&]() {
+    Simulation& sim = _s->sim;
+
+    // same as the batch driver
+    add_init_elements(sim, _s->ffeatures, _s->bfeatures, _s->mfeatures, _s->rparams);
+
+    sim.set_initialized();
+
+    _s->err = sim.check_initialization();
+    return _s->err.empty() ? 0 : -1;
+  });
+}
+
+int o3d_step(o3d_sim* _s) {
+  return guarded(_s, [&]() {
+    Simulation& sim = _s->sim;
+
+    _s->err = advance_step(sim, _s->ffeatures, _s->mfeatures, _s->rparams);
+    if (not _s->err.empty()) return -1;
+
+    return sim.test_vs_stop() ? 1 : 0;
+  });
+}
+
+double o3d_get_time(const o3d_sim* _s) { return _s ? (double)_s->sim.get_time() : 0.0; }
+
+size_t o3d_get_nstep(const o3d_sim* _s) { return _s ? _s->sim.get_nstep() : 0; }
+
+// pick the list of collections
+static std::vector<Collection>& get_set(o3d_sim* _s, const enum o3d_elem_set _which) {
+  if (_which == O3D_BOUNDARY) return _s->sim.get_bdry();
+  if (_which == O3D_FIELD) return _s->sim.get_fldpt();
+  return _s->sim.get_vort();
+}
+
+size_t o3d_num_sets(o3d_sim* _s, const enum o3d_elem_set _which) {
+  return _s ? get_set(_s, _which).size() : 0;
+}
+
+int o3d_get_points(o3d_sim* _s, const enum o3d_elem_set _which, const size_t _iset, o3d_points_view* _view) {
+  return guarded(_s, [&]() {
+    std::vector<Collection>& set = get_set(_s, _which);
+    if (_iset >= set.size() or not std::holds_alternative<Points<float>>(set[_iset])) {
+      _s->err = "requested collection is not a set of points";
+      return -1;
+    }
+    Points<float>& pts = std::get<Points<float>>(set[_iset]);
+
+    _view->n = pts.get_n();
+    _view->x = vec_ptr(pts.get_pos()[0]);
+    _view->y = vec_ptr(pts.get_pos()[1]);
+    _view->z = vec_ptr(pts.get_pos()[2]);
+    if (pts.is_inert()) {
+      _view->sx = _view->sy = _view->sz = nullptr;
+    } else {
+      _view->sx = vec_ptr(pts.get_str()[0]);
+      _view->sy = vec_ptr(pts.get_str()[1]);
+      _view->sz = vec_ptr(pts.get_str()[2]);
+    }
+    _view->r = vec_ptr(pts.get_rad());
+    _view->u = vec_ptr(pts.get_vel()[0]);
+    _view->v = vec_ptr(pts.get_vel()[1]);
+    _view->w = vec_ptr(pts.get_vel()[2]);
+    return 0;
+  });
+}
+
+int o3d_get_panels(o3d_sim* _s, const size_t _iset, o3d_panels_view* _view) {
+  return guarded(_s, [&]() {
+    std::vector<Collection>& set = _s->sim.get_bdry();
+    if (_iset >= set.size() or not std::holds_alternative<Surfaces<float>>(set[_iset])) {
+      _s->err = "requested collection is not a set of panels";
+      return -1;
+    }
+    Surfaces<float>& surf = std::get<Surfaces<float>>(set[_iset]);
+
+    _view->nnodes = surf.get_n();
+    _view->x = vec_ptr(surf.get_pos()[0]);
+    _view->y = vec_ptr(surf.get_pos()[1]);
+    _view->z = vec_ptr(surf.get_pos()[2]);
+    _view->npanels = surf.get_npanels();
+    _view->idx = surf.get_idx().data();
+    _view->area = surf.get_area().data();
+    _view->nx = surf.get_norm()[0].data();
+    _view->ny = surf.get_norm()[1].data();
+    _view->nz = surf.get_norm()[2].data();
+    _view->sx = vec_ptr(surf.get_str()[0]);
+    _view->sy = vec_ptr(surf.get_str()[1]);
+    _view->sz = vec_ptr(surf.get_str()[2]);
+    _view->u = vec_ptr(surf.get_vel()[0]);
+    _view->v = vec_ptr(surf.get_vel()[1]);
+    _view->w = vec_ptr(surf.get_vel()[2]);
+    return 0;
+  });
+}
+
+void o3d_reset(o3d_sim* _s) {
+  if (_s) _s->sim.reset();
+}
+
+int o3d_fork(o3d_sim* _s, const char* _patch) {
+  return guarded(_s, [&]() {
+#ifdef _WIN32
+    _s->err = "fork() is not available on this platform";
+    return -1;
+#else
+    // parse first, so that a bad patch is reported in the parent
+    const nlohmann::json patch = (_patch and *_patch) ? nlohmann::json::parse(_patch) : nlohmann::json::object();
+
+    // nothing may be open or buffered twice across the fork
+    _s->sim.close_streams();
+    std::cout.flush();
+    std::fflush(stdout);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+      _s->err = "fork() failed";
+      return -1;
+    }
+    if (pid == 0) {
+#ifdef _OPENMP
+      if (forked_children_are_serial()) omp_set_num_threads(1);
+#endif
+      apply_branch_patch(_s->sim, patch);
+    }
+    return (int)pid;
+#endif
+  });
+}
+
+} // extern "C"
@@ -0,0 +1,97 @@
+/*
+ * Omega3DLib.h - C interface to the embeddable Omega3D solver library (libomega3d)
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ *
+ * All arrays handed back in the view structs point directly into the solver's own
+ * structure-of-arrays storage: nothing is copied. Views remain valid only until the
+ * next call that can add or remove elements (o3d_step, o3d_add_*, o3d_initialize).
+ * Strengths and velocities may be modified in place between steps.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// opaque handle to one simulation
+typedef struct o3d_sim o3d_sim;
+
+// which set of elements to look at
+enum o3d_elem_set {
+  O3D_VORTICITY = 0,    // active particles
+  O3D_BOUNDARY  = 1,    // reactive panels
+  O3D_FIELD     = 2     // inert tracers and field points
+};
+
+// a set of particles, any array may be NULL when it does not apply
+typedef struct {
+  size_t n;
+  float *x, *y, *z;     // positions
+  float *sx, *sy, *sz;  // vector strengths (NULL for inert points)
+  float *r;             // core radii (NULL for inert points)
+  float *u, *v, *w;     // velocities
+} o3d_points_view;
+
+// a set of triangular panels, strengths and velocities are at panel centers
+typedef struct {
+  size_t nnodes;
+  const float *x, *y, *z;           // node positions
+  size_t npanels;
+  const uint32_t *idx;              // three node indices per panel
+  const float *area;
+  const float *nx, *ny, *nz;        // unit normals
+  float *sx, *sy, *sz;              // total vortex sheet strength
+  float *u, *v, *w;                 // velocities
+} o3d_panels_view;
+
+// lifetime
+o3d_sim* o3d_create(void);
+void o3d_destroy(o3d_sim*);
+const char* o3d_last_error(const o3d_sim*);
+
+// configuration: a complete JSON input (as a string), and/or direct parameters
+int o3d_load_json(o3d_sim*, const char* json_text);
+int o3d_set_flow(o3d_sim*, const float re, const float dt, const float fs[3]);
+
+// add elements directly from structure-of-arrays inputs
+int o3d_add_particles(o3d_sim*, const size_t n,
+                      const float* x, const float* y, const float* z,
+                      const float* sx, const float* sy, const float* sz,
+                      const float* r);
+int o3d_add_field_points(o3d_sim*, const size_t n,
+                         const float* x, const float* y, const float* z);
+// nodes are interleaved xyz, bcs (3 per panel) may be NULL for no-slip
+int o3d_add_surface(o3d_sim*, const size_t nnodes, const float* xyz,
+                    const size_t npanels, const uint32_t* idx, const float* bcs);
+
+// create elements from any loaded features and check the setup; 0 means ready
+int o3d_initialize(o3d_sim*);
+
+// take one time step; 0 means success, 1 means the simulation asks to stop, -1 is an error
+int o3d_step(o3d_sim*);
+double o3d_get_time(const o3d_sim*);
+size_t o3d_get_nstep(const o3d_sim*);
+
+// zero-copy access to the element arrays
+size_t o3d_num_sets(o3d_sim*, const enum o3d_elem_set);
+int o3d_get_points(o3d_sim*, const enum o3d_elem_set, const size_t iset, o3d_points_view*);
+int o3d_get_panels(o3d_sim*, const size_t iset, o3d_panels_view*);
+
+// clear all elements and time, keep parameters
+void o3d_reset(o3d_sim*);
+
+// branch the calling process with fork(): the child continues with the JSON merge patch
+//   ("simparams" and "flowparams" only, may be NULL) applied and gets 0, the parent gets the
+//   child's process id, and -1 is an error; memory is shared copy-on-write until they diverge,
+//   and with GNU OpenMP the child continues on one thread
+int o3d_fork(o3d_sim*, const char* patch_json);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,351 @@
+/*
+ * Outflow.h - Remove particles that leave the domain but keep their far-field influence
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "MathHelper.h"
+#include "Collection.h"
+
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <limits>
+#include <chrono>
+#include <algorithm>
+
+
+//
+// Active particles that cross an outflow plane, or that enter an outflow box, are removed
+//   from the simulation, so that the wake far downstream stops costing work at every target.
+//
+// Their strength goes into a few large "super-particles" which drift with the freestream and
+//   keep inducing the far wake's velocity upstream. Each removed particle joins the nearest
+//   super-particle within the aggregation radius, or starts a new one; when there are too many,
+//   the one furthest downstream is merged into its nearest neighbor. Total circulation is kept
+//   exactly, and each merge also keeps the linear impulse unless that would move the result
+//   further than the aggregation radius from the strength-weighted centroid.
+//
+// The super-particles are an active collection that does not move with the flow (fixed), so
+//   they are sources for every velocity evaluation and the BEM, but are not convected, diffused,
+//   merged, or split like the particles they replace.
+//
+template <class S>
+class Outflow {
+public:
+  Outflow()
+    : max_super(32),
+      radius_factor(8.0),
+      nremoved(0)
+    {}
+
+  bool is_enabled() const { return not regions.empty(); }
+  size_t get_nremoved() const { return nremoved; }
+
+  // a plane removes everything on the side its normal points to; a box (any size > 0)
+  //   removes everything inside it and ignores the normal
+  void add_region(const std::array<S,Dimensions>& _center,
+                  const std::array<S,Dimensions>& _normal,
+                  const std::array<S,Dimensions>& _size,
+                  const int32_t _max_super,
+                  const S _radius_factor) {
+    Region r;
+    r.center = _center;
+    r.normal = _normal;
+    const S nlen = std::sqrt(dot_product(_normal, _normal));
+    if (nlen > std::numeric_limits<S>::epsilon()) for (auto& n : r.normal) n /= nlen;
+    r.is_box = false;
+    for (size_t d=0; d<Dimensions; ++d) {
+      r.half[d] = (S)0.5 * _size[d];
+      if (_size[d] > (S)0.0) r.is_box = true;
+    }
+    regions.push_back(r);
+    // every region feeds the same super-particles, so the most generous settings win
+    max_super = std::max(max_super, _max_super);
+    radius_factor = std::max(radius_factor, _radius_factor);
+  }
+
+  void clear() {
+    regions.clear();
+    max_super = 32;
+    radius_factor = 8.0;
+    nremoved = 0;
+  }
+  void reset() { nremoved = 0; }
+
+  // returns the number of particles removed this time
+  size_t apply(std::vector<Collection>&, const std::array<double,Dimensions>&, const double, const S);
+
+private:
+  struct Region {
+    std::array<S,Dimensions> center;
+    std::array<S,Dimensions> normal;
+    std::array<S,Dimensions> half;
+    bool is_box;
+  };
+
+  bool is_outside(const std::array<S,Dimensions>& _x) const {
+    for (auto const& r : regions) {
+      if (r.is_box) {
+        bool inside = true;
+        for (size_t d=0; d<Dimensions; ++d) {
+          if (std::abs(_x[d]-r.center[d]) > r.half[d]) inside = false;
+        }
+        if (inside) return true;
+      } else {
+        S dist = 0.0;
+        for (size_t d=0; d<Dimensions; ++d) dist += (_x[d]-r.center[d]) * r.normal[d];
+        if (dist > (S)0.0) return true;
+      }
+    }
+    return false;
+  }
+
+  void combine(std::array<S,Dimensions>&, std::array<S,Dimensions>&,
+               const std::array<S,Dimensions>&, const std::array<S,Dimensions>&, const S) const;
+  void absorb(Points<S>&, const std::array<S,Dimensions>&, const std::array<S,Dimensions>&,
+              const S, const std::array<S,Dimensions>&);
+  void merge_into(Points<S>&, const size_t, const size_t);
+
+  std::vector<Region> regions;
+  int32_t max_super;	// most super-particles kept
+  S radius_factor;	// their core radius and aggregation distance, in particle spacings
+  size_t nremoved;	// particles removed since the start
+};
+
+
+//
+// Combine the particle at _x2 with strength _s2 into the one at _x1 with _s1. The sum sits
+//   near the strength-weighted centroid, moved across its strength just enough to keep the
+//   impulse 1/2 x cross s of the pair, but never more than _rad (a pair whose strengths nearly
+//   cancel has an impulse that no single particle can carry)
+//
+template <class S>
+void Outflow<S>::combine(std::array<S,Dimensions>& _x1, std::array<S,Dimensions>& _s1,
+                         const std::array<S,Dimensions>& _x2, const std::array<S,Dimensions>& _s2,
+                         const S _rad) const {
+  const S w1 = length(_s1);
+  const S w2 = length(_s2);
+  std::array<S,Dimensions> xc = _x1;
+  if (w1+w2 > (S)0.0) {
+    for (size_t d=0; d<Dimensions; ++d) xc[d] = (w1*_x1[d] + w2*_x2[d]) / (w1+w2);
+  }
+
+  std::array<S,Dimensions> ssum;
+  for (size_t d=0; d<Dimensions; ++d) ssum[d] = _s1[d] + _s2[d];
+
+  // impulse still missing if the sum sat at the centroid, and the shift that supplies it
+  std::array<S,Dimensions> i1, i2, ic, resid, shift;
+  cross_product(_x1, _s1, i1);
+  cross_product(_x2, _s2, i2);
+  cross_product(xc, ssum, ic);
+  for (size_t d=0; d<Dimensions; ++d) resid[d] = i1[d] + i2[d] - ic[d];
+  const S ssq = dot_product(ssum, ssum);
+  if (ssq > std::numeric_limits<S>::min()) {
+    cross_product(ssum, resid, shift);
+    for (auto& v : shift) v /= ssq;
+    const S slen = length(shift);
+    if (slen > _rad) for (auto& v : shift) v *= _rad / slen;
+    for (size_t d=0; d<Dimensions; ++d) xc[d] += shift[d];
+  }
+
+  _x1 = xc;
+  _s1 = ssum;
+}
+
+//
+// Fold super-particle _from into _into and remove _from
+//
+template <class S>
+void Outflow<S>::merge_into(Points<S>& _sp, const size_t _into, const size_t _from) {
+  std::array<Vector<S>,Dimensions>& x = _sp.get_pos();
+  std::array<Vector<S>,Dimensions>& s = _sp.get_str();
+
+  std::array<S,Dimensions> x1 = {x[0][_into], x[1][_into], x[2][_into]};
+  std::array<S,Dimensions> s1 = {s[0][_into], s[1][_into], s[2][_into]};
+  combine(x1, s1, {x[0][_from], x[1][_from], x[2][_from]}, {s[0][_from], s[1][_from], s[2][_from]},
+          _sp.get_rad()[_into]);
+  for (size_t d=0; d<Dimensions; ++d) {
+    x[d][_into] = x1[d];
+    s[d][_into] = s1[d];
+  }
+
+  std::vector<bool> gone(_sp.get_n(), false);
+  gone[_from] = true;
+  _sp.compact(gone);
+}
+
+//
+// Add one removed particle to the super-particles
+//
+template <class S>
+void Outflow<S>::absorb(Points<S>& _sp,
+                        const std::array<S,Dimensions>& _x,
+                        const std::array<S,Dimensions>& _s,
+                        const S _rad,
+                        const std::array<S,Dimensions>& _downstream) {
+
+  std::array<Vector<S>,Dimensions>& x = _sp.get_pos();
+  std::array<Vector<S>,Dimensions>& s = _sp.get_str();
+
+  // nearest existing super-particle
+  size_t inear = 0;
+  S dnear = std::numeric_limits<S>::max();
+  for (size_t j=0; j<_sp.get_n(); ++j) {
+    S dsq = 0.0;
+    for (size_t d=0; d<Dimensions; ++d) dsq += (x[d][j]-_x[d]) * (x[d][j]-_x[d]);
+    if (dsq < dnear) {
+      dnear = dsq;
+      inear = j;
+    }
+  }
+
+  if (_sp.get_n() > 0 and dnear < _rad*_rad) {
+    // join it
+    std::array<S,Dimensions> x1 = {x[0][inear], x[1][inear], x[2][inear]};
+    std::array<S,Dimensions> s1 = {s[0][inear], s[1][inear], s[2][inear]};
+    combine(x1, s1, _x, _s, _rad);
+    for (size_t d=0; d<Dimensions; ++d) {
+      x[d][inear] = x1[d];
+      s[d][inear] = s1[d];
+    }
+    return;
+  }
+
+  // start a new one
+  const size_t inew = _sp.extend(1);
+  for (size_t d=0; d<Dimensions; ++d) {
+    _sp.get_pos()[d][inew] = _x[d];
+    _sp.get_str()[d][inew] = _s[d];
+  }
+  _sp.get_rad()[inew] = _rad;
+
+  if (_sp.get_n() <= (size_t)max_super) return;
+
+  // too many: the one furthest downstream joins its nearest neighbor
+  size_t ifar = 0;
+  S xfar = -std::numeric_limits<S>::max();
+  for (size_t j=0; j<_sp.get_n(); ++j) {
+    S xd = 0.0;
+    for (size_t d=0; d<Dimensions; ++d) xd += _sp.get_pos()[d][j] * _downstream[d];
+    if (xd > xfar) {
+      xfar = xd;
+      ifar = j;
+    }
+  }
+  size_t ipartner = (ifar == 0) ? 1 : 0;
+  S dpartner = std::numeric_limits<S>::max();
+  for (size_t j=0; j<_sp.get_n(); ++j) {
+    if (j == ifar) continue;
+    S dsq = 0.0;
+    for (size_t d=0; d<Dimensions; ++d) {
+      const S dx = _sp.get_pos()[d][j] - _sp.get_pos()[d][ifar];
+      dsq += dx*dx;
+    }
+    if (dsq < dpartner) {
+      dpartner = dsq;
+      ipartner = j;
+    }
+  }
+  merge_into(_sp, ipartner, ifar);
+}
+
+//
+// Drift the super-particles, then remove and absorb every particle in an outflow region
+//
+template <class S>
+size_t Outflow<S>::apply(std::vector<Collection>& _vort,
+                         const std::array<double,Dimensions>& _fs,
+                         const double _dt,
+                         const S _ips) {
+
+  if (regions.empty()) return 0;
+  auto start = std::chrono::system_clock::now();
+
+  // the super-particles are the only active collection that does not move with the flow
+  size_t isuper = _vort.size();
+  for (size_t i=0; i<_vort.size(); ++i) {
+    if (not std::holds_alternative<Points<S>>(_vort[i])) continue;
+    Points<S>& pts = std::get<Points<S>>(_vort[i]);
+    if (not pts.is_inert() and pts.get_movet() == fixed) isuper = i;
+  }
+
+  // they left with the flow, and keep going with it
+  if (isuper < _vort.size()) {
+    Points<S>& sp = std::get<Points<S>>(_vort[isuper]);
+    std::array<Vector<S>,Dimensions>& spx = sp.get_pos();
+    for (size_t d=0; d<Dimensions; ++d) {
+      for (size_t j=0; j<sp.get_n(); ++j) spx[d][j] += (S)(_dt * _fs[d]);
+    }
+  }
+
+  // flag the particles to remove
+  std::vector<std::vector<bool>> gone(_vort.size());
+  size_t nthis = 0;
+  for (size_t i=0; i<_vort.size(); ++i) {
+    if (i == isuper) continue;
+    if (not std::holds_alternative<Points<S>>(_vort[i])) continue;
+    Points<S>& pts = std::get<Points<S>>(_vort[i]);
+    if (pts.is_inert() or pts.get_movet() != lagrangian) continue;
+
+    const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+    gone[i].resize(pts.get_n(), false);
+    for (size_t j=0; j<pts.get_n(); ++j) {
+      if (is_outside({x[0][j], x[1][j], x[2][j]})) {
+        gone[i][j] = true;
+        nthis++;
+      }
+    }
+  }
+  if (nthis == 0) return 0;
+
+  // the first removal makes the collection, appended so that no other collection is renumbered
+  if (isuper == _vort.size()) {
+    _vort.push_back(Points<S>(std::vector<S>(), active, fixed, nullptr));
+    gone.push_back(std::vector<bool>());
+  }
+  Points<S>& sp = std::get<Points<S>>(_vort[isuper]);
+
+  // direction in which to merge the oldest super-particles
+  std::array<S,Dimensions> downstream = {(S)_fs[0], (S)_fs[1], (S)_fs[2]};
+  if (dot_product(downstream, downstream) < std::numeric_limits<S>::epsilon()) {
+    downstream = regions.front().normal;
+  }
+
+  // move their strength over and take them out
+  const S rad = radius_factor * _ips;
+  for (size_t i=0; i<_vort.size(); ++i) {
+    if (gone[i].empty()) continue;
+    Points<S>& pts = std::get<Points<S>>(_vort[i]);
+    const std::array<Vector<S>,Dimensions>& x = pts.get_pos();
+    const std::array<Vector<S>,Dimensions>& s = pts.get_str();
+    bool any = false;
+    for (size_t j=0; j<pts.get_n(); ++j) {
+      if (gone[i][j]) {
+        absorb(sp, {x[0][j], x[1][j], x[2][j]}, {s[0][j], s[1][j], s[2][j]}, rad, downstream);
+        any = true;
+      }
+    }
+    if (any) pts.compact(gone[i]);
+  }
+
+  nremoved += nthis;
+
+  if (nthis > 0) {
+    std::cout << "  outflow removed " << nthis << " particles, " << nremoved << " so far, now in "
+              << sp.get_n() << " super-particles" << std::endl;
+    auto end = std::chrono::system_clock::now();
+    std::chrono::duration<double> elapsed_seconds = end-start;
+    printf("    outflow:\t\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+  }
+
+  return nthis;
+}
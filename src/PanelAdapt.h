@@ -0,0 +1,227 @@
+/*
+ * PanelAdapt.h - Periodic refinement and coarsening of reactive boundary panels
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "Surfaces.h"
+#include "GuiHelper.h"
+#include "json/json.hpp"
+
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+
+
+//
+// Every few steps, look at the solved vortex sheet strength on each reactive surface and
+//   split the panels where it (or its jump to the neighboring panels) is large, and merge
+//   previously-split panels back where it is small. Both measures are scaled by the largest
+//   sheet strength on that surface, so the thresholds are fractions in 0..1. Panels only
+//   merge below a fraction (the hysteresis) of the refine threshold, so that children which
+//   were just split do not merge straight back when the indicator sits near a threshold.
+//
+// The caller is responsible for telling the BEM which collections changed, so that only
+//   their rows and columns get recomputed; the surface lists the panels that did not change.
+//
+template <class S>
+class PanelAdapt {
+public:
+  PanelAdapt()
+    : enabled(false),
+      interval(10),
+      refine_thresh(0.3),
+      coarsen_thresh(0.05),
+      hysteresis(0.5),
+      max_level(2),
+      use_gradient(true)
+    {}
+
+  bool is_enabled() const { return enabled; }
+  void set_enabled(const bool _on) { enabled = _on; }
+  bool is_due(const size_t _nstep) const { return enabled and _nstep > 0 and _nstep%interval == 0; }
+
+  // returns true if the panels changed
+  bool adapt(Surfaces<S>&) const;
+
+  void from_json(const nlohmann::json);
+  void add_to_json(nlohmann::json&) const;
+#ifdef USE_IMGUI
+  void draw_advanced();
+#endif
+
+private:
+  bool enabled;
+  int32_t interval;
+  float refine_thresh;
+  float coarsen_thresh;
+  float hysteresis;
+  int32_t max_level;
+  bool use_gradient;
+};
+
+
+//
+// Flag each panel and let the surface do the splitting and merging
+//
+template <class S>
+bool PanelAdapt<S>::adapt(Surfaces<S>& _surf) const {
+
+  const size_t np = _surf.get_npanels();
+  if (np == 0) return false;
+
+  // sheet strength vector of each panel
+  const std::array<Vector<S>,Dimensions>& ts = _surf.get_str();
+  const Vector<S>& area = _surf.get_area();
+  std::array<Vector<S>,Dimensions> gam;
+  for (size_t d=0; d<Dimensions; ++d) gam[d].resize(np);
+  Vector<S> gmag(np);
+  #pragma omp parallel for
+  for (int32_t i=0; i<(int32_t)np; ++i) {
+    for (size_t d=0; d<Dimensions; ++d) gam[d][i] = ts[d][i] / area[i];
+    gmag[i] = std::sqrt(gam[0][i]*gam[0][i] + gam[1][i]*gam[1][i] + gam[2][i]*gam[2][i]);
+  }
+  const S gmax = *std::max_element(gmag.begin(), gmag.end());
+  if (gmax <= 0.0) return false;
+
+  Vector<S> indicator(np);
+  if (use_gradient) {
+    // panels around each node, in compressed rows
+    const std::vector<Int>& idx = _surf.get_idx();
+    const size_t nn = _surf.get_n();
+    std::vector<Int> first(nn+1, 0);
+    for (auto const& inode : idx) first[inode+1]++;
+    for (size_t i=0; i<nn; ++i) first[i+1] += first[i];
+    std::vector<Int> around(idx.size());
+    std::vector<Int> fill(first.begin(), first.end()-1);
+    for (size_t j=0; j<idx.size(); ++j) around[fill[idx[j]]++] = j/3;
+
+    // largest jump in sheet strength to any panel sharing a node
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)np; ++i) {
+      S maxjump = 0.0;
+      for (size_t k=0; k<3; ++k) {
+        const Int inode = idx[3*i+k];
+        for (Int j=first[inode]; j<first[inode+1]; ++j) {
+          const Int jp = around[j];
+          const S dx = gam[0][jp] - gam[0][i];
+          const S dy = gam[1][jp] - gam[1][i];
+          const S dz = gam[2][jp] - gam[2][i];
+          maxjump = std::max(maxjump, std::sqrt(dx*dx + dy*dy + dz*dz));
+        }
+      }
+      indicator[i] = maxjump / gmax;
+    }
+  } else {
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)np; ++i) indicator[i] = gmag[i] / gmax;
+  }
+
+  std::vector<int8_t> want(np, 0);
+  size_t nref = 0, ncrs = 0;
+  const float merge_below = std::min(coarsen_thresh, hysteresis*refine_thresh);
+  for (size_t i=0; i<np; ++i) {
+    if (indicator[i] > refine_thresh) {
+      want[i] = 1;
+      nref++;
+    } else if (indicator[i] < merge_below) {
+      want[i] = -1;
+      ncrs++;
+    }
+  }
+  std::cout << "  panel adaptation flagged " << nref << " to split and " << ncrs << " to merge of " << np << std::endl;
+  if (nref == 0 and ncrs == 0) return false;
+
+  const auto changed = _surf.adapt_panels(want, max_level);
+  return (changed.first > 0 or changed.second > 0);
+}
+
+//
+// read/write parameters
+//
+template <class S>
+void PanelAdapt<S>::from_json(const nlohmann::json simj) {
+  if (simj.find("panelAdaptation") != simj.end()) {
+    nlohmann::json j = simj["panelAdaptation"];
+    if (j.find("enabled") != j.end()) {
+      enabled = j["enabled"];
+      std::cout << "  setting panel adaptation= " << enabled << std::endl;
+    }
+    if (j.find("interval") != j.end()) {
+      interval = std::max(1, j["interval"].get<int32_t>());
+      std::cout << "  setting panel adaptation interval= " << interval << std::endl;
+    }
+    if (j.find("refineThreshold") != j.end()) {
+      refine_thresh = j["refineThreshold"];
+      std::cout << "  setting panel refine threshold= " << refine_thresh << std::endl;
+    }
+    if (j.find("coarsenThreshold") != j.end()) {
+      coarsen_thresh = j["coarsenThreshold"];
+      std::cout << "  setting panel coarsen threshold= " << coarsen_thresh << std::endl;
+    }
+    if (j.find("hysteresis") != j.end()) {
+      hysteresis = std::clamp(j["hysteresis"].get<float>(), 0.0f, 1.0f);
+      std::cout << "  setting panel adaptation hysteresis= " << hysteresis << std::endl;
+    }
+    if (j.find("maxLevel") != j.end()) {
+      max_level = std::clamp(j["maxLevel"].get<int32_t>(), 0, 8);
+      std::cout << "  setting panel max refinement level= " << max_level << std::endl;
+    }
+    if (j.find("indicator") != j.end()) {
+      const std::string ind = j["indicator"];
+      use_gradient = (ind != "strength");
+      std::cout << "  setting panel adaptation indicator= " << (use_gradient ? "gradient" : "strength") << std::endl;
+    }
+  }
+}
+
+template <class S>
+void PanelAdapt<S>::add_to_json(nlohmann::json& simj) const {
+  if (enabled) {
+    nlohmann::json j;
+    j["enabled"] = true;
+    j["interval"] = interval;
+    j["refineThreshold"] = refine_thresh;
+    j["coarsenThreshold"] = coarsen_thresh;
+    j["hysteresis"] = hysteresis;
+    j["maxLevel"] = max_level;
+    j["indicator"] = use_gradient ? "gradient" : "strength";
+    simj["panelAdaptation"] = j;
+  }
+}
+
+#ifdef USE_IMGUI
+template <class S>
+void PanelAdapt<S>::draw_advanced() {
+
+  ImGui::Spacing();
+  ImGui::Text("Panel adaptation settings");
+
+  ImGui::Checkbox("Refine and coarsen boundary panels", &enabled);
+  ImGui::SameLine();
+  ShowHelpMarker("Periodically split panels where the vortex sheet strength changes quickly (or is large), and merge them back where it does not. Only the affected parts of the BEM matrix are recomputed.");
+
+  if (enabled) {
+    ImGui::SliderInt("Steps between adaptations", &interval, 1, 100);
+    ImGui::SliderInt("Maximum refinement level", &max_level, 0, 5);
+    ImGui::Checkbox("Use jump to neighbors", &use_gradient);
+    ImGui::SameLine();
+    ShowHelpMarker("Measure the change in sheet strength between neighboring panels, instead of the sheet strength itself.");
+    ImGui::SliderFloat("Refine above", &refine_thresh, 0.0, 1.0, "%.3f");
+    ImGui::SliderFloat("Coarsen below", &coarsen_thresh, 0.0, 1.0, "%.3f");
+    coarsen_thresh = std::min(coarsen_thresh, refine_thresh);
+    ImGui::SliderFloat("Hysteresis", &hysteresis, 0.0, 1.0, "%.2f");
+    ImGui::SameLine();
+    ShowHelpMarker("Panels only merge below this fraction of the refine threshold, even if the coarsen threshold is higher.");
+  }
+}
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Philox.h - Counter-based random number generation
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+
+//
+// Philox4x32-10 from Salmon et al., "Parallel random numbers: as easy as 1, 2, 3" (SC11)
+//
+// Each (counter, key) pair maps to four independent 32-bit values with no state carried
+//   between calls, so particle i can draw its numbers from counter i on any thread and
+//   the result does not depend on how the loop was split up
+//
+using philox_ctr_t = std::array<uint32_t,4>;
+
+inline philox_ctr_t philox4x32(philox_ctr_t _ctr, const uint64_t _key) {
+  uint32_t k0 = (uint32_t)_key;
+  uint32_t k1 = (uint32_t)(_key >> 32);
+
+  for (int r=0; r<10; ++r) {
+    const uint64_t p0 = (uint64_t)0xD2511F53 * _ctr[0];
+    const uint64_t p1 = (uint64_t)0xCD9E8D57 * _ctr[2];
+    _ctr = { (uint32_t)(p1 >> 32) ^ _ctr[1] ^ k0,
+             (uint32_t)p1,
+             (uint32_t)(p0 >> 32) ^ _ctr[3] ^ k1,
+             (uint32_t)p0 };
+    k0 += 0x9E3779B9;
+    k1 += 0xBB67AE85;
+  }
+  return _ctr;
+}
+
+// the four values for the given element and stream, as floats on [0,1)
+inline std::array<float,4> philox_uniform(const uint64_t _key, const uint64_t _elem, const uint32_t _stream = 0) {
+  const philox_ctr_t r = philox4x32({(uint32_t)_elem, (uint32_t)(_elem >> 32), _stream, 0}, _key);
+  // use the top 24 bits so that the result is exactly representable and never 1.0
+  return { (float)(r[0] >> 8) * 0x1.0p-24f,
+           (float)(r[1] >> 8) * 0x1.0p-24f,
+           (float)(r[2] >> 8) * 0x1.0p-24f,
+           (float)(r[3] >> 8) * 0x1.0p-24f };
+}
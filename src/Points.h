@@ -11,6 +11,7 @@
 #include "VectorHelper.h"
 #include "MathHelper.h"
 #include "ElementBase.h"
+#include "PointsTree.h"
 
 #ifdef USE_GL
 #include "GlState.h"
@@ -83,6 +84,9 @@ public:
         this->elong[i] = 1.0;
       }
 
+      // these did not come from a feature
+      tag.resize(this->n, 0);
+
       // optional strength in base class
       // need to assign it a vector first!
       std::array<Vector<S>,numStrenPerNode> new_s;
@@ -117,7 +121,8 @@ public:
          const elem_t _e,
          const move_t _m,
          std::shared_ptr<Body> _bp,
-         const float _vd)
+         const float _vd,
+         const int32_t _tag = 0)
     : ElementBase<S>(0, _e, _m, _bp),
       max_strength(-1.0) {
 
@@ -143,9 +148,10 @@ public:
     this->n = _in.nelem;
 
     // this initialization specific to Points - is it, though?
-    for (size_t d=0; d<Dimensions; ++d) {
-      this->x[d].resize(this->n);
-      for (size_t i=0; i<this->n; ++i) {
+    for (size_t d=0; d<Dimensions; ++d) this->x[d].resize(this->n);
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)this->n; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) {
         this->x[d][i] = _in.x[Dimensions*i+d];
       }
     }
@@ -168,14 +174,18 @@ public:
       for (size_t i=0; i<this->n; ++i) {
         this->elong[i] = 1.0;
       }
+
+      // and the feature they came from
+      tag.resize(this->n, _tag);
       
       // optional strength in base class
       // need to assign it a vector first!
       std::array<Vector<S>, numStrenPerNode> new_s;
       const size_t nper = _in.val.size() / this->n;
-      for (size_t j = 0; j < numStrenPerNode; j++) {
-        new_s[j].resize(this->n);
-        for (size_t i = 0; i < this->n; i++) {
+      for (size_t j = 0; j < numStrenPerNode; j++) new_s[j].resize(this->n);
+      #pragma omp parallel for
+      for (int32_t i=0; i<(int32_t)this->n; ++i) {
+        for (size_t j = 0; j < numStrenPerNode; j++) {
           new_s[j][i] = _in.val[i*nper+j];
         }
       }
@@ -206,6 +216,14 @@ public:
   std::optional<std::array<Vector<S>,Dimensions*Dimensions>>&       get_velgrad()       { return ug; }
   const Vector<S>& get_rad() const { return r; }
   Vector<S>&       get_rad()       { return r; }
+  const Vector<int32_t>& get_tag() const { return tag; }
+  Vector<int32_t>&       get_tag()       { return tag; }
+
+  // persistent spatial tree and neighbor lists, shared among copies (like RK stages)
+  PointsTree<S>& get_tree() {
+    if (not tree) tree = std::make_shared<PointsTree<S>>();
+    return *tree;
+  }
 
   // a little logic to see if we should augment the BEM equations for this object (see Surfaces.h)
   const bool is_augmented() const { return false; }
@@ -248,11 +266,13 @@ public:
       for (size_t i=nold; i<nold+nnew; ++i) {
         elong[i] = 1.0;
       }
+
+      tag.resize(nold+nnew, 0);
     }
   }
 
   // append more elements this collection
-  void add_new(const ElementPacket<S>& _in, const float _vd) {
+  void add_new(const ElementPacket<S>& _in, const float _vd, const int32_t _tag = 0) {
     // ensure that this packet really is Points
     assert(_in.idx.size() == 0 && "Input ElementPacket is not Points");
     assert(_in.ndim == 0 && "Input ElementPacket is not Points");
@@ -283,6 +303,8 @@ public:
       for (size_t i=nold; i<nold+nnew; ++i) {
         elong[i] = 1.0;
       }
+
+      tag.resize(nold+nnew, _tag);
     }
 
     // save the new untransformed positions if we have a Body pointer
@@ -303,6 +325,47 @@ public:
     }
   }
 
+  // tracers from an emitter with a limited lifetime live in their own collection, which
+  //   holds at most _cap of them; _owner is the tag of the feature that emits them
+  void set_ring_capacity(const size_t _cap, const int32_t _owner) {
+    ring_cap = _cap;
+    ring_owner = _owner;
+    ring_next = 0;
+  }
+  size_t get_ring_capacity() const { return ring_cap; }
+  int32_t get_ring_owner() const { return ring_owner; }
+
+  // add tracers to a collection with a ring capacity: append until it is full, then
+  //   overwrite the oldest in turn, so retiring a tracer costs no compaction or copying
+  void add_new_ring(const ElementPacket<S>& _in) {
+    assert(this->E == inert && "Only tracers can be kept in a ring");
+    assert(ring_cap > 0 && "Collection has no ring capacity");
+
+    // if more arrive than fit, only the newest survive
+    const size_t nin = _in.x.size() / Dimensions;
+    size_t first = (nin > ring_cap) ? nin - ring_cap : 0;
+
+    // fill any free space at the end
+    if (this->n < ring_cap and first < nin) {
+      const size_t nfit = std::min(nin - first, ring_cap - this->n);
+      ElementPacket<S> head(std::vector<S>(_in.x.begin() + Dimensions*first,
+                                           _in.x.begin() + Dimensions*(first+nfit)),
+                            std::vector<Int>(), std::vector<S>(), nfit, 0);
+      add_new(head, 0.0);
+      first += nfit;
+    }
+
+    // and replace the oldest with the rest, they move and are measured like new ones
+    if (VERBOSE and first < nin) { std::cout << "  retiring " << (nin-first) << " tracers" << std::endl; }
+    for (size_t i=first; i<nin; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) {
+        this->x[d][ring_next] = _in.x[Dimensions*i+d];
+        if (this->B) (*this->ux)[d][ring_next] = _in.x[Dimensions*i+d];
+      }
+      ring_next = (ring_next + 1) % ring_cap;
+    }
+  }
+
   // up-size all arrays to the new size, filling with sane values
   void resize(const size_t _nnew) {
     const size_t currn = this->n;
@@ -313,6 +376,9 @@ public:
 
     if (_nnew == currn) return;
 
+    // particles appended later are all sources, but a shrink can drop listed ones
+    if (_nnew < active_upto) clear_active_sources();
+
     // radii here
     if (this->E == inert) {
       // no radii or elongation
@@ -329,6 +395,9 @@ public:
       for (size_t i=thisen; i<_nnew; ++i) {
         elong[i] = 1.0;
       }
+
+      // new particles from diffusion or shedding belong to no feature
+      tag.resize(_nnew, 0);
     }
 
     // vel grads ((no need to set it)
@@ -339,6 +408,76 @@ public:
     }
   }
 
+  // remove the flagged particles, preserving the order of the others
+  void compact(const std::vector<bool>& _remove) {
+    // compress the local arrays before the base class resets n
+    size_t copyto = 0;
+    for (size_t i=0; i<this->n; ++i) {
+      if (not _remove[i]) {
+        if (i != copyto) {
+          if (this->E != inert) {
+            r[copyto] = r[i];
+            elong[copyto] = elong[i];
+            tag[copyto] = tag[i];
+          }
+          if (ug) for (size_t d=0; d<Dimensions*Dimensions; ++d) (*ug)[d][copyto] = (*ug)[d][i];
+        }
+        copyto++;
+      }
+    }
+    if (this->E != inert) {
+      r.resize(copyto);
+      elong.resize(copyto);
+      tag.resize(copyto);
+    }
+    if (ug) for (size_t d=0; d<Dimensions*Dimensions; ++d) (*ug)[d].resize(copyto);
+
+    // must explicitly call the method in the base class
+    ElementBase<S>::compact(_remove);
+
+    // particle indices have changed
+    if (tree) tree->invalidate();
+    clear_active_sources();
+  }
+
+  // make room for at least _nmax particles without changing n
+  void reserve(const size_t _nmax) {
+    ElementBase<S>::reserve(_nmax);
+    if (this->E != inert) {
+      r.reserve(_nmax);
+      elong.reserve(_nmax);
+      tag.reserve(_nmax);
+    }
+    if (ug) for (size_t d=0; d<Dimensions*Dimensions; ++d) (*ug)[d].reserve(_nmax);
+  }
+
+  // add _nnew particles to the end and return the index of the first one, the caller
+  //   fills in their positions, strengths, and radii; capacity grows geometrically so
+  //   that adding a few rows of particles every step rarely moves the arrays
+  size_t extend(const size_t _nnew) {
+    const size_t nold = this->n;
+    if (this->x[0].capacity() < nold+_nnew) reserve(std::max(nold+_nnew, nold+nold/2));
+    resize(nold+_nnew);
+    return nold;
+  }
+
+  // append all particles from another Points collection of the same type
+  void append(Points<S> const & _other) {
+    if (this->E != inert) {
+      r.insert(r.end(), _other.r.begin(), _other.r.end());
+      elong.insert(elong.end(), _other.elong.begin(), _other.elong.end());
+      tag.insert(tag.end(), _other.tag.begin(), _other.tag.end());
+    }
+    if (ug and _other.ug) {
+      for (size_t d=0; d<Dimensions*Dimensions; ++d) {
+        (*ug)[d].insert((*ug)[d].end(), (*_other.ug)[d].begin(), (*_other.ug)[d].end());
+      }
+    }
+
+    // must explicitly call the method in the base class
+    ElementBase<S>::append(_other);
+  }
+
   void zero_vels() {
     // must explicitly call the method in the base class to zero the vels
     ElementBase<S>::zero_vels();
@@ -558,6 +697,67 @@ public:
     return *imax;
   }
 
+  // list the particles strong enough to be worth using as sources - all remain targets,
+  //   and any particles appended after this are sources until the next call
+  void set_active_sources(const S _reltol) {
+    clear_active_sources();
+    if (this->E == inert or not this->s or this->n == 0) return;
+
+    Vector<S> smag(this->n);
+    S maxmag = 0.0;
+    S totcirc = 0.0;
+    for (size_t i=0; i<this->n; ++i) {
+      smag[i] = std::sqrt(std::pow((*this->s)[0][i], 2) + std::pow((*this->s)[1][i], 2) + std::pow((*this->s)[2][i], 2));
+      maxmag = std::max(maxmag, smag[i]);
+      totcirc += smag[i];
+    }
+
+    // zero-strength particles are always dropped
+    const S thresh = _reltol * maxmag;
+    S dropcirc = 0.0;
+    active_src.reserve(this->n);
+    for (size_t i=0; i<this->n; ++i) {
+      if (smag[i] > thresh) active_src.push_back(i);
+      else dropcirc += smag[i];
+    }
+    active_upto = this->n;
+
+    std::cout << "    using " << active_src.size() << " of " << this->n << " particles as sources, ignoring "
+              << dropcirc << " of " << totcirc << " total circulation" << std::endl;
+  }
+
+  void clear_active_sources() {
+    active_src.clear();
+    active_upto = 0;
+  }
+
+  // copy out the source particles, if some have been dropped
+  bool get_active_sources(std::array<Vector<S>,Dimensions>& _x,
+                          Vector<S>& _r,
+                          std::array<Vector<S>,Dimensions>& _s) const {
+    if (active_upto == 0 or active_upto > this->n or not this->s) return false;
+    const size_t nsrc = active_src.size() + (this->n - active_upto);
+    if (nsrc == this->n) return false;
+
+    for (size_t d=0; d<Dimensions; ++d) {
+      _x[d].resize(nsrc);
+      _s[d].resize(nsrc);
+    }
+    _r.resize(nsrc);
+    size_t k = 0;
+    auto copy_one = [&](const size_t i) {
+      for (size_t d=0; d<Dimensions; ++d) {
+        _x[d][k] = this->x[d][i];
+        _s[d][k] = (*this->s)[d][i];
+      }
+      _r[k] = r[i];
+      k++;
+    };
+    for (auto const& i : active_src) copy_one(i);
+    for (size_t i=active_upto; i<this->n; ++i) copy_one(i);
+    return true;
+  }
+
   // find the new peak strength magnitude
   void update_max_str() {
     S thismax = ElementBase<S>::get_max_str();
@@ -879,6 +1079,7 @@ protected:
   // additional state vectors
   Vector<S> r;		// thickness/radius
   Vector<S> elong;	// scalar elongation, does not require register alignment
+  Vector<int32_t> tag;	// which flow feature created each particle, 0 if none
 
   // derivatives of state vector
   std::optional<std::array<Vector<S>,Dimensions*Dimensions>> ug;   // velocity gradients
@@ -887,6 +1088,12 @@ private:
 #ifdef USE_GL
   std::shared_ptr<GlState> mgl;		// for drawing only
 #endif
+  std::shared_ptr<PointsTree<S>> tree;	// for neighbor searches
   float max_strength;
+  std::vector<Int> active_src;		// particles strong enough to use as sources
+  size_t active_upto = 0;		// n when that list was made, 0 if there is none
+  size_t ring_cap = 0;			// most tracers kept, 0 if they live forever
+  size_t ring_next = 0;			// slot of the oldest tracer once the ring is full
+  int32_t ring_owner = 0;		// tag of the feature whose tracers are in the ring
 };
 
@@ -0,0 +1,355 @@
+/*
+ * PointsTree.h - persistent spatial tree and Verlet-style neighbor lists for Points
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+
+
+//
+// A binary spatial tree over a set of particles which is kept alive between calls.
+//
+// Particles move only a small fraction of their spacing per RK stage or step, so
+// rather than rebuild the tree, we refit the bounding boxes bottom-up over the
+// existing topology. Neighbor lists are generated with an extra skin
+// margin (like MD Verlet lists) and reused until some particle has moved more than
+// half of the skin. Small numbers of appended particles are inserted into the
+// existing leaves and get lists of their own, and only the existing lists that they
+// appear in are extended; the whole structure is rebuilt only when particles cross
+// the skin or when N changes by more than a threshold fraction.
+//
+template <class S>
+class PointsTree {
+public:
+  PointsTree(const S _skin = 0.25, const S _grow = 0.05)
+    : skin_frac(_skin),
+      grow_frac(_grow),
+      list_cutoff(-1.0),
+      num_refit(0),
+      num_insert(0),
+      num_rebuild(0)
+    {}
+
+  // one tree node, children (if any) are at child and child+1
+  struct Node {
+    std::array<S,Dimensions> bmin, bmax;    // bounding box
+    int32_t child;                          // -1 for leaves
+    int32_t leaf;                           // index into leafidx, -1 for internal nodes
+  };
+
+  // call this before every use: refits, inserts, or rebuilds as necessary, and
+  //   guarantees that the neighbor lists contain all particles within _cutoff
+  void update(const std::array<Vector<S>,Dimensions>& _x,
+              const S _cutoff) {
+
+    const size_t n = _x[0].size();
+
+    // decide what needs to be done
+    bool rebuild = false;
+    bool insert = false;
+    if (nodes.empty() or n < nref) {
+      rebuild = true;
+    } else if (n > nref) {
+      // too many new particles and the tree becomes unbalanced
+      if ((S)(n-nref) > grow_frac*(S)nref) rebuild = true;
+      else insert = true;
+    }
+    // did any particle cross half of the skin? then the lists may miss pairs
+    if (not rebuild and _cutoff + 2.0*max_displacement(_x) > list_cutoff) rebuild = true;
+
+    if (rebuild) {
+      build(_x, _cutoff);
+      num_rebuild++;
+    } else if (insert) {
+      add_new(_x);
+      num_insert++;
+    } else {
+      refit(_x);
+      num_refit++;
+    }
+  }
+
+  // force a full rebuild next time (call after reordering or removing particles)
+  void invalidate() { nodes.clear(); }
+
+  // neighbors of particle _i include itself, and may include particles out to cutoff+skin
+  size_t get_num_nbrs(const size_t _i) const { return nbr_off[_i+1] - nbr_off[_i]; }
+  const int32_t* get_nbrs(const size_t _i) const { return nbr_idx.data() + nbr_off[_i]; }
+
+  const std::vector<Node>& get_nodes() const { return nodes; }
+  const std::vector<std::vector<int32_t>>& get_leaves() const { return leafidx; }
+  const size_t get_n() const { return nref; }
+
+  // how often each kind of update has happened
+  long int get_num_rebuilds() const { return num_rebuild; }
+  long int get_num_inserts() const { return num_insert; }
+  long int get_num_refits() const { return num_refit; }
+
+private:
+  // largest move of any particle since the neighbor lists were generated
+  S max_displacement(const std::array<Vector<S>,Dimensions>& _x) const {
+    S maxdsq = 0.0;
+    #pragma omp parallel for reduction(max:maxdsq)
+    for (int32_t i=0; i<(int32_t)xref[0].size(); ++i) {
+      S dsq = 0.0;
+      for (size_t d=0; d<Dimensions; ++d) dsq += std::pow(_x[d][i]-xref[d][i], 2);
+      maxdsq = std::max(maxdsq, dsq);
+    }
+    return std::sqrt(maxdsq);
+  }
+
+  // full construction of tree topology and neighbor lists
+  void build(const std::array<Vector<S>,Dimensions>& _x,
+             const S _cutoff) {
+
+    const size_t n = _x[0].size();
+    nodes.clear();
+    leafidx.clear();
+    if (n == 0) {
+      nref = 0;
+      list_cutoff = _cutoff * (1.0+skin_frac);
+      nbr_off.assign(1, 0);
+      nbr_idx.clear();
+      for (size_t d=0; d<Dimensions; ++d) xref[d].clear();
+      return;
+    }
+
+    // recursive median splits over an index array
+    std::vector<int32_t> idx(n);
+    std::iota(idx.begin(), idx.end(), 0);
+    nodes.reserve(4*n/leaf_size + 1);
+    nodes.emplace_back();
+    split_node(_x, idx, 0, (int32_t)n, 0);
+
+    refit(_x);
+    list_cutoff = _cutoff * (1.0+skin_frac);
+    make_lists(_x);
+  }
+
+  // recursively partition [_first,_last) along the longest box dimension
+  void split_node(const std::array<Vector<S>,Dimensions>& _x,
+                  std::vector<int32_t>& _idx,
+                  const int32_t _first, const int32_t _last,
+                  const int32_t _inode) {
+
+    nodes[_inode].child = -1;
+    nodes[_inode].leaf = -1;
+
+    if (_last - _first <= (int32_t)leaf_size) {
+      nodes[_inode].leaf = (int32_t)leafidx.size();
+      leafidx.emplace_back(_idx.begin()+_first, _idx.begin()+_last);
+      return;
+    }
+
+    // find the longest dimension of this subset
+    std::array<S,Dimensions> bmin, bmax;
+    bmin.fill(std::numeric_limits<S>::max());
+    bmax.fill(std::numeric_limits<S>::lowest());
+    for (int32_t i=_first; i<_last; ++i) {
+      for (size_t d=0; d<Dimensions; ++d) {
+        bmin[d] = std::min(bmin[d], _x[d][_idx[i]]);
+        bmax[d] = std::max(bmax[d], _x[d][_idx[i]]);
+      }
+    }
+    size_t dim = 0;
+    for (size_t d=1; d<Dimensions; ++d) if (bmax[d]-bmin[d] > bmax[dim]-bmin[dim]) dim = d;
+
+    // split at the median
+    const int32_t mid = _first + (_last-_first)/2;
+    std::nth_element(_idx.begin()+_first, _idx.begin()+mid, _idx.begin()+_last,
+                     [&](const int32_t a, const int32_t b) { return _x[dim][a] < _x[dim][b]; });
+
+    // children are adjacent and always follow their parent
+    const int32_t ichild = (int32_t)nodes.size();
+    nodes[_inode].child = ichild;
+    nodes.emplace_back();
+    nodes.emplace_back();
+    split_node(_x, _idx, _first, mid, ichild);
+    split_node(_x, _idx, mid, _last, ichild+1);
+  }
+
+  // bottom-up recalculation of boxes, topology is unchanged
+  void refit(const std::array<Vector<S>,Dimensions>& _x) {
+
+    // children always have higher indices than their parents
+    for (int32_t inode=(int32_t)nodes.size()-1; inode>=0; --inode) {
+      Node& nd = nodes[inode];
+      nd.bmin.fill(std::numeric_limits<S>::max());
+      nd.bmax.fill(std::numeric_limits<S>::lowest());
+
+      if (nd.leaf >= 0) {
+        for (const int32_t i : leafidx[nd.leaf]) {
+          for (size_t d=0; d<Dimensions; ++d) {
+            nd.bmin[d] = std::min(nd.bmin[d], _x[d][i]);
+            nd.bmax[d] = std::max(nd.bmax[d], _x[d][i]);
+          }
+        }
+      } else if (nd.child >= 0) {
+        for (int32_t c=nd.child; c<nd.child+2; ++c) {
+          const Node& ch = nodes[c];
+          for (size_t d=0; d<Dimensions; ++d) {
+            nd.bmin[d] = std::min(nd.bmin[d], ch.bmin[d]);
+            nd.bmax[d] = std::max(nd.bmax[d], ch.bmax[d]);
+          }
+        }
+      }
+    }
+  }
+
+  // drop particles appended since the last build into the closest leaves
+  void add_new(const std::array<Vector<S>,Dimensions>& _x) {
+
+    const size_t n = _x[0].size();
+    for (size_t i=nref; i<n; ++i) {
+      int32_t inode = 0;
+      while (nodes[inode].leaf < 0) {
+        // descend into the child whose box is nearest
+        const int32_t c = nodes[inode].child;
+        inode = (box_distsq(nodes[c], _x, i) <= box_distsq(nodes[c+1], _x, i)) ? c : c+1;
+      }
+      leafidx[nodes[inode].leaf].push_back((int32_t)i);
+    }
+
+    refit(_x);
+    append_lists(_x);
+  }
+
+  // squared distance from particle _i to a node's bounding box
+  S box_distsq(const Node& _nd, const std::array<Vector<S>,Dimensions>& _x, const size_t _i) const {
+    S dsq = 0.0;
+    for (size_t d=0; d<Dimensions; ++d) {
+      const S dx = std::max(std::max(_nd.bmin[d] - _x[d][_i], _x[d][_i] - _nd.bmax[d]), (S)0.0);
+      dsq += dx*dx;
+    }
+    return dsq;
+  }
+
+  // all particles within list_cutoff of particle _i, from the current tree
+  void find_nbrs(const std::array<Vector<S>,Dimensions>& _x, const size_t _i,
+                 std::vector<int32_t>& _out) const {
+
+    const S cutsq = list_cutoff*list_cutoff;
+    std::vector<int32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (not stack.empty()) {
+      const Node& nd = nodes[stack.back()];
+      stack.pop_back();
+      if (box_distsq(nd, _x, _i) > cutsq) continue;
+      if (nd.leaf >= 0) {
+        for (const int32_t j : leafidx[nd.leaf]) {
+          S dsq = 0.0;
+          for (size_t d=0; d<Dimensions; ++d) dsq += std::pow(_x[d][_i]-_x[d][j], 2);
+          if (dsq <= cutsq) _out.push_back(j);
+        }
+      } else if (nd.child >= 0) {
+        stack.push_back(nd.child);
+        stack.push_back(nd.child+1);
+      }
+    }
+  }
+
+  // generate compressed neighbor lists at radius list_cutoff from the current tree
+  void make_lists(const std::array<Vector<S>,Dimensions>& _x) {
+
+    const size_t n = _x[0].size();
+    std::vector<std::vector<int32_t>> tmp(n);
+
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)n; ++i) find_nbrs(_x, i, tmp[i]);
+
+    // compress into one array
+    nbr_off.resize(n+1);
+    nbr_off[0] = 0;
+    for (size_t i=0; i<n; ++i) nbr_off[i+1] = nbr_off[i] + tmp[i].size();
+    nbr_idx.resize(nbr_off[n]);
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)n; ++i) {
+      std::copy(tmp[i].begin(), tmp[i].end(), nbr_idx.begin()+nbr_off[i]);
+    }
+
+    // save reference positions for the skin test
+    nref = n;
+    for (size_t d=0; d<Dimensions; ++d) xref[d] = _x[d];
+  }
+
+  // give particles appended since the last lists their own, and add them to the lists of
+  //   the existing particles they are near; the old pairs are still good within the skin,
+  //   because the displacement test keeps measuring from the old reference positions
+  void append_lists(const std::array<Vector<S>,Dimensions>& _x) {
+
+    const size_t n = _x[0].size();
+    const size_t nold = nref;
+    std::vector<std::vector<int32_t>> tmp(n-nold);
+
+    #pragma omp parallel for
+    for (int32_t i=(int32_t)nold; i<(int32_t)n; ++i) find_nbrs(_x, i, tmp[i-nold]);
+
+    // existing particles that gained a neighbor
+    std::vector<uint32_t> nadd(nold, 0);
+    for (auto const& lst : tmp) {
+      for (const int32_t j : lst) if ((size_t)j < nold) nadd[j]++;
+    }
+
+    // move the old lists apart to make room, last first, so that nothing is overwritten
+    std::vector<size_t> new_off(n+1);
+    new_off[0] = 0;
+    for (size_t i=0; i<nold; ++i) new_off[i+1] = new_off[i] + (nbr_off[i+1]-nbr_off[i]) + nadd[i];
+    for (size_t i=nold; i<n; ++i) new_off[i+1] = new_off[i] + tmp[i-nold].size();
+    nbr_idx.resize(new_off[n]);
+    for (size_t i=nold; i>0; --i) {
+      if (new_off[i-1] == nbr_off[i-1]) break;
+      std::copy_backward(nbr_idx.begin()+nbr_off[i-1], nbr_idx.begin()+nbr_off[i],
+                         nbr_idx.begin()+new_off[i-1]+(nbr_off[i]-nbr_off[i-1]));
+    }
+
+    // then fill the gaps and the new lists
+    std::vector<size_t> fill(nold);
+    for (size_t i=0; i<nold; ++i) fill[i] = new_off[i] + (nbr_off[i+1]-nbr_off[i]);
+    for (size_t i=nold; i<n; ++i) {
+      const std::vector<int32_t>& lst = tmp[i-nold];
+      std::copy(lst.begin(), lst.end(), nbr_idx.begin()+new_off[i]);
+      for (const int32_t j : lst) if ((size_t)j < nold) nbr_idx[fill[j]++] = (int32_t)i;
+    }
+    nbr_off = std::move(new_off);
+
+    // only the new particles get reference positions now
+    nref = n;
+    for (size_t d=0; d<Dimensions; ++d) xref[d].insert(xref[d].end(), _x[d].begin()+nold, _x[d].end());
+  }
+
+  static constexpr size_t leaf_size = 16;
+
+  S skin_frac;          // skin thickness as a fraction of the requested cutoff
+  S grow_frac;          // allowed fractional growth of N before a full rebuild
+  S list_cutoff;        // radius of the current neighbor lists, including skin
+
+  std::vector<Node> nodes;
+  std::vector<std::vector<int32_t>> leafidx;
+
+  // neighbor lists, compressed
+  std::vector<size_t> nbr_off;
+  std::vector<int32_t> nbr_idx;
+
+  // positions when lists were last generated
+  size_t nref = 0;
+  std::array<Vector<S>,Dimensions> xref;
+
+  // statistics
+  long int num_refit, num_insert, num_rebuild;
+};
@@ -11,170 +11,13 @@
 #include "Points.h"
 #include "Surfaces.h"
 #include "MathHelper.h"
+#include "DistanceField.h"
 
 #include <cstdlib>
 #include <limits>
 #include <vector>
 #include <cmath>
 
-enum ClosestType { panel, edge, node };
-
-//
-// on output of this routine, jidx is:
-//   -1..-3 if an edge is the closest
-//    0 if the panel face is closest
-//    1..3 if a node is closest
-//
-template <class S> 
-struct ClosestReturn { 
-  int jidx; 
-  S distsq; 
-  S cpx, cpy, cpz;
-  ClosestType disttype; 
-}; 
-
-//
-// find closest distance from a point to a triangle
-// logic taken from pointElemDistance3d
-//
-// most likely 147 flops
-//
-template <class S>
-ClosestReturn<S> panel_point_distance(const S sx0, const S sy0, const S sz0,
-                                      const S sx1, const S sy1, const S sz1,
-                                      const S sx2, const S sy2, const S sz2,
-                                      const S sxn, const S syn, const S szn,
-                                      const S tx,  const S ty,  const S tz) {
-
-  ClosestReturn<S> retval;
-  retval.jidx = 0;
-  retval.distsq = 9.9e+9;
-
-  // test against each of the three corners
-  const std::array<S,3> dt0 = {tx-sx0, ty-sy0, tz-sz0};
-  const S dt0ds = dot_product(dt0, dt0);
-  if (dt0ds < retval.distsq) {
-    retval.jidx = 1;
-    retval.distsq = dt0ds;
-    retval.disttype = node;
-    retval.cpx = sx0;
-    retval.cpy = sy0;
-    retval.cpz = sz0;
-  }
-
-  const std::array<S,3> dt1 = {tx-sx1, ty-sy1, tz-sz1};
-  const S dt1ds = dot_product(dt1, dt1);
-  if (dt1ds < retval.distsq) {
-    retval.jidx = 2;
-    retval.distsq = dt1ds;
-    retval.disttype = node;
-    retval.cpx = sx1;
-    retval.cpy = sy1;
-    retval.cpz = sz1;
-  }
-
-  const std::array<S,3> dt2 = {tx-sx2, ty-sy2, tz-sz2};
-  const S dt2ds = dot_product(dt2, dt2);
-  if (dt2ds < retval.distsq) {
-    retval.jidx = 3;
-    retval.distsq = dt2ds;
-    retval.disttype = node;
-    retval.cpx = sx2;
-    retval.cpy = sy2;
-    retval.cpz = sz2;
-  }
-  // 27 flops to here
-
-  //std::cout << "test point " << tx << " " << ty << " " << tz << std::endl;
-  //std::cout << "  current distsq " << retval.distsq << std::endl;
-
-  // compare to the edges
-  const std::array<S,3> ds01 = {sx1-sx0, sy1-sy0, sz1-sz0};
-  //std::cout << "  ds01 " << ds01[0] << " " << ds01[1] << " " << ds01[2] << std::endl;
-  const S ds01ds = 1.0 / dot_product(ds01, ds01);
-  //std::cout << "  ds01ds " << ds01ds << std::endl;
-  std::array<S,3> rx;
-  cross_product(ds01, dt0, rx);
-  //std::cout << "  rx   " << rx[0] << " " << rx[1] << " " << rx[2] << std::endl;
-  const S dt01ds = dot_product(rx, rx) * ds01ds;
-  //std::cout << "  dt01ds " << dt01ds << std::endl;
-  if (dt01ds < retval.distsq) {
-    const S t = dot_product(ds01, dt0) * ds01ds;
-    //std::cout << "  t " << t << std::endl;
-    if (0.0 < t and t < 1.0) {
-      retval.jidx = -1;
-      retval.distsq = dt01ds;
-      retval.disttype = edge;
-      retval.cpx = sx0 + t*ds01[0];
-      retval.cpy = sy0 + t*ds01[1];
-      retval.cpz = sz0 + t*ds01[2];
-    }
-  }
-  // 25 minimum, 33 maybe, 39 possibly
-
-  const std::array<S,3> ds12 = {sx2-sx1, sy2-sy1, sz2-sz1};
-  const S ds12ds = 1.0 / dot_product(ds12, ds12);
-  cross_product(ds12, dt1, rx);
-  const S dt12ds = dot_product(rx, rx) * ds12ds;
-  //std::cout << "  dt12ds " << dt12ds << std::endl;
-  if (dt12ds < retval.distsq) {
-    const S t = dot_product(ds12, dt1) * ds12ds;
-    //std::cout << "  t " << t << std::endl;
-    if (0.0 < t and t < 1.0) {
-      retval.jidx = -2;
-      retval.distsq = dt12ds;
-      retval.disttype = edge;
-      retval.cpx = sx1 + t*ds12[0];
-      retval.cpy = sy1 + t*ds12[1];
-      retval.cpz = sz1 + t*ds12[2];
-    }
-  }
-
-  const std::array<S,3> ds20 = {sx0-sx2, sy0-sy2, sz0-sz2};
-  const S ds20ds = 1.0 / dot_product(ds20, ds20);
-  cross_product(ds20, dt2, rx);
-  const S dt20ds = dot_product(rx, rx) * ds20ds;
-  //std::cout << "  dt20ds " << dt20ds << std::endl;
-  if (dt20ds < retval.distsq) {
-    const S t = dot_product(ds20, dt2) * ds20ds;
-    //std::cout << "  t " << t << std::endl;
-    if (0.0 < t and t < 1.0) {
-      retval.jidx = -3;
-      retval.distsq = dt20ds;
-      retval.disttype = edge;
-      retval.cpx = sx2 + t*ds20[0];
-      retval.cpy = sy2 + t*ds20[1];
-      retval.cpz = sz2 + t*ds20[2];
-    }
-  }
-  // 102 minimum flops to here
-
-  // finally, check vs. the panel prism
-  // test to see if the test point is in the positive half-space of each edge
-  const std::array<S,3> norm = {sxn, syn, szn};
-  std::array<S,3> interior;
-  cross_product(norm, ds01, interior);
-  const S in01 = dot_product(dt0, interior);
-  cross_product(norm, ds12, interior);
-  const S in12 = dot_product(dt1, interior);
-  cross_product(norm, ds20, interior);
-  const S in20 = dot_product(dt2, interior);
-  //std::cout << "  interior distances are " << in01 << " " << in12 << " " << in20 << std::endl;
-  if (in01 > 0.0 and in12 > 0.0 and in20 > 0.0) {
-    retval.jidx = 0;
-    retval.disttype = panel;
-    const S truedist = dot_product(dt0, norm);
-    retval.distsq = truedist*truedist;
-    retval.cpx = tx - sxn*truedist;
-    retval.cpy = ty - syn*truedist;
-    retval.cpz = tz - szn*truedist;
-  }
-  // minumum 45 more flops here, possibly 57 if match
-
-  return retval;
-}
-
-
 //
 // naive caller for the O(N^2) panel-particle reflection kernel
 //
@@ -191,42 +34,41 @@ void reflect_panp2 (Surfaces<S> const& _src, Points<S>& _targ) {
   std::array<Vector<S>,Dimensions> const& sn = _src.get_norm();
   std::array<Vector<S>,Dimensions>&       tx = _targ.get_pos();
 
+  // only particles near or inside the body need the exact panel search
+  const S band = (_src.get_distance_field() ? (S)0.0 : typical_panel_size<S>(_src));
+  Eigen::Transform<double,3,Eigen::Affine> tobody;
+  std::shared_ptr<DistanceField<S>> sdf = get_distance_field<S>(_src, band);
+  if (not get_body_frame<S>(_src, (S)0.01*sdf->get_reach(), tobody)) sdf.reset();
+  const S reachsq = sdf ? std::pow(sdf->get_reach(), 2) : (S)0.0;
+
   size_t num_reflected = 0;
-  const S eps = 10.0*std::numeric_limits<S>::epsilon();
+  size_t num_tests = 0;
 
-  #pragma omp parallel for reduction(+:num_reflected)
+  #pragma omp parallel for reduction(+:num_reflected,num_tests)
   for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) {
-    S mindist = std::numeric_limits<S>::max();
-    std::vector<ClosestReturn<S>> hits;
-
-    // iterate and search for closest panel
-    for (size_t j=0; j<_src.get_npanels(); ++j) {
-      const Int jp0 = si[3*j+0];
-      const Int jp1 = si[3*j+1];
-      const Int jp2 = si[3*j+2];
-      ClosestReturn<S> result = panel_point_distance<S>(sx[0][jp0], sx[1][jp0], sx[2][jp0],
-                                                        sx[0][jp1], sx[1][jp1], sx[2][jp1],
-                                                        sx[0][jp2], sx[1][jp2], sx[2][jp2],
-                                                        sn[0][j],   sn[1][j],   sn[2][j],
-                                                        tx[0][i],   tx[1][i],   tx[2][i]);
-
-      if (result.distsq < mindist - eps) {
-        // we blew the old one away
-        mindist = result.distsq;
-        // rewrite jidx as the panel index
-        result.jidx = j;
-        hits.clear();
-        hits.push_back(result);
-        //std::cout << "  THIS BLOWS AWAY THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
-
-      } else if (result.distsq < mindist + eps) {
-        // we are effectively the same as the old closest
-        // rewrite jidx as the panel index
-        result.jidx = j;
-        hits.push_back(result);
-        //std::cout << "  THIS TIES THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
+
+    // search all panels, or just the few that could be closest
+    const Int* cand = nullptr;
+    size_t ncand = _src.get_npanels();
+    if (sdf) {
+      const Eigen::Vector3d pb = tobody * Eigen::Vector3d(tx[0][i], tx[1][i], tx[2][i]);
+      const Int* list = nullptr;
+      size_t nlist = 0;
+      const auto cell = sdf->lookup((S)pb(0), (S)pb(1), (S)pb(2), list, nlist);
+      if (cell == DistanceField<S>::far_outside) continue;
+      if (cell == DistanceField<S>::near_wall) {
+        cand = list;
+        ncand = nlist;
       }
     }
+    num_tests += ncand;
+    std::vector<ClosestReturn<S>> hits = find_closest_panels<S>(sx, si, sn, cand, ncand, tx[0][i], tx[1][i], tx[2][i]);
+
+    // a candidate list is only good close to the wall
+    if (cand and hits[0].distsq > reachsq) {
+      num_tests += _src.get_npanels();
+      hits = find_closest_panels<S>(sx, si, sn, nullptr, _src.get_npanels(), tx[0][i], tx[1][i], tx[2][i]);
+    }
 
     // dump out the hits
     if (false) {
@@ -285,7 +127,7 @@ void reflect_panp2 (Surfaces<S> const& _src, Points<S>& _targ) {
   }
 
   std::cout << "    reflected " << num_reflected << " particles" << std::endl;
-  const S flops = 149.0 * (float)_targ.get_n() * (float)_src.get_npanels();
+  const S flops = 149.0 * (float)num_tests;
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
@@ -307,6 +149,9 @@ void reflect_interior(std::vector<Collection> const & _bdry,
     if (std::holds_alternative<Points<S>>(targ)) {
       Points<S>& pts = std::get<Points<S>>(targ);
 
+      // particles that do not move with the flow were not put there by it
+      if (pts.get_movet() != lagrangian) continue;
+
       for (auto &src : _bdry) {
         if (std::holds_alternative<Surfaces<S>>(src)) {
           Surfaces<S> const & surf = std::get<Surfaces<S>>(src);
@@ -392,7 +237,7 @@ std::vector<std::tuple<S,S,S>> init_cut_tables (const S _dx) {
 // use the cut tables - assume _pos is normalized by vdelta
 //
 template <class S>
-std::pair<S,S> get_cut_entry (std::vector<std::tuple<S,S,S>>& ct, const S _pos) {
+std::pair<S,S> get_cut_entry (std::vector<std::tuple<S,S,S>> const & ct, const S _pos) {
   // set defaults (change nothing)
   S smult = 1.0;
   S dshift = 0.0;
@@ -440,12 +285,8 @@ void clear_inner_panp2 (const int _method,
   std::cout << "  Clearing" << _targ.to_string() << " from near" << _src.to_string() << std::endl;
   auto start = std::chrono::system_clock::now();
 
-  static bool made_cut_tables = false;
-  static std::vector<std::tuple<S,S,S>> ct;
-  if (not made_cut_tables) {
-    ct = init_cut_tables<S>((S)0.1);
-    made_cut_tables = true;
-  }
+  // built once, safely, even with several simulations running in threads
+  static const std::vector<std::tuple<S,S,S>> ct = init_cut_tables<S>((S)0.1);
 
   // get handles for the vectors
   std::array<Vector<S>,Dimensions> const& sx = _src.get_pos();
@@ -458,43 +299,45 @@ void clear_inner_panp2 (const int _method,
   Vector<S>&                              tr = _targ.get_rad();
   const bool are_fldpts = tr.empty();
 
+  // particles farther than this from the wall are not changed
+  S band = _cutoff_mult*_ips;
+  if (_method == 0) band += are_fldpts ? _ips : *std::max_element(tr.begin(), tr.end());
+  band = std::max(band, _ips);
+
+  // so only particles near or inside the body need the exact panel search
+  Eigen::Transform<double,3,Eigen::Affine> tobody;
+  std::shared_ptr<DistanceField<S>> sdf = get_distance_field<S>(_src, band);
+  if (not get_body_frame<S>(_src, (S)0.01*sdf->get_reach(), tobody)) sdf.reset();
+  const S reachsq = sdf ? std::pow(sdf->get_reach(), 2) : (S)0.0;
+
   size_t num_cropped = 0;
-  const S eps = 10.0*std::numeric_limits<S>::epsilon();
+  size_t num_tests = 0;
 
-  #pragma omp parallel for reduction(+:num_cropped)
+  #pragma omp parallel for reduction(+:num_cropped,num_tests)
   for (int32_t i=0; i<(int32_t)_targ.get_n(); ++i) {
 
-    S mindist = std::numeric_limits<S>::max();
-    std::vector<ClosestReturn<S>> hits;
-
-    // iterate and search for closest panel/node
-    for (size_t j=0; j<_src.get_npanels(); ++j) {
-      const Int jp0 = si[3*j+0];
-      const Int jp1 = si[3*j+1];
-      const Int jp2 = si[3*j+2];
-      ClosestReturn<S> result = panel_point_distance<S>(sx[0][jp0], sx[1][jp0], sx[2][jp0],
-                                                        sx[0][jp1], sx[1][jp1], sx[2][jp1],
-                                                        sx[0][jp2], sx[1][jp2], sx[2][jp2],
-                                                        sn[0][j],   sn[1][j],   sn[2][j],
-                                                        tx[0][i],   tx[1][i],   tx[2][i]);
-
-      if (result.distsq < mindist - eps) {
-        // we blew the old one away
-        mindist = result.distsq;
-        // rewrite jidx as the panel index
-        result.jidx = j;
-        hits.clear();
-        hits.push_back(result);
-        //std::cout << "  THIS BLOWS AWAY THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
-
-      } else if (result.distsq < mindist + eps) {
-        // we are effectively the same as the old closest
-        // rewrite jidx as the panel index
-        result.jidx = j;
-        hits.push_back(result);
-        //std::cout << "  THIS TIES THE CLOSEST, AT " << std::sqrt(mindist) << std::endl;
+    // search all panels, or just the few that could be closest
+    const Int* cand = nullptr;
+    size_t ncand = _src.get_npanels();
+    if (sdf) {
+      const Eigen::Vector3d pb = tobody * Eigen::Vector3d(tx[0][i], tx[1][i], tx[2][i]);
+      const Int* list = nullptr;
+      size_t nlist = 0;
+      const auto cell = sdf->lookup((S)pb(0), (S)pb(1), (S)pb(2), list, nlist);
+      if (cell == DistanceField<S>::far_outside) continue;
+      if (cell == DistanceField<S>::near_wall) {
+        cand = list;
+        ncand = nlist;
       }
-    } // end of loop over panels
+    }
+    num_tests += ncand;
+    std::vector<ClosestReturn<S>> hits = find_closest_panels<S>(sx, si, sn, cand, ncand, tx[0][i], tx[1][i], tx[2][i]);
+
+    // a candidate list is only good close to the wall
+    if (cand and hits[0].distsq > reachsq) {
+      num_tests += _src.get_npanels();
+      hits = find_closest_panels<S>(sx, si, sn, nullptr, _src.get_npanels(), tx[0][i], tx[1][i], tx[2][i]);
+    }
 
     // dump out the hits
     if (false) {
@@ -597,7 +440,7 @@ void clear_inner_panp2 (const int _method,
   }
 
   // flops count here is taken from reflect - might be different here
-  const S flops = 149.0 * (float)_targ.get_n() * (float)_src.get_npanels();
+  const S flops = 149.0 * (float)num_tests;
 
   auto end = std::chrono::system_clock::now();
   std::chrono::duration<double> elapsed_seconds = end-start;
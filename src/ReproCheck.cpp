@@ -0,0 +1,127 @@
+/*
+ * ReproCheck.cpp - Verify that a simulation gives the same bits on any number of threads
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "ReproCheck.h"
+#include "FlowFeature.h"
+#include "BoundaryFeature.h"
+#include "MeasureFeature.h"
+#include "Simulation.h"
+#include "JsonHelper.h"
+#include "RenderParams.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+using json = nlohmann::json;
+
+
+// set up and run one copy of the case, saving the fingerprint after each step
+static bool run_copy(const json& _j, const int _nsteps, const int _nthreads,
+                     std::vector<uint64_t>& _hashes, json* _resolved) {
+
+#ifdef _OPENMP
+  omp_set_num_threads(_nthreads);
+#endif
+  std::cout << std::endl << "Running reproducibility check on " << _nthreads << " thread(s)" << std::endl;
+
+  Simulation sim;
+  std::vector< std::unique_ptr<FlowFeature> > ffeatures;
+  std::vector< std::unique_ptr<BoundaryFeature> > bfeatures;
+  std::vector< std::unique_ptr<MeasureFeature> > mfeatures;
+  RenderParams rparams;
+
+  parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, _j);
+  sim.set_reproducible(true);
+
+  // random features chose their seeds while parsing, so the second copy must reuse them
+  if (_resolved) {
+    *_resolved = _j;
+    if (not ffeatures.empty()) {
+      std::vector<json> jflows;
+      for (auto const& ff : ffeatures) jflows.push_back(ff->to_json());
+      (*_resolved)["flowstructures"] = jflows;
+    }
+  }
+
+  add_init_elements(sim, ffeatures, bfeatures, mfeatures, rparams);
+  sim.set_initialized();
+
+  std::string err = sim.check_initialization();
+  if (not err.empty()) {
+    std::cout << std::endl << "ERROR: " << err;
+    return false;
+  }
+
+  for (int istep=0; istep<_nsteps; ++istep) {
+    err = advance_step(sim, ffeatures, mfeatures, rparams);
+    if (not err.empty()) {
+      std::cout << std::endl << "ERROR: " << err;
+      sim.reset();
+      return false;
+    }
+    _hashes.push_back(sim.get_state_hash());
+  }
+
+  sim.reset();
+  return true;
+}
+
+
+int check_reproducible(const json& _j, const int _nsteps) {
+
+  auto start = std::chrono::system_clock::now();
+
+  // run quietly: no status file, series file, or live feed
+  json j = _j;
+  j.erase("runtime");
+
+  // measurement features only add field points, which do not feed back into the flow,
+  //   and their emitters jitter with an unseeded generator
+  j.erase("measurements");
+
+  int nthreads = 1;
+#ifdef _OPENMP
+  nthreads = omp_get_max_threads();
+#endif
+  if (nthreads == 1) {
+    std::cout << "Only one thread is available, so this only checks run-to-run repeatability" << std::endl;
+  }
+
+  std::vector<uint64_t> serial, parallel;
+  json resolved;
+  if (not run_copy(j, _nsteps, 1, serial, &resolved)) return -1;
+  if (not run_copy(resolved, _nsteps, nthreads, parallel, nullptr)) return -1;
+
+#ifdef _OPENMP
+  omp_set_num_threads(nthreads);
+#endif
+
+  // compare step by step, and report the first difference
+  int retval = 0;
+  std::cout << std::endl;
+  for (size_t i=0; i<serial.size(); ++i) {
+    const bool same = (i < parallel.size() and serial[i] == parallel[i]);
+    printf("  step %ld:\t%016llx\t%016llx\t%s\n", i+1, (unsigned long long)serial[i],
+           (unsigned long long)((i < parallel.size()) ? parallel[i] : 0), same ? "same" : "DIFFERENT");
+    if (not same and retval == 0) retval = 1;
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  printf("\nreproducibility check:\t[%.4f] seconds, 1 vs %d threads, %s\n", (float)elapsed_seconds.count(),
+         nthreads, (retval == 0) ? "all steps identical" : "results differ");
+
+  return retval;
+}
@@ -0,0 +1,19 @@
+/*
+ * ReproCheck.h - Verify that a simulation gives the same bits on any number of threads
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "json/json.hpp"
+
+//
+// Run the first steps of the given simulation twice in reproducible mode, once on a single
+//   thread and once on all of them, and compare the state fingerprints after every step.
+//   No output files are written.
+//
+// Returns 0 if every step matched, 1 if any did not, and -1 if the case could not be run
+//
+int check_reproducible(const nlohmann::json& _j, const int _nsteps);
@@ -0,0 +1,28 @@
+/*
+ * SearchHelper.h - Common tools for nearest-neighbor search results
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+
+//
+// Sort (index, squared distance) matches by distance, and break ties by index
+//
+// nanoflann's own sort leaves equidistant neighbors (common on lattices) in whatever order
+//   the tree visited them, and neighbor lists come back in build order, so the sums over
+//   neighbors in VRM, merge, and split would depend on how the tree or list was made
+//
+template <class I, class S>
+inline void sort_matches (std::vector<std::pair<I,S>>& _matches) {
+  std::sort(_matches.begin(), _matches.end(),
+            [](const std::pair<I,S>& _a, const std::pair<I,S>& _b) {
+              return (_a.second < _b.second) or (_a.second == _b.second and _a.first < _b.first);
+            });
+}
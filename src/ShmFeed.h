@@ -0,0 +1,408 @@
+/*
+ * ShmFeed.h - Publish the latest element arrays through POSIX shared memory
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "Points.h"
+#include "Surfaces.h"
+
+#ifdef USE_SHM_FEED
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <new>
+#include <algorithm>
+
+
+//
+// Layout of the shared segment: one ShmFeedHeader, then nslots slots of slot_bytes each.
+//   Every slot starts with a ShmFeedSlot, then one ShmFeedColl per collection (as many as
+//   the simulation has), then the raw arrays they describe.
+//
+// Frame f (counting from 1) goes into slot f%nslots. While it is written, the slot's seq is
+//   2f-1; once complete it is 2f and the header's latest becomes f. A reader copies the
+//   slot out and then checks that seq did not change, so the writer never waits for anyone.
+//
+// If a frame outgrows the slots, the writer marks the segment stale and makes a new,
+//   larger one under the same name; readers see the flag and open it again.
+//
+const char     shm_feed_magic[8] = "O3DFEED";
+const uint32_t shm_feed_version = 2;
+
+// which element set a collection came from, and what it holds
+enum shm_feed_set_t  : uint32_t { shm_vort = 0, shm_bdry = 1, shm_fldpt = 2 };
+enum shm_feed_kind_t : uint32_t { shm_points = 0, shm_panels = 1 };
+
+struct ShmFeedHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nslots;
+  uint64_t slot_bytes;
+  std::atomic<uint64_t> latest;		// newest complete frame, 0 if none yet
+  std::atomic<uint32_t> stale;		// nonzero once the writer has moved to a new segment
+};
+
+//
+// Points:  x, y, z, [sx, sy, sz, r] as floats, n entries each
+// Panels:  x, y, z as floats (nnodes each), then idx as 3*npanels Int, then [vs1, vs2] (npanels each)
+//
+struct ShmFeedColl {
+  uint32_t set;
+  uint32_t kind;
+  uint32_t nnodes;
+  uint32_t npanels;
+  uint32_t has_str;
+  uint32_t pad;
+  uint64_t offset;			// bytes from the start of the slot
+};
+
+struct ShmFeedSlot {
+  std::atomic<uint64_t> seq;
+  uint64_t step;
+  double time;
+  uint32_t ncoll;
+  uint32_t pad;
+};
+
+
+//
+// Writer side, owned by the Simulation
+//
+class ShmFeed {
+public:
+  ShmFeed() = default;
+  ~ShmFeed() { close(); }
+  ShmFeed(const ShmFeed&) = delete;
+  ShmFeed& operator=(const ShmFeed&) = delete;
+
+  void set_name(const std::string _name) {
+    close();
+    name = _name;
+    if (not name.empty() and name[0] != '/') name = "/" + name;
+  }
+  const std::string& get_name() const { return name; }
+  bool is_active() const { return not name.empty(); }
+
+  template <class S>
+  void publish(std::vector<Collection> const&, std::vector<Collection> const&,
+               std::vector<Collection> const&, const size_t, const double);
+
+  void close() {
+#ifdef USE_SHM_FEED
+    if (base) {
+      // tell attached readers that this segment will not change again
+      static_cast<ShmFeedHeader*>(base)->stale.store(1, std::memory_order_release);
+      munmap(base, seg_bytes);
+      shm_unlink(name.c_str());
+    }
+#endif
+    base = nullptr;
+    seg_bytes = 0;
+    frame = 0;
+  }
+
+private:
+  std::string name;
+  void* base = nullptr;
+  size_t seg_bytes = 0;
+  uint64_t frame = 0;
+  const uint32_t nslots = 3;
+
+  static size_t pad8(const size_t _n) { return (_n+7) & ~(size_t)7; }
+
+  bool create(const size_t);
+
+  // append one array to the slot, return the new write offset
+  static size_t put(char* _slot, size_t _off, const void* _src, const size_t _bytes) {
+    if (_bytes > 0) std::memcpy(_slot + _off, _src, _bytes);
+    return pad8(_off + _bytes);
+  }
+};
+
+
+inline bool ShmFeed::create(const size_t _slot_bytes) {
+#ifdef USE_SHM_FEED
+  // retire any previous segment, readers still holding it see the flag
+  if (base) {
+    static_cast<ShmFeedHeader*>(base)->stale.store(1, std::memory_order_release);
+    munmap(base, seg_bytes);
+    base = nullptr;
+  }
+  shm_unlink(name.c_str());
+
+  const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    std::cout << "  could not open shared memory " << name << std::endl;
+    return false;
+  }
+  const size_t bytes = pad8(sizeof(ShmFeedHeader)) + nslots*_slot_bytes;
+  if (ftruncate(fd, bytes) != 0) {
+    std::cout << "  could not size shared memory " << name << " to " << bytes << " bytes" << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (ptr == MAP_FAILED) {
+    std::cout << "  could not map shared memory " << name << std::endl;
+    return false;
+  }
+  base = ptr;
+  seg_bytes = bytes;
+
+  ShmFeedHeader* hdr = new (base) ShmFeedHeader;
+  std::memcpy(hdr->magic, shm_feed_magic, 8);
+  hdr->version = shm_feed_version;
+  hdr->nslots = nslots;
+  hdr->slot_bytes = _slot_bytes;
+  hdr->stale.store(0);
+  for (uint32_t i=0; i<nslots; ++i) {
+    ShmFeedSlot* slot = new (static_cast<char*>(base) + pad8(sizeof(ShmFeedHeader)) + i*_slot_bytes) ShmFeedSlot;
+    slot->seq.store(0);
+  }
+  hdr->latest.store(0, std::memory_order_release);
+  frame = 0;
+
+  std::cout << "  publishing to shared memory " << name << " (" << (bytes/(1024*1024)) << " MiB)" << std::endl;
+  return true;
+#else
+  (void)_slot_bytes;
+  return false;
+#endif
+}
+
+//
+// copy the current arrays into the next slot
+//
+template <class S>
+void ShmFeed::publish(std::vector<Collection> const& _vort,
+                      std::vector<Collection> const& _bdry,
+                      std::vector<Collection> const& _fldpt,
+                      const size_t _step, const double _time) {
+
+#ifdef USE_SHM_FEED
+  auto start = std::chrono::system_clock::now();
+
+  // first pass: what goes in, and how many bytes it takes
+  std::vector<ShmFeedColl> descs;
+  std::vector<const Collection*> colls;
+  size_t need = 0;
+
+  auto plan = [&](std::vector<Collection> const& _set, const shm_feed_set_t _which) {
+    for (auto &elem : _set) {
+      ShmFeedColl d = {(uint32_t)_which, shm_points, 0, 0, 0, 0, 0};
+      if (std::holds_alternative<Points<S>>(elem)) {
+        Points<S> const & pts = std::get<Points<S>>(elem);
+        d.nnodes = pts.get_n();
+        d.has_str = pts.is_inert() ? 0 : 1;
+        need += (d.has_str ? 7 : 3) * pad8(d.nnodes*sizeof(S));
+      } else if (std::holds_alternative<Surfaces<S>>(elem)) {
+        Surfaces<S> const & surf = std::get<Surfaces<S>>(elem);
+        d.kind = shm_panels;
+        d.nnodes = surf.get_n();
+        d.npanels = surf.get_npanels();
+        d.has_str = surf.is_inert() ? 0 : 1;
+        need += 3*pad8(d.nnodes*sizeof(S)) + pad8(3*d.npanels*sizeof(Int));
+        if (d.has_str) need += 2*pad8(d.npanels*sizeof(S));
+      } else {
+        continue;
+      }
+      descs.push_back(d);
+      colls.push_back(&elem);
+    }
+  };
+  plan(_vort, shm_vort);
+  plan(_bdry, shm_bdry);
+  plan(_fldpt, shm_fldpt);
+
+  // the descriptor table is as long as the collection list
+  const size_t table = pad8(sizeof(ShmFeedSlot)) + pad8(descs.size()*sizeof(ShmFeedColl));
+  need += table;
+
+  // (re)make the segment with room to grow
+  if (not base or need > static_cast<ShmFeedHeader*>(base)->slot_bytes) {
+    if (not create(std::max(2*need, (size_t)1<<24))) {
+      std::cout << "  disabling shared memory output" << std::endl;
+      name.clear();
+      return;
+    }
+  }
+
+  ShmFeedHeader* hdr = static_cast<ShmFeedHeader*>(base);
+  ++frame;
+  char* sbase = static_cast<char*>(base) + pad8(sizeof(ShmFeedHeader)) + (frame%nslots)*hdr->slot_bytes;
+  ShmFeedSlot* slot = reinterpret_cast<ShmFeedSlot*>(sbase);
+
+  // mark the slot as being written
+  slot->seq.store(2*frame-1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->step = _step;
+  slot->time = _time;
+  slot->ncoll = (uint32_t)descs.size();
+
+  ShmFeedColl* table_start = reinterpret_cast<ShmFeedColl*>(sbase + pad8(sizeof(ShmFeedSlot)));
+  size_t off = table;
+  for (size_t c=0; c<descs.size(); ++c) {
+    ShmFeedColl& d = descs[c];
+    d.offset = off;
+    if (d.kind == shm_points) {
+      Points<S> const & pts = std::get<Points<S>>(*colls[c]);
+      for (size_t i=0; i<Dimensions; ++i) off = put(sbase, off, pts.get_pos()[i].data(), d.nnodes*sizeof(S));
+      if (d.has_str) {
+        for (size_t i=0; i<Dimensions; ++i) off = put(sbase, off, pts.get_str()[i].data(), d.nnodes*sizeof(S));
+        off = put(sbase, off, pts.get_rad().data(), d.nnodes*sizeof(S));
+      }
+    } else {
+      Surfaces<S> const & surf = std::get<Surfaces<S>>(*colls[c]);
+      for (size_t i=0; i<Dimensions; ++i) off = put(sbase, off, surf.get_pos()[i].data(), d.nnodes*sizeof(S));
+      off = put(sbase, off, surf.get_idx().data(), 3*d.npanels*sizeof(Int));
+      if (d.has_str) {
+        off = put(sbase, off, surf.get_vort1_str().data(), d.npanels*sizeof(S));
+        off = put(sbase, off, surf.get_vort2_str().data(), d.npanels*sizeof(S));
+      }
+    }
+    table_start[c] = d;
+  }
+
+  // and mark it complete
+  slot->seq.store(2*frame, std::memory_order_release);
+  hdr->latest.store(frame, std::memory_order_release);
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  printf("    shm feed:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+
+#else
+  static bool warned = false;
+  if (not warned) std::cout << "  shared memory output was not compiled in (USE_SHM_FEED)" << std::endl;
+  warned = true;
+  (void)_vort; (void)_bdry; (void)_fldpt; (void)_step; (void)_time;
+#endif
+}
+
+
+//
+// Reader side, for viewers attached to a running simulation
+//
+struct ShmFeedFrame {
+  uint64_t step = 0;
+  double time = 0.0;
+  std::vector<ShmFeedColl> colls;	// offsets are into data
+  std::vector<char> data;
+};
+
+class ShmFeedReader {
+public:
+  ShmFeedReader() = default;
+  ~ShmFeedReader() { close(); }
+  ShmFeedReader(const ShmFeedReader&) = delete;
+  ShmFeedReader& operator=(const ShmFeedReader&) = delete;
+
+  bool open(const std::string _name) {
+    name = (not _name.empty() and _name[0] != '/') ? "/" + _name : _name;
+    return attach(true);
+  }
+
+  void close() {
+#ifdef USE_SHM_FEED
+    if (base) munmap(base, seg_bytes);
+#endif
+    base = nullptr;
+    seg_bytes = 0;
+  }
+
+  // copy out the newest frame if it is newer than _last, return false otherwise
+  bool read_latest(ShmFeedFrame& _out, uint64_t& _last) {
+    // a regrow may have caught us between unlink and re-create, so keep trying the name
+    if (not base) {
+      if (name.empty() or not attach(false)) return false;
+      _last = 0;
+    }
+    const ShmFeedHeader* hdr = static_cast<const ShmFeedHeader*>(base);
+
+    // writer moved on to a bigger segment
+    if (hdr->stale.load(std::memory_order_acquire) != 0) {
+      if (not attach(false)) return false;
+      hdr = static_cast<const ShmFeedHeader*>(base);
+      _last = 0;
+      // the old segment was not yet unlinked, so drop it and retry on a later call
+      if (hdr->stale.load(std::memory_order_acquire) != 0) { close(); return false; }
+    }
+
+    const uint64_t f = hdr->latest.load(std::memory_order_acquire);
+    if (f == 0 or f == _last) return false;
+
+    const char* sbase = static_cast<const char*>(base) + ((sizeof(ShmFeedHeader)+7) & ~(size_t)7)
+                        + (f % hdr->nslots) * hdr->slot_bytes;
+    const ShmFeedSlot* slot = reinterpret_cast<const ShmFeedSlot*>(sbase);
+
+    const uint64_t s1 = slot->seq.load(std::memory_order_acquire);
+    if (s1 != 2*f) return false;
+
+    _out.step = slot->step;
+    _out.time = slot->time;
+    const size_t slot_head = (sizeof(ShmFeedSlot)+7) & ~(size_t)7;
+    const size_t ncoll = std::min((size_t)slot->ncoll, (hdr->slot_bytes - slot_head) / sizeof(ShmFeedColl));
+    const ShmFeedColl* table = reinterpret_cast<const ShmFeedColl*>(sbase + slot_head);
+    _out.colls.assign(table, table + ncoll);
+    _out.data.assign(sbase, sbase + hdr->slot_bytes);
+
+    // if the writer came around to this slot while we copied, try again later
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->seq.load(std::memory_order_relaxed) != s1) return false;
+
+    _last = f;
+    return true;
+  }
+
+private:
+  // map the named segment, failing quietly if it is missing or not yet initialized
+  bool attach(const bool _verbose) {
+#ifdef USE_SHM_FEED
+    close();
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 or (size_t)st.st_size < sizeof(ShmFeedHeader)) { ::close(fd); return false; }
+    void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) return false;
+    base = ptr;
+    seg_bytes = st.st_size;
+    const ShmFeedHeader* hdr = static_cast<const ShmFeedHeader*>(base);
+    if (std::memcmp(hdr->magic, shm_feed_magic, 8) != 0 or hdr->version != shm_feed_version) {
+      if (_verbose) std::cout << "  " << name << " is not a compatible feed" << std::endl;
+      close();
+      return false;
+    }
+    return true;
+#else
+    (void)_verbose;
+    return false;
+#endif
+  }
+
+  std::string name;
+  void* base = nullptr;
+  size_t seg_bytes = 0;
+};
@@ -13,6 +13,7 @@
 #include "GuiHelper.h"
 
 #include <cassert>
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <variant>
@@ -29,7 +30,17 @@ Simulation::Simulation()
     bem(),
     diff(),
     conv(),
+    loads(),
+    bdry_keys(),
+    prev_bdry_keys(),
+    prev_bdry_rows(),
+    reproducible(false),
     sf(),
+    vtu_bits(0),
+    last_force_time(0.0),
+    last_impulse{0.0,0.0,0.0},
+    next_loads_time(0.0),
+    last_loads(),
     description(),
     time(0.0),
     output_dt(0.0),
@@ -42,7 +53,9 @@ Simulation::Simulation()
     quit_on_stop(false),
     sim_is_initialized(false),
     step_has_started(false),
-    step_is_finished(false)
+    step_is_finished(false),
+    stop_reported(false),
+    last_output_step(std::numeric_limits<size_t>::max())
   {}
 
 // addresses for use in imgui
@@ -80,6 +93,48 @@ void Simulation::set_quit_on_stop(const bool qos) { quit_on_stop = qos; }
 // access status file
 void Simulation::set_status_file_name(const std::string _fn) { sf.set_filename(_fn); }
 std::string Simulation::get_status_file_name() { return sf.get_filename(); }
+void Simulation::set_series_file_name(const std::string _fn) { h5out.set_file_name(_fn); }
+std::string Simulation::get_series_file_name() { return h5out.get_file_name(); }
+void Simulation::set_shm_feed_name(const std::string _fn) { feed.set_name(_fn); }
+
+//
+// The CPU summations, BEM, and particle operations give the same bits on any number of
+//   threads (each target sums its sources in a fixed order, neighbor searches come back
+//   sorted by distance and index, and new particles are appended serially). The GPU and
+//   external solvers make no such promise, so this mode turns them off.
+//
+void Simulation::set_reproducible(const bool _on) {
+  reproducible = _on;
+  conv.set_reproducible(_on);
+}
+
+//
+// Fingerprint of the flow state: particle positions, radii and strengths, and the panel
+//   positions and strengths - field points are left out because emitted tracers are jittered
+//
+uint64_t Simulation::get_state_hash() const {
+  uint64_t h = fnv_offset;
+  const uint64_t nstepcopy = nstep;
+  hash_bytes(h, &nstepcopy, sizeof(nstepcopy));
+  for (auto const& coll : vort) {
+    std::visit([&](auto const& elem) {
+      hash_vector(h, elem.get_pos());
+      hash_vector(h, elem.get_str());
+    }, coll);
+    if (std::holds_alternative<Points<STORE>>(coll)) hash_vector(h, std::get<Points<STORE>>(coll).get_rad());
+  }
+  for (auto const& coll : bdry) {
+    std::visit([&](auto const& elem) {
+      hash_vector(h, elem.get_pos());
+      hash_vector(h, elem.get_str());
+    }, coll);
+  }
+  return h;
+}
+std::string Simulation::get_shm_feed_name() { return feed.get_name(); }
+void Simulation::close_streams() { h5out.close(); feed.close(); }
+void Simulation::set_vtu_bits(const int _bits) { vtu_bits = std::clamp(_bits, 0, 16); }
+int Simulation::get_vtu_bits() const { return vtu_bits; }
 
 // status
 size_t Simulation::get_npanels() {
@@ -193,9 +248,29 @@ Simulation::from_json(const nlohmann::json j) {
     use_end_time = false;
   }
 
+  if (j.find("reproducible") != j.end()) {
+    set_reproducible(j["reproducible"]);
+    std::cout << "  setting reproducible= " << reproducible << std::endl;
+  }
+
   // set diffusion-specific parameters
   // Diffusion will find and set "viscous", "VRM" and "AMR" parameters
   diff.from_json(j);
+
+  // Convection will find and set "multirate" parameters
+  conv.from_json(j);
+
+  // SurfaceLoads will find and set "surfaceLoads"
+  loads.from_json(j);
+
+  // FieldStats will find and set "fieldStatistics"
+  stats.from_json(j);
+
+  // PanelAdapt will find and set "panelAdaptation"
+  adapt.from_json(j);
+
+  // Convergence will find and set "convergence"
+  convergence.from_json(j);
 }
 
 // create and write a json object for "simparams"
@@ -208,9 +283,26 @@ Simulation::to_json() const {
   if (using_max_steps()) j["maxSteps"] = get_max_steps();
   if (using_end_time()) j["endTime"] = get_end_time();
 
+  if (reproducible) j["reproducible"] = true;
+
   // Diffusion will write "viscous", "VRM" and "AMR" parameters
   diff.add_to_json(j);
 
+  // Convection will write "multirate" parameters
+  conv.add_to_json(j);
+
+  // SurfaceLoads will write "surfaceLoads"
+  loads.add_to_json(j);
+
+  // FieldStats will write "fieldStatistics"
+  stats.add_to_json(j);
+
+  // PanelAdapt will write "panelAdaptation"
+  adapt.add_to_json(j);
+
+  // Convergence will write "convergence"
+  convergence.add_to_json(j);
+
   return j;
 }
 
@@ -221,11 +313,30 @@ Simulation::to_json() const {
 //
 void Simulation::draw_advanced() {
 
+  // thread-count-independent results
+  bool repro = reproducible;
+  ImGui::Checkbox("Bitwise reproducible", &repro);
+  ImGui::SameLine();
+  ShowHelpMarker("Give the same results on any number of threads by avoiding the GPU and external solvers, and print a fingerprint of the flow state after every step.");
+  if (repro != reproducible) set_reproducible(repro);
+
   // set the execution environment in Convection.h
   conv.draw_advanced();
 
   // set the diffusion parameters in Diffusion.h
   diff.draw_advanced();
+
+  // enable surface loads in SurfaceLoads.h
+  loads.draw_advanced();
+
+  // enable measurement statistics in FieldStats.h
+  stats.draw_advanced();
+
+  // enable panel refinement in PanelAdapt.h
+  adapt.draw_advanced();
+
+  // enable early stopping in Convergence.h
+  convergence.draw_advanced();
 }
 #endif
 
@@ -481,9 +592,78 @@ void Simulation::computeGL() {
 
 bool Simulation::is_initialized() { return sim_is_initialized; }
 
-void Simulation::set_initialized() { sim_is_initialized = true; }
+void Simulation::set_initialized() {
+  sim_is_initialized = true;
+
+  // after a restart, find the boundary collections that came from unchanged features
+  if (not prev_bdry_keys.empty()) {
+    std::vector<std::optional<size_t>> old_start(bdry.size());
+    size_t nkept = 0;
+    for (size_t i=0; i<bdry.size(); ++i) {
+      if (not bdry_keys[i]) continue;
+      const size_t nrows = std::visit([=](auto& elem) { return (size_t)elem.get_num_rows(); }, bdry[i]);
+      for (size_t j=0; j<prev_bdry_keys.size(); ++j) {
+        if (prev_bdry_keys[j] and *prev_bdry_keys[j] == *bdry_keys[i] and prev_bdry_rows[j].second == nrows) {
+          old_start[i] = prev_bdry_rows[j].first;
+          nkept++;
+          break;
+        }
+      }
+    }
+    std::cout << "  " << nkept << " of " << bdry.size() << " boundary collections are unchanged since restart" << std::endl;
+    bem.keep_blocks(std::move(old_start));
+    prev_bdry_keys.clear();
+    prev_bdry_rows.clear();
+  }
+}
 
-void Simulation::reset() {
+//
+// Split and merge reactive panels according to their last solved strengths, and tell the
+//   BEM to keep the blocks belonging only to collections that did not change
+//
+void Simulation::adapt_panels() {
+  // without a solution there is nothing to go on
+  if (not bem.is_A_current()) return;
+
+  auto start = std::chrono::system_clock::now();
+
+  std::vector<std::optional<size_t>> old_start(bdry.size());
+  std::vector<std::vector<size_t>> old_lead(bdry.size());
+  size_t nchanged = 0;
+  for (size_t i=0; i<bdry.size(); ++i) {
+    old_start[i] = std::visit([=](auto& elem) { return (size_t)elem.get_first_row(); }, bdry[i]);
+
+    if (std::holds_alternative<Surfaces<STORE>>(bdry[i])) {
+      Surfaces<STORE>& surf = std::get<Surfaces<STORE>>(bdry[i]);
+      if (surf.get_elemt() == reactive and adapt.adapt(surf)) {
+        // the panels that did not change keep their rows and columns
+        const size_t nunk = surf.num_unknowns_per_panel();
+        for (auto const& ip : surf.get_kept_panels()) {
+          for (size_t k=0; k<nunk; ++k) old_lead[i].push_back(*old_start[i] + nunk*ip + k);
+        }
+        old_start[i].reset();
+        // this collection no longer matches its feature
+        if (i < bdry_keys.size()) bdry_keys[i].reset();
+        nchanged++;
+      }
+    }
+  }
+
+  if (nchanged > 0) {
+    bem.reset_but_keep_A();
+    bem.keep_blocks(std::move(old_start), std::move(old_lead));
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  printf("    adapt_panels:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+}
+
+//
+// Wait for any step in flight, then return all state to t=0; both reset and restart
+//   end up here, and differ only in what they keep of the BEM matrix
+//
+void Simulation::clear_state(const bool _keep_A) {
 
   // must wait for step() to complete, if it's still working
   if (stepfuture.valid()) {
@@ -491,24 +671,59 @@ void Simulation::reset() {
     stepfuture.get();
   }
 
+  // a restart remembers which rows each boundary collection used
+  prev_bdry_keys.clear();
+  prev_bdry_rows.clear();
+  if (_keep_A and bem.is_A_current()) {
+    prev_bdry_keys = bdry_keys;
+    for (auto &coll : bdry) {
+      const size_t first = std::visit([=](auto& elem) { return (size_t)elem.get_first_row(); }, coll);
+      const size_t nrows = std::visit([=](auto& elem) { return (size_t)elem.get_num_rows(); }, coll);
+      prev_bdry_rows.push_back(std::make_pair(first, nrows));
+    }
+  }
+
   // now reset everything else
   time = 0.0;
   nstep = 0;
   vort.clear();
   bdry.clear();
+  bdry_keys.clear();
+  feature_tags.clear();
   fldpt.clear();
-  bem.reset();
+  if (_keep_A) bem.reset_but_keep_A();
+  else bem.reset();
   sf.reset_sim();
+  h5out.close();
+  stats.reset();
+  outflow.reset();
+  convergence.reset();
   sim_is_initialized = false;
   step_has_started = false;
   step_is_finished = false;
+  stop_reported = false;
+  last_output_step = std::numeric_limits<size_t>::max();
+  next_loads_time = 0.0;
+  last_loads.clear();
+}
+
+void Simulation::reset() {
+  clear_state(false);
+}
+
+//
+// Return to t=0 like reset(), but remember the boundary collections and the BEM matrix,
+//   so that the next initialization only recomputes blocks for features that changed
+//
+void Simulation::restart() {
+  clear_state(true);
 }
 
 void Simulation::clear_bodies() {
   bodies.clear();
 }
 
-// Write a set of vtu files for the particles and panels
+// Write a set of vtu files for the particles and panels, or one frame of the hdf5 series
 std::vector<std::string> Simulation::write_vtk(const int _index,
                                                const bool _do_bdry,
                                                const bool _do_flow,
@@ -528,6 +743,12 @@ std::vector<std::string> Simulation::write_vtk(const int _index,
   if (_do_bdry)    conv.find_vels(thisfs, vort, bdry, bdry, true);
 #endif
 
+  // panel pressure and shear for the files, from the solution above
+  if (_do_bdry and loads.is_enabled() and not bdry.empty()) {
+    std::array<double,3> loadfs = {fs[0], fs[1], fs[2]};
+    (void)loads.compute(time, dt, 1.0/re, get_diffuse(), loadfs, bdry);
+  }
+
   // may eventually want to avoid clobbering by maintaining an internal count of the
   //   number of simulations run from this execution of the GUI
   std::vector<std::string> files;
@@ -539,15 +760,39 @@ std::vector<std::string> Simulation::write_vtk(const int _index,
   } else {
     stepnum = (size_t)_index;
   }
+  last_output_step = stepnum;
+
+  // statistics are checkpointed along with the measurement points
+  if (_do_measure) {
+    const std::vector<std::string> sfiles = write_stats((int)stepnum);
+    files.insert(files.end(), sfiles.begin(), sfiles.end());
+  }
+
+  // a time series file takes all selected collections as one frame
+  if (h5out.is_active()) {
+    if (h5out.write_frame<float>(_do_flow ? vort : std::vector<Collection>(),
+                                 _do_measure ? fldpt : std::vector<Collection>(),
+                                 _do_bdry ? bdry : std::vector<Collection>(),
+                                 stepnum, time)) {
+      files.push_back(h5out.get_file_name());
+      return files;
+    }
+  }
 
   // ask Vtk to write files for each collection
-  if (_do_flow)    write_vtk_files<float>(vort, stepnum, time, files);
-  if (_do_measure) write_vtk_files<float>(fldpt, stepnum, time, files);
-  if (_do_bdry)    write_vtk_files<float>(bdry, stepnum, time, files);
+  if (_do_flow)    write_vtk_files<float>(vort, stepnum, time, files, vtu_bits, out_prefix);
+  if (_do_measure) write_vtk_files<float>(fldpt, stepnum, time, files, vtu_bits, out_prefix);
+  if (_do_bdry)    write_vtk_files<float>(bdry, stepnum, time, files, 0, out_prefix);
 
   return files;
 }
 
+// Write the accumulated measurement statistics, if any
+std::vector<std::string> Simulation::write_stats(const int _index) {
+  if (not stats.has_samples()) return std::vector<std::string>();
+  return stats.write(fldpt, (_index < 0) ? nstep : (size_t)_index, time, out_prefix);
+}
+
 //
 // Check all aspects of the initialization for conditions that prevent a run from starting
 //
@@ -700,8 +945,13 @@ void Simulation::first_step() {
   // update BEM and find vels on any particles but DO NOT ADVECT
   conv.advect_1st(time, 0.0, thisfs, get_ips(), vort, bdry, fldpt, bem);
 
+  if (reproducible) printf("  state fingerprint at step %ld:\t%016llx\n", nstep, (unsigned long long)get_state_hash());
+
   // and write status file
   dump_stats_to_status();
+
+  // hand the new state to any attached viewer
+  if (feed.is_active()) feed.publish<float>(vort, bdry, fldpt, nstep, time);
 }
 
 //
@@ -718,9 +968,15 @@ void Simulation::async_step() {
 void Simulation::step() {
   std::cout << std::endl << "Taking step " << nstep << " at t=" << time << " with n=" << get_nparts() << std::endl;
 
+  // refine or coarsen boundary panels every few steps
+  if (adapt.is_due(nstep)) adapt_panels();
+
   // we wind up using this a lot
   std::array<double,3> thisfs = {fs[0], fs[1], fs[2]};
 
+  // statistics are sampled inside the advection, from the velocities at the start of this step
+  conv.set_stats(&stats);
+
   // for simplicity's sake, just run one full diffusion step here
   diff.step(time, dt, re, get_vdelta(), thisfs, vort, bdry, bem);
 
@@ -729,11 +985,19 @@ void Simulation::step() {
 
   // advect with no diffusion (must update BEM strengths)
   //conv.advect_1st(time, dt, thisfs, get_ips(), vort, bdry, fldpt, bem);
-  conv.advect_2nd(time, dt, thisfs, get_ips(), vort, bdry, fldpt, bem);
+  if (conv.using_multirate()) {
+    // near-body particles take several smaller substeps
+    conv.advect_multirate(time, dt, thisfs, get_ips(), vort, bdry, fldpt, bem);
+  } else {
+    conv.advect_2nd(time, dt, thisfs, get_ips(), vort, bdry, fldpt, bem);
+  }
 
   // operator splitting requires another half-step diffuse (must compute new coefficients)
   //diff.step(time, 0.5*dt, re, get_vdelta(), thisfs, vort, bdry, bem);
 
+  // particles past an outflow boundary leave, their strength stays on as super-particles
+  if (outflow.is_enabled()) (void) outflow.apply(vort, thisfs, dt, get_ips());
+
   // push field points out of objects every few steps
   if (nstep%5 == 0) clear_inner_layer<STORE>(1, bdry, fldpt, (STORE)0.0, (STORE)(0.5*get_ips()));
 
@@ -744,6 +1008,7 @@ void Simulation::step() {
     if (std::holds_alternative<Points<float>>(coll)) {
 
       Points<float>& pts = std::get<Points<float>>(coll);
+      if (pts.get_movet() != lagrangian) continue;
       //std::cout << "    check split for " << pts.get_n() << " particles" << std::endl;
       //std::cout << std::endl;
 
@@ -753,11 +1018,11 @@ void Simulation::step() {
       Vector<float>&                              elong = pts.get_elong();
       std::array<Vector<float>, numStrenPerNode>& s = pts.get_str();
 
-      // last two arguments are: relative distance, allow variable core radii
-      (void)split_elongated<float>(x[0], x[1], x[2], r, elong, s[0], s[1], s[2],
+      // last two arguments are: relative distance, and the persistent neighbor lists
+      (void)split_elongated<float>(x, r, elong, s,
                                    diff.get_core_func(),
                                    diff.get_particle_overlap(),
-                                   1.2);
+                                   1.2, &pts.get_tree(), &pts.get_tag());
 
       // we probably have a different number of particles now, resize the u, ug, elong arrays
       pts.resize(r.size());
@@ -773,18 +1038,26 @@ void Simulation::step() {
   // only increment step here!
   nstep++;
 
+  if (reproducible) printf("  state fingerprint at step %ld:\t%016llx\n", nstep, (unsigned long long)get_state_hash());
+
   // and write status file
   dump_stats_to_status();
+
+  // hand the new state to any attached viewer
+  if (feed.is_active()) feed.publish<float>(vort, bdry, fldpt, nstep, time);
 }
 
 //
 // close out the step with some work and output to the status file
 //
 void Simulation::dump_stats_to_status() {
-  if (sf.is_active()) {
+  // the convergence monitor needs the same values
+  if (sf.is_active() or convergence.is_enabled()) {
     // the basics
-    sf.append_value((float)time);
-    sf.append_value((int)get_nparts());
+    if (sf.is_active()) {
+      sf.append_value((float)time);
+      sf.append_value((int)get_nparts());
+    }
 
     // more advanced info
 
@@ -813,14 +1086,40 @@ void Simulation::dump_stats_to_status() {
       this_circ = std::visit([=](auto& elem) { return elem.get_body_circ(time); }, src);
       for (size_t i=0; i<3; ++i) tot_circ[i] += this_circ[i];
     }
-    for (size_t i=0; i<3; ++i) sf.append_value(tot_circ[i]);
 
     // now forces
     std::array<float,Dimensions> this_force = calculate_simple_forces();
-    for (size_t i=0; i<Dimensions; ++i) sf.append_value(this_force[i]);
+
+    // and surface loads, which use the BEM solution above
+    if (sf.is_active() and loads.is_enabled() and not bdry.empty()) {
+      if (get_diffuse()) {
+        last_loads = loads.compute(time, dt, 1.0/re, true, thisfs, bdry);
+      } else if (output_dt <= 0.0 or time >= next_loads_time - 1.e-6*output_dt) {
+        // the inviscid pressure needs the velocity on the panels
+        conv.find_vels(thisfs, vort, bdry, bdry, true);
+        last_loads = loads.compute(time, dt, 1.0/re, false, thisfs, bdry);
+        if (output_dt > 0.0) while (next_loads_time <= time) next_loads_time += output_dt;
+      }
+    }
+    const std::vector<BodyLoads>& body_loads = last_loads;
 
     // write here
-    sf.write_line();
+    if (sf.is_active()) {
+      for (size_t i=0; i<3; ++i) sf.append_value(tot_circ[i]);
+      for (size_t i=0; i<Dimensions; ++i) sf.append_value(this_force[i]);
+      // force then moment for each body, in the order of the boundary collections
+      for (auto const& bl : body_loads) {
+        for (size_t i=0; i<Dimensions; ++i) sf.append_value((float)bl.force[i]);
+        for (size_t i=0; i<Dimensions; ++i) sf.append_value((float)bl.moment[i]);
+      }
+      sf.write_line();
+    }
+
+    // and see if they have settled
+    if (convergence.is_enabled()) {
+      convergence.add_sample(time, get_nparts(), tot_circ, this_force);
+      (void)convergence.check(nstep);
+    }
   }
 }
 
@@ -828,12 +1127,9 @@ void Simulation::dump_stats_to_status() {
 std::array<float,Dimensions>
 Simulation::calculate_simple_forces() {
 
-  static double last_time = 0.0;
-  static std::array<float,Dimensions> last_impulse = {0.0};
-
   // reset the "last" values if time is zero
   if (time < 0.1*dt) {
-    last_time = -dt;
+    last_force_time = -dt;
     last_impulse.fill(0.0);
   }
 
@@ -841,10 +1137,10 @@ Simulation::calculate_simple_forces() {
 
   // find the time derivative of the impulses
   std::array<float,Dimensions> forces;
-  for (size_t i=0; i<Dimensions; ++i) forces[i] = (this_impulse[i] - last_impulse[i]) / (time - last_time);
+  for (size_t i=0; i<Dimensions; ++i) forces[i] = (this_impulse[i] - last_impulse[i]) / (time - last_force_time);
 
   // save the last condition
-  last_time = time;
+  last_force_time = time;
   for (size_t i=0; i<Dimensions; ++i) last_impulse[i] = this_impulse[i];
 
   return forces;
@@ -873,30 +1169,66 @@ Simulation::calculate_total_impulse() {
 }
 
 // Add elements - any kind
-void Simulation::add_elements(const ElementPacket<float> _elems,
+void Simulation::add_elements(const ElementPacket<float>& _elems,
                               const elem_t _et, const move_t _mt,
-                              std::shared_ptr<Body> _bptr) {
+                              std::shared_ptr<Body> _bptr,
+                              const std::string _key,
+                              const float _maxage,
+                              const size_t _maxcount) {
 
   // skip out early if nothing's here
   if (_elems.nelem == 0) return;
 
+  // particles and field points remember which feature made them, because file_elements
+  //   puts all active particles into one collection
+  int32_t tag = 0;
+  if (not _key.empty() and _et != reactive) {
+    auto found = std::find(feature_tags.begin(), feature_tags.end(), _key);
+    tag = 1 + (int32_t)(found - feature_tags.begin());
+    if (found == feature_tags.end()) {
+      feature_tags.push_back(_key);
+      std::cout << "  elements from feature " << tag << " are " << _key << std::endl;
+    }
+  }
+
   // now split on which Collection will receive this
   if (_et == active) {
     // it's active vorticity, add to vort
-    file_elements(vort, _elems, active, _mt, _bptr);
+    file_elements(vort, _elems, active, _mt, _bptr, tag);
     // in that routine, we will look for a match for move type, body pointer, and points/surfs/vols
   } else if (_et == reactive) {
-    file_elements(bdry, _elems, reactive, _mt, _bptr);
+    const size_t icoll = file_elements(bdry, _elems, reactive, _mt, _bptr);
+
+    // a collection is only identifiable if every piece of it has a key, and its body's
+    //   position and motion are part of it, so that blocks of a moved body are never reused
+    const std::string key = _key + " on " + (_bptr ? _bptr->to_json().dump() : std::string("ground"));
+    if (icoll == bdry_keys.size()) {
+      bdry_keys.push_back(_key.empty() ? std::nullopt : std::optional<std::string>(key));
+    } else if (_key.empty()) {
+      bdry_keys[icoll].reset();
+    } else if (bdry_keys[icoll]) {
+      bdry_keys[icoll]->append("\n" + key);
+    }
   } else {
-    file_elements(fldpt, _elems, inert, _mt, _bptr);
+    // tracers with a lifetime go into a ring that holds as many as the emitter makes in
+    //   that time at the current step size, or the given count, whichever is fewer
+    size_t ringcap = 0;
+    if (tag > 0 and (_maxage > 0.0 or _maxcount > 0)) {
+      const size_t nperstep = _elems.x.size() / Dimensions;
+      if (_maxage > 0.0) ringcap = nperstep * (size_t)std::ceil(_maxage / dt);
+      if (_maxcount > 0) ringcap = (ringcap > 0) ? std::min(ringcap, _maxcount) : _maxcount;
+    }
+    file_elements(fldpt, _elems, inert, _mt, _bptr, tag, ringcap);
   }
 }
 
-// File the new elements into the correct collection
-void Simulation::file_elements(std::vector<Collection>& _collvec,
-                               const ElementPacket<float> _elems,
+// File the new elements into the correct collection, return its index
+size_t Simulation::file_elements(std::vector<Collection>& _collvec,
+                               const ElementPacket<float>& _elems,
                                const elem_t _et, const move_t _mt,
-                               std::shared_ptr<Body> _bptr) {
+                               std::shared_ptr<Body> _bptr,
+                               const int32_t _tag,
+                               const size_t _ringcap) {
 
   // search the collections list for a match (same movement type, Body, elem dims)
   size_t imatch = 0;
@@ -924,6 +1256,13 @@ void Simulation::file_elements(std::vector<Collection>& _collvec,
       this_match = false;
     }
 
+    // tracers with a lifetime share a collection only with those of the same feature
+    if (std::holds_alternative<Points<float>>(coll)) {
+      const Points<float>& pts = std::get<Points<float>>(coll);
+      if ((pts.get_ring_capacity() > 0) != (_ringcap > 0)) this_match = false;
+      else if (_ringcap > 0 and pts.get_ring_owner() != _tag) this_match = false;
+    }
+
     if (this_match) {
       imatch = i;
       no_match = false;
@@ -933,8 +1272,20 @@ void Simulation::file_elements(std::vector<Collection>& _collvec,
   // if no match, or no collections exist
   if (no_match) {
     // make a new collection according to element dimension
-    if (_elems.ndim == 0) {
-      _collvec.push_back(Points<float>(_elems, _et, _mt, _bptr, get_vdelta()));
+    if (_elems.ndim == 0 and _ringcap > 0) {
+      // start empty and let the ring take only what fits
+      _collvec.push_back(Points<float>(ElementPacket<float>(std::vector<float>(), std::vector<Int>(),
+                                                            std::vector<float>(), 0, 0),
+                                       _et, _mt, _bptr, get_vdelta(), _tag));
+      Points<float>& pts = std::get<Points<float>>(_collvec.back());
+      pts.set_ring_capacity(_ringcap, _tag);
+      pts.add_new_ring(_elems);
+      std::cout << "  tracers from feature " << _tag << " are kept to the newest " << _ringcap << std::endl;
+#ifdef USE_OGL_COMPUTE
+      pts.set_opengl_compute_state(cgl);
+#endif
+    } else if (_elems.ndim == 0) {
+      _collvec.push_back(Points<float>(_elems, _et, _mt, _bptr, get_vdelta(), _tag));
 #ifdef USE_OGL_COMPUTE
       { // tell the new collection where the compute shader vao is
         Points<float>& pts = std::get<Points<float>>(_collvec.back());
@@ -959,12 +1310,15 @@ void Simulation::file_elements(std::vector<Collection>& _collvec,
     // proceed to add the correct object type
     if (_elems.ndim == 0) {
       Points<float>& pts = std::get<Points<float>>(coll);
-      pts.add_new(_elems, get_vdelta());
+      if (pts.get_ring_capacity() > 0) pts.add_new_ring(_elems);
+      else pts.add_new(_elems, get_vdelta(), _tag);
     } else if (_elems.ndim == 2) {
       Surfaces<float>& surf = std::get<Surfaces<float>>(coll);
       surf.add_new(_elems);
     }
   }
+
+  return no_match ? _collvec.size()-1 : imatch;
 }
 
 // add a new Body with the given name
@@ -1023,33 +1377,73 @@ bool Simulation::test_vs_stop() {
     std::cout << "Stopping at time " << get_end_time() << std::endl;
     should_stop = true;
   }
+  if (not should_stop and convergence.has_converged()) {
+    std::cout << "Stopping at step " << nstep << ", time " << time << std::endl;
+    convergence.print_summary();
+    should_stop = true;
+  }
   return should_stop;
 }
 
+//
+// Finish a run that stopped because its status quantities settled: write the last step,
+//   unless it was just written, and the summary of the converged quantities
+//
+std::vector<std::string> Simulation::write_converged() {
+  std::vector<std::string> files;
+  if (not convergence.has_converged()) return files;
+  if (last_output_step != nstep) files = write_vtk();
+  // name it after the status file (out.dat -> out_convergence.json) unless told otherwise
+  std::string fn = convergence.get_summary_file();
+  if (fn.empty()) {
+    const std::string sfn = get_status_file_name();
+    if (sfn.empty()) {
+      fn = "convergence.json";
+    } else {
+      const size_t dot = sfn.find_last_of('.');
+      const size_t slash = sfn.find_last_of('/');
+      const bool has_ext = (dot != std::string::npos) and (slash == std::string::npos or dot > slash);
+      fn = (has_ext ? sfn.substr(0, dot) : sfn) + "_convergence.json";
+    }
+  }
+  fn = out_prefix + fn;
+  if (convergence.write_summary(fn, nstep, time)) files.push_back(fn);
+  return files;
+}
+
 // this is different because we have to trigger when last step is still running
 bool Simulation::test_vs_stop_async() {
   bool should_stop = false;
-  static bool already_reported = false;
 
   if (using_max_steps() and get_max_steps() == nstep+1) {
-    if (not already_reported) {
+    if (not stop_reported) {
       std::cout << std::endl << "Stopping at step " << get_max_steps() << std::endl;
-      already_reported = true;
+      stop_reported = true;
     }
     should_stop = true;
   }
 
   if (using_end_time() and get_end_time() >= time+0.5*dt
                        and get_end_time() <= time+1.5*dt) {
-    if (not already_reported) {
+    if (not stop_reported) {
       std::cout << std::endl << "Stopping at time " << get_end_time() << std::endl;
-      already_reported = true;
+      stop_reported = true;
+    }
+    should_stop = true;
+  }
+
+  // the step that just finished may have settled the flow
+  if (convergence.has_converged()) {
+    if (not stop_reported) {
+      std::cout << std::endl << "Stopping at step " << nstep << ", time " << time << std::endl;
+      convergence.print_summary();
+      stop_reported = true;
     }
     should_stop = true;
   }
 
   // reset the toggle
-  if (not should_stop) already_reported = false;
+  if (not should_stop) stop_reported = false;
 
   return should_stop;
 }
@@ -14,8 +14,16 @@
 #include "BEM.h"
 #include "Convection.h"
 #include "Diffusion.h"
+#include "SurfaceLoads.h"
+#include "FieldStats.h"
+#include "PanelAdapt.h"
+#include "Outflow.h"
+#include "Convergence.h"
 #include "ElementPacket.h"
 #include "StatusFile.h"
+#include "Hdf5Helper.h"
+#include "ShmFeed.h"
+#include "StateHash.h"
 
 #ifdef USE_GL
 #include "RenderParams.h"
@@ -25,6 +33,7 @@
 #include <vector>
 #include <future>
 #include <chrono>
+#include <optional>
 
 #ifdef USE_VC
 #define STORE float
@@ -83,6 +92,30 @@ public:
   void set_status_file_name(const std::string);
   std::string get_status_file_name();
 
+  // access single-file time series output
+  void set_series_file_name(const std::string);
+  std::string get_series_file_name();
+
+  // access live shared memory output
+  void set_shm_feed_name(const std::string);
+  std::string get_shm_feed_name();
+
+  // finish the time series file and drop the shared memory feed, before a fork()
+  void close_streams();
+
+  // bits per value of quantized particle output, 0 for plain Float32
+  void set_vtu_bits(const int);
+  int get_vtu_bits() const;
+
+  // put in front of every vtu and summary file name, like "case03/"
+  void set_output_prefix(const std::string _pre) { out_prefix = _pre; }
+  const std::string& get_output_prefix() const { return out_prefix; }
+
+  // results that do not depend on the number of threads, and a fingerprint of them
+  void set_reproducible(const bool);
+  bool is_reproducible() const { return reproducible; }
+  uint64_t get_state_hash() const;
+
   // get runtime status
   size_t get_npanels();
   size_t get_nparts();
@@ -91,9 +124,14 @@ public:
   // inviscid case needs this
   void set_re_for_ips(float);
 
-  // receive and add a set of elements
-  void add_elements(const ElementPacket<float>, const elem_t, const move_t, std::shared_ptr<Body>);
-  void file_elements(std::vector<Collection>&, const ElementPacket<float>, const elem_t, const move_t, std::shared_ptr<Body>);
+  // receive and add a set of elements, the key names the source of the elements; tracers
+  //   from a keyed source can be retired after an age or beyond a count (0 means never)
+  void add_elements(const ElementPacket<float>&, const elem_t, const move_t, std::shared_ptr<Body>,
+                    const std::string _key = std::string(),
+                    const float _maxage = 0.0, const size_t _maxcount = 0);
+  size_t file_elements(std::vector<Collection>&, const ElementPacket<float>&, const elem_t, const move_t, std::shared_ptr<Body>,
+                       const int32_t _tag = 0, const size_t _ringcap = 0);
+  const std::vector<std::string>& get_feature_tags() const { return feature_tags; }
 
   // access body list
   void add_body(std::shared_ptr<Body>);
@@ -107,9 +145,12 @@ public:
   void set_diffuse(const bool);
   const bool get_amr() const { return diff.get_amr(); };
   const bool get_diffuse() const { return diff.get_diffuse(); };
+  CoreType get_core_func() const { return diff.get_core_func(); }
+  ExecEnv get_exec_env() const { return conv.get_env(); }
 
   // act on stuff
   void reset();
+  void restart();
   void clear_bodies();
   void async_first_step();
   void first_step();
@@ -118,6 +159,18 @@ public:
   void dump_stats_to_status();
   std::array<float,Dimensions> calculate_simple_forces();
   std::array<float,Dimensions> calculate_total_impulse();
+
+  // direct access to the element collections (for the library interface)
+  std::vector<Collection>& get_vort() { return vort; }
+  std::vector<Collection>& get_bdry() { return bdry; }
+  std::vector<Collection>& get_fldpt() { return fldpt; }
+
+  // outflow boundary features register their regions here
+  Outflow<STORE>& get_outflow() { return outflow; }
+
+  // ensemble runs share the influence matrix among cases with identical geometry
+  bool bem_is_current() { return bem.is_A_current(); }
+  void share_bem_from(const Simulation& _lead) { bem.share_A_from(_lead.bem); }
   bool is_initialized();
   void set_initialized();
   std::string check_initialization();
@@ -129,8 +182,12 @@ public:
                                      const bool _do_bdry = true,
                                      const bool _do_flow = true,
                                      const bool _do_measure = true);
+  std::vector<std::string> write_stats(const int _index = -1);
+  bool wrote_this_step() const { return last_output_step == nstep; }
   bool test_vs_stop();
   bool test_vs_stop_async();
+  bool has_converged() const { return convergence.has_converged(); }
+  std::vector<std::string> write_converged();
 
   // read to and write from a json object
   void flow_from_json(const nlohmann::json);
@@ -157,6 +214,9 @@ public:
 #endif
 
 private:
+  // shared teardown for reset and restart
+  void clear_state(const bool _keep_A);
+
   // primary simulation params
   float re;
   float dt;
@@ -192,9 +252,55 @@ private:
   // Note that with Vc, the storage and accumulator classes have to be the same
   Convection<STORE,ACCUM,Int> conv;
 
+  // optional surface pressure, shear, and per-body loads
+  SurfaceLoads<STORE> loads;
+
+  // optional running statistics at fixed measurement points
+  FieldStats<STORE> stats;
+
+  // optional periodic refinement and coarsening of reactive panels
+  PanelAdapt<STORE> adapt;
+  void adapt_panels();
+
+  // optional regions where particles leave the domain, set by outflow boundary features
+  Outflow<STORE> outflow;
+
+  // optional monitor on the status quantities that ends the run once they settle
+  Convergence<STORE> convergence;
+
+  // where each boundary collection came from, and the same from before the last restart
+  std::vector<std::optional<std::string>> bdry_keys;
+  std::vector<std::optional<std::string>> prev_bdry_keys;
+  std::vector<std::pair<size_t,size_t>> prev_bdry_rows;
+
+  // names of the features that created particles or field points, tag i+1 is feature_tags[i]
+  std::vector<std::string> feature_tags;
+
+  // print a state fingerprint every step, and use only thread-count-independent solvers
+  bool reproducible;
+
   // status file
   StatusFile sf;
 
+  // all output frames in one hdf5 file, when set
+  Hdf5Series h5out;
+
+  // latest arrays for attached viewers, when named
+  ShmFeed feed;
+
+  // write particle arrays to vtu files as integers of this many bits (0 writes Float32)
+  int vtu_bits;
+  std::string out_prefix;
+
+  // for finite-differencing impulse into forces
+  double last_force_time;
+  std::array<float,Dimensions> last_impulse;
+
+  // inviscid surface loads need an extra velocity evaluation on the panels, so the status
+  //   file refreshes them only every output_dt and repeats the last ones in between
+  double next_loads_time;
+  std::vector<BodyLoads> last_loads;
+
   // state
   std::string description;
   double time;
@@ -209,6 +315,8 @@ private:
   bool sim_is_initialized;
   bool step_has_started;
   bool step_is_finished;
+  bool stop_reported;
+  size_t last_output_step;       // step of the last write_vtk, to avoid writing it twice
   std::future<void> stepfuture;  // this future needs to be listed after the big four: diff, conv, ...
 
 #ifdef USE_OGL_COMPUTE
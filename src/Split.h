@@ -10,7 +10,9 @@
 #include "Core.h"
 #include "VectorHelper.h"
 #include "MathHelper.h"
+#include "PointsTree.h"
 #include "nanoflann.hpp"
+#include "SearchHelper.h"
 
 #include <cstdlib>
 #include <cstdio>
@@ -19,6 +21,7 @@
 #include <chrono>
 #include <vector>
 #include <algorithm>
+#include <memory>
 
 
 //
@@ -27,17 +30,29 @@
 //
 // templated on storage class S (typically float or double)
 //
+// if a persistent tree is given, its neighbor lists are reused from the last step
+//
 template <class S>
-size_t split_elongated(Vector<S>& x, Vector<S>& y, Vector<S>& z,
+size_t split_elongated(std::array<Vector<S>,Dimensions>& pos,
                        Vector<S>& r, Vector<S>& elong,
-                       Vector<S>& sx, Vector<S>& sy, Vector<S>& sz,
+                       std::array<Vector<S>,numStrenPerNode>& str,
                        const CoreType corefunc,
                        const S particle_overlap,
-                       const S threshold) {
+                       const S threshold,
+                       PointsTree<S>* _tree = nullptr,
+                       Vector<int32_t>* _tag = nullptr) {
 
   // start timer
   auto start = std::chrono::system_clock::now();
 
+  // reference the local set of vectors
+  Vector<S>& x = pos[0];
+  Vector<S>& y = pos[1];
+  Vector<S>& z = pos[2];
+  Vector<S>& sx = str[0];
+  Vector<S>& sy = str[1];
+  Vector<S>& sz = str[2];
+
   // make sure all vector sizes are identical
   assert(x.size()==y.size() && "Input array sizes do not match");
   assert(x.size()==z.size() && "Input array sizes do not match");
@@ -50,24 +65,37 @@ size_t split_elongated(Vector<S>& x, Vector<S>& y, Vector<S>& z,
 
   std::cout << "  Splitting elongated particles with n " << n << std::endl;
 
+  // find the largest search radius needed below
+  S max_rad = 0.0;
+  for (size_t i=0; i<n; ++i) max_rad = std::max(max_rad, r[i]);
+  const S max_search_rad = 3.0 * max_rad / particle_overlap;
+
   // convert particle positions into something nanoflann can understand
   Eigen::Matrix<S, Eigen::Dynamic, 3> xp;
-  xp.resize(n,3);
-  xp.col(0) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(x.data(), n);
-  xp.col(1) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(y.data(), n);
-  xp.col(2) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(z.data(), n);
-  
-  // generate the searchable data structure
   typedef typename Eigen::Matrix<S, Eigen::Dynamic, Dimensions> EigenMatType;
   typedef typename EigenMatType::Index EigenIndexType;
   typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  mat_index.index->buildIndex();
+  std::unique_ptr<my_kd_tree_t> mat_index;
+
+  if (_tree) {
+    // refit, or rebuild only if particles moved too far
+    _tree->update(pos, max_search_rad);
+
+  } else {
+    xp.resize(n,3);
+    xp.col(0) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(x.data(), n);
+    xp.col(1) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(y.data(), n);
+    xp.col(2) = Eigen::Map<Eigen::Matrix<S, Eigen::Dynamic, 1> >(z.data(), n);
+
+    // generate the searchable data structure
+    mat_index = std::make_unique<my_kd_tree_t>(Dimensions, std::cref(xp));
+    mat_index->index->buildIndex();
+  }
 
   std::vector<std::pair<EigenIndexType,S> > ret_matches;
   ret_matches.reserve(48);
   nanoflann::SearchParams params;
-  params.sorted = true;
+  params.sorted = false;	// sort_matches does this in a repeatable order
 
   //
   // split elongated particles, add new ones to end of list
@@ -83,6 +111,7 @@ size_t split_elongated(Vector<S>& x, Vector<S>& y, Vector<S>& z,
   Vector<S> newsx; newsx.reserve(n/40);
   Vector<S> newsy; newsy.reserve(n/40);
   Vector<S> newsz; newsz.reserve(n/40);
+  Vector<int32_t> newt; newt.reserve(n/40);
 
   // track the largest elongation
   S maxElong = 0.0;
@@ -116,9 +145,21 @@ size_t split_elongated(Vector<S>& x, Vector<S>& y, Vector<S>& z,
     const S search_rad = 3.0 * nom_sep;
     const S distsq_thresh = std::pow(search_rad, 2);
 
-    // tree-based search with nanoflann
-    const S query_pt[3] = { x[i], y[i], z[i] };
-    (void) mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+    if (_tree) {
+      // filter the neighbor list, which includes a skin
+      ret_matches.clear();
+      const int32_t* nbrs = _tree->get_nbrs(i);
+      for (size_t j=0; j<_tree->get_num_nbrs(i); ++j) {
+        const int32_t iother = nbrs[j];
+        const S distsq = std::pow(x[i]-x[iother],2) + std::pow(y[i]-y[iother],2) + std::pow(z[i]-z[iother],2);
+        if (distsq < distsq_thresh) ret_matches.emplace_back((EigenIndexType)iother, distsq);
+      }
+    } else {
+      // tree-based search with nanoflann
+      const S query_pt[3] = { x[i], y[i], z[i] };
+      (void) mat_index->index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+    }
+    sort_matches(ret_matches);
     //const size_t nMatches = mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
 
     // search the new particle list, also
@@ -182,6 +223,8 @@ size_t split_elongated(Vector<S>& x, Vector<S>& y, Vector<S>& z,
     newsx[num_split-1] = 0.5 * sx[i];
     newsy[num_split-1] = 0.5 * sy[i];
     newsz[num_split-1] = 0.5 * sz[i];
+    // children keep the feature of their parent
+    if (_tag) newt.push_back((*_tag)[i]);
 
     // reset the split particle
     x[i] += halfd*axis[0];
@@ -241,6 +284,7 @@ size_t split_elongated(Vector<S>& x, Vector<S>& y, Vector<S>& z,
     sx.insert(sx.end(), newsx.begin(), newsx.end());
     sy.insert(sy.end(), newsy.begin(), newsy.end());
     sz.insert(sz.end(), newsz.begin(), newsz.end());
+    if (_tag) _tag->insert(_tag->end(), newt.begin(), newt.end());
 
     std::cout << "    split added " << num_split << " particles" << std::endl;
   }
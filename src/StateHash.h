@@ -0,0 +1,41 @@
+/*
+ * StateHash.h - Bitwise fingerprint of simulation arrays
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "VectorHelper.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+
+//
+// 64-bit FNV-1a over the raw bytes, so that two runs agree only if every bit of every
+//   value agrees - this is for checking reproducibility, not for detecting tampering
+//
+const uint64_t fnv_offset = 0xcbf29ce484222325ULL;
+
+inline void hash_bytes (uint64_t& _h, const void* _data, const size_t _nbytes) {
+  const unsigned char* p = static_cast<const unsigned char*>(_data);
+  for (size_t i=0; i<_nbytes; ++i) {
+    _h ^= (uint64_t)p[i];
+    _h *= 0x100000001b3ULL;
+  }
+}
+
+template <class S>
+inline void hash_vector (uint64_t& _h, const Vector<S>& _v) {
+  const uint64_t n = _v.size();
+  hash_bytes(_h, &n, sizeof(n));
+  hash_bytes(_h, _v.data(), n*sizeof(S));
+}
+
+template <class S, size_t N>
+inline void hash_vector (uint64_t& _h, const std::array<Vector<S>,N>& _v) {
+  for (auto const& v : _v) hash_vector<S>(_h, v);
+}
@@ -0,0 +1,392 @@
+/*
+ * SurfaceLoads.h - Surface pressure, shear, and integrated loads on bodies
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include "Omega3D.h"
+#include "VectorHelper.h"
+#include "Collection.h"
+#include "Body.h"
+#include "GuiHelper.h"
+#include "json/json.hpp"
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+
+// integrated loads on one body
+struct BodyLoads {
+  std::string name;
+  std::array<double,Dimensions> force;
+  std::array<double,Dimensions> moment;
+};
+
+
+//
+// Compute per-panel pressure and shear from the panel-center velocities (which came
+// from the regular, fast influence path) and the solved vortex sheet strengths. This
+// runs whenever panels are written and at status dumps, reusing the BEM solution made
+// there: every step with diffusion, but only every output time step without it, since
+// then the panel velocities cost an extra evaluation. Body velocities and moments are
+// both taken about the body's position.
+//
+// With diffusion, the whole sheet is shed every step, so the sheet strength is the
+// vorticity flux over that step. The flux balances the tangential pressure gradient
+//   grad_s p = -rho ( (gamma x n)/dt + a_body )
+// which we integrate over the panel mesh in a least-squares sense. Wall shear comes
+// from the same sheet after diffusing for one step (Stokes' first problem).
+//
+// Without diffusion, the sheet is the potential slip, and we use unsteady Bernoulli
+// in the body frame with the velocity on the outside of the sheet. The surface
+// potential comes from integrating that tangential velocity over the same panel graph,
+// and its time derivative is a backward difference against the previous call on the
+// same mesh (so the first call after a mesh change is quasi-steady). The potential is
+// only known to a constant, and we drop its mean: that part adds a uniform pressure,
+// which gives no net force or moment on a closed body.
+//
+// Panel quantities use one-point (centroid) quadrature, like the BEM.
+//
+template <class S>
+class SurfaceLoads {
+public:
+  SurfaceLoads()
+    : enabled(false),
+      rho(1.0)
+    {}
+
+  bool is_enabled() const { return enabled; }
+  void set_enabled(const bool _on) { enabled = _on; }
+
+  // compute loads on all Surfaces, save pressure and shear there, and return per-body totals
+  std::vector<BodyLoads> compute(const double _time,
+                                 const double _dt,
+                                 const double _nu,
+                                 const bool _viscous,
+                                 const std::array<double,Dimensions>& _fs,
+                                 std::vector<Collection>& _bdry);
+
+  void from_json(const nlohmann::json);
+  void add_to_json(nlohmann::json&) const;
+#ifdef USE_IMGUI
+  void draw_advanced();
+#endif
+
+private:
+  // panel connectivity and a factored surface Laplacian, reused while topology is fixed
+  struct PanelGraph {
+    size_t np = 0;
+    uint32_t version = 0;
+    std::vector<std::pair<Int,Int>> edges;
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver;
+    // surface potential and its rate at the last inviscid call
+    double phi_time = 0.0;
+    Eigen::VectorXd phi, dphidt;
+  };
+  void make_graph(const Surfaces<S>&, PanelGraph&);
+  Eigen::VectorXd integrate_gradient(const PanelGraph&, const std::array<Vector<S>,Dimensions>&,
+                                     const std::array<Vector<S>,Dimensions>&, const Vector<S>&);
+
+  bool enabled;
+  S rho;
+  std::vector<std::unique_ptr<PanelGraph>> graphs;
+};
+
+
+//
+// find all panel pairs that share an edge, and factor the graph Laplacian
+//
+template <class S>
+void SurfaceLoads<S>::make_graph(const Surfaces<S>& _surf, PanelGraph& _g) {
+
+  const size_t np = _surf.get_npanels();
+  std::vector<Int> const& idx = _surf.get_idx();
+
+  std::map<std::pair<Int,Int>,Int> edge_owner;
+  _g.edges.clear();
+  for (size_t i=0; i<np; ++i) {
+    for (size_t e=0; e<3; ++e) {
+      Int n0 = idx[3*i+e];
+      Int n1 = idx[3*i+(e+1)%3];
+      if (n1 < n0) std::swap(n0, n1);
+      auto found = edge_owner.find(std::make_pair(n0,n1));
+      if (found == edge_owner.end()) edge_owner[std::make_pair(n0,n1)] = (Int)i;
+      else _g.edges.push_back(std::make_pair(found->second, (Int)i));
+    }
+  }
+
+  // least-squares matrix, with a tiny diagonal so that every disconnected piece is solvable
+  std::vector<Eigen::Triplet<double>> trip;
+  trip.reserve(4*_g.edges.size() + np);
+  for (auto const& e : _g.edges) {
+    trip.emplace_back(e.first, e.first, 1.0);
+    trip.emplace_back(e.second, e.second, 1.0);
+    trip.emplace_back(e.first, e.second, -1.0);
+    trip.emplace_back(e.second, e.first, -1.0);
+  }
+  for (size_t i=0; i<np; ++i) trip.emplace_back(i, i, 1.e-8);
+  Eigen::SparseMatrix<double> L(np, np);
+  L.setFromTriplets(trip.begin(), trip.end());
+  _g.solver.compute(L);
+  _g.np = np;
+
+  std::cout << "    surface loads graph has " << np << " panels and " << _g.edges.size() << " edges" << std::endl;
+}
+
+//
+// least-squares integration of a per-panel gradient over the panel graph, zero area-weighted mean
+//
+template <class S>
+Eigen::VectorXd SurfaceLoads<S>::integrate_gradient(const PanelGraph& _g,
+                                                    const std::array<Vector<S>,Dimensions>& _grad,
+                                                    const std::array<Vector<S>,Dimensions>& _cen,
+                                                    const Vector<S>& _area) {
+  Eigen::VectorXd rhs = Eigen::VectorXd::Zero(_g.np);
+  for (auto const& e : _g.edges) {
+    // expected difference along this edge, from the mean gradient
+    double df = 0.0;
+    for (size_t d=0; d<Dimensions; ++d) {
+      df += 0.5 * (_grad[d][e.first] + _grad[d][e.second]) * (_cen[d][e.second] - _cen[d][e.first]);
+    }
+    rhs[e.first] -= df;
+    rhs[e.second] += df;
+  }
+  Eigen::VectorXd f = _g.solver.solve(rhs);
+
+  // only known to a constant, choose zero mean
+  double fmean = 0.0, atot = 0.0;
+  for (size_t i=0; i<_g.np; ++i) {
+    fmean += f[i]*_area[i];
+    atot += _area[i];
+  }
+  fmean /= atot;
+  for (size_t i=0; i<_g.np; ++i) f[i] -= fmean;
+  return f;
+}
+
+template <class S>
+std::vector<BodyLoads> SurfaceLoads<S>::compute(const double _time,
+                                                const double _dt,
+                                                const double _nu,
+                                                const bool _viscous,
+                                                const std::array<double,Dimensions>& _fs,
+                                                std::vector<Collection>& _bdry) {
+
+  auto start = std::chrono::system_clock::now();
+  std::vector<BodyLoads> loads;
+  if (graphs.size() < _bdry.size()) graphs.resize(_bdry.size());
+
+  for (size_t ic=0; ic<_bdry.size(); ++ic) {
+    if (not std::holds_alternative<Surfaces<S>>(_bdry[ic])) continue;
+    Surfaces<S>& surf = std::get<Surfaces<S>>(_bdry[ic]);
+    const size_t np = surf.get_npanels();
+    if (np == 0) continue;
+
+    // convenience references
+    std::array<Vector<S>,Dimensions> const& x = surf.get_pos();
+    std::vector<Int> const&               idx = surf.get_idx();
+    std::array<Vector<S>,Dimensions> const& x1 = surf.get_x1();
+    std::array<Vector<S>,Dimensions> const& x2 = surf.get_x2();
+    std::array<Vector<S>,Dimensions> const& nm = surf.get_norm();
+    Vector<S> const&                     area = surf.get_area();
+    std::array<Vector<S>,Dimensions> const& pu = surf.get_vel();
+    Vector<S> const&                      vs1 = surf.get_vort1_str();
+    Vector<S> const&                      vs2 = surf.get_vort2_str();
+
+    // body motion
+    std::shared_ptr<Body> bp = surf.get_body_ptr();
+    std::array<double,Dimensions> bpos = {0.0, 0.0, 0.0};
+    std::array<double,Dimensions> bvel = {0.0, 0.0, 0.0};
+    std::array<double,Dimensions> bacc = {0.0, 0.0, 0.0};
+    std::array<double,Dimensions> brot = {0.0, 0.0, 0.0};
+    if (bp) {
+      bpos = bp->get_pos(_time);
+      bvel = bp->get_vel(_time);
+      brot = bp->get_rotvel_vec(_time);
+      const std::array<double,Dimensions> lastvel = bp->get_vel(_time-_dt);
+      for (size_t d=0; d<Dimensions; ++d) bacc[d] = (bvel[d]-lastvel[d]) / _dt;
+    }
+
+    // panel centers, sheet strengths, and slip velocities
+    std::array<Vector<S>,Dimensions> cen, slip;
+    for (size_t d=0; d<Dimensions; ++d) {
+      cen[d].resize(np);
+      slip[d].resize(np);
+    }
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)np; ++i) {
+      std::array<S,Dimensions> gam, ub;
+      for (size_t d=0; d<Dimensions; ++d) {
+        cen[d][i] = (x[d][idx[3*i]] + x[d][idx[3*i+1]] + x[d][idx[3*i+2]]) / 3.0;
+        gam[d] = vs1[i]*x1[d][i] + vs2[i]*x2[d][i];
+      }
+      // velocity of the panel center due to body motion, the body rotates about its position
+      const S xc = cen[0][i]-bpos[0], yc = cen[1][i]-bpos[1], zc = cen[2][i]-bpos[2];
+      ub[0] = bvel[0] + brot[1]*zc - brot[2]*yc;
+      ub[1] = bvel[1] + brot[2]*xc - brot[0]*zc;
+      ub[2] = bvel[2] + brot[0]*yc - brot[1]*xc;
+      // gamma x n is the velocity jump across the sheet
+      const std::array<S,Dimensions> jump = {gam[1]*nm[2][i] - gam[2]*nm[1][i],
+                                             gam[2]*nm[0][i] - gam[0]*nm[2][i],
+                                             gam[0]*nm[1][i] - gam[1]*nm[0][i]};
+      if (_viscous) {
+        for (size_t d=0; d<Dimensions; ++d) slip[d][i] = jump[d];
+      } else {
+        // outside velocity relative to the body
+        for (size_t d=0; d<Dimensions; ++d) slip[d][i] = pu[d][i] + 0.5*jump[d] - ub[d];
+      }
+    }
+
+    Vector<S> pres(np);
+    std::array<Vector<S>,Dimensions> tau;
+    for (size_t d=0; d<Dimensions; ++d) tau[d].assign(np, 0.0);
+
+    // both branches integrate a tangential gradient over the panel graph
+    if (not graphs[ic] or graphs[ic]->np != np or graphs[ic]->version != surf.get_mesh_version()) {
+      graphs[ic] = std::make_unique<PanelGraph>();
+      make_graph(surf, *graphs[ic]);
+      graphs[ic]->version = surf.get_mesh_version();
+    }
+    PanelGraph& g = *graphs[ic];
+
+    if (_viscous) {
+
+      std::array<Vector<S>,Dimensions> gradp;
+      for (size_t d=0; d<Dimensions; ++d) gradp[d].resize(np);
+      #pragma omp parallel for
+      for (int32_t i=0; i<(int32_t)np; ++i) {
+        std::array<S,Dimensions> gp;
+        for (size_t d=0; d<Dimensions; ++d) gp[d] = -rho * (slip[d][i]/_dt + bacc[d]);
+        // keep only the tangential part
+        const S gn = gp[0]*nm[0][i] + gp[1]*nm[1][i] + gp[2]*nm[2][i];
+        for (size_t d=0; d<Dimensions; ++d) gradp[d][i] = gp[d] - gn*nm[d][i];
+      }
+
+      // pressure is only known to a constant, this has zero mean
+      const Eigen::VectorXd p = integrate_gradient(g, gradp, cen, area);
+      for (size_t i=0; i<np; ++i) pres[i] = p[i];
+
+      // wall vorticity of a sheet diffused for one step is gamma / sqrt(pi nu dt)
+      const S shear_fac = rho * std::sqrt(_nu / (M_PI * _dt));
+      for (size_t d=0; d<Dimensions; ++d) {
+        for (size_t i=0; i<np; ++i) tau[d][i] = shear_fac * slip[d][i];
+      }
+
+    } else {
+      // surface potential from the tangential part of the outside velocity
+      std::array<Vector<S>,Dimensions> gradphi;
+      for (size_t d=0; d<Dimensions; ++d) gradphi[d].resize(np);
+      for (size_t i=0; i<np; ++i) {
+        const S un = slip[0][i]*nm[0][i] + slip[1][i]*nm[1][i] + slip[2][i]*nm[2][i];
+        for (size_t d=0; d<Dimensions; ++d) gradphi[d][i] = slip[d][i] - un*nm[d][i];
+      }
+      Eigen::VectorXd phi = integrate_gradient(g, gradphi, cen, area);
+
+      // a repeated call at the same time keeps the rate from the last distinct one
+      if (g.phi.size() == (Eigen::Index)np and _time > g.phi_time) {
+        g.dphidt = (phi - g.phi) / (_time - g.phi_time);
+      } else if (g.phi.size() != (Eigen::Index)np or _time < g.phi_time) {
+        g.dphidt = Eigen::VectorXd::Zero(np);
+      }
+      if (_time != g.phi_time or g.phi.size() != (Eigen::Index)np) {
+        g.phi = std::move(phi);
+        g.phi_time = _time;
+      }
+
+      // unsteady Bernoulli in the body frame
+      S qinf = 0.0;
+      for (size_t d=0; d<Dimensions; ++d) qinf += std::pow(_fs[d]-bvel[d], 2);
+      for (size_t i=0; i<np; ++i) {
+        const S q = slip[0][i]*slip[0][i] + slip[1][i]*slip[1][i] + slip[2][i]*slip[2][i];
+        pres[i] = 0.5 * rho * (qinf - q) - rho * g.dphidt[i];
+      }
+    }
+
+    // integrate over this collection
+    BodyLoads bl;
+    bl.name = bp ? bp->get_name() : "ground";
+    bl.force.fill(0.0);
+    bl.moment.fill(0.0);
+    for (size_t i=0; i<np; ++i) {
+      std::array<double,Dimensions> f;
+      for (size_t d=0; d<Dimensions; ++d) f[d] = area[i] * (tau[d][i] - pres[i]*nm[d][i]);
+      const std::array<double,Dimensions> r = {cen[0][i]-bpos[0], cen[1][i]-bpos[1], cen[2][i]-bpos[2]};
+      for (size_t d=0; d<Dimensions; ++d) bl.force[d] += f[d];
+      bl.moment[0] += r[1]*f[2] - r[2]*f[1];
+      bl.moment[1] += r[2]*f[0] - r[0]*f[2];
+      bl.moment[2] += r[0]*f[1] - r[1]*f[0];
+    }
+
+    // add to an existing body entry, or make a new one
+    bool found = false;
+    for (auto& other : loads) {
+      if (other.name == bl.name) {
+        for (size_t d=0; d<Dimensions; ++d) {
+          other.force[d] += bl.force[d];
+          other.moment[d] += bl.moment[d];
+        }
+        found = true;
+      }
+    }
+    if (not found) loads.push_back(bl);
+
+    surf.set_loads(std::move(pres), std::move(tau));
+  }
+
+  for (auto const& bl : loads) {
+    std::cout << "    loads on " << bl.name << ": force " << bl.force[0] << " " << bl.force[1] << " " << bl.force[2]
+              << ", moment " << bl.moment[0] << " " << bl.moment[1] << " " << bl.moment[2] << std::endl;
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> elapsed_seconds = end-start;
+  printf("    surface loads:\t[%.4f] seconds\n", (float)elapsed_seconds.count());
+
+  return loads;
+}
+
+//
+// read/write parameters to json
+//
+template <class S>
+void SurfaceLoads<S>::from_json(const nlohmann::json simj) {
+  if (simj.find("surfaceLoads") != simj.end()) {
+    enabled = simj["surfaceLoads"];
+    std::cout << "  setting surfaceLoads= " << enabled << std::endl;
+  }
+}
+
+template <class S>
+void SurfaceLoads<S>::add_to_json(nlohmann::json& simj) const {
+  if (enabled) simj["surfaceLoads"] = true;
+}
+
+#ifdef USE_IMGUI
+//
+// draw advanced options parts of the GUI
+//
+template <class S>
+void SurfaceLoads<S>::draw_advanced() {
+
+  ImGui::Spacing();
+  ImGui::Text("Surface loads settings");
+
+  ImGui::Checkbox("Compute surface pressure and loads", &enabled);
+  ImGui::SameLine();
+  ShowHelpMarker("Find pressure and shear on every panel, and total force and moment on each body, at every step (every output time step without viscosity). Panel values are written to the vtu files, and the per-body force and moment to the status file.");
+}
+#endif
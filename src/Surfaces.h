@@ -26,6 +26,9 @@
 #include <algorithm> // for max_element
 #include <optional>
 #include <cassert>
+#include <map>
+#include <limits>
+#include <utility>
 
 
 // useful structure for panel strengths and BCs
@@ -35,6 +38,9 @@
 //   ps[2] means that the normal (source) strength is present
 template <class S> using Strength = std::array<std::optional<Vector<S>>,3>;
 
+// built and queried in DistanceField.h
+template <class S> class DistanceField;
+
 // useful structure for basis vectors
 // Basis<S> b;
 //   b[0] is the pair of arrays of the normalized tangential-1 vectors, b[0][0] for x, b[0][1] for y
@@ -236,6 +242,15 @@ public:
   const Vector<S>&                    get_src_str() const { return *ps[2]; }
   Vector<S>&                          get_src_str()       { return *ps[2]; }
 
+  // surface pressure and shear stress, only present once SurfaceLoads has run
+  void set_loads(Vector<S>&& _p, std::array<Vector<S>,Dimensions>&& _tau) {
+    pres = std::move(_p);
+    shear = std::move(_tau);
+  }
+  const bool                          have_loads() const { return pres and pres->size() == np; }
+  const Vector<S>&                  get_pressure() const { return *pres; }
+  const std::array<Vector<S>,Dimensions>& get_shear() const { return *shear; }
+
   // and (reactive only) boundary conditions
   const Vector<S>&                  get_tang1_bcs() const { return *bc[0]; }
   const Vector<S>&                  get_tang2_bcs() const { return *bc[1]; }
@@ -291,6 +306,19 @@ public:
     vortex_sheet_to_panel_strength(get_npanels());
   }
 
+  // the current strengths in the layout that set_str takes, as a starting guess for the BEM
+  Vector<S> get_unknowns() const {
+    const size_t nunk = num_unknowns_per_panel();
+    Vector<S> out(get_num_rows(), 0.0);
+    if (not ps[0] or ps[0]->size() != get_npanels()) return out;
+    for (size_t i=0; i<get_npanels(); ++i) {
+      out[nunk*i+0] = (*ps[0])[i];
+      out[nunk*i+1] = (*ps[1])[i];
+      if (nunk == 3 and have_src_str()) out[nunk*i+2] = (*ps[2])[i];
+    }
+    return out;
+  }
+
   // convert vortex sheet strength to absolute panel strength
   // HACK - throw away the source strength
   void vortex_sheet_to_panel_strength(const size_t num) {
@@ -673,6 +701,274 @@ public:
     }
   }
 
+  //
+  // Split flagged panels (+1) into four at their edge midpoints, and merge any complete
+  //   family of four children that are all flagged (-1) back into their parent.
+  //
+  // The surface itself does not move: children are coplanar with their parent, so the
+  //   sheet strength (as a vector), the source strength, and the boundary velocity carry over
+  //   unchanged, and a merged parent takes the area-weighted mean of its children. Either way
+  //   the total circulation is the same before and after.
+  //
+  // A panel next to a split one keeps its edge, so the mesh is not conforming there; the
+  //   BEM only needs panel centers, and the split edge's midpoint is reused if the
+  //   neighbor is split later.
+  //
+  // Panels that were neither split nor merged come first, in their old order, so that their
+  //   rows and columns of the BEM matrix can be carried over (see get_kept_panels).
+  //
+  // Returns the number of panels split and the number of families merged.
+  //
+  std::pair<size_t,size_t> adapt_panels(const std::vector<int8_t>& _want, const int32_t _max_level) {
+
+    assert(_want.size() == np && "Adaptation flags do not match panel count");
+    assert(this->E == reactive && "Only reactive panels can be adapted");
+
+    if (plevel.size() != np) {
+      plevel.assign(np, 0);
+      pfam.assign(np, -1);
+      pslot.assign(np, 0);
+    }
+
+    // per-panel global vectors of sheet strength and boundary velocity
+    auto sheet_vec = [&](const size_t i) {
+      std::array<S,Dimensions> g;
+      for (size_t d=0; d<Dimensions; ++d) g[d] = (*ps[0])[i]*b[0][d][i] + (*ps[1])[i]*b[1][d][i];
+      return g;
+    };
+    auto bc_vec = [&](const size_t i) {
+      std::array<S,Dimensions> v;
+      for (size_t d=0; d<Dimensions; ++d) v[d] = (*bc[0])[i]*b[1][d][i] - (*bc[1])[i]*b[0][d][i];
+      return v;
+    };
+
+    // what each new panel is made of: corners, family info, and the carried-over values
+    struct NewPanel {
+      std::array<Int,3> c;
+      int32_t fam;
+      uint8_t slot;
+      uint8_t level;
+      std::array<S,Dimensions> g;	// sheet strength vector
+      std::array<S,Dimensions> v;	// tangential boundary velocity vector
+      S src, nbc;
+    };
+    std::vector<NewPanel> newp, splitp;
+    newp.reserve(np + 3*std::count(_want.begin(), _want.end(), (int8_t)1));
+    std::vector<Int> kept;
+    kept.reserve(np);
+
+    // how many current panels belong directly to each family
+    std::vector<int32_t> nchild(families.size(), 0);
+    for (size_t i=0; i<np; ++i) if (pfam[i] >= 0) nchild[pfam[i]]++;
+
+    // merge complete families whose children all asked for it
+    std::vector<int32_t> nwant(families.size(), 0);
+    for (size_t i=0; i<np; ++i) if (pfam[i] >= 0 and _want[i] < 0) nwant[pfam[i]]++;
+    std::vector<bool> merging(families.size(), false);
+    size_t nmerged = 0;
+    for (size_t f=0; f<families.size(); ++f) {
+      if (nchild[f] == 4 and nwant[f] == 4) {
+        merging[f] = true;
+        nmerged++;
+      }
+    }
+
+    // merged parents accumulate area-weighted values from their children
+    std::vector<NewPanel> merged(families.size());
+    std::vector<S> marea(families.size(), 0.0);
+
+    // midpoints that already exist, from live families
+    std::map<std::pair<Int,Int>,Int> midpts;
+    auto edge = [](const Int _a, const Int _b) { return std::make_pair(std::min(_a,_b), std::max(_a,_b)); };
+    for (size_t f=0; f<families.size(); ++f) {
+      if (merging[f] or not families[f].alive) continue;
+      for (size_t e=0; e<3; ++e) {
+        midpts[edge(families[f].corners[e], families[f].corners[(e+1)%3])] = families[f].mids[e];
+      }
+    }
+
+    const size_t nnold = this->n;
+    auto midpoint = [&](const Int _a, const Int _b) {
+      auto found = midpts.find(edge(_a,_b));
+      if (found != midpts.end()) return found->second;
+      const Int inew = (Int)this->n++;
+      for (size_t d=0; d<Dimensions; ++d) {
+        this->x[d].push_back(0.5*(this->x[d][_a] + this->x[d][_b]));
+        if (this->ux) (*this->ux)[d].push_back(0.5*((*this->ux)[d][_a] + (*this->ux)[d][_b]));
+      }
+      midpts[edge(_a,_b)] = inew;
+      return inew;
+    };
+
+    size_t nsplit = 0;
+    for (size_t i=0; i<np; ++i) {
+      const std::array<Int,3> c = {idx[3*i], idx[3*i+1], idx[3*i+2]};
+      const int32_t f = pfam[i];
+
+      if (f >= 0 and merging[f]) {
+        // accumulate into the parent
+        NewPanel& mp = merged[f];
+        const std::array<S,Dimensions> g = sheet_vec(i);
+        const std::array<S,Dimensions> v = bc_vec(i);
+        for (size_t d=0; d<Dimensions; ++d) {
+          mp.g[d] += area[i]*g[d];
+          mp.v[d] += area[i]*v[d];
+        }
+        mp.src += area[i] * (have_src_str() ? (*ps[2])[i] : 0.0);
+        mp.nbc += area[i] * (*bc[2])[i];
+        mp.level = plevel[i] - 1;
+        marea[f] += area[i];
+
+      } else if (_want[i] > 0 and plevel[i] < _max_level) {
+        // split into four, keeping the parent's orientation
+        const Int m01 = midpoint(c[0], c[1]);
+        const Int m12 = midpoint(c[1], c[2]);
+        const Int m20 = midpoint(c[2], c[0]);
+        const int32_t fnew = (int32_t)families.size();
+        families.push_back({c, {m01, m12, m20}, f, pslot[i], true});
+        nchild.push_back(0);
+        merging.push_back(false);
+
+        const std::array<std::array<Int,3>,4> kids = {{ {c[0], m01, m20}, {m01, c[1], m12},
+                                                        {m20, m12, c[2]}, {m01, m12, m20} }};
+        for (uint8_t k=0; k<4; ++k) {
+          splitp.push_back({kids[k], fnew, k, (uint8_t)(plevel[i]+1), sheet_vec(i), bc_vec(i),
+                            have_src_str() ? (*ps[2])[i] : (S)0.0, (*bc[2])[i]});
+        }
+        nsplit++;
+
+      } else {
+        newp.push_back({c, f, pslot[i], plevel[i], sheet_vec(i), bc_vec(i),
+                        have_src_str() ? (*ps[2])[i] : (S)0.0, (*bc[2])[i]});
+        kept.push_back((Int)i);
+      }
+    }
+
+    // split children follow the unchanged panels
+    newp.insert(newp.end(), splitp.begin(), splitp.end());
+
+    // merged parents go at the end
+    for (size_t f=0; f<merging.size(); ++f) {
+      if (not merging[f]) continue;
+      NewPanel mp = merged[f];
+      const S inv = 1.0 / marea[f];
+      for (size_t d=0; d<Dimensions; ++d) {
+        mp.g[d] *= inv;
+        mp.v[d] *= inv;
+      }
+      mp.src *= inv;
+      mp.nbc *= inv;
+      mp.c = families[f].corners;
+      mp.fam = families[f].parent;
+      mp.slot = families[f].slot;
+      newp.push_back(mp);
+      families[f].alive = false;
+    }
+
+    if (nsplit == 0 and nmerged == 0) return std::make_pair(nsplit, nmerged);
+
+    // drop nodes that no panel uses any more, and renumber the rest
+    np = newp.size();
+    std::vector<Int> remap(this->n, 0);
+    for (auto const& p : newp) for (size_t k=0; k<3; ++k) remap[p.c[k]] = 1;
+    Int nkeep = 0;
+    for (size_t i=0; i<this->n; ++i) {
+      if (remap[i]) {
+        for (size_t d=0; d<Dimensions; ++d) {
+          this->x[d][nkeep] = this->x[d][i];
+          if (this->ux) (*this->ux)[d][nkeep] = (*this->ux)[d][i];
+        }
+        remap[i] = nkeep++;
+      } else {
+        remap[i] = std::numeric_limits<Int>::max();
+      }
+    }
+    for (size_t d=0; d<Dimensions; ++d) {
+      this->x[d].resize(nkeep);
+      if (this->ux) (*this->ux)[d].resize(nkeep);
+      this->u[d].resize(nkeep);
+    }
+    this->n = nkeep;
+
+    // and forget merged families, renumbering the live ones
+    std::vector<int32_t> fremap(families.size(), -1);
+    int32_t nfam = 0;
+    for (size_t f=0; f<families.size(); ++f) {
+      if (families[f].alive) {
+        families[nfam] = families[f];
+        fremap[f] = nfam++;
+      }
+    }
+    families.resize(nfam);
+    for (auto& fam : families) {
+      for (size_t k=0; k<3; ++k) {
+        fam.corners[k] = remap[fam.corners[k]];
+        fam.mids[k] = remap[fam.mids[k]];
+      }
+      if (fam.parent >= 0) fam.parent = fremap[fam.parent];
+    }
+
+    // rebuild the panel arrays
+    idx.resize(3*np);
+    plevel.resize(np);
+    pfam.resize(np);
+    pslot.resize(np);
+    for (size_t i=0; i<np; ++i) {
+      for (size_t k=0; k<3; ++k) idx[3*i+k] = remap[newp[i].c[k]];
+      plevel[i] = newp[i].level;
+      pfam[i] = (newp[i].fam >= 0) ? fremap[newp[i].fam] : -1;
+      pslot[i] = newp[i].slot;
+    }
+    compute_bases(np);
+
+    // project the carried-over vectors onto each new panel's basis
+    for (size_t d=0; d<3; ++d) {
+      if (ps[d]) ps[d]->resize(np);
+      bc[d]->resize(np);
+    }
+    for (size_t i=0; i<np; ++i) {
+      std::array<S,Dimensions> x1, x2;
+      for (size_t d=0; d<Dimensions; ++d) {
+        x1[d] = b[0][d][i];
+        x2[d] = b[1][d][i];
+      }
+      (*ps[0])[i] = dot_product<S>(newp[i].g, x1);
+      (*ps[1])[i] = dot_product<S>(newp[i].g, x2);
+      if (have_src_str()) (*ps[2])[i] = newp[i].src;
+      (*bc[0])[i] = dot_product<S>(newp[i].v, x2);
+      (*bc[1])[i] = -dot_product<S>(newp[i].v, x1);
+      (*bc[2])[i] = newp[i].nbc;
+    }
+    vortex_sheet_to_panel_strength(np);
+
+    for (size_t d=0; d<Dimensions; ++d) pu[d].resize(np);
+
+    // loads belong to the old panels
+    pres.reset();
+    shear.reset();
+    pkept = std::move(kept);
+    mesh_version++;
+
+    std::cout << "  adapted panels: split " << nsplit << ", merged " << nmerged << ", now "
+              << np << " panels and " << this->n << " nodes (was " << nnold << ")" << std::endl;
+
+    return std::make_pair(nsplit, nmerged);
+  }
+
+  // refinement level of each panel, and a counter that changes whenever the mesh does
+  const std::vector<uint8_t>& get_panel_level() const { return plevel; }
+  const uint32_t get_mesh_version() const { return mesh_version; }
+
+  // the old index of each leading panel that came through the last adaptation unchanged
+  const std::vector<Int>& get_kept_panels() const { return pkept; }
+
+  // node positions in the body's own frame (the current ones if there is no body)
+  const std::array<Vector<S>,Dimensions>& get_body_pos() const { return this->ux ? *this->ux : this->x; }
+
+  // cached signed distance field in the body frame, see DistanceField.h
+  std::shared_ptr<DistanceField<S>> get_distance_field() const { return sdf; }
+  void set_distance_field(std::shared_ptr<DistanceField<S>> _sdf) const { sdf = _sdf; }
+
   // calculate the geometric center of all geometry in this object
   void set_geom_center() {
 
@@ -907,6 +1203,31 @@ public:
   }
 */
 
+  // position and total strength of the particle that represents one panel
+  void panel_as_particle(const size_t i, const S _offset, S* _x, S* _s) const {
+    const Int id0 = idx[3*i];
+    const Int id1 = idx[3*i+1];
+    const Int id2 = idx[3*i+2];
+    const std::array<Vector<S>,3>&   x1 = b[0];
+    const std::array<Vector<S>,3>&   x2 = b[1];
+    const std::array<Vector<S>,3>& norm = b[2];
+
+    // start at center of panel
+    for (size_t j=0; j<3; ++j) _x[j] = (1./3.) * (this->x[j][id0] + this->x[j][id1] + this->x[j][id2]);
+    // push out a fixed distance
+    // this assumes properly resolved, vdelta and dt
+    for (size_t j=0; j<3; ++j) _x[j] += _offset * norm[j][i];
+    // the panel strength is the solved strength plus the boundary condition
+    for (size_t j=0; j<3; ++j) _s[j] = ts[j][i];
+    // add on the (vortex) bc values here
+    if (this->E == reactive) {
+      const Vector<S>& bc1 = *bc[0];
+      const Vector<S>& bc2 = *bc[1];
+      for (size_t j=0; j<3; ++j) _s[j] += (bc1[i]*x1[j][i] + bc2[i]*x2[j][i]) * area[i];
+    }
+    // IGNORE SOURCE SHEET STRENGTHS
+  }
+
   //
   // return a particle version of the panels (useful during Diffusion)
   // offset is in world units - NOT scaled
@@ -922,30 +1243,9 @@ public:
     // init the output vector (x, y, z, sx, sy, sz, r)
     std::vector<S> px(num_pts*7);
 
-    // get basis vectors
-    std::array<Vector<S>,3>&   x1 = b[0];
-    std::array<Vector<S>,3>&   x2 = b[1];
-    std::array<Vector<S>,3>& norm = b[2];
-    Vector<S>&                bc1 = *bc[0];
-    Vector<S>&                bc2 = *bc[1];
-
     for (size_t i=0; i<num_pts; i++) {
-      const Int id0 = idx[3*i];
-      const Int id1 = idx[3*i+1];
-      const Int id2 = idx[3*i+2];
       const Int idx = 7*i;
-      // start at center of panel
-      for (size_t j=0; j<3; ++j) px[idx+j] = (1./3.) * (this->x[j][id0] + this->x[j][id1] + this->x[j][id2]);
-      // push out a fixed distance
-      // this assumes properly resolved, vdelta and dt
-      for (size_t j=0; j<3; ++j) px[idx+j] += _offset * norm[j][i];
-      // the panel strength is the solved strength plus the boundary condition
-      for (size_t j=0; j<3; ++j) px[idx+3+j] = ts[j][i];
-      // add on the (vortex) bc values here
-      if (this->E == reactive) {
-        for (size_t j=0; j<3; ++j) px[idx+3+j] += (bc1[i]*x1[j][i] + bc2[i]*x2[j][i]) * area[i];
-      }
-      // IGNORE SOURCE SHEET STRENGTHS
+      panel_as_particle(i, _offset, &px[idx], &px[idx+3]);
       // and the core size
       px[idx+6] = _vdelta;
       //std::cout << "  new part at " << px[idx+0] << " " << px[idx+1] << " " << px[idx+2];
@@ -955,6 +1255,31 @@ public:
     return px;
   }
 
+  // same as above, but write directly into the given particle arrays starting at _ioff,
+  //   which must already be large enough to hold one particle per panel
+  void represent_as_particles(const S _offset, const S _vdelta,
+                              std::array<Vector<S>,Dimensions>& _px,
+                              std::array<Vector<S>,numStrenPerNode>& _ps,
+                              Vector<S>& _pr,
+                              const size_t _ioff) {
+
+    const size_t num_pts = get_npanels();
+    assert(_pr.size() >= _ioff+num_pts && "Particle arrays too small for shed particles");
+
+    // recompute the total strengths (ts)
+    vortex_sheet_to_panel_strength(num_pts);
+
+    #pragma omp parallel for
+    for (int32_t i=0; i<(int32_t)num_pts; ++i) {
+      std::array<S,3> thisx, thiss;
+      panel_as_particle(i, _offset, thisx.data(), thiss.data());
+      const size_t ip = _ioff + i;
+      for (size_t j=0; j<3; ++j) _px[j][ip] = thisx[j];
+      for (size_t j=0; j<3; ++j) _ps[j][ip] = thiss[j];
+      _pr[ip] = _vdelta;
+    }
+  }
+
   // find the new peak vortex sheet strength magnitude
   S get_max_str() {
     if (this->E != inert) {
@@ -1254,6 +1579,10 @@ protected:
   std::array<Vector<S>,Dimensions>  ts; // total element strengths (do not use s in ElementBase)
   bool           source_str_is_unknown; // should the BEM solve for source strengths?
 
+  // surface loads, per panel
+  std::optional<Vector<S>>                     pres; // pressure
+  std::optional<std::array<Vector<S>,Dimensions>> shear; // wall shear stress
+
   // parameters for the encompassing body
   Int                           istart; // index of first entry in RHS vector and A matrix
   S                                vol; // volume of the body - for augmented BEM solution
@@ -1263,6 +1592,24 @@ protected:
   // augmented-BEM-related (see Omega2D for more)
   //std::array<S,Dimensions> solved_omega; // rotation rate returned from augmented row in BEM
 
+  // adaptive refinement history: each family is one split panel and its midpoint nodes
+  struct PanelFamily {
+    std::array<Int,3> corners;
+    std::array<Int,3> mids;		// on edges 0-1, 1-2, 2-0
+    int32_t parent;			// family of the panel that was split, -1 if original
+    uint8_t slot;			// which child of that family it was
+    bool alive;
+  };
+  std::vector<PanelFamily>    families;
+  std::vector<int32_t>            pfam; // family of each panel, -1 if original
+  std::vector<uint8_t>           pslot; // which child of its family
+  std::vector<uint8_t>          plevel; // number of splits since the original panel
+  std::vector<Int>               pkept; // see get_kept_panels
+  uint32_t                mesh_version = 0;
+
+  // rigid motion does not change this, so copies of the collection can share it
+  mutable std::shared_ptr<DistanceField<S>> sdf;
+
 private:
 #ifdef USE_GL
   std::shared_ptr<GlState> mgl;		// for drawing only
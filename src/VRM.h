@@ -11,6 +11,8 @@
 #include "Icosahedron.h"
 #include "VectorHelper.h"
 #include "nanoflann.hpp"
+#include "SearchHelper.h"
+#include "PointsTree.h"
 #ifdef PLUGIN_SIMPLEX
 #include "simplex.h"
 #endif
@@ -27,6 +29,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 enum SolverType { nnls, simplex };
@@ -51,13 +54,14 @@ public:
   const float get_ignore() const { return ignore_thresh; }
   const bool get_simplex() const { return (use_solver==simplex); }
 
-  // all-to-all diffuse; can change array sizes
+  // all-to-all diffuse; can change array sizes; reuses the neighbor lists of a persistent tree if given
   void diffuse_all(std::array<Vector<ST>,3>&,
                    std::array<Vector<ST>,3>&,
                    Vector<ST>&,
                    const ST,
                    const CoreType,
-                   const ST);
+                   const ST,
+                   PointsTree<ST>* _tree = nullptr);
 
   // other functions to eventually support:
   // two-to-one merge (when particles are close to each other)
@@ -246,7 +250,8 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,3>& pos,
                                     Vector<ST>& rad,
                                     const ST h_nu,
                                     const CoreType core_func,
-                                    const ST particle_overlap) {
+                                    const ST particle_overlap,
+                                    PointsTree<ST>* _tree) {
 
   // make sure all vector sizes are identical
   assert(pos[0].size()==pos[1].size() && "Input arrays are not uniform size");
@@ -300,24 +305,37 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,3>& pos,
   const ST maxStrSqrd = maxStr;
   //std::cout << "    maxStrSqrd " << maxStrSqrd << std::endl;
 
+  // the largest search radius needed below
+  ST max_rad = 0.0;
+  for (size_t i=0; i<n; ++i) max_rad = std::max(max_rad, r[i]);
+  const ST max_search_rad = (max_rad / particle_overlap) * ((num_moments > 2) ? 2.5 : 1.6);
+
   // convert particle positions into something nanoflann can understand
   Eigen::Matrix<ST, Eigen::Dynamic, Dimensions> xp;
-  xp.resize(n,Dimensions);
-  xp.col(0) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(x.data(), n);
-  xp.col(1) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(y.data(), n);
-  xp.col(2) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(z.data(), n);
-  
-  // generate the searchable data structure
   typedef typename Eigen::Matrix<ST, Eigen::Dynamic, 3> EigenMatType;
   typedef typename EigenMatType::Index EigenIndexType;
   typedef nanoflann::KDTreeEigenMatrixAdaptor< EigenMatType >  my_kd_tree_t;
-  my_kd_tree_t mat_index(Dimensions, std::cref(xp));
-  if (use_tree) mat_index.index->buildIndex();
+  std::unique_ptr<my_kd_tree_t> mat_index;
+
+  if (use_tree and _tree) {
+    // refit, or rebuild only if particles moved too far
+    _tree->update(pos, max_search_rad);
+
+  } else if (use_tree) {
+    xp.resize(n,Dimensions);
+    xp.col(0) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(x.data(), n);
+    xp.col(1) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(y.data(), n);
+    xp.col(2) = Eigen::Map<Eigen::Matrix<ST, Eigen::Dynamic, 1> >(z.data(), n);
+
+    // generate the searchable data structure
+    mat_index = std::make_unique<my_kd_tree_t>(Dimensions, std::cref(xp));
+    mat_index->index->buildIndex();
+  }
 
   std::vector<std::pair<EigenIndexType,ST> > ret_matches;
   ret_matches.reserve(max_near);
   nanoflann::SearchParams params;
-  params.sorted = true;
+  params.sorted = false;	// sort_matches does this in a repeatable order
 
   // do not adapt particle radii -- copy current to new
   newr = r;
@@ -355,10 +373,22 @@ void VRM<ST,CT,MAXMOM>::diffuse_all(std::array<Vector<ST>,3>& pos,
 
     // switch on search method
     if (use_tree) {
-      // tree-based search with nanoflann
       const ST distsq_thresh = std::pow(search_rad, 2);
-      const ST query_pt[3] = { x[i], y[i], z[i] };
-      (void) mat_index.index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+      if (_tree) {
+        // filter the neighbor list, which includes a skin
+        ret_matches.clear();
+        const int32_t* nbrs = _tree->get_nbrs(i);
+        for (size_t j=0; j<_tree->get_num_nbrs(i); ++j) {
+          const int32_t iother = nbrs[j];
+          const ST distsq = std::pow(x[i]-x[iother],2) + std::pow(y[i]-y[iother],2) + std::pow(z[i]-z[iother],2);
+          if (distsq < distsq_thresh) ret_matches.emplace_back((EigenIndexType)iother, distsq);
+        }
+      } else {
+        // tree-based search with nanoflann
+        const ST query_pt[3] = { x[i], y[i], z[i] };
+        (void) mat_index->index->radiusSearch(query_pt, distsq_thresh, ret_matches, params);
+      }
+      sort_matches(ret_matches);
       //if (ret_matches.size() > 100) std::cout << "part " << i << " at " << x[i] << " " << y[i] << " " << z[i] << " has " << ret_matches.size() << " matches" << std::endl;
 
       // copy the indexes into my vector
@@ -567,9 +597,9 @@ bool VRM<ST,CT,MAXMOM>::attempt_solution(const int32_t idiff,
   bool haveSolution = false;
 
   // the matricies that we will repeatedly work on
-  static Eigen::Matrix<CT, num_rows, Eigen::Dynamic, 0, num_rows, max_near> A;
-  static Eigen::Matrix<CT, num_rows, 1> b;
-  static Eigen::Matrix<CT, Eigen::Dynamic, 1, 0, max_near, 1> fractions;
+  thread_local Eigen::Matrix<CT, num_rows, Eigen::Dynamic, 0, num_rows, max_near> A;
+  thread_local Eigen::Matrix<CT, num_rows, 1> b;
+  thread_local Eigen::Matrix<CT, Eigen::Dynamic, 1, 0, max_near, 1> fractions;
 
   // second moment in each direction
   // one dt should generate 6 hnu^2 of second moment, or when distances
@@ -17,6 +17,10 @@
 #include "cppcodec/base64_rfc4648.hpp"
 
 #include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
 #include <cstdint>	// for uint32_t
 #include <cstdio>	// for FILE
 #include <string>	// for string
@@ -29,19 +33,107 @@
 //
 
 
+//
+// the VTK type of an array of floats quantized to _bits bits, or of the floats themselves
+//
+inline const char* quantized_type_name (const int _bits) {
+  if (_bits <= 0) return "Float32";
+  return (_bits <= 8) ? "UInt8" : "UInt16";
+}
+
+template <class S>
+void write_DataArray (tinyxml2::XMLPrinter&, Vector<S> const &,
+                      bool _compress = false, bool _asbase64 = false,
+                      const int _qbits = 0, const int _ncomp = 1);
+
+//
+// quantize interleaved floats with _ncomp components to _bits-bit integers, from the minimum
+//   to the maximum of each component, and write them with the offset and step of each
+//   component as extra attributes (which VTK ignores) - value = offset + step * integer
+//
+// rounding to the nearest step is off by at most half a step, and rounding the decoded value
+//   back to a float adds at most one more float epsilon of the largest magnitude; their sum is
+//   written as QuantError, a guaranteed bound on the absolute error of every decoded value
+//
+template <class S, class I>
+void write_quantized_DataArray (tinyxml2::XMLPrinter& _p,
+                                Vector<S> const & _data,
+                                const int _bits,
+                                const int _ncomp,
+                                bool _asbase64) {
+
+  const size_t n = _data.size() / _ncomp;
+  const double levels = std::pow(2.0, std::min(_bits, 8*(int)sizeof(I))) - 1.0;
+
+  std::vector<double> offset(_ncomp), step(_ncomp), maxerr(_ncomp);
+  for (int c=0; c<_ncomp; ++c) {
+    double minv = std::numeric_limits<double>::max();
+    double maxv = -std::numeric_limits<double>::max();
+    for (size_t i=0; i<n; ++i) {
+      const double v = _data[_ncomp*i+c];
+      if (std::isfinite(v)) {
+        minv = std::min(minv, v);
+        maxv = std::max(maxv, v);
+      }
+    }
+    if (minv > maxv) { minv = 0.0; maxv = 0.0; }
+    offset[c] = minv;
+    step[c] = (maxv - minv) / levels;
+    maxerr[c] = 0.5*step[c] + std::numeric_limits<float>::epsilon() * std::max(std::abs(minv), std::abs(maxv));
+  }
+
+  Vector<I> qvec(_data.size());
+  for (size_t i=0; i<n; ++i) {
+    for (int c=0; c<_ncomp; ++c) {
+      const double v = _data[_ncomp*i+c];
+      double q = (step[c] > 0.0 and std::isfinite(v)) ? std::round((v - offset[c]) / step[c]) : 0.0;
+      qvec[_ncomp*i+c] = (I)std::clamp(q, 0.0, levels);
+    }
+  }
+
+  // the attributes must all precede the data
+  auto push_list = [&_p](const char* _name, const std::vector<double>& _vals) {
+    std::stringstream ss;
+    ss << std::setprecision(17);
+    for (size_t c=0; c<_vals.size(); ++c) ss << (c==0 ? "" : " ") << _vals[c];
+    _p.PushAttribute( _name, ss.str().c_str() );
+  };
+  _p.PushAttribute( "QuantBits", _bits );
+  push_list( "QuantOffset", offset );
+  push_list( "QuantStep", step );
+  push_list( "QuantError", maxerr );
+
+  write_DataArray<I>(_p, qvec, false, _asbase64, 0, 1);
+}
+
+
 //
 // write vector to the vtk file
 //
 // why would you ever want to use base64 for floats and such? so wasteful.
 //
+// set _qbits to write floats as integers of that many bits instead, see above
+//
 template <class S>
 void write_DataArray (tinyxml2::XMLPrinter& _p,
                       Vector<S> const & _data,
-                      bool _compress = false,
-                      bool _asbase64 = false) {
+                      bool _compress,
+                      bool _asbase64,
+                      const int _qbits,
+                      const int _ncomp) {
 
   using base64 = cppcodec::base64_rfc4648;
 
+  if constexpr (std::is_floating_point<S>::value) {
+    if (_qbits > 8) {
+      write_quantized_DataArray<S,uint16_t>(_p, _data, _qbits, _ncomp, _asbase64);
+      return;
+    } else if (_qbits > 0) {
+      write_quantized_DataArray<S,uint8_t>(_p, _data, _qbits, _ncomp, _asbase64);
+      return;
+    }
+  }
+
   if (_compress) {
     // not yet implemented
   }
@@ -93,7 +185,8 @@ template <class S>
 void write_DataArray (tinyxml2::XMLPrinter& _p,
                       std::array<Vector<S>,2> const & _data,
                       bool _compress = false,
-                      bool _asbase64 = false) {
+                      bool _asbase64 = false,
+                      const int _qbits = 0) {
 
   // interleave the two vectors into a new one
   Vector<S> newvec;
@@ -105,7 +198,7 @@ void write_DataArray (tinyxml2::XMLPrinter& _p,
   }
 
   // pass it on to write
-  write_DataArray<S>(_p, newvec, _compress, _asbase64);
+  write_DataArray<S>(_p, newvec, _compress, _asbase64, _qbits, 3);
 }
 
 
@@ -116,7 +209,8 @@ template <class S>
 void write_DataArray (tinyxml2::XMLPrinter& _p,
                       std::array<Vector<S>,3> const & _data,
                       bool _compress = false,
-                      bool _asbase64 = false) {
+                      bool _asbase64 = false,
+                      const int _qbits = 0) {
 
   // interleave the three vectors into a new one
   Vector<S> newvec;
@@ -128,7 +222,7 @@ void write_DataArray (tinyxml2::XMLPrinter& _p,
   }
 
   // pass it on to write
-  write_DataArray<S>(_p, newvec, _compress, _asbase64);
+  write_DataArray<S>(_p, newvec, _compress, _asbase64, _qbits, 3);
 }
 
 //
@@ -138,7 +232,8 @@ template <class S>
 void write_DataArray (tinyxml2::XMLPrinter& _p,
                       std::array<Vector<S>,9> const & _data,
                       bool _compress = false,
-                      bool _asbase64 = false) {
+                      bool _asbase64 = false,
+                      const int _qbits = 0) {
 
   // interleave the three vectors into a new one
   Vector<S> newvec;
@@ -150,7 +245,7 @@ void write_DataArray (tinyxml2::XMLPrinter& _p,
   }
 
   // pass it on to write
-  write_DataArray<S>(_p, newvec, _compress, _asbase64);
+  write_DataArray<S>(_p, newvec, _compress, _asbase64, _qbits, 3);
 }
 
 
@@ -177,7 +272,8 @@ void write_DataArray (tinyxml2::XMLPrinter& _p,
 //
 template <class S>
 std::string write_vtu_points(Points<S> const& pts, const size_t file_idx,
-                             const size_t frameno, const double time) {
+                             const size_t frameno, const double time,
+                             const int qbits = 0, const std::string& _prefix = std::string()) {
 
   assert(pts.get_n() > 0 && "Inside write_vtu_points with no points");
 
@@ -199,7 +295,7 @@ std::string write_vtu_points(Points<S> const& pts, const size_t file_idx,
 
   // generate file name
   std::stringstream vtkfn;
-  vtkfn << prefix << std::setfill('0') << std::setw(2) << file_idx << "_" << std::setw(5) << frameno << ".vtu";
+  vtkfn << _prefix << prefix << std::setfill('0') << std::setw(2) << file_idx << "_" << std::setw(5) << frameno << ".vtu";
 
   // prepare file pointer and printer
   std::FILE* fp = std::fopen(vtkfn.str().c_str(), "wb");
@@ -243,8 +339,8 @@ std::string write_vtu_points(Points<S> const& pts, const size_t file_idx,
   printer.OpenElement( "DataArray" );
   printer.PushAttribute( "NumberOfComponents", "3" );
   printer.PushAttribute( "Name", "position" );
-  printer.PushAttribute( "type", "Float32" );
-  write_DataArray (printer, pts.get_pos(), compress, asbase64);
+  printer.PushAttribute( "type", quantized_type_name(qbits) );
+  write_DataArray (printer, pts.get_pos(), compress, asbase64, qbits);
   printer.CloseElement();	// DataArray
   printer.CloseElement();	// Points
 
@@ -309,24 +405,33 @@ std::string write_vtu_points(Points<S> const& pts, const size_t file_idx,
     printer.OpenElement( "DataArray" );
     printer.PushAttribute( "NumberOfComponents", "3" );
     printer.PushAttribute( "Name", "circulation" );
-    printer.PushAttribute( "type", "Float32" );
-    write_DataArray (printer, pts.get_str(), compress, asbase64);
+    printer.PushAttribute( "type", quantized_type_name(qbits) );
+    write_DataArray (printer, pts.get_str(), compress, asbase64, qbits);
     printer.CloseElement();	// DataArray
   }
 
   if (has_elong) {
     printer.OpenElement( "DataArray" );
     printer.PushAttribute( "Name", "elongation" );
-    printer.PushAttribute( "type", "Float32" );
-    write_DataArray (printer, pts.get_elong(), compress, asbase64);
+    printer.PushAttribute( "type", quantized_type_name(qbits) );
+    write_DataArray (printer, pts.get_elong(), compress, asbase64, qbits);
     printer.CloseElement();	// DataArray
   }
 
   if (has_radii) {
     printer.OpenElement( "DataArray" );
     printer.PushAttribute( "Name", "radius" );
-    printer.PushAttribute( "type", "Float32" );
-    write_DataArray (printer, pts.get_rad(), compress, asbase64);
+    printer.PushAttribute( "type", quantized_type_name(qbits) );
+    write_DataArray (printer, pts.get_rad(), compress, asbase64, qbits);
+    printer.CloseElement();	// DataArray
+  }
+
+  // which flow feature made each particle (0 for diffused or shed particles)
+  if (has_strengths and pts.get_tag().size() == pts.get_n()) {
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "Name", "feature" );
+    printer.PushAttribute( "type", "Int32" );
+    write_DataArray (printer, pts.get_tag(), compress, asbase64);
     printer.CloseElement();	// DataArray
   }
 
@@ -334,17 +439,17 @@ std::string write_vtu_points(Points<S> const& pts, const size_t file_idx,
     printer.OpenElement( "DataArray" );
     printer.PushAttribute( "NumberOfComponents", "3" );
     printer.PushAttribute( "Name", "vorticity" );
-    printer.PushAttribute( "type", "Float32" );
+    printer.PushAttribute( "type", quantized_type_name(qbits) );
     const std::array<Vector<S>,9>& tug = *(pts.get_velgrad());
-    write_DataArray (printer, tug, compress, asbase64);
+    write_DataArray (printer, tug, compress, asbase64, qbits);
     printer.CloseElement();	// DataArray
   }
 
   printer.OpenElement( "DataArray" );
   printer.PushAttribute( "NumberOfComponents", "3" );
   printer.PushAttribute( "Name", "velocity" );
-  printer.PushAttribute( "type", "Float32" );
-  write_DataArray (printer, pts.get_vel(), compress, asbase64);
+  printer.PushAttribute( "type", quantized_type_name(qbits) );
+  write_DataArray (printer, pts.get_vel(), compress, asbase64, qbits);
   printer.CloseElement();	// DataArray
 
   printer.CloseElement();	// PointData
@@ -392,7 +497,8 @@ std::string write_vtu_points(Points<S> const& pts, const size_t file_idx,
 //
 template <class S>
 std::string write_vtu_panels(Surfaces<S> const& surf, const size_t file_idx,
-                             const size_t frameno, const double time) {
+                             const size_t frameno, const double time,
+                             const std::string& _prefix = std::string()) {
 
   assert(surf.get_npanels() > 0 && "Inside write_vtu_panels with no panels");
 
@@ -407,7 +513,7 @@ std::string write_vtu_panels(Surfaces<S> const& surf, const size_t file_idx,
 
   // generate file name
   std::stringstream vtkfn;
-  vtkfn << prefix << std::setfill('0') << std::setw(2) << file_idx << "_" << std::setw(5) << frameno << ".vtu";
+  vtkfn << _prefix << prefix << std::setfill('0') << std::setw(2) << file_idx << "_" << std::setw(5) << frameno << ".vtu";
 
   // prepare file pointer and printer
   std::FILE* fp = std::fopen(vtkfn.str().c_str(), "wb");
@@ -496,6 +602,8 @@ std::string write_vtu_panels(Surfaces<S> const& surf, const size_t file_idx,
 
   if (has_strengths) vector_list.append("vortex sheet strength,");
   if (surf.have_src_str()) scalar_list.append("source sheet strength,");
+  if (surf.have_loads()) vector_list.append("wall shear stress,");
+  if (surf.have_loads()) scalar_list.append("pressure,");
   //if (has_radii) scalar_list.append("area,");
 
   if (vector_list.size()>1) {
@@ -542,6 +650,21 @@ std::string write_vtu_panels(Surfaces<S> const& surf, const size_t file_idx,
     printer.CloseElement();	// DataArray
   }
 
+  if (surf.have_loads()) {
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "NumberOfComponents", "3" );
+    printer.PushAttribute( "Name", "wall shear stress" );
+    printer.PushAttribute( "type", "Float32" );
+    write_DataArray (printer, surf.get_shear(), compress, asbase64);
+    printer.CloseElement();	// DataArray
+
+    printer.OpenElement( "DataArray" );
+    printer.PushAttribute( "Name", "pressure" );
+    printer.PushAttribute( "type", "Float32" );
+    write_DataArray (printer, surf.get_pressure(), compress, asbase64);
+    printer.CloseElement();	// DataArray
+  }
+
   printer.CloseElement();	// CellData
 
 
@@ -561,7 +684,8 @@ std::string write_vtu_panels(Surfaces<S> const& surf, const size_t file_idx,
 //
 template <class S>
 void write_vtk_files(std::vector<Collection> const& coll, const size_t _index, const double _time,
-                     std::vector<std::string>& _files) {
+                     std::vector<std::string>& _files, const int _qbits = 0,
+                     const std::string& _prefix = std::string()) {
 
   size_t idx = 0;
   for (auto &elem : coll) {
@@ -572,12 +696,12 @@ void write_vtk_files(std::vector<Collection> const& coll, const size_t _index, c
     if (std::holds_alternative<Points<S>>(elem)) {
       Points<S> const & pts = std::get<Points<S>>(elem);
       if (pts.get_n() > 0) {
-        _files.emplace_back(write_vtu_points<S>(pts, idx++, _index, _time));
+        _files.emplace_back(write_vtu_points<S>(pts, idx++, _index, _time, _qbits, _prefix));
       }
     } else if (std::holds_alternative<Surfaces<S>>(elem)) {
       Surfaces<S> const & surf = std::get<Surfaces<S>>(elem);
       if (surf.get_npanels() > 0) {
-        _files.emplace_back(write_vtu_panels<S>(surf, idx++, _index, _time));
+        _files.emplace_back(write_vtu_panels<S>(surf, idx++, _index, _time, _prefix));
       }
     }
   }
@@ -0,0 +1,144 @@
+/*
+ * VtuDequantize.cpp - Turn a quantized particle .vtu file back into a plain Float32 one
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "VtuDequantize.h"
+
+#include "tinyxml2.h"
+#include "cppcodec/base64_rfc4648.hpp"
+
+#ifdef _WIN32
+  #include <ciso646>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using base64 = cppcodec::base64_rfc4648;
+
+
+// read a space-separated list of numbers from an attribute
+static std::vector<double> read_list(const char* _attr) {
+  std::vector<double> vals;
+  std::istringstream ss(_attr);
+  double v;
+  while (ss >> v) vals.push_back(v);
+  return vals;
+}
+
+// the raw bytes after the base64-encoded UInt32 header
+static bool decode_binary(const char* _text, std::vector<uint8_t>& _bytes) {
+  std::string text(_text ? _text : "");
+  const size_t first = text.find_first_not_of(" \t\n\r");
+  const size_t last = text.find_last_not_of(" \t\n\r");
+  if (first == std::string::npos) return false;
+  text = text.substr(first, last-first+1);
+
+  // 4 header bytes encode to 8 characters
+  const size_t hlen = base64::encoded_size(sizeof(uint32_t));
+  if (text.size() < hlen) return false;
+  try {
+    _bytes = base64::decode(text.substr(hlen));
+  } catch (...) {
+    return false;
+  }
+  return true;
+}
+
+// replace the contents of one quantized array, return false if it was not readable
+static bool decode_array(tinyxml2::XMLElement* _el) {
+
+  const std::vector<double> offset = read_list(_el->Attribute("QuantOffset"));
+  const std::vector<double> step = read_list(_el->Attribute("QuantStep"));
+  const char* type = _el->Attribute("type");
+  const char* format = _el->Attribute("format");
+  if (offset.empty() or offset.size() != step.size() or not type or not format) return false;
+  if (std::strcmp(format, "binary") != 0) return false;
+
+  std::vector<uint8_t> bytes;
+  if (not decode_binary(_el->GetText(), bytes)) return false;
+
+  // integers back to floats, component by component
+  const size_t ncomp = offset.size();
+  std::vector<float> vals;
+  if (std::strcmp(type, "UInt16") == 0) {
+    vals.resize(bytes.size() / sizeof(uint16_t));
+    for (size_t i=0; i<vals.size(); ++i) {
+      uint16_t q;
+      std::memcpy(&q, bytes.data() + sizeof(uint16_t)*i, sizeof(uint16_t));
+      vals[i] = (float)(offset[i%ncomp] + step[i%ncomp]*(double)q);
+    }
+  } else if (std::strcmp(type, "UInt8") == 0) {
+    vals.resize(bytes.size());
+    for (size_t i=0; i<vals.size(); ++i) {
+      vals[i] = (float)(offset[i%ncomp] + step[i%ncomp]*(double)bytes[i]);
+    }
+  } else {
+    return false;
+  }
+
+  // encode the same way as write_DataArray
+  const std::string encoded = base64::encode((const char*)vals.data(), sizeof(float)*vals.size());
+  const uint32_t encoded_length = encoded.size();
+  const std::string header = base64::encode((const char*)(&encoded_length), sizeof(uint32_t));
+  _el->SetText((" " + header + encoded + " ").c_str());
+
+  const char* name = _el->Attribute("Name");
+  std::cout << "  decoded " << (name ? name : "array") << " with max error " << _el->Attribute("QuantError") << std::endl;
+
+  _el->SetAttribute("type", "Float32");
+  _el->DeleteAttribute("QuantBits");
+  _el->DeleteAttribute("QuantOffset");
+  _el->DeleteAttribute("QuantStep");
+  _el->DeleteAttribute("QuantError");
+  return true;
+}
+
+// look for quantized arrays anywhere below this element
+static int decode_all(tinyxml2::XMLElement* _el, bool& _ok) {
+  int ndone = 0;
+  for (tinyxml2::XMLElement* child = _el->FirstChildElement(); child; child = child->NextSiblingElement()) {
+    if (std::strcmp(child->Name(), "DataArray") == 0 and child->Attribute("QuantStep")) {
+      if (decode_array(child)) ndone++;
+      else _ok = false;
+    } else {
+      ndone += decode_all(child, _ok);
+    }
+  }
+  return ndone;
+}
+
+int dequantize_vtu(const std::string& _in, const std::string& _out) {
+
+  tinyxml2::XMLDocument doc;
+  if (doc.LoadFile(_in.c_str()) != tinyxml2::XML_SUCCESS) {
+    std::cout << "ERROR: could not read " << _in << std::endl;
+    return -1;
+  }
+  tinyxml2::XMLElement* root = doc.RootElement();
+  if (not root) {
+    std::cout << "ERROR: no elements in " << _in << std::endl;
+    return -1;
+  }
+
+  std::cout << "Dequantizing " << _in << std::endl;
+  bool ok = true;
+  const int ndone = decode_all(root, ok);
+  if (not ok) {
+    std::cout << "ERROR: could not decode every quantized array in " << _in << std::endl;
+    return -1;
+  }
+
+  if (doc.SaveFile(_out.c_str()) != tinyxml2::XML_SUCCESS) {
+    std::cout << "ERROR: could not write " << _out << std::endl;
+    return -1;
+  }
+  std::cout << "Wrote " << ndone << " decoded arrays to " << _out << std::endl;
+  return ndone;
+}
@@ -0,0 +1,19 @@
+/*
+ * VtuDequantize.h - Turn a quantized particle .vtu file back into a plain Float32 one
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#pragma once
+
+#include <string>
+
+//
+// Read a .vtu file written with quantized arrays (see write_quantized_DataArray), replace
+//   each of those arrays with the decoded Float32 values, and write the result to _out,
+//   which any VTK reader can then open with the right coordinates and values
+//
+// Returns the number of arrays decoded, or -1 if the file could not be read or written
+//
+int dequantize_vtu(const std::string& _in, const std::string& _out);
@@ -13,6 +13,12 @@
 #include "Simulation.h"
 #include "JsonHelper.h"
 #include "RenderParams.h"
+#include "Ensemble.h"
+#include "ReproCheck.h"
+#include "CoreBench.h"
+#include "VtuDequantize.h"
+#include "Fork.h"
+#include "Estimate.h"
 
 #ifdef _WIN32
   // for glad
@@ -23,6 +29,7 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 
 
 // execution starts here
@@ -30,6 +37,60 @@
 int main(int argc, char const *argv[]) {
   std::cout << std::endl << "Omega3D Batch" << std::endl;
 
+  // run many variants of one input file at once
+  if (argc >= 4 and std::string(argv[1]) == "--ensemble") {
+    nlohmann::json base = read_json(argv[2]);
+    nlohmann::json cases = read_json(argv[3]);
+    const int nconcurrent = (argc > 4) ? std::stoi(argv[4]) : 0;
+    const float spacing = (argc > 5) ? std::stof(argv[5]) : 0.0;
+    const int nfailed = run_ensemble(base, cases, nconcurrent, spacing);
+    std::cout << "Quitting" << std::endl;
+    return (nfailed == 0) ? 0 : 1;
+  }
+
+  // check that the first few steps give the same bits on one thread and on all of them
+  if (argc >= 3 and std::string(argv[1]) == "--check-reproducible") {
+    nlohmann::json j = read_json(argv[2]);
+    const int nsteps = (argc > 3) ? std::stoi(argv[3]) : 5;
+    const int retval = check_reproducible(j, nsteps);
+    std::cout << "Quitting" << std::endl;
+    return (retval == 0) ? 0 : 1;
+  }
+
+  // time the core function helpers at each accuracy tier
+  if (argc >= 2 and std::string(argv[1]) == "--bench-core") {
+    const int nvals = (argc > 2) ? std::stoi(argv[2]) : 1000000;
+    const int retval = bench_core_funcs(nvals);
+    std::cout << "Quitting" << std::endl;
+    return retval;
+  }
+
+  // spin up one case, then branch it into several runs with changed parameters
+  if (argc >= 5 and std::string(argv[1]) == "--fork") {
+    nlohmann::json base = read_json(argv[2]);
+    const int nsteps = std::stoi(argv[3]);
+    nlohmann::json branches = read_json(argv[4]);
+    const int nconcurrent = (argc > 5) ? std::stoi(argv[5]) : 0;
+    const int nfailed = run_branches(base, nsteps, branches, nconcurrent);
+    std::cout << "Quitting" << std::endl;
+    return (nfailed == 0) ? 0 : 1;
+  }
+
+  // predict memory and runtime without running any steps
+  if (argc >= 3 and std::string(argv[1]) == "--estimate") {
+    nlohmann::json j = read_json(argv[2]);
+    const int retval = estimate_run(j);
+    std::cout << "Quitting" << std::endl;
+    return retval;
+  }
+
+  // turn a quantized particle file back into a plain one
+  if (argc >= 4 and std::string(argv[1]) == "--dequantize") {
+    const int ndone = dequantize_vtu(argv[2], argv[3]);
+    std::cout << "Quitting" << std::endl;
+    return (ndone >= 0) ? 0 : 1;
+  }
+
   // Set up vortex particle simulation
   Simulation sim;
   std::vector< std::unique_ptr<FlowFeature> > ffeatures;
@@ -47,37 +108,21 @@ int main(int argc, char const *argv[]) {
     parse_json(sim, ffeatures, bfeatures, mfeatures, rparams, j);
   } else {
     std::cout << std::endl << "Usage:" << std::endl;
-    std::cout << "  " << argv[0] << " filename.json" << std::endl << std::endl;
+    std::cout << "  " << argv[0] << " filename.json" << std::endl;
+    std::cout << "  " << argv[0] << " --ensemble base.json cases.json [concurrent cases] [panel spacing]" << std::endl;
+    std::cout << "  " << argv[0] << " --fork base.json steps branches.json [concurrent branches]" << std::endl;
+    std::cout << "  " << argv[0] << " --check-reproducible filename.json [steps]" << std::endl;
+    std::cout << "  " << argv[0] << " --estimate filename.json" << std::endl;
+    std::cout << "  " << argv[0] << " --bench-core [values]" << std::endl;
+    std::cout << "  " << argv[0] << " --dequantize quantized.vtu plain.vtu" << std::endl << std::endl;
     return -1;
   }
 
 
   std::cout << std::endl << "Initializing simulation" << std::endl;
 
-  // initialize particle distributions
-  for (auto const& ff: ffeatures) {
-    if (ff->is_enabled()) {
-      ElementPacket<float> newpacket = ff->init_elements(sim.get_ips());
-      sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
-    }
-  }
-
-  // initialize solid objects
-  for (auto const& bf : bfeatures) {
-    if (bf->is_enabled()) {
-      ElementPacket<float> newpacket = bf->init_elements(sim.get_ips());
-      const move_t newmovetype = (bf->get_body() ? bodybound : fixed);
-      sim.add_elements(newpacket, reactive, newmovetype, bf->get_body() );
-    }
-  }
-
-  // initialize measurement features
-  for (auto const& mf: mfeatures) {
-    if (mf->is_enabled()) {
-      const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-      sim.add_elements( mf->init_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
-    }
-  }
+  // initialize particle distributions, solid objects, and measurement features
+  add_init_elements(sim, ffeatures, bfeatures, mfeatures, rparams);
 
   sim.set_initialized();
 
@@ -96,32 +141,16 @@ int main(int argc, char const *argv[]) {
   // Main loop
   //
 
+  // time of the next data file output; only runs naming a seriesFile write during the run
+  const bool write_series = not sim.get_series_file_name().empty();
+  double next_output = 0.0;
+
   while (true) {
 
-    // check flow for blow-up or errors
-    sim_err_msg = sim.check_simulation();
-
-    if (sim_err_msg.empty()) {
-      // the last simulation step was fine, OK to continue
-      // generate new particles from emitters
-      for (auto const& ff: ffeatures) {
-        if (ff->is_enabled()) {
-          ElementPacket<float> newpacket = ff->step_elements(sim.get_ips());
-          // echo any errors
-          sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
-        }
-      }
-
-      for (auto const& mf: mfeatures) {
-        if (mf->is_enabled()) {
-          const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-          sim.add_elements( mf->step_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
-        }
-      }
-
-      // begin a new dynamic step: convection and diffusion
-      sim.step();
-    } else {
+    // check flow for blow-up or errors, emit new particles, then convection and diffusion
+    sim_err_msg = advance_step(sim, ffeatures, mfeatures, rparams);
+
+    if (not sim_err_msg.empty()) {
       // the last step had some difficulty
       std::cout << std::endl << "ERROR: " << sim_err_msg;
 
@@ -130,6 +159,10 @@ int main(int argc, char const *argv[]) {
     }
 
     // export data files at this step?
+    if (write_series and sim.get_output_dt() > 0.0 and sim.get_time() >= next_output - 1.e-6*sim.get_output_dt()) {
+      (void) sim.write_vtk();
+      while (next_output <= sim.get_time()) next_output += sim.get_output_dt();
+    }
 
     // check vs. stopping conditions
     if (sim.test_vs_stop()) break;
@@ -146,6 +179,12 @@ int main(int argc, char const *argv[]) {
     std::cout << std::endl << "Wrote simulation to " << outfile << std::endl;
   }
 
+  // a run that stopped because it settled gets a last checkpoint and a summary
+  if (sim.has_converged()) (void) sim.write_converged();
+
+  // running statistics are only written at checkpoints and here at the end, if not just done
+  if (not sim.wrote_this_step()) (void) sim.write_stats();
+
   sim.reset();
   std::cout << "Quitting" << std::endl;
 
@@ -15,6 +15,7 @@
 #include "Body.h"
 #include "RenderParams.h"
 #include "FeatureDraw.h"
+#include "FeatureCache.h"
 #include "json/json.hpp"
 #include "main_gui_functions.cpp"
 #include "imgui/imgui_internal.h"
@@ -58,6 +59,8 @@ int main(int argc, char const *argv[]) {
   FeatureDraw bdraw;
   FeatureDraw fdraw;
   FeatureDraw mdraw;
+  // elements from each feature, kept until that feature changes
+  FeatureCache fcache;
   size_t nframes = 0;
   static bool sim_is_running = false;
   static bool begin_single_step = false;
@@ -224,32 +227,37 @@ int main(int argc, char const *argv[]) {
 
       std::cout << std::endl << "Initializing simulation" << std::endl;
 
-      // initialize particle distributions
+      // initialize particle distributions (only changed features generate new elements)
       for (auto const& ff: ffeatures) {
         if (ff->is_enabled()) {
-          ElementPacket<float> newpacket = ff->init_elements(sim.get_ips());
-          sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
+          ElementPacket<float> newpacket = fcache.get(*ff, sim.get_ips());
+          sim.add_elements( newpacket, active, lagrangian, ff->get_body(), ff->to_string() );
         }
       }
 
-      // initialize solid objects
+      // initialize solid objects, the key lets unchanged ones keep their BEM blocks
       for (auto const& bf : bfeatures) {
         if (bf->is_enabled()) {
-          ElementPacket<float> newpacket = bf->init_elements(sim.get_ips());
+          ElementPacket<float> newpacket = fcache.get(*bf, sim.get_ips());
           const move_t newMoveType = (bf->get_body() ? bodybound : fixed);
-          sim.add_elements(newpacket, reactive, newMoveType, bf->get_body() );
+          sim.add_elements(newpacket, reactive, newMoveType, bf->get_body(), fcache.key_of(*bf, sim.get_ips()) );
         }
       }
+      add_outflow_regions(sim, bfeatures);
 
-      // initialize measurement features
+      // initialize measurement features, these never touch the boundary solution
       for (auto const& mf: mfeatures) {
         if (mf->is_enabled()) {
-          ElementPacket<float> newpacket = mf->init_elements(rparams.tracer_scale*sim.get_ips());
+          ElementPacket<float> newpacket = fcache.get(*mf, rparams.tracer_scale*sim.get_ips());
           const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-          sim.add_elements(newpacket, inert, newMoveType, mf->get_body() );
+          sim.add_elements(newpacket, inert, newMoveType, mf->get_body(), mf->to_string(),
+                           mf->get_max_age(), mf->get_max_count() );
         }
       }
 
+      // drop elements of features that were removed or edited
+      fcache.prune();
+
       sim.set_initialized();
 
       // check setup for obvious errors
@@ -332,20 +340,7 @@ int main(int argc, char const *argv[]) {
       if (sim_err_msg.empty()) {
         // the last simulation step was fine, OK to continue
         // generate new particles from emitters
-        for (auto const& ff: ffeatures) {
-          if (ff->is_enabled()) {
-            ElementPacket<float> newpacket = ff->step_elements(sim.get_ips());
-            // echo any errors
-             sim.add_elements( newpacket, active, lagrangian, ff->get_body() );
-          }
-        }
-
-        for (auto const& mf: mfeatures) {
-          if (mf->is_enabled()) {
-            const move_t newMoveType = (mf->get_is_lagrangian() ? lagrangian : fixed);
-            sim.add_elements( mf->step_elements(rparams.tracer_scale*sim.get_ips()), inert, newMoveType, mf->get_body() );
-          }
-        }
+        add_step_elements(sim, ffeatures, mfeatures, rparams);
 
         // begin a new dynamic step: convection and diffusion
         sim.async_step();
@@ -425,6 +420,7 @@ int main(int argc, char const *argv[]) {
 
         // stop and clear before loading
         sim.reset();
+        fcache.clear();
         bfeatures.clear();
         ffeatures.clear();
         mfeatures.clear();
@@ -475,6 +471,7 @@ int main(int argc, char const *argv[]) {
 
           // stop and clear before loading
           sim.reset();
+          fcache.clear();
           bfeatures.clear();
           ffeatures.clear();
           mfeatures.clear();
@@ -522,6 +519,7 @@ int main(int argc, char const *argv[]) {
 
       // stop and clear before loading
       sim.reset();
+      fcache.clear();
       bfeatures.clear();
       ffeatures.clear();
       mfeatures.clear();
@@ -1026,8 +1024,8 @@ int main(int argc, char const *argv[]) {
       ImGui::SameLine();
       if (ImGui::Button("Reset", ImVec2(120,0))) {
         std::cout << std::endl << "Reset requested" << std::endl;
-        // remove all particles and reset timer
-        sim.reset();
+        // remove all particles and reset timer, but keep work from unchanged features
+        sim.restart();
         std::cout << "Reset complete" << std::endl;
       }
 
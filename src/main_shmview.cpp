@@ -0,0 +1,78 @@
+/*
+ * main_shmview.cpp - Minimal reader for a running simulation's shared memory feed
+ *
+ * (c)2020 Applied Scientific Research, Inc.
+ *         Mark J Stock <markjstock@gmail.com>
+ */
+
+#include "ShmFeed.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+
+// execution starts here
+
+int main(int argc, char const *argv[]) {
+  std::cout << std::endl << "Omega3D Shared Memory Viewer" << std::endl;
+
+  if (argc < 2) {
+    std::cout << "Usage:" << std::endl;
+    std::cout << "  " << argv[0] << " feedname [nframes]" << std::endl << std::endl;
+    return 1;
+  }
+  const std::string name = argv[1];
+  const int maxframes = (argc > 2) ? std::stoi(argv[2]) : 0;
+
+  ShmFeedReader reader;
+  std::cout << "  waiting for " << name << std::endl;
+  while (not reader.open(name)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  ShmFeedFrame frame;
+  uint64_t last = 0;
+  int nseen = 0;
+
+  while (maxframes == 0 or nseen < maxframes) {
+    if (not reader.read_latest(frame, last)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      continue;
+    }
+    nseen++;
+
+    std::cout << "step " << frame.step << " at t=" << frame.time << std::endl;
+    for (auto const& c : frame.colls) {
+      const char* setname = (c.set == shm_vort) ? "vort" : (c.set == shm_bdry) ? "bdry" : "fldpt";
+
+      // bounding box from the node positions, which always come first
+      const float* x = reinterpret_cast<const float*>(frame.data.data() + c.offset);
+      const size_t stride = (c.nnodes*sizeof(float)+7) & ~(size_t)7;
+      std::array<float,6> bb = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                                std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(),
+                                std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+      for (size_t d=0; d<3; ++d) {
+        const float* xd = reinterpret_cast<const float*>(reinterpret_cast<const char*>(x) + d*stride);
+        for (size_t i=0; i<c.nnodes; ++i) {
+          bb[d]   = std::min(bb[d], xd[i]);
+          bb[d+3] = std::max(bb[d+3], xd[i]);
+        }
+      }
+
+      std::cout << "  " << setname << " " << ((c.kind == shm_points) ? "points" : "panels")
+                << " n=" << c.nnodes;
+      if (c.kind == shm_panels) std::cout << " panels=" << c.npanels;
+      if (c.nnodes > 0) {
+        std::cout << " box [" << bb[0] << " " << bb[1] << " " << bb[2] << "] to ["
+                  << bb[3] << " " << bb[4] << " " << bb[5] << "]";
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  return 0;
+}